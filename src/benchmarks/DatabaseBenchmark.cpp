@@ -0,0 +1,217 @@
+// DatabaseBenchmark measures the throughput of a running Database Server.  It connects to the
+// daemon's Message Director, creates a batch of objects of one class, and then keeps a window of
+// requests in flight against them: first a SET_FIELDS of every db field of the class followed by
+// a GET_FIELDS of the same fields (whose response confirms the set has been written), and then
+// GET_FIELDS alone.
+//
+// Usage: bench_dbserver [md host:port] [db channel] [dc file] [class] [objects] [operations]
+//                       [window]
+//
+// The fields are set to their default values from the dc file.  To compare backends, run it
+// against the same daemon configured with each backend in turn (for example soci with sqlite3 or
+// postgresql, and yaml).
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "core/msgtypes.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+#include "dclass/dc/File.h"
+#include "dclass/file/read.h"
+#include "util/Datagram.h"
+#include "util/DatagramIterator.h"
+using namespace std;
+using boost::asio::ip::tcp;
+
+typedef chrono::steady_clock bench_clock;
+
+// The channel the benchmark subscribes to for the Database Server's responses.
+static const channel_t BENCH_CHANNEL = 0x42454e43;
+
+class Connection
+{
+  public:
+    Connection(boost::asio::io_service &io, const string &host, const string &port) : m_socket(io)
+    {
+        tcp::resolver resolver(io);
+        boost::asio::connect(m_socket, resolver.resolve(tcp::resolver::query(host, port)));
+        m_socket.set_option(tcp::no_delay(true));
+    }
+
+    void send(DatagramHandle dg)
+    {
+        DatagramPtr frame = Datagram::create();
+        frame->add_size(dg->size());
+        frame->add_data(dg);
+        boost::asio::write(m_socket, boost::asio::buffer(frame->get_data(), frame->size()));
+    }
+
+    // receive reads the next datagram, skipping its server header up to the message type.
+    DatagramIterator receive(uint16_t &msgtype)
+    {
+        uint8_t size_buf[sizeof(dgsize_t)];
+        boost::asio::read(m_socket, boost::asio::buffer(size_buf, sizeof(size_buf)));
+        dgsize_t size = 0;
+        for(size_t i = 0; i < sizeof(dgsize_t); ++i) {
+            size |= dgsize_t(size_buf[i]) << (8 * i);
+        }
+
+        m_buffer.resize(size);
+        boost::asio::read(m_socket, boost::asio::buffer(m_buffer.data(), size));
+        DatagramIterator dgi(Datagram::create(m_buffer.data(), size));
+        dgi.seek_payload();
+        dgi.skip(sizeof(channel_t)); // sender
+        msgtype = dgi.read_uint16();
+        return dgi;
+    }
+
+  private:
+    tcp::socket m_socket;
+    vector<uint8_t> m_buffer;
+};
+
+static void report(const string &phase, size_t operations, bench_clock::time_point start)
+{
+    double ms = chrono::duration<double, milli>(bench_clock::now() - start).count();
+    cout << "  " << phase << ": " << operations << " in " << ms << " ms, "
+         << (ms > 0 ? operations / ms * 1000.0 : 0) << " ops/s\n";
+}
+
+int main(int argc, char *argv[])
+{
+    string addr = argc > 1 ? argv[1] : "127.0.0.1:7199";
+    channel_t db_channel = argc > 2 ? strtoull(argv[2], nullptr, 10) : 75757;
+    string dc_file = argc > 3 ? argv[3] : "test/files/test.dc";
+    string class_name = argc > 4 ? argv[4] : "DistributedTestObject5";
+    size_t objects = argc > 5 ? strtoul(argv[5], nullptr, 10) : 1000;
+    size_t operations = argc > 6 ? strtoul(argv[6], nullptr, 10) : 10000;
+    size_t window = argc > 7 ? strtoul(argv[7], nullptr, 10) : 64;
+
+    size_t colon = addr.rfind(':');
+    if(colon == string::npos || !objects || !window) {
+        cerr << "Usage: bench_dbserver [md host:port] [db channel] [dc file] [class] [objects]"
+                " [operations] [window]\n";
+        return 1;
+    }
+
+    // The same keywords the daemon declares.
+    dclass::File *dcf = new dclass::File();
+    for(const char *keyword : {"required", "ram", "db", "broadcast", "clrecv", "clsend",
+                               "ownsend", "ownrecv", "airecv"}) {
+        dcf->add_keyword(keyword);
+    }
+    if(!dclass::append(dcf, dc_file)) {
+        cerr << "Failed to read " << dc_file << ".\n";
+        return 1;
+    }
+    const dclass::Class *dcc = dcf->get_class_by_name(class_name);
+    if(!dcc) {
+        cerr << "No class named " << class_name << " in " << dc_file << ".\n";
+        return 1;
+    }
+
+    vector<const dclass::Field*> fields;
+    for(unsigned int i = 0; i < dcc->get_num_fields(); ++i) {
+        const dclass::Field *field = dcc->get_field(i);
+        if(field->has_keyword("db") && !field->as_molecular()) {
+            fields.push_back(field);
+        }
+    }
+    if(fields.empty()) {
+        cerr << "Class " << class_name << " has no db fields.\n";
+        return 1;
+    }
+
+    boost::asio::io_service io;
+    Connection md(io, addr.substr(0, colon), addr.substr(colon + 1));
+
+    DatagramPtr subscribe = Datagram::create();
+    subscribe->add_control_header(CONTROL_ADD_CHANNEL);
+    subscribe->add_channel(BENCH_CHANNEL);
+    md.send(subscribe);
+
+    cout << "Database Server benchmark: " << objects << " " << class_name << " objects with "
+         << fields.size() << " db fields, " << operations << " operations, window " << window
+         << "\n";
+
+    // Create the objects, keeping a window of creates in flight.
+    vector<doid_t> doids;
+    bench_clock::time_point start = bench_clock::now();
+    size_t sent = 0;
+    while(doids.size() < objects) {
+        while(sent < objects && sent - doids.size() < window) {
+            DatagramPtr dg = Datagram::create(db_channel, BENCH_CHANNEL, DBSERVER_CREATE_OBJECT);
+            dg->add_uint32(sent++);
+            dg->add_uint16(dcc->get_id());
+            dg->add_uint16(fields.size());
+            for(const dclass::Field *field : fields) {
+                dg->add_uint16(field->get_id());
+                dg->add_data(field->get_default_value());
+            }
+            md.send(dg);
+        }
+
+        uint16_t msgtype;
+        DatagramIterator dgi = md.receive(msgtype);
+        if(msgtype != DBSERVER_CREATE_OBJECT_RESP) {
+            continue;
+        }
+        dgi.read_uint32(); // context
+        doid_t doid = dgi.read_doid();
+        if(doid == INVALID_DO_ID) {
+            cerr << "The Database Server failed to create an object.\n";
+            return 1;
+        }
+        doids.push_back(doid);
+    }
+    report("create", objects, start);
+
+    // run keeps a window of operations in flight, each ending with a GET_FIELDS whose response
+    // marks it as complete.
+    auto run = [&](const string &phase, bool set) {
+        bench_clock::time_point start = bench_clock::now();
+        size_t sent = 0, done = 0;
+        while(done < operations) {
+            while(sent < operations && sent - done < window) {
+                doid_t doid = doids[sent % doids.size()];
+                if(set) {
+                    DatagramPtr dg = Datagram::create(db_channel, BENCH_CHANNEL,
+                                                      DBSERVER_OBJECT_SET_FIELDS);
+                    dg->add_doid(doid);
+                    dg->add_uint16(fields.size());
+                    for(const dclass::Field *field : fields) {
+                        dg->add_uint16(field->get_id());
+                        dg->add_data(field->get_default_value());
+                    }
+                    md.send(dg);
+                }
+
+                DatagramPtr dg = Datagram::create(db_channel, BENCH_CHANNEL,
+                                                  DBSERVER_OBJECT_GET_FIELDS);
+                dg->add_uint32(sent++);
+                dg->add_doid(doid);
+                dg->add_uint16(fields.size());
+                for(const dclass::Field *field : fields) {
+                    dg->add_uint16(field->get_id());
+                }
+                md.send(dg);
+            }
+
+            uint16_t msgtype;
+            DatagramIterator dgi = md.receive(msgtype);
+            if(msgtype == DBSERVER_OBJECT_GET_FIELDS_RESP) {
+                ++done;
+            }
+        }
+        report(phase, operations, start);
+    };
+    run("set+get", true);
+    run("get", false);
+
+    return 0;
+}
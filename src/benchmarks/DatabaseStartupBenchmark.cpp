@@ -0,0 +1,358 @@
+// DatabaseStartupBenchmark measures how quickly a Database Server comes back up with a full
+// database, and how quickly it reads objects once it has, for each of the embedded backends
+// (yaml and snapshot).  For each backend, it starts an astrond with a fresh database of its own
+// under the work directory, creates the objects, asks for a checkpoint and kills the daemon.
+// Then it starts the daemon back up and times:
+//
+//   start: from starting the daemon to the answer to its first read.
+//   load:  reading each of the objects once, in order, one read at a time.
+//   read:  reading objects at random, one read at a time.
+//
+// Usage: bench_dbstartup [astrond] [dc file] [work dir] [class] [objects] [reads] [md port]
+//
+// The fields are set to their default values from the dc file.  The work directory must exist;
+// the benchmark leaves each backend's database and log in it.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "core/msgtypes.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+#include "dclass/dc/File.h"
+#include "dclass/file/read.h"
+#include "util/Datagram.h"
+#include "util/DatagramIterator.h"
+using namespace std;
+using boost::asio::ip::tcp;
+
+typedef chrono::steady_clock bench_clock;
+
+// The channel the benchmark subscribes to for the Database Server's responses.
+static const channel_t BENCH_CHANNEL = 0x42454e43;
+static const channel_t DB_CHANNEL = 75757;
+static const doid_t MIN_ID = 1000000;
+
+class Connection
+{
+  public:
+    Connection(boost::asio::io_service &io, const string &host, const string &port) : m_socket(io)
+    {
+        tcp::resolver resolver(io);
+        boost::asio::connect(m_socket, resolver.resolve(tcp::resolver::query(host, port)));
+        m_socket.set_option(tcp::no_delay(true));
+    }
+
+    void send(DatagramHandle dg)
+    {
+        DatagramPtr frame = Datagram::create();
+        frame->add_size(dg->size());
+        frame->add_data(dg);
+        boost::asio::write(m_socket, boost::asio::buffer(frame->get_data(), frame->size()));
+    }
+
+    // receive reads the next datagram, skipping its server header up to the message type.
+    DatagramIterator receive(uint16_t &msgtype)
+    {
+        uint8_t size_buf[sizeof(dgsize_t)];
+        boost::asio::read(m_socket, boost::asio::buffer(size_buf, sizeof(size_buf)));
+        dgsize_t size = 0;
+        for(size_t i = 0; i < sizeof(dgsize_t); ++i) {
+            size |= dgsize_t(size_buf[i]) << (8 * i);
+        }
+
+        m_buffer.resize(size);
+        boost::asio::read(m_socket, boost::asio::buffer(m_buffer.data(), size));
+        DatagramIterator dgi(Datagram::create(m_buffer.data(), size));
+        dgi.seek_payload();
+        dgi.skip(sizeof(channel_t)); // sender
+        msgtype = dgi.read_uint16();
+        return dgi;
+    }
+
+    // expect reads datagrams until one of the given message type arrives.
+    DatagramIterator expect(uint16_t wanted)
+    {
+        while(true) {
+            uint16_t msgtype;
+            DatagramIterator dgi = receive(msgtype);
+            if(msgtype == wanted) {
+                return dgi;
+            }
+        }
+    }
+
+  private:
+    tcp::socket m_socket;
+    vector<uint8_t> m_buffer;
+};
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return chrono::duration<double, milli>(bench_clock::now() - start).count();
+}
+
+static void report(const string &phase, vector<double> &latencies)
+{
+    sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for(double latency : latencies) {
+        total += latency;
+    }
+    auto percentile = [&](double p) {
+        return latencies[min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+    cout << "  " << phase << ": " << latencies.size() << " in " << total << " ms, p50 "
+         << percentile(0.5) * 1000.0 << " us, p99 " << percentile(0.99) * 1000.0
+         << " us, max " << latencies.back() * 1000.0 << " us\n";
+}
+
+// start_daemon starts astrond with a config, sending its output to a log.
+static pid_t start_daemon(const string &astrond, const string &config, const string &log)
+{
+    pid_t pid = fork();
+    if(pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+        }
+        execl(astrond.c_str(), astrond.c_str(), config.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void kill_daemon(pid_t pid)
+{
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+// connect waits for the daemon's Message Director to take connections, and subscribes to the
+// benchmark's channel.
+static unique_ptr<Connection> connect(boost::asio::io_service &io, const string &port, pid_t pid)
+{
+    while(true) {
+        try {
+            unique_ptr<Connection> md(new Connection(io, "127.0.0.1", port));
+            DatagramPtr subscribe = Datagram::create();
+            subscribe->add_control_header(CONTROL_ADD_CHANNEL);
+            subscribe->add_channel(BENCH_CHANNEL);
+            md->send(subscribe);
+            return md;
+        } catch(boost::system::system_error &) {
+            if(waitpid(pid, nullptr, WNOHANG) != 0) {
+                return nullptr; // The daemon has died.
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+}
+
+static void get_fields(Connection &md, uint32_t context, doid_t doid,
+                       const vector<const dclass::Field*> &fields)
+{
+    DatagramPtr dg = Datagram::create(DB_CHANNEL, BENCH_CHANNEL, DBSERVER_OBJECT_GET_FIELDS);
+    dg->add_uint32(context);
+    dg->add_doid(doid);
+    dg->add_uint16(fields.size());
+    for(const dclass::Field *field : fields) {
+        dg->add_uint16(field->get_id());
+    }
+    md.send(dg);
+}
+
+// timed_read reads an object, returning the latency of the read in ms, or a negative number if
+// it failed.
+static double timed_read(Connection &md, doid_t doid,
+                         const vector<const dclass::Field*> &fields)
+{
+    bench_clock::time_point start = bench_clock::now();
+    get_fields(md, 0, doid, fields);
+    DatagramIterator dgi = md.expect(DBSERVER_OBJECT_GET_FIELDS_RESP);
+    dgi.read_uint32(); // context
+    if(dgi.read_uint8() != SUCCESS) {
+        return -1;
+    }
+    return elapsed_ms(start);
+}
+
+int main(int argc, char *argv[])
+{
+    string astrond = argc > 1 ? argv[1] : "./astrond";
+    string dc_file = argc > 2 ? argv[2] : "test/files/test.dc";
+    string work_dir = argc > 3 ? argv[3] : "/tmp";
+    string class_name = argc > 4 ? argv[4] : "DistributedTestObject5";
+    size_t objects = argc > 5 ? strtoul(argv[5], nullptr, 10) : 10000;
+    size_t reads = argc > 6 ? strtoul(argv[6], nullptr, 10) : 10000;
+    string port = argc > 7 ? argv[7] : "57199";
+
+    if(!objects || !reads) {
+        cerr << "Usage: bench_dbstartup [astrond] [dc file] [work dir] [class] [objects] [reads]"
+                " [md port]\n";
+        return 1;
+    }
+
+    // The same keywords the daemon declares.
+    dclass::File *dcf = new dclass::File();
+    for(const char *keyword : {"required", "ram", "db", "broadcast", "clrecv", "clsend",
+                               "ownsend", "ownrecv", "airecv"}) {
+        dcf->add_keyword(keyword);
+    }
+    if(!dclass::append(dcf, dc_file)) {
+        cerr << "Failed to read " << dc_file << ".\n";
+        return 1;
+    }
+    const dclass::Class *dcc = dcf->get_class_by_name(class_name);
+    if(!dcc) {
+        cerr << "No class named " << class_name << " in " << dc_file << ".\n";
+        return 1;
+    }
+
+    vector<const dclass::Field*> fields;
+    for(unsigned int i = 0; i < dcc->get_num_fields(); ++i) {
+        const dclass::Field *field = dcc->get_field(i);
+        if(field->has_keyword("db") && !field->as_molecular()) {
+            fields.push_back(field);
+        }
+    }
+    if(fields.empty()) {
+        cerr << "Class " << class_name << " has no db fields.\n";
+        return 1;
+    }
+
+    // The daemon reads the dc file relative to its config, which is in the work directory.
+    char *dc_path = realpath(dc_file.c_str(), nullptr);
+    if(dc_path) {
+        dc_file = dc_path;
+        free(dc_path);
+    }
+
+    cout << "Database startup benchmark: " << objects << " " << class_name << " objects with "
+         << fields.size() << " db fields, " << reads << " random reads\n";
+
+    boost::asio::io_service io;
+    for(const char *backend : {"yaml", "snapshot"}) {
+        string base = work_dir + "/bench_dbstartup-" + backend;
+        string config = base + ".yml", log = base + ".log", data = base + ".db";
+        {
+            ofstream out(config);
+            out << "messagedirector:\n"
+                << "    bind: 127.0.0.1:" << port << "\n"
+                << "general:\n"
+                << "    dc_files:\n"
+                << "        - " << dc_file << "\n"
+                << "roles:\n"
+                << "    - type: database\n"
+                << "      control: " << DB_CHANNEL << "\n"
+                << "      generate:\n"
+                << "        min: " << MIN_ID << "\n"
+                << "        max: " << MIN_ID + objects * 2 << "\n"
+                << "      backend:\n"
+                << "        type: " << backend << "\n"
+                << "        directory: " << data << "\n";
+        }
+        if(system(("rm -rf '" + data + "' && mkdir -p '" + data + "'").c_str()) != 0) {
+            cerr << "Failed to create " << data << ".\n";
+            return 1;
+        }
+
+        cout << backend << ":\n";
+
+        // Fill the database, keeping a window of creates in flight.
+        pid_t pid = start_daemon(astrond, config, log);
+        unique_ptr<Connection> md = connect(io, port, pid);
+        if(!md) {
+            cerr << "astrond exited; see " << log << ".\n";
+            return 1;
+        }
+        vector<doid_t> doids;
+        size_t sent = 0;
+        while(doids.size() < objects) {
+            while(sent < objects && sent - doids.size() < 64) {
+                DatagramPtr dg = Datagram::create(DB_CHANNEL, BENCH_CHANNEL,
+                                                  DBSERVER_CREATE_OBJECT);
+                dg->add_uint32(sent++);
+                dg->add_uint16(dcc->get_id());
+                dg->add_uint16(fields.size());
+                for(const dclass::Field *field : fields) {
+                    dg->add_uint16(field->get_id());
+                    dg->add_data(field->get_default_value());
+                }
+                md->send(dg);
+            }
+
+            DatagramIterator dgi = md->expect(DBSERVER_CREATE_OBJECT_RESP);
+            dgi.read_uint32(); // context
+            doid_t doid = dgi.read_doid();
+            if(doid == INVALID_DO_ID) {
+                cerr << "The Database Server failed to create an object.\n";
+                return 1;
+            }
+            doids.push_back(doid);
+        }
+        sort(doids.begin(), doids.end());
+
+        DatagramPtr dg = Datagram::create(DB_CHANNEL, BENCH_CHANNEL, DBSERVER_CHECKPOINT);
+        dg->add_uint32(0); // context
+        md->send(dg);
+        DatagramIterator dgi = md->expect(DBSERVER_CHECKPOINT_RESP);
+        dgi.read_uint32(); // context
+        if(dgi.read_uint8() != SUCCESS) {
+            cerr << "The Database Server failed to checkpoint.\n";
+            return 1;
+        }
+        md.reset();
+        kill_daemon(pid);
+
+        // Start it back up, and wait for it to answer a read.
+        bench_clock::time_point start = bench_clock::now();
+        pid = start_daemon(astrond, config, log);
+        md = connect(io, port, pid);
+        if(!md) {
+            cerr << "astrond exited; see " << log << ".\n";
+            return 1;
+        }
+        if(timed_read(*md, doids[0], fields) < 0) {
+            cerr << "The Database Server failed to read an object.\n";
+            return 1;
+        }
+        cout << "  start: " << elapsed_ms(start) << " ms\n";
+
+        vector<double> latencies;
+        for(doid_t doid : doids) {
+            latencies.push_back(timed_read(*md, doid, fields));
+            if(latencies.back() < 0) {
+                cerr << "The Database Server failed to read an object.\n";
+                return 1;
+            }
+        }
+        report("load", latencies);
+
+        latencies.clear();
+        mt19937 random(0);
+        for(size_t i = 0; i < reads; ++i) {
+            latencies.push_back(timed_read(*md, doids[random() % doids.size()], fields));
+        }
+        report("read", latencies);
+
+        md.reset();
+        kill_daemon(pid);
+    }
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+// EventLoggerBenchmark blasts synthetic events at a running Event Logger as fast as it can, and
+// (given the Event Logger's output file) counts how many of them made it into the log.
+//
+// Usage: bench_eventlogger [host:port] [events] [log file]
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+using namespace std;
+using boost::asio::ip::udp;
+
+typedef chrono::steady_clock bench_clock;
+
+static void pack_string(string &out, const string &str)
+{
+    // str8 is enough for everything we send.
+    out.push_back(char(0xd9));
+    out.push_back(char(str.size()));
+    out.append(str);
+}
+
+static void pack_uint(string &out, uint64_t value)
+{
+    out.push_back(char(0xcf));
+    for(int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(char(value >> shift));
+    }
+}
+
+// make_event builds a MessagePack map shaped like the events the daemon sends itself.
+static string make_event(uint64_t seq)
+{
+    string event;
+    event.push_back(char(0x84)); // fixmap with 4 entries
+    pack_string(event, "type");
+    pack_string(event, "bench-event");
+    pack_string(event, "sender");
+    pack_string(event, "bench_eventlogger");
+    pack_string(event, "seq");
+    pack_uint(event, seq);
+    pack_string(event, "msg");
+    pack_string(event, "A synthetic event, about as long as a typical \"msg\" field is.");
+    return event;
+}
+
+static size_t count_lines(const string &file)
+{
+    ifstream in(file);
+    size_t lines = 0;
+    string line;
+    while(getline(in, line)) {
+        ++lines;
+    }
+    return lines;
+}
+
+int main(int argc, char *argv[])
+{
+    string addr = argc > 1 ? argv[1] : "127.0.0.1:7197";
+    size_t events = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000000;
+    string log_file = argc > 3 ? argv[3] : "";
+
+    size_t colon = addr.rfind(':');
+    if(colon == string::npos) {
+        cerr << "Expected an address of the form host:port.\n";
+        return 1;
+    }
+
+    boost::asio::io_service io;
+    udp::resolver resolver(io);
+    udp::endpoint target = *resolver.resolve(udp::resolver::query(udp::v4(),
+                           addr.substr(0, colon), addr.substr(colon + 1)));
+    udp::socket socket(io, udp::endpoint(udp::v4(), 0));
+
+    size_t lines_before = log_file.empty() ? 0 : count_lines(log_file);
+
+    cout << "Event Logger benchmark: sending " << events << " events to " << addr << "\n";
+    bench_clock::time_point start = bench_clock::now();
+    for(size_t i = 0; i < events; ++i) {
+        string event = make_event(i);
+        boost::system::error_code ec;
+        socket.send_to(boost::asio::buffer(event), target, 0, ec);
+        if(ec == boost::asio::error::no_buffer_space) {
+            --i; // The local send queue is full; try again.
+            continue;
+        }
+    }
+    double ms = chrono::duration<double, milli>(bench_clock::now() - start).count();
+    cout << "  sent in " << ms << " ms, " << (ms > 0 ? events / ms * 1000.0 : 0)
+         << " events/s\n";
+
+    if(log_file.empty()) {
+        return 0;
+    }
+
+    // Wait for the log to stop growing.
+    size_t logged = count_lines(log_file) - lines_before;
+    for(int idle = 0; idle < 10; ++idle) {
+        this_thread::sleep_for(chrono::milliseconds(200));
+        size_t now = count_lines(log_file) - lines_before;
+        if(now != logged) {
+            logged = now;
+            idle = 0;
+        }
+    }
+
+    cout << "  logged " << logged << " events, " << (events - min(logged, events))
+         << " lost (" << (events ? 100.0 * (events - min(logged, events)) / events : 0)
+         << "%)\n";
+    return 0;
+}
@@ -0,0 +1,305 @@
+// MeshBenchmark compares Message Director topologies.  It starts a small cluster of astrond
+// processes, first as a tree (a root MD with leaf MDs connected to it over TCP), then as the
+// same tree with the leaves linked to the root over shared memory, and then as a mesh (MDs
+// peered with each other), and bounces datagrams between a client on one MD and a client on
+// another, keeping a window of them in flight.
+//
+// Usage: bench_mesh [astrond] [messages] [window] [MDs]
+//
+// In the tree, a message from one leaf to another passes through the leaf, the root and the
+// other leaf: 3 MDs.  In the mesh it passes through the sending MD and the receiving MD: 2 MDs.
+// Each round trip makes the crossing twice.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+#include "core/msgtypes.h"
+#include "util/Datagram.h"
+#include "util/DatagramIterator.h"
+using namespace std;
+using boost::asio::ip::tcp;
+
+typedef chrono::steady_clock bench_clock;
+
+static const channel_t PING_CHANNEL = 0x50494e47;
+static const channel_t PONG_CHANNEL = 0x504f4e47;
+static const uint16_t PING_MSGTYPE = 0x5042;
+static const uint32_t PROBE = 0xffffffff;
+
+static const unsigned int MD_PORT = 57400;
+static const unsigned int MESH_PORT = 57500;
+
+class Connection
+{
+  public:
+    Connection(boost::asio::io_service &io, unsigned int port) : m_socket(io)
+    {
+        m_socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+        m_socket.set_option(tcp::no_delay(true));
+    }
+
+    void send(DatagramHandle dg)
+    {
+        DatagramPtr frame = Datagram::create();
+        frame->add_size(dg->size());
+        frame->add_data(dg);
+        boost::asio::write(m_socket, boost::asio::buffer(frame->get_data(), frame->size()));
+    }
+
+    // receive reads the next datagram, skipping its server header up to the message type.
+    DatagramIterator receive()
+    {
+        uint8_t size_buf[sizeof(dgsize_t)];
+        boost::asio::read(m_socket, boost::asio::buffer(size_buf, sizeof(size_buf)));
+        dgsize_t size = 0;
+        for(size_t i = 0; i < sizeof(dgsize_t); ++i) {
+            size |= dgsize_t(size_buf[i]) << (8 * i);
+        }
+
+        m_buffer.resize(size);
+        boost::asio::read(m_socket, boost::asio::buffer(m_buffer.data(), size));
+        DatagramIterator dgi(Datagram::create(m_buffer.data(), size));
+        dgi.seek_payload();
+        dgi.skip(sizeof(channel_t) + sizeof(uint16_t)); // sender, msgtype
+        return dgi;
+    }
+
+    void subscribe(channel_t channel)
+    {
+        DatagramPtr dg = Datagram::create();
+        dg->add_control_header(CONTROL_ADD_CHANNEL);
+        dg->add_channel(channel);
+        send(dg);
+    }
+
+    bool available()
+    {
+        return m_socket.available() > 0;
+    }
+
+    void close()
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown(tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+    }
+
+  private:
+    tcp::socket m_socket;
+    vector<uint8_t> m_buffer;
+};
+
+// A Cluster is a set of astrond processes, one per config, stopped when it's destroyed.
+class Cluster
+{
+  public:
+    Cluster(const string &astrond, const vector<string> &configs, const vector<unsigned int> &ports)
+    {
+        char dir_template[] = "/tmp/bench_meshXXXXXX";
+        m_dir = mkdtemp(dir_template);
+
+        for(size_t i = 0; i < configs.size(); ++i) {
+            stringstream filename;
+            filename << m_dir << "/md" << i << ".yml";
+            ofstream(filename.str()) << configs[i];
+            m_files.push_back(filename.str());
+
+            pid_t pid = fork();
+            if(pid == 0) {
+                execl(astrond.c_str(), astrond.c_str(), "--loglevel", "warning",
+                      filename.str().c_str(), (char*)nullptr);
+                _exit(127);
+            }
+            m_pids.push_back(pid);
+        }
+
+        // Wait for every MD to start listening.
+        for(unsigned int port : ports) {
+            boost::asio::io_service io;
+            for(int attempt = 0;; ++attempt) {
+                try {
+                    Connection(io, port).close();
+                    break;
+                } catch(const boost::system::system_error &) {
+                    if(attempt == 100) {
+                        throw;
+                    }
+                    this_thread::sleep_for(chrono::milliseconds(50));
+                }
+            }
+        }
+    }
+
+    ~Cluster()
+    {
+        for(pid_t pid : m_pids) {
+            kill(pid, SIGKILL);
+            waitpid(pid, nullptr, 0);
+        }
+        for(const string &file : m_files) {
+            remove(file.c_str());
+        }
+        rmdir(m_dir.c_str());
+    }
+
+  private:
+    string m_dir;
+    vector<string> m_files;
+    vector<pid_t> m_pids;
+};
+
+// run bounces messages between a client on the MD at from_port and one on the MD at to_port.
+static void run(const string &topology, unsigned int hops, unsigned int from_port,
+                unsigned int to_port, size_t messages, size_t window)
+{
+    boost::asio::io_service io;
+    Connection ping(io, from_port), pong(io, to_port);
+    ping.subscribe(PONG_CHANNEL);
+    pong.subscribe(PING_CHANNEL);
+
+    // The far side echoes everything back until the benchmark closes its connection.
+    thread echo([&]() {
+        try {
+            while(true) {
+                DatagramIterator dgi = pong.receive();
+                DatagramPtr dg = Datagram::create(PONG_CHANNEL, PING_CHANNEL, PING_MSGTYPE);
+                dg->add_data(dgi.read_remainder());
+                pong.send(dg);
+            }
+        } catch(const boost::system::system_error &) {
+        }
+    });
+
+    auto send_ping = [&](uint32_t seq) {
+        DatagramPtr dg = Datagram::create(PING_CHANNEL, PONG_CHANNEL, PING_MSGTYPE);
+        dg->add_uint32(seq);
+        dg->add_uint64(chrono::duration_cast<chrono::nanoseconds>(
+                           bench_clock::now().time_since_epoch()).count());
+        ping.send(dg);
+    };
+
+    // Probe until the subscriptions have made it across the cluster.
+    while(true) {
+        send_ping(PROBE);
+        this_thread::sleep_for(chrono::milliseconds(50));
+        if(ping.available()) {
+            break;
+        }
+    }
+    while(ping.available()) {
+        ping.receive();
+    }
+    this_thread::sleep_for(chrono::milliseconds(100));
+    while(ping.available()) {
+        ping.receive();
+    }
+
+    bench_clock::time_point start = bench_clock::now();
+    size_t sent = 0, done = 0;
+    double total_rtt = 0;
+    while(done < messages) {
+        while(sent < messages && sent - done < window) {
+            send_ping(sent++);
+        }
+
+        DatagramIterator dgi = ping.receive();
+        if(dgi.read_uint32() == PROBE) {
+            continue;
+        }
+        uint64_t sent_at = dgi.read_uint64();
+        uint64_t now = chrono::duration_cast<chrono::nanoseconds>(
+                           bench_clock::now().time_since_epoch()).count();
+        total_rtt += (now - sent_at) / 1000.0;
+        ++done;
+    }
+    double ms = chrono::duration<double, milli>(bench_clock::now() - start).count();
+
+    ping.close();
+    pong.close();
+    echo.join();
+
+    cout << "  " << topology << ": " << hops << " MD hops each way, " << messages
+         << " round trips in " << ms << " ms, " << (ms > 0 ? messages / ms * 1000.0 : 0)
+         << " round trips/s, mean " << total_rtt / messages << " us\n";
+}
+
+int main(int argc, char *argv[])
+{
+    string astrond = argc > 1 ? argv[1] : "./astrond";
+    size_t messages = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+    size_t window = argc > 3 ? strtoul(argv[3], nullptr, 10) : 64;
+    unsigned int mds = argc > 4 ? strtoul(argv[4], nullptr, 10) : 3;
+
+    if(!messages || !window || mds < 2) {
+        cerr << "Usage: bench_mesh [astrond] [messages] [window] [MDs]\n";
+        return 1;
+    }
+
+    cout << "Message Director benchmark: " << mds << " MDs, " << messages
+         << " round trips, window " << window << "\n";
+
+    // The tree: a root, and a leaf for each of the other MDs; first over TCP, then over
+    // shared memory.
+    for(bool shm : {false, true}) {
+        stringstream shm_name;
+        shm_name << "bench_mesh." << getpid();
+
+        vector<string> configs;
+        vector<unsigned int> ports;
+        for(unsigned int i = 0; i <= mds; ++i) {
+            stringstream config;
+            config << "messagedirector:\n"
+                   << "    bind: 127.0.0.1:" << MD_PORT + i << "\n";
+            if(i == 0 && shm) {
+                config << "    shm:\n"
+                       << "        bind: " << shm_name.str() << "\n";
+            } else if(i > 0 && shm) {
+                config << "    connect: shm://" << shm_name.str() << "\n";
+            } else if(i > 0) {
+                config << "    connect: 127.0.0.1:" << MD_PORT << "\n";
+            }
+            configs.push_back(config.str());
+            ports.push_back(MD_PORT + i);
+        }
+
+        Cluster cluster(astrond, configs, ports);
+        run(shm ? "tree (shm)" : "tree", 3, MD_PORT + 1, MD_PORT + 2, messages, window);
+    }
+
+    // The mesh: every MD peered with every other.
+    {
+        vector<string> configs;
+        vector<unsigned int> ports;
+        for(unsigned int i = 0; i < mds; ++i) {
+            stringstream config;
+            config << "messagedirector:\n"
+                   << "    bind: 127.0.0.1:" << MD_PORT + i << "\n"
+                   << "    mesh:\n"
+                   << "        bind: 127.0.0.1:" << MESH_PORT + i << "\n"
+                   << "        peers:\n";
+            for(unsigned int j = 0; j < mds; ++j) {
+                if(j != i) {
+                    config << "            - 127.0.0.1:" << MESH_PORT + j << "\n";
+                }
+            }
+            configs.push_back(config.str());
+            ports.push_back(MD_PORT + i);
+        }
+
+        Cluster cluster(astrond, configs, ports);
+        run("mesh", 2, MD_PORT, MD_PORT + 1, messages, window);
+    }
+
+    return 0;
+}
@@ -0,0 +1,214 @@
+// TimeoutBenchmark compares the TimerWheel used by Timeout against giving every timeout
+// its own boost::asio::deadline_timer, which is how Timeout used to be implemented.
+//
+// Usage: bench_timeout [timers] [resets]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include "util/TimerWheel.h"
+using namespace std;
+
+typedef chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start)
+{
+    return chrono::duration<double, milli>(bench_clock::now() - start).count();
+}
+
+static void report(const char *test, const char *impl, double ms, size_t ops)
+{
+    cout << "  " << test << " (" << impl << "): " << ms << " ms, "
+         << (ms > 0 ? ops / ms * 1000.0 : 0) << " ops/s\n";
+}
+
+class BenchEntry : public TimerWheelEntry
+{
+  public:
+    size_t *fired;
+    bench_clock::time_point deadline;
+    double *late_ms;
+
+  protected:
+    void expire() override
+    {
+        *late_ms += elapsed_ms(deadline);
+        ++*fired;
+    }
+};
+
+static void timer_fired(const boost::system::error_code &ec, size_t *fired,
+                        bench_clock::time_point deadline, double *late_ms)
+{
+    if(ec) {
+        return;
+    }
+    *late_ms += elapsed_ms(deadline);
+    ++*fired;
+}
+
+// Schedule n timeouts far in the future, then cancel them all; the common case
+// for timeouts that guard an operation which almost always completes in time.
+static void bench_schedule_cancel(size_t n)
+{
+    {
+        boost::asio::io_service io;
+        TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io);
+        vector<shared_ptr<BenchEntry>> entries;
+        for(size_t i = 0; i < n; ++i) {
+            entries.push_back(make_shared<BenchEntry>());
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            wheel.schedule(entries[i], 30000 + i % 1000);
+        }
+        for(auto &entry : entries) {
+            wheel.cancel(entry.get());
+        }
+        io.run();
+        report("schedule+cancel", "wheel", elapsed_ms(start), 2 * n);
+    }
+
+    {
+        boost::asio::io_service io;
+        vector<unique_ptr<boost::asio::deadline_timer>> timers;
+        size_t fired = 0;
+        double late = 0;
+        for(size_t i = 0; i < n; ++i) {
+            timers.emplace_back(new boost::asio::deadline_timer(io));
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            timers[i]->expires_from_now(boost::posix_time::milliseconds(30000 + i % 1000));
+            timers[i]->async_wait(boost::bind(&timer_fired, boost::asio::placeholders::error,
+                                              &fired, bench_clock::now(), &late));
+        }
+        for(auto &timer : timers) {
+            timer->cancel();
+        }
+        io.run();
+        report("schedule+cancel", "deadline_timer", elapsed_ms(start), 2 * n);
+    }
+}
+
+// Keep n timeouts alive and reset each of them the given number of times, like
+// client heartbeats being pushed back on every received message.
+static void bench_reset(size_t n, size_t resets)
+{
+    {
+        boost::asio::io_service io;
+        TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io);
+        vector<shared_ptr<BenchEntry>> entries;
+        for(size_t i = 0; i < n; ++i) {
+            entries.push_back(make_shared<BenchEntry>());
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t r = 0; r < resets; ++r) {
+            for(size_t i = 0; i < n; ++i) {
+                wheel.schedule(entries[i], 10000 + i % 5000);
+            }
+        }
+        for(auto &entry : entries) {
+            wheel.cancel(entry.get());
+        }
+        io.run();
+        report("reset", "wheel", elapsed_ms(start), n * resets);
+    }
+
+    {
+        boost::asio::io_service io;
+        vector<unique_ptr<boost::asio::deadline_timer>> timers;
+        size_t fired = 0;
+        double late = 0;
+        for(size_t i = 0; i < n; ++i) {
+            timers.emplace_back(new boost::asio::deadline_timer(io));
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t r = 0; r < resets; ++r) {
+            for(size_t i = 0; i < n; ++i) {
+                // This is what the old Timeout::reset did.
+                timers[i]->cancel();
+                timers[i]->expires_from_now(boost::posix_time::milliseconds(10000 + i % 5000));
+                timers[i]->async_wait(boost::bind(&timer_fired, boost::asio::placeholders::error,
+                                                  &fired, bench_clock::now(), &late));
+            }
+        }
+        for(auto &timer : timers) {
+            timer->cancel();
+        }
+        io.run();
+        report("reset", "deadline_timer", elapsed_ms(start), n * resets);
+    }
+}
+
+// Let n timeouts spread over the next quarter second actually fire, measuring
+// both the total cost and how late they fire on average.
+static void bench_fire(size_t n)
+{
+    const unsigned long spread = 250;
+
+    {
+        boost::asio::io_service io;
+        TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io);
+        size_t fired = 0;
+        double late = 0;
+        vector<shared_ptr<BenchEntry>> entries;
+        for(size_t i = 0; i < n; ++i) {
+            entries.push_back(make_shared<BenchEntry>());
+            entries.back()->fired = &fired;
+            entries.back()->late_ms = &late;
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            unsigned long ms = i % spread;
+            entries[i]->deadline = bench_clock::now() + chrono::milliseconds(ms);
+            wheel.schedule(entries[i], ms);
+        }
+        io.run();
+        report("fire", "wheel", elapsed_ms(start), fired);
+        cout << "    mean lateness " << (fired ? late / fired : 0) << " ms (tick "
+             << wheel.get_resolution() << " ms)\n";
+    }
+
+    {
+        boost::asio::io_service io;
+        vector<unique_ptr<boost::asio::deadline_timer>> timers;
+        size_t fired = 0;
+        double late = 0;
+        for(size_t i = 0; i < n; ++i) {
+            timers.emplace_back(new boost::asio::deadline_timer(io));
+        }
+
+        bench_clock::time_point start = bench_clock::now();
+        for(size_t i = 0; i < n; ++i) {
+            unsigned long ms = i % spread;
+            timers[i]->expires_from_now(boost::posix_time::milliseconds(ms));
+            timers[i]->async_wait(boost::bind(&timer_fired, boost::asio::placeholders::error,
+                                              &fired, bench_clock::now() + chrono::milliseconds(ms),
+                                              &late));
+        }
+        io.run();
+        report("fire", "deadline_timer", elapsed_ms(start), fired);
+        cout << "    mean lateness " << (fired ? late / fired : 0) << " ms\n";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t timers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    size_t resets = argc > 2 ? strtoul(argv[2], nullptr, 10) : 10;
+
+    cout << "Timeout benchmark: " << timers << " timers, " << resets << " resets each\n";
+    bench_schedule_cancel(timers);
+    bench_reset(timers, resets);
+    bench_fire(timers);
+    return 0;
+}
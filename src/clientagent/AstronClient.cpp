@@ -60,6 +60,29 @@ class AstronClient : public Client, public NetworkHandler
     long m_heartbeat_timeout;
     std::shared_ptr<Timeout> m_heartbeat_timer = nullptr;
 
+    // Messages held back by begin_batch() until the matching end_batch().
+    unsigned int m_batch_depth = 0;
+    std::vector<DatagramHandle> m_batch;
+
+    // send writes a message to the client, or adds it to the current batch.
+    void send(DatagramHandle dg)
+    {
+        if(m_batch_depth > 0) {
+            m_batch.push_back(dg);
+        } else {
+            m_client->send_datagram(dg);
+        }
+    }
+
+    // flush_batch writes out any batched messages immediately.
+    void flush_batch()
+    {
+        if(!m_batch.empty()) {
+            m_client->send_datagrams(m_batch);
+            m_batch.clear();
+        }
+    }
+
   public:
     AstronClient(ConfigNode config, ClientAgent* client_agent, tcp::socket *socket,
                  const tcp::endpoint &remote, const tcp::endpoint &local) :
@@ -158,6 +181,7 @@ class AstronClient : public Client, public NetworkHandler
             resp->add_uint16(CLIENT_EJECT);
             resp->add_uint16(reason);
             resp->add_string(error_string);
+            flush_batch();
             m_client->send_datagram(resp);
 
             m_clean_disconnect = true;
@@ -234,7 +258,20 @@ class AstronClient : public Client, public NetworkHandler
     // Handler for CLIENTAGENT_SEND_DATAGRAM.
     virtual void forward_datagram(DatagramHandle dg)
     {
-        m_client->send_datagram(dg);
+        send(dg);
+    }
+
+    // begin_batch and end_batch bracket a run of messages that are written to the network
+    // together once the outermost batch ends.
+    virtual void begin_batch()
+    {
+        ++m_batch_depth;
+    }
+    virtual void end_batch()
+    {
+        if(m_batch_depth > 0 && --m_batch_depth == 0) {
+            flush_batch();
+        }
     }
 
     // handle_drop should immediately disconnect the client without sending any more data.
@@ -261,7 +298,7 @@ class AstronClient : public Client, public NetworkHandler
         for(auto it = i.zones.begin(); it != i.zones.end(); ++it) {
             resp->add_zone(*it);
         }
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_remove_interest should inform the client an interest was removed by the server.
@@ -271,7 +308,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_uint16(CLIENT_REMOVE_INTEREST);
         resp->add_uint32(context);
         resp->add_uint16(interest_id);
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_add_object should inform the client of a new object. The datagram iterator
@@ -286,7 +323,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_location(parent_id, zone_id);
         resp->add_uint16(dc_id);
         resp->add_data(dgi.read_remainder());
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_add_ownership should inform the client it has control of a new object. The datagram
@@ -302,7 +339,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_location(parent_id, zone_id);
         resp->add_uint16(dc_id);
         resp->add_data(dgi.read_remainder());
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_set_field should inform the client that the field has been updated.
@@ -313,7 +350,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_doid(do_id);
         resp->add_uint16(field_id);
         resp->add_data(dgi.read_remainder());
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_set_fields should inform the client that a group of fields has been updated.
@@ -324,7 +361,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_doid(do_id);
         resp->add_uint16(num_fields);
         resp->add_data(dgi.read_remainder());
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_change_location should inform the client that the objects location has changed.
@@ -334,7 +371,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_uint16(CLIENT_OBJECT_LOCATION);
         resp->add_doid(do_id);
         resp->add_location(new_parent, new_zone);
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_remove_object should send a mesage to remove the object from the connected client.
@@ -345,7 +382,7 @@ class AstronClient : public Client, public NetworkHandler
         DatagramPtr resp = Datagram::create();
         resp->add_uint16(CLIENT_OBJECT_LEAVING);
         resp->add_doid(do_id);
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_remove_ownership should notify the client it no has control of the object.
@@ -355,7 +392,7 @@ class AstronClient : public Client, public NetworkHandler
         DatagramPtr resp = Datagram::create();
         resp->add_uint16(CLIENT_OBJECT_LEAVING_OWNER);
         resp->add_doid(do_id);
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // handle_interest_done is called when all of the objects from an opened interest have been
@@ -366,7 +403,7 @@ class AstronClient : public Client, public NetworkHandler
         resp->add_uint16(CLIENT_DONE_INTEREST_RESP);
         resp->add_uint32(context);
         resp->add_uint16(interest_id);
-        m_client->send_datagram(resp);
+        send(resp);
     }
 
     // Client has just connected and should only send "CLIENT_HELLO"
@@ -410,7 +447,7 @@ class AstronClient : public Client, public NetworkHandler
 
         DatagramPtr resp = Datagram::create();
         resp->add_uint16(CLIENT_HELLO_RESP);
-        m_client->send_datagram(resp);
+        send(resp);
 
         m_state = CLIENT_STATE_ANONYMOUS;
     }
@@ -202,8 +202,9 @@ void Client::add_interest(Interest &i, uint32_t context, channel_t caller)
 
     uint32_t request_context = m_next_context++;
 
-    InterestOperation *iop = new InterestOperation(this, m_client_agent->m_interest_timeout,
-            i.id, context, request_context, i.parent, new_zones, caller);
+    InterestOperation *iop = m_client_agent->m_interest_pool.acquire();
+    iop->begin(this, m_client_agent->m_interest_timeout,
+               i.id, context, request_context, i.parent, new_zones, caller);
     m_pending_interests.emplace(request_context, iop);
 
     DatagramPtr resp = Datagram::create();
@@ -599,8 +600,8 @@ void Client::handle_datagram(DatagramHandle in_dg, DatagramIterator &dgi)
             return;
         }
 
-        m_pending_objects.emplace(dgi.read_doid(), request_context);
-        it->second->queue_expected(in_dg);
+        bool with_other = (msgtype == STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED_OTHER);
+        it->second->queue_expected(in_dg, dgi, with_other);
         if(it->second->is_ready()) {
             it->second->finish();
         }
@@ -757,7 +758,12 @@ void Client::handle_object_entrance(DatagramIterator &dgi, bool other)
     doid_t parent = dgi.read_doid();
     zone_t zone = dgi.read_zone();
     uint16_t dc_id = dgi.read_uint16();
+    handle_object_entrance(do_id, parent, zone, dc_id, dgi, other);
+}
 
+void Client::handle_object_entrance(doid_t do_id, doid_t parent, zone_t zone, uint16_t dc_id,
+                                    DatagramIterator &dgi, bool other)
+{
     // this object is no longer pending
     m_pending_objects.erase(do_id);
 
@@ -814,26 +820,35 @@ void Client::notify_interest_done(const InterestOperation* iop)
 /* ========================== *
  *       HELPER CLASSES       *
  * ========================== */
-InterestOperation::InterestOperation(
+InterestOperation::~InterestOperation()
+{
+    assert(m_finished);
+}
+
+void InterestOperation::begin(
     Client *client, unsigned long timeout,
     uint16_t interest_id, uint32_t client_context, uint32_t request_context,
-    doid_t parent, unordered_set<zone_t> zones, channel_t caller) :
-    m_client(client),
-    m_interest_id(interest_id),
-    m_client_context(client_context),
-    m_request_context(request_context),
-    m_parent(parent), m_zones(zones),
-    m_timeout(std::make_shared<Timeout>(timeout, bind(&InterestOperation::timeout, this)))
+    doid_t parent, unordered_set<zone_t> zones, channel_t caller)
 {
+    m_client = client;
+    m_interest_id = interest_id;
+    m_client_context = client_context;
+    m_request_context = request_context;
+    m_parent = parent;
+    m_zones = move(zones);
+    m_callers.clear();
     m_callers.insert(m_callers.end(), caller);
+    m_has_total = false;
+    m_total = 0;
+    m_streaming = client->m_client_agent->m_stream_interests;
+    m_received = 0;
+    m_finished = false;
+
+    // The pending queues were cleared by the last finish(), but keep their capacity.
+    m_timeout = std::make_shared<Timeout>(timeout, bind(&InterestOperation::timeout, this));
     m_timeout->start();
 }
 
-InterestOperation::~InterestOperation()
-{
-    assert(m_finished);
-}
-
 void InterestOperation::timeout()
 {
     lock_guard<recursive_mutex> lock(m_client->m_client_lock);
@@ -848,46 +863,43 @@ void InterestOperation::finish(bool is_timeout)
         return;
     }
 
-    // Send objects in the initial snapshot
-    for(const auto& it : m_pending_generates) {
-        DatagramIterator dgi(it);
-        dgi.seek_payload();
-        dgi.skip(sizeof(channel_t)); // skip sender
+    Client *client = m_client;
 
-        uint16_t msgtype = dgi.read_uint16();
-        bool with_other = (msgtype == STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED_OTHER);
-
-        dgi.skip(sizeof(uint32_t)); // skip request_context
-        m_client->handle_object_entrance(dgi, with_other);
+    // Send objects in the initial snapshot, along with the interest done message,
+    // to the client in one go.
+    client->begin_batch();
+    for(const auto& it : m_pending_generates) {
+        DatagramIterator dgi(it.dg, it.offset);
+        client->handle_object_entrance(it.do_id, it.parent, it.zone, it.dc_id, dgi, it.other);
     }
 
     // Distribute the interest done message
-    m_client->notify_interest_done(this);
-    m_client->handle_interest_done(m_interest_id, m_client_context);
+    client->notify_interest_done(this);
+    client->handle_interest_done(m_interest_id, m_client_context);
+    client->end_batch();
 
     // N. B. We need to delete the pending interest before we send queued
     //       datagrams, so that they aren't just re-added to the queue.
-    //       Move the queued datagrams to the stack so it is safe to delete the Operation.
-    list<DatagramHandle> dispatch = move(m_pending_datagrams);
-
-    // Delete the Interest Operation
-    m_client->m_pending_interests.erase(m_request_context);
+    client->m_pending_interests.erase(m_request_context);
 
     // Dispatch other received and queued messages
-    for(const auto& it : dispatch) {
+    for(const auto& it : m_pending_datagrams) {
         DatagramIterator dgi(it);
         dgi.seek_payload();
-        m_client->handle_datagram(it, dgi);
+        client->handle_datagram(it, dgi);
     }
 
     m_finished = true;
+    m_pending_generates.clear();
+    m_pending_datagrams.clear();
+    m_timeout = nullptr;
 
-    delete this;
+    client->m_client_agent->m_interest_pool.release(this);
 }
 
 bool InterestOperation::is_ready()
 {
-    return m_has_total && m_pending_generates.size() >= m_total;
+    return m_has_total && m_received >= m_total;
 }
 
 void InterestOperation::set_expected(doid_t total)
@@ -898,12 +910,74 @@ void InterestOperation::set_expected(doid_t total)
     }
 }
 
-void InterestOperation::queue_expected(DatagramHandle dg)
+void InterestOperation::queue_expected(DatagramHandle dg, DatagramIterator &dgi, bool other)
 {
-    m_pending_generates.push_back(dg);
+    PendingEntry entry;
+    entry.dg = dg;
+    entry.do_id = dgi.read_doid();
+    entry.parent = dgi.read_doid();
+    entry.zone = dgi.read_zone();
+    entry.dc_id = dgi.read_uint16();
+    entry.other = other;
+    entry.offset = dgi.tell();
+    ++m_received;
+
+    // When streaming, the object can go straight to the client, unless messages for it are
+    // already sitting in m_pending_datagrams (eg. it entered the zone while we were waiting
+    // for the snapshot).  Those are only dispatched by finish(), so the entrance has to wait
+    // too; otherwise later updates for the object would overtake the queued ones.
+    if(m_streaming && m_client->m_pending_objects.find(entry.do_id)
+       == m_client->m_pending_objects.end()) {
+        m_client->handle_object_entrance(entry.do_id, entry.parent, entry.zone, entry.dc_id,
+                                         dgi, other);
+        return;
+    }
+
+    m_client->m_pending_objects.emplace(entry.do_id, m_request_context);
+    m_pending_generates.push_back(entry);
 }
 
 void InterestOperation::queue_datagram(DatagramHandle dg)
 {
     m_pending_datagrams.push_back(dg);
 }
+
+InterestOperationPool::InterestOperationPool(size_t max_idle) : m_max_idle(max_idle)
+{
+}
+
+void InterestOperationPool::set_max_idle(size_t max_idle)
+{
+    lock_guard<mutex> lock(m_lock);
+    m_max_idle = max_idle;
+    if(m_idle.size() > m_max_idle) {
+        m_idle.resize(m_max_idle);
+    }
+}
+
+InterestOperation *InterestOperationPool::acquire()
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        if(!m_idle.empty()) {
+            InterestOperation *iop = m_idle.back().release();
+            m_idle.pop_back();
+            return iop;
+        }
+    }
+
+    return new InterestOperation;
+}
+
+void InterestOperationPool::release(InterestOperation *iop)
+{
+    {
+        lock_guard<mutex> lock(m_lock);
+        if(m_idle.size() < m_max_idle) {
+            m_idle.emplace_back(iop);
+            return;
+        }
+    }
+
+    delete iop;
+}
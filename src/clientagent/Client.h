@@ -6,6 +6,7 @@
 
 #include <queue>
 #include <memory>
+#include <vector>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -56,15 +57,31 @@ class Client; // forward declaration
 // An InterestOperation represents the process of receiving the entirety of the interest
 // within a client.  The InterestOperation stays around until all new visible objects from a
 // newly created or updated interest have been received and forwarded to the Client.
+//
+// InterestOperations are recycled through their ClientAgent's InterestOperationPool, along
+// with the storage of their pending queues, so they are started with begin() rather than
+// constructed for each interest.
 class InterestOperation
 {
   public:
-    Client *m_client;
-
-    uint16_t m_interest_id;
-    uint32_t m_client_context;
-    uint32_t m_request_context;
-    doid_t m_parent;
+    // A PendingEntry is an object entrance received for the interest, with its header
+    // parsed when it was queued so that finish() can hand it straight to the client.
+    struct PendingEntry {
+        DatagramHandle dg;
+        dgsize_t offset; // The offset of the object's required fields in dg.
+        doid_t do_id;
+        doid_t parent;
+        zone_t zone;
+        uint16_t dc_id;
+        bool other;
+    };
+
+    Client *m_client = nullptr;
+
+    uint16_t m_interest_id = 0;
+    uint32_t m_client_context = 0;
+    uint32_t m_request_context = 0;
+    doid_t m_parent = 0;
     std::unordered_set<zone_t> m_zones;
     std::unordered_set<channel_t> m_callers;
 
@@ -73,23 +90,55 @@ class InterestOperation
     bool m_has_total = false;
     doid_t m_total = 0; // as doid_t because <max_objs_in_zones> == <max_total_objs>
 
-    std::list<DatagramHandle> m_pending_generates;
-    std::list<DatagramHandle> m_pending_datagrams;
+    // In streaming mode, objects in the interest are sent to the client as soon as they arrive
+    // rather than all at once when the operation finishes; see ClientAgent's stream_interests.
+    bool m_streaming = false;
+    doid_t m_received = 0; // The number of objects received so far, whether sent or pending.
+
+    std::vector<PendingEntry> m_pending_generates;
+    std::vector<DatagramHandle> m_pending_datagrams;
 
-    InterestOperation(Client *client, unsigned long timeout,
-                      uint16_t interest_id, uint32_t client_context, uint32_t request_context,
-                      doid_t parent, std::unordered_set<zone_t> zones, channel_t caller);
+    InterestOperation() = default;
     ~InterestOperation();
 
+    void begin(Client *client, unsigned long timeout,
+               uint16_t interest_id, uint32_t client_context, uint32_t request_context,
+               doid_t parent, std::unordered_set<zone_t> zones, channel_t caller);
+
     bool is_ready();
     void set_expected(doid_t total);
-    void queue_expected(DatagramHandle dg);
+    // queue_expected handles an object entrance into the interest, which is either queued until
+    // the operation finishes or, when streaming, sent on right away.  The DGI should be
+    // positioned at the do_id.
+    void queue_expected(DatagramHandle dg, DatagramIterator &dgi, bool other);
     void queue_datagram(DatagramHandle dg);
     void finish(bool is_timeout = false);
     void timeout();
 
   private:
-    bool m_finished = false;
+    bool m_finished = true; // Idle operations count as finished.
+};
+
+// An InterestOperationPool keeps finished InterestOperations for reuse, so that a busy
+// ClientAgent isn't allocating an operation and its queues for every interest request.
+// It is shared by all of a ClientAgent's clients, which may be on different event loops.
+class InterestOperationPool
+{
+  public:
+    InterestOperationPool(size_t max_idle = 256);
+
+    // set_max_idle sets how many finished operations are kept around for reuse.
+    void set_max_idle(size_t max_idle);
+
+    // acquire returns an idle operation if there is one, or a new one otherwise.
+    InterestOperation *acquire();
+    // release returns a finished operation to the pool, or deletes it if the pool is full.
+    void release(InterestOperation *iop);
+
+  private:
+    std::mutex m_lock;
+    size_t m_max_idle;
+    std::vector<std::unique_ptr<InterestOperation>> m_idle;
 };
 
 class Client : public MDParticipantInterface
@@ -183,12 +232,25 @@ class Client : public MDParticipantInterface
     // handle_object_entrance is a common handler for object entrance. the DGI should be positioned
     // at the start of the do_id parameter
     void handle_object_entrance(DatagramIterator &dgi, bool other);
+    // This overload takes an already parsed header, with the DGI positioned at the required fields.
+    void handle_object_entrance(doid_t do_id, doid_t parent, zone_t zone, uint16_t dc_id,
+                                DatagramIterator &dgi, bool other);
 
     // try_queue_pending checks the object against m_pending_objects, and if the objects is
     // involved in a pending iop, queues the datagram for later sending, and returns true
     inline bool try_queue_pending(doid_t do_id, DatagramHandle dg);
 
     /* Client Interface */
+    // begin_batch and end_batch bracket a run of messages to the client, such as the objects
+    // of a completed interest, that should be written to the network together.  Batches may
+    // nest; the messages are written when the outermost batch ends.
+    virtual void begin_batch()
+    {
+    }
+    virtual void end_batch()
+    {
+    }
+
     // send_disconnect must close any connections with a connected client; the given reason and
     // error should be forwarded to the client. Additionally, it is recommend to log the event.
     // Handler for CLIENTAGENT_EJECT.
@@ -1,6 +1,7 @@
 #include "ClientAgent.h"
 #include "ClientFactory.h"
 
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include "core/global.h"
 #include "core/shutdown.h"
@@ -46,6 +47,7 @@ static InvalidChannelConstraint min_not_invalid(min_channel);
 static InvalidChannelConstraint max_not_invalid(max_channel);
 static ReservedChannelConstraint min_not_reserved(min_channel);
 static ReservedChannelConstraint max_not_reserved(max_channel);
+static ConfigVariable<unsigned long> channel_quarantine("quarantine", 0, channels_config);
 
 KeyedConfigGroup ca_client_config("client", "type", clientagent_config, "libastron");
 ConfigVariable<string> ca_client_type("type", "libastron", ca_client_config);
@@ -58,23 +60,30 @@ ConfigConstraint<string> client_type_exists(have_client_type, ca_client_type,
 
 static ConfigGroup tuning_config("tuning", clientagent_config);
 static ConfigVariable<unsigned long> interest_timeout("interest_timeout", 500, tuning_config);
+static ConfigVariable<unsigned int> interest_pool_size("interest_pool_size", 256, tuning_config);
+static ConfigVariable<bool> distribute_clients("distribute_clients", true, tuning_config);
+static ConfigVariable<bool> stream_interests("stream_interests", false, tuning_config);
+static ConfigVariable<unsigned long> stats_interval("stats_interval", 0, tuning_config);
+static BooleanValueConstraint distribute_clients_is_boolean(distribute_clients);
+static BooleanValueConstraint stream_interests_is_boolean(stream_interests);
 
 ClientAgent::ClientAgent(RoleConfig roleconfig) : Role(roleconfig), m_net_acceptor(nullptr),
-    m_server_version(server_version.get_rval(roleconfig)), m_ssl_ctx(ssl::context::sslv23)
+    m_server_version(server_version.get_rval(roleconfig)),
+    m_ct(min_channel.get_rval(clientagent_config.get_child_node(channels_config, roleconfig)),
+         max_channel.get_rval(clientagent_config.get_child_node(channels_config, roleconfig))),
+    m_ssl_ctx(ssl::context::sslv23)
 {
 
+    m_bind_addr = bind_addr.get_rval(roleconfig);
+
     stringstream ss;
-    ss << "Client Agent (" << bind_addr.get_rval(roleconfig) << ")";
+    ss << "Client Agent (" << m_bind_addr << ")";
     m_log = std::unique_ptr<LogCategory>(new LogCategory("clientagent", ss.str()));
 
     // We need to get the client type...
     ConfigNode client = clientagent_config.get_child_node(ca_client_config, roleconfig);
     m_client_type = ca_client_type.get_rval(client);
 
-    // ... and also the channel range ...
-    ConfigNode channels = clientagent_config.get_child_node(channels_config, roleconfig);
-    m_ct = ChannelTracker(min_channel.get_rval(channels), max_channel.get_rval(channels));
-
     // ... then store a copy of the client config.
     m_clientconfig = clientagent_config.get_child_node(ca_client_config, roleconfig);
 
@@ -89,6 +98,17 @@ ClientAgent::ClientAgent(RoleConfig roleconfig) : Role(roleconfig), m_net_accept
     // Load tuning parameters.
     ConfigNode tuning = clientagent_config.get_child_node(tuning_config, roleconfig);
     m_interest_timeout = interest_timeout.get_rval(tuning);
+    m_interest_pool.set_max_idle(interest_pool_size.get_rval(tuning));
+    m_stream_interests = stream_interests.get_rval(tuning);
+
+    ConfigNode channels = clientagent_config.get_child_node(channels_config, roleconfig);
+    m_ct.set_quarantine(channel_quarantine.get_rval(channels));
+
+    m_stats_interval = stats_interval.get_rval(tuning);
+    if(m_stats_interval > 0) {
+        m_stats_timer.reset(new boost::asio::deadline_timer(m_io_service));
+        schedule_stats();
+    }
 
     // Load SSL data from Config vars
     ConfigNode tls_settings = clientagent_config.get_child_node(tls_config, roleconfig);
@@ -103,7 +123,7 @@ ClientAgent::ClientAgent(RoleConfig roleconfig) : Role(roleconfig), m_net_accept
                                        std::placeholders::_1,
                                        std::placeholders::_2,
                                        std::placeholders::_3);
-        m_net_acceptor = std::unique_ptr<TcpAcceptor>(new TcpAcceptor(io_service, callback));
+        m_net_acceptor = std::unique_ptr<TcpAcceptor>(new TcpAcceptor(m_io_service, callback));
     }
 
     // Handle SSL requested, but some information missing
@@ -176,7 +196,8 @@ ClientAgent::ClientAgent(RoleConfig roleconfig) : Role(roleconfig), m_net_accept
                                        std::placeholders::_1,
                                        std::placeholders::_2,
                                        std::placeholders::_3);
-        std::unique_ptr<SslAcceptor> ssl_acceptor(new SslAcceptor(io_service, m_ssl_ctx, callback));
+        std::unique_ptr<SslAcceptor> ssl_acceptor(new SslAcceptor(m_io_service, m_ssl_ctx,
+                callback));
 
         // Set SSL handshake timeout.
         ssl_acceptor->set_handshake_timeout(tls_handshake_timeout.get_rval(tls_settings));
@@ -185,6 +206,7 @@ ClientAgent::ClientAgent(RoleConfig roleconfig) : Role(roleconfig), m_net_accept
     }
 
     m_net_acceptor->set_haproxy_mode(behind_haproxy.get_rval(m_roleconfig));
+    m_net_acceptor->set_distribute_connections(distribute_clients.get_rval(tuning));
 
     // Begin listening for new Clients
     boost::system::error_code ec;
@@ -230,40 +252,40 @@ void ClientAgent::handle_datagram(DatagramHandle, DatagramIterator&)
     // At the moment, the client agent doesn't actually handle any datagrams
 }
 
-string ClientAgent::ssl_password_callback()
+void ClientAgent::schedule_stats()
 {
-    stringstream prompt;
-    prompt << "Enter password for " << m_ssl_key << ": ";
-    return password_prompt(prompt.str());
+    m_stats_timer->expires_from_now(boost::posix_time::milliseconds(m_stats_interval));
+    m_stats_timer->async_wait(boost::bind(&ClientAgent::handle_stats, this,
+                                          boost::asio::placeholders::error));
 }
 
-static RoleFactoryItem<ClientAgent> ca_fact("clientagent");
+// handle_stats reports the channel tracker's utilization to the log and the event logger.
+void ClientAgent::handle_stats(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return;
+    }
 
+    ChannelTracker::Stats stats = m_ct.get_stats();
+    m_log->info() << "Channels: " << stats.allocated << "/" << stats.capacity << " allocated, "
+                  << stats.quarantined << " quarantined, " << stats.failed
+                  << " failed allocations.\n";
 
+    LoggedEvent event("channel-stats", "ClientAgent:" + m_bind_addr);
+    event.add("capacity", to_string(stats.capacity));
+    event.add("allocated", to_string(stats.allocated));
+    event.add("quarantined", to_string(stats.quarantined));
+    event.add("failed", to_string(stats.failed));
+    g_eventsender.send(event);
 
-/* ========================== *
- *       HELPER CLASSES       *
- * ========================== */
-ChannelTracker::ChannelTracker(channel_t min, channel_t max) : m_next(min), m_max(max),
-    m_unused_channels()
-{
+    schedule_stats();
 }
 
-channel_t ChannelTracker::alloc_channel()
+string ClientAgent::ssl_password_callback()
 {
-    if(m_next <= m_max) {
-        return m_next++;
-    } else {
-        if(!m_unused_channels.empty()) {
-            channel_t c = m_unused_channels.front();
-            m_unused_channels.pop();
-            return c;
-        }
-    }
-    return 0;
+    stringstream prompt;
+    prompt << "Enter password for " << m_ssl_key << ": ";
+    return password_prompt(prompt.str());
 }
 
-void ChannelTracker::free_channel(channel_t channel)
-{
-    m_unused_channels.push(channel);
-}
+static RoleFactoryItem<ClientAgent> ca_fact("clientagent");
@@ -1,36 +1,22 @@
 #pragma once
 #include "core/Role.h"
+#include "util/ChannelTracker.h"
 #include "Client.h"
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 
 #include <memory>
+#include <mutex>
 
 extern RoleConfigGroup clientagent_config;
 extern KeyedConfigGroup ca_client_config;
 extern ConfigVariable<std::string> ca_client_type;
 
-// A ChannelTracker is used to keep track of available and allocated channels that
-// the ClientAgent can use to assign to new Clients.
-// TODO: Consider moving to util/ this class might be reusable in other roles that utilize ranges.
-class ChannelTracker
-{
-  public:
-    ChannelTracker(channel_t min = INVALID_CHANNEL, channel_t max = INVALID_CHANNEL);
-
-    channel_t alloc_channel();
-    void free_channel(channel_t channel);
-
-  private:
-    channel_t m_next;
-    channel_t m_max;
-    std::queue<channel_t> m_unused_channels;
-};
-
 class ClientAgent final : public Role
 {
     friend class Client;
+    friend class InterestOperation;
 
   public:
     ClientAgent(RoleConfig rolconfig);
@@ -70,6 +56,7 @@ class ClientAgent final : public Role
 
   private:
     std::unique_ptr<NetworkAcceptor> m_net_acceptor;
+    std::string m_bind_addr;
     std::string m_client_type;
     std::string m_server_version;
     ChannelTracker m_ct;
@@ -78,8 +65,17 @@ class ClientAgent final : public Role
     uint32_t m_hash;
 
     unsigned long m_interest_timeout;
+    InterestOperationPool m_interest_pool;
+    bool m_stream_interests;
+
+    // Channel utilization reporting
+    unsigned long m_stats_interval = 0;
+    std::unique_ptr<boost::asio::deadline_timer> m_stats_timer;
 
     boost::asio::ssl::context m_ssl_ctx;
     std::string m_ssl_cert;
     std::string m_ssl_key;
+
+    void schedule_stats();
+    void handle_stats(const boost::system::error_code &ec);
 };
@@ -0,0 +1,333 @@
+#include "EventLoopPool.h"
+#ifdef __linux__
+#  include <pthread.h>
+#  include <sched.h>
+#endif
+#include <algorithm>
+#include <boost/bind.hpp>
+#include "core/global.h"
+#include "core/shutdown.h"
+#include "config/ConfigVariable.h"
+#include "config/constraints.h"
+#include "util/TimerWheel.h"
+using namespace std;
+
+static LogCategory loop_log("eventloop", "Event Loops");
+
+static ConfigGroup loops_config("event_loops", daemon_config);
+// The number of loops to run; 0 means one per hardware thread.
+static ConfigVariable<unsigned int> loop_count("count", 1, loops_config);
+// If enabled, loop N is pinned to CPU N (or the Nth entry of "cpus" if given).
+static ConfigVariable<bool> cpu_affinity("cpu_affinity", false, loops_config);
+static ConfigVariable<vector<unsigned int> > cpu_list("cpus", vector<unsigned int>(), loops_config);
+// How often (in ms) each loop samples its own scheduling latency; 0 disables the probe.
+static ConfigVariable<unsigned long> probe_interval("probe_interval", 0, loops_config);
+// How often (in ms) the sampled latencies are written to the log; 0 disables reporting.
+static ConfigVariable<unsigned long> report_interval("report_interval", 0, loops_config);
+// The tick length (in ms) of each loop's timer wheel; Timeouts fire at most one tick late.
+static ConfigVariable<unsigned long> timer_resolution("timer_resolution", 10, loops_config);
+static BooleanValueConstraint cpu_affinity_is_boolean(cpu_affinity);
+
+// The loop, if any, running on the current thread.
+static thread_local EventLoop *current_loop = nullptr;
+
+static void set_thread_affinity(int cpu)
+{
+    if(cpu < 0) {
+        return;
+    }
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if(err != 0) {
+        loop_log.warning() << "Could not pin thread to CPU " << cpu
+                           << " (error " << err << ").\n";
+    }
+#else
+    loop_log.warning() << "CPU affinity is not supported on this platform; ignoring.\n";
+#endif
+}
+
+
+EventLoop::EventLoop(unsigned int index, boost::asio::io_service &io_service) :
+    m_index(index), m_io_service(&io_service)
+{
+}
+
+EventLoop::EventLoop(unsigned int index) : m_index(index),
+    m_owned_io_service(new boost::asio::io_service)
+{
+    m_io_service = m_owned_io_service.get();
+}
+
+EventLoop::LatencyStats EventLoop::get_latency() const
+{
+    LatencyStats stats;
+    stats.samples = m_samples;
+    stats.mean_us = stats.samples ? m_total_us / stats.samples : 0;
+    stats.max_us = m_max_us;
+    return stats;
+}
+
+void EventLoop::reset_latency()
+{
+    m_samples = 0;
+    m_total_us = 0;
+    m_max_us = 0;
+}
+
+void EventLoop::start_probe(unsigned long interval_ms)
+{
+    m_probe_interval = interval_ms;
+    m_probe_timer.reset(new boost::asio::deadline_timer(*m_io_service));
+    schedule_probe();
+}
+
+void EventLoop::schedule_probe()
+{
+    m_probe_timer->expires_from_now(boost::posix_time::milliseconds(m_probe_interval));
+    m_probe_timer->async_wait(boost::bind(&EventLoop::handle_probe, this,
+                                          boost::asio::placeholders::error));
+}
+
+void EventLoop::handle_probe(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return; // The loop is shutting down.
+    }
+
+    // The timer was ready at expires_at(); anything beyond that is time spent
+    // waiting behind other handlers in this loop's queue.
+    boost::posix_time::time_duration late;
+    late = boost::posix_time::microsec_clock::universal_time() - m_probe_timer->expires_at();
+    uint64_t late_us = late.is_negative() ? 0 : late.total_microseconds();
+
+    m_samples += 1;
+    m_total_us += late_us;
+    uint64_t max_us = m_max_us;
+    while(late_us > max_us && !m_max_us.compare_exchange_weak(max_us, late_us)) {
+        // max_us is reloaded by the failed exchange
+    }
+
+    schedule_probe();
+}
+
+
+EventLoopPool::EventLoopPool()
+{
+    // Loop 0 always exists so that work can be assigned before (or without) init().
+    m_loops.emplace_back(new EventLoop(0, io_service));
+}
+
+EventLoopPool::~EventLoopPool()
+{
+    stop();
+    for(auto &loop : m_loops) {
+        if(loop->m_thread && loop->m_thread->joinable()) {
+            loop->m_thread->join();
+        }
+    }
+}
+
+unsigned int EventLoopPool::configured_size()
+{
+    unsigned int count = loop_count.get_val();
+    if(count == 0) {
+        count = max(1u, thread::hardware_concurrency());
+    }
+    return count;
+}
+
+void EventLoopPool::init()
+{
+    if(m_initialized) {
+        return;
+    }
+    m_initialized = true;
+
+    unsigned int count = configured_size();
+    for(unsigned int i = 1; i < count; ++i) {
+        m_loops.emplace_back(new EventLoop(i));
+    }
+    m_shared = count;
+
+    if(count > 1) {
+        // With more than one loop, work may live on any of them, so no single loop
+        // running out of work means the daemon is done; keep all of them alive until stop().
+        for(auto &loop : m_loops) {
+            loop->m_work.reset(new boost::asio::io_service::work(loop->get_io_service()));
+        }
+        loop_log.info() << "Running " << count << " event loops.\n";
+    }
+
+    for(auto &loop : m_loops) {
+        boost::asio::use_service<TimerWheel>(loop->get_io_service())
+        .set_resolution(timer_resolution.get_val());
+    }
+
+    unsigned long probe = probe_interval.get_val();
+    if(probe > 0) {
+        for(auto &loop : m_loops) {
+            loop->start_probe(probe);
+        }
+
+        m_report_interval = report_interval.get_val();
+        if(m_report_interval > 0) {
+            m_report_timer.reset(new boost::asio::deadline_timer(io_service));
+            schedule_report();
+        }
+    }
+}
+
+void EventLoopPool::run()
+{
+    // Work out which CPU each loop should be pinned to, if any.
+    vector<int> cpus(m_loops.size(), -1);
+    if(cpu_affinity.get_val()) {
+        vector<unsigned int> configured = cpu_list.get_val();
+        unsigned int hardware = max(1u, thread::hardware_concurrency());
+        for(size_t i = 0; i < cpus.size(); ++i) {
+            if(configured.empty()) {
+                cpus[i] = i % hardware;
+            } else {
+                cpus[i] = configured[i % configured.size()];
+            }
+        }
+    }
+
+    for(size_t i = 1; i < m_loops.size(); ++i) {
+        EventLoop *loop = m_loops[i].get();
+        loop->m_thread.reset(new thread(&EventLoopPool::worker, this, loop, cpus[i]));
+    }
+
+    set_thread_affinity(cpus[0]);
+    current_loop = m_loops[0].get();
+
+    // Loop 0 runs on this thread; make sure the workers are told to stop and are
+    // joined even if it exits by exception (eg. a ShutdownException).
+    try {
+        io_service.run();
+    } catch(...) {
+        stop();
+        for(size_t i = 1; i < m_loops.size(); ++i) {
+            m_loops[i]->m_thread->join();
+        }
+        throw;
+    }
+
+    stop();
+    for(size_t i = 1; i < m_loops.size(); ++i) {
+        m_loops[i]->m_thread->join();
+    }
+}
+
+void EventLoopPool::worker(EventLoop *loop, int cpu)
+{
+    set_thread_affinity(cpu);
+    current_loop = loop;
+
+    try {
+        loop->get_io_service().run();
+    }
+
+    // This exception is propogated if astron_shutdown is called
+    catch(const ShutdownException& e) {
+        m_exit_code = e.exit_code();
+        stop();
+    }
+
+    // Catch any other exception that propogates
+    catch(const exception &e) {
+        loop_log.fatal() << "Uncaught exception from event loop " << loop->get_index()
+                         << ": " << e.what() << endl;
+        m_exit_code = 1;
+        stop();
+    }
+}
+
+void EventLoopPool::stop()
+{
+    for(auto &loop : m_loops) {
+        loop->get_io_service().stop();
+    }
+
+}
+
+EventLoop &EventLoopPool::add_dedicated()
+{
+    EventLoop *loop = new EventLoop(m_loops.size());
+    m_loops.emplace_back(loop);
+
+    // Whatever the role has queued, its loop is only done when the daemon is.
+    loop->m_work.reset(new boost::asio::io_service::work(loop->get_io_service()));
+    boost::asio::use_service<TimerWheel>(loop->get_io_service())
+    .set_resolution(timer_resolution.get_val());
+    if(probe_interval.get_val() > 0) {
+        loop->start_probe(probe_interval.get_val());
+    }
+
+    loop_log.info() << "Running a dedicated event loop (" << loop->get_index() << ").\n";
+    return *loop;
+}
+
+EventLoop &EventLoopPool::get(unsigned int index)
+{
+    return *m_loops[index % m_shared];
+}
+
+EventLoop &EventLoopPool::next()
+{
+    return get(m_next++);
+}
+
+EventLoop &EventLoopPool::current()
+{
+    if(current_loop != nullptr) {
+        return *current_loop;
+    }
+    return *m_loops[0];
+}
+
+EventLoop &EventLoopPool::for_role(ConfigNode roleconfig)
+{
+    ConfigNode index = roleconfig["event_loop"];
+    if(index.IsDefined() && index.IsScalar()) {
+        // The config file is validated against event_loops/count, so this only happens if
+        // the pool was set up some other way.
+        unsigned int i = index.as<unsigned int>();
+        if(i >= m_shared) {
+            loop_log.warning() << "A role asked for event loop " << i << ", but only "
+                               << m_shared << " are running; using loop " << i % m_shared
+                               << " instead.\n";
+        }
+        return get(i);
+    }
+    return next();
+}
+
+void EventLoopPool::schedule_report()
+{
+    m_report_timer->expires_from_now(boost::posix_time::milliseconds(m_report_interval));
+    m_report_timer->async_wait(boost::bind(&EventLoopPool::handle_report, this,
+                                           boost::asio::placeholders::error));
+}
+
+void EventLoopPool::handle_report(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return;
+    }
+
+    for(auto &loop : m_loops) {
+        EventLoop::LatencyStats stats = loop->get_latency();
+        loop->reset_latency();
+        loop_log.info() << "Loop " << loop->get_index() << " latency: "
+                        << stats.mean_us << "us mean, " << stats.max_us << "us max over "
+                        << stats.samples << " samples.\n";
+    }
+
+    schedule_report();
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <boost/version.hpp>
+#include <boost/asio.hpp>
+#include "config/ConfigGroup.h"
+
+// An EventLoop is a single boost::asio::io_service with the thread that runs it.
+// Loop 0 wraps the global io_service and runs on the daemon's main thread; any
+// additional loops each own an io_service and run on a thread of their own.
+class EventLoop
+{
+  public:
+    EventLoop(unsigned int index, boost::asio::io_service &io_service);
+    EventLoop(unsigned int index);
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    inline unsigned int get_index() const
+    {
+        return m_index;
+    }
+    inline boost::asio::io_service &get_io_service()
+    {
+        return *m_io_service;
+    }
+
+    // LatencyStats are a snapshot of how late this loop's latency probe has fired.
+    // Lateness is the time between a handler being ready to run and it actually running,
+    // which is a good approximation of how backed-up the loop's queue is.
+    struct LatencyStats {
+        uint64_t samples;
+        uint64_t mean_us;
+        uint64_t max_us;
+    };
+
+    // get_latency returns the probe lateness since the last call to reset_latency.
+    LatencyStats get_latency() const;
+    void reset_latency();
+
+  private:
+    friend class EventLoopPool;
+
+    unsigned int m_index;
+    boost::asio::io_service *m_io_service;
+    std::unique_ptr<boost::asio::io_service> m_owned_io_service;
+    std::unique_ptr<boost::asio::io_service::work> m_work;
+    std::unique_ptr<std::thread> m_thread;
+
+    // Latency probe
+    unsigned long m_probe_interval = 0;
+    std::unique_ptr<boost::asio::deadline_timer> m_probe_timer;
+    std::atomic<uint64_t> m_samples {0};
+    std::atomic<uint64_t> m_total_us {0};
+    std::atomic<uint64_t> m_max_us {0};
+
+    void start_probe(unsigned long interval_ms);
+    void schedule_probe();
+    void handle_probe(const boost::system::error_code &ec);
+};
+
+// The EventLoopPool is the daemon's execution model: a fixed set of EventLoops that
+// roles, network connections, acceptors and timeouts are assigned to.  With a single
+// loop (the default) the daemon behaves exactly as a classic single io_service daemon.
+class EventLoopPool
+{
+  public:
+    EventLoopPool();
+    ~EventLoopPool();
+
+    // init creates the configured number of loops.  It must be called after the
+    // config file has been loaded and before any role is instantiated; until then
+    // the pool only contains loop 0.
+    void init();
+
+    // run starts the worker loops, runs loop 0 on the calling thread, and returns once
+    // every loop has stopped.  Exceptions escaping loop 0 are rethrown to the caller.
+    void run();
+
+    // stop asks every loop to stop running; it is safe to call from any thread.
+    void stop();
+
+    // configured_size returns the number of loops init() creates, as set in the config file.
+    static unsigned int configured_size();
+
+    // size returns the number of loops that work is spread over (excluding dedicated loops).
+    inline size_t size() const
+    {
+        return m_shared;
+    }
+
+    // add_dedicated creates an extra loop, outside of the set that get() and next() spread work
+    // over, for a role that wants a thread of its own.  It must be called after init() and
+    // before run(), like role instantiation.
+    EventLoop &add_dedicated();
+
+    // get returns the loop with the given index, wrapping around the number of loops.
+    EventLoop &get(unsigned int index);
+
+    // next returns a loop in round-robin order, for spreading work across the pool.
+    EventLoop &next();
+
+    // current returns the loop whose thread is calling, or loop 0 if the caller
+    // is not running on one of the pool's loops (eg. the MD routing thread).
+    EventLoop &current();
+
+    // for_role returns the loop a role should run on: the loop index in the
+    // role's "event_loop" setting if present, otherwise the next loop in order.
+    EventLoop &for_role(ConfigNode roleconfig);
+
+    // exit_code returns the exit code requested by a worker loop that stopped the daemon.
+    inline int exit_code() const
+    {
+        return m_exit_code;
+    }
+
+  private:
+    bool m_initialized = false;
+    std::vector<std::unique_ptr<EventLoop>> m_loops; // Shared loops first, then dedicated ones.
+    size_t m_shared = 1;
+    std::atomic<unsigned int> m_next {0};
+    std::atomic<int> m_exit_code {0};
+    unsigned long m_report_interval = 0;
+    std::unique_ptr<boost::asio::deadline_timer> m_report_timer;
+
+    void worker(EventLoop *loop, int cpu);
+    void schedule_report();
+    void handle_report(const boost::system::error_code &ec);
+};
+
+// loop_of returns the io_service an asio I/O object (socket, timer, stream) belongs to.
+template<typename IOObject>
+inline boost::asio::io_service &loop_of(IOObject &obj)
+{
+#if BOOST_VERSION >= 106600
+    return static_cast<boost::asio::io_service&>(obj.get_executor().context());
+#else
+    return obj.get_io_service();
+#endif
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+
+// A LogRing is a single-producer byte ring holding the messages one thread has logged but which
+// have not been written out yet.  Each record is a header (the message's length and its global
+// sequence number, used to restore the order of messages across threads) followed by the message,
+// padded out to a whole number of words.
+//
+// The owning thread only ever advances m_head.  m_tail is advanced by the writer as it consumes
+// records, but also by the owning thread when it needs to drop the oldest record to make room;
+// both do so with a compare-and-swap, and the writer discards any record whose tail it loses.
+//
+// The writer may therefore be copying a record out while the owning thread overwrites it, as in
+// a seqlock.  The contents are kept in atomic words, accessed relaxed, so that this is not a data
+// race; the fences in push and pop make sure that a writer which saw any overwritten word also
+// loses the compare-and-swap on m_tail, and so never keeps a torn copy.
+class LogRing
+{
+  public:
+    static const size_t CAPACITY = 64 * 1024; // Must be a power of two.
+
+    LogRing() : m_head(0), m_tail(0)
+    {
+    }
+
+    // push appends a message, returning the number of older messages dropped to make room.
+    unsigned int push(uint64_t seq, const char *data, size_t length)
+    {
+        length = std::min(length, CAPACITY - HEADER_SIZE);
+        uint64_t size = record_size(length);
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+
+        unsigned int dropped = 0;
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        while(head + size - tail > CAPACITY) {
+            // Only this thread stores to the ring, so its own header can't change under it.
+            uint64_t oldest = word(tail).load(std::memory_order_relaxed);
+            if(m_tail.compare_exchange_weak(tail, tail + record_size(oldest),
+                                            std::memory_order_acq_rel)) {
+                tail += record_size(oldest);
+                ++dropped;
+            }
+            // Otherwise, tail was reloaded: the writer took the oldest message first.
+        }
+
+        // Order the moves of m_tail above before the stores below, which may overwrite a record
+        // the writer is still copying out.
+        std::atomic_thread_fence(std::memory_order_release);
+
+        word(head).store(length, std::memory_order_relaxed);
+        word(head + WORD_SIZE).store(seq, std::memory_order_relaxed);
+        copy_in(head + HEADER_SIZE, data, length);
+        m_head.store(head + size, std::memory_order_release);
+        return dropped;
+    }
+
+    // pop removes the oldest message, appending it to out.  It must only be called by one thread
+    // at a time (the Logger holds its write lock).  Returns false if the ring is empty.
+    bool pop(uint64_t &seq, std::string &out)
+    {
+        size_t start = out.size();
+        uint64_t tail = m_tail.load(std::memory_order_acquire);
+        while(tail != m_head.load(std::memory_order_acquire)) {
+            uint64_t length = word(tail).load(std::memory_order_relaxed);
+            seq = word(tail + WORD_SIZE).load(std::memory_order_relaxed);
+            length = std::min(length, uint64_t(CAPACITY - HEADER_SIZE));
+            out.resize(start + length);
+            copy_out(tail + HEADER_SIZE, &out[start], length);
+
+            // If the owning thread dropped this record while we were copying it, the copy may
+            // have been overwritten; throw it away and try again from the new tail.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(m_tail.compare_exchange_strong(tail, tail + record_size(length),
+                                              std::memory_order_acq_rel)) {
+                return true;
+            }
+            out.resize(start);
+        }
+        return false;
+    }
+
+    bool empty()
+    {
+        return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+    }
+
+  private:
+    static const size_t WORD_SIZE = sizeof(uint64_t);
+    static const size_t HEADER_SIZE = 2 * WORD_SIZE;
+
+    std::atomic<uint64_t> m_words[CAPACITY / WORD_SIZE];
+    std::atomic<uint64_t> m_head; // Position after the newest record.
+    std::atomic<uint64_t> m_tail; // Position of the oldest record.
+
+    static uint64_t record_size(uint64_t length)
+    {
+        return HEADER_SIZE + (length + WORD_SIZE - 1) / WORD_SIZE * WORD_SIZE;
+    }
+
+    // word returns the word at the given (word-aligned) position.
+    std::atomic<uint64_t> &word(uint64_t pos)
+    {
+        return m_words[(pos & (CAPACITY - 1)) / WORD_SIZE];
+    }
+
+    void copy_in(uint64_t pos, const char *data, size_t length)
+    {
+        for(size_t i = 0; i < length; i += WORD_SIZE) {
+            uint64_t value = 0;
+            memcpy(&value, data + i, std::min(length - i, size_t(WORD_SIZE)));
+            word(pos + i).store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void copy_out(uint64_t pos, char *data, size_t length)
+    {
+        for(size_t i = 0; i < length; i += WORD_SIZE) {
+            uint64_t value = word(pos + i).load(std::memory_order_relaxed);
+            memcpy(data + i, &value, std::min(length - i, size_t(WORD_SIZE)));
+        }
+    }
+};
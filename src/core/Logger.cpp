@@ -1,23 +1,216 @@
+#include <string.h>
 #include <time.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
-#include <fstream>
+#include <unordered_map>
 
 #include "Logger.h"
+#include "LogRing.h"
 
 NullStream null_stream; // used to print nothing by compiling out the unwanted messages
 NullBuffer null_buffer; // used to print nothing by ignoring the unwanted messages
 
+// Every Logger gets a distinct id, so that threads can tell when g_logger has been replaced.
+static std::atomic<uint64_t> next_logger_id(1);
+
+// How long the writer sleeps when nothing wakes it, in milliseconds.
+static const unsigned int WRITER_INTERVAL = 100;
+
+// A LineBuffer is a streambuf which appends to whichever message is currently being formatted.
+class LineBuffer : public std::streambuf
+{
+  public:
+    std::string *target = nullptr;
+
+  protected:
+    int overflow(int c)
+    {
+        if(c != EOF) {
+            target->push_back(char(c));
+        }
+        return c;
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n)
+    {
+        target->append(s, n);
+        return n;
+    }
+};
+
+// A TimestampCache holds the formatted local time, only reformatting it once a second.
+struct TimestampCache {
+    time_t second = 0;
+    char text[32];
+    size_t length = 0;
+
+    void append_to(std::string &line)
+    {
+        time_t now = time(nullptr);
+        if(now != second || length == 0) {
+            struct tm local;
+#ifdef _WIN32
+            localtime_s(&local, &now);
+#else
+            localtime_r(&now, &local);
+#endif
+            length = strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+            second = now;
+        }
+        line.append(text, length);
+    }
+};
+
+// Per-thread logging state.
+struct LogThreadState {
+    LineBuffer buffer;
+    std::ostream stream;
+    std::ios_base::fmtflags default_flags;
+    std::string spare; // A message buffer kept around so its capacity can be reused.
+    TimestampCache timestamp;
+
+    // The ring this thread logs into, and the Logger it belongs to.
+    uint64_t logger_id = 0;
+    std::shared_ptr<LogRing> ring;
+
+    LogThreadState() : stream(&buffer), default_flags(stream.flags())
+    {
+    }
+};
+
+// The state is only reached through plain pointers, so that a thread which still logs from
+// another thread_local's destructor after its state was cleaned up just gets a new one.
+static thread_local LogThreadState *thread_state_ptr = nullptr;
+static thread_local bool thread_exiting = false;
+
+struct LogThreadCleanup {
+    ~LogThreadCleanup()
+    {
+        thread_exiting = true;
+        delete thread_state_ptr;
+        thread_state_ptr = nullptr;
+    }
+};
+
+static LogThreadState &thread_state()
+{
+    if(thread_state_ptr == nullptr) {
+        thread_state_ptr = new LogThreadState;
+        if(!thread_exiting) {
+            static thread_local LogThreadCleanup cleanup;
+            (void)cleanup;
+        }
+    }
+    return *thread_state_ptr;
+}
+
+static const char *get_severity_text(LogSeverity sev)
+{
+    switch(sev) {
+    case LSEVERITY_PACKET:
+        return "PACKET";
+    case LSEVERITY_TRACE:
+        return "TRACE";
+    case LSEVERITY_DEBUG:
+        return "DEBUG";
+    case LSEVERITY_INFO:
+        return "INFO";
+    case LSEVERITY_WARNING:
+        return "WARNING";
+    case LSEVERITY_SECURITY:
+        return "SECURITY";
+    case LSEVERITY_ERROR:
+        return "ERROR";
+    case LSEVERITY_FATAL:
+        return "FATAL";
+    }
+    return "";
+}
+
+
+LogOutput::LogOutput(Logger *logger, LogSeverity sev) : m_logger(logger), m_severity(sev)
+{
+    LogThreadState &state = thread_state();
+    m_line.swap(state.spare);
+    m_line.clear();
+
+    // Don't let formatting flags set by one message leak into the next.
+    state.stream.flags(state.default_flags);
+    state.stream.fill(' ');
+    state.stream.precision(6);
+    state.stream.width(0);
+}
+
+LogOutput::LogOutput(LogOutput &&other) : m_logger(other.m_logger),
+    m_severity(other.m_severity), m_line(std::move(other.m_line))
+{
+    other.m_logger = nullptr;
+}
+
+LogOutput::~LogOutput()
+{
+    if(m_logger) {
+        m_logger->submit(m_severity, m_line);
+        thread_state().spare.swap(m_line);
+    }
+}
+
+LogOutput::LogStream::LogStream(std::string &line)
+{
+    LogThreadState &state = thread_state();
+    m_stream = &state.stream;
+    m_previous = state.buffer.target;
+    state.buffer.target = &line;
+}
+
+LogOutput::LogStream::~LogStream()
+{
+    thread_state().buffer.target = m_previous;
+}
+
+
 Logger::Logger(const std::string &log_file, LogSeverity sev, bool console_output) :
-    m_buf(log_file, console_output), m_severity(sev), m_output(&m_buf)
+    m_id(next_logger_id++), m_severity(sev), m_color_enabled(true),
+    m_output_to_console(console_output), m_file(fopen(log_file.c_str(), "w"))
 {
+    start();
 }
 
 #ifdef ASTRON_DEBUG_MESSAGES
-Logger::Logger() : m_buf(), m_severity(LSEVERITY_DEBUG), m_output(&m_buf), m_color_enabled(true)
+Logger::Logger() : m_id(next_logger_id++), m_severity(LSEVERITY_DEBUG), m_color_enabled(true),
+    m_output_to_console(true), m_file(nullptr)
 #else
-Logger::Logger() : m_buf(), m_severity(LSEVERITY_INFO), m_output(&m_buf), m_color_enabled(true)
+Logger::Logger() : m_id(next_logger_id++), m_severity(LSEVERITY_INFO), m_color_enabled(true),
+    m_output_to_console(true), m_file(nullptr)
 #endif
 {
+    start();
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_wake_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_writer.join();
+
+    drain();
+    if(m_file != nullptr) {
+        fclose(m_file);
+    }
+}
+
+void Logger::start()
+{
+    m_sequence = 0;
+    m_dropped = 0;
+    m_reported_dropped = 0;
+    m_pending = false;
+    m_stopping = false;
+    m_writer = std::thread(&Logger::run_writer, this);
 }
 
 /* Reset code */
@@ -66,64 +259,168 @@ const char* Logger::get_severity_color(LogSeverity sev)
 }
 
 // log returns an output stream for C++ style stream operations.
-LockedLogOutput Logger::log(LogSeverity sev)
+LogOutput Logger::log(LogSeverity sev)
 {
-    const char *sevtext;
+    if(sev < m_severity.load(std::memory_order_relaxed)) {
+        return LogOutput();
+    }
+
+    return begin(sev);
+}
 
-    if(sev < m_severity) {
-        LockedLogOutput null_out(nullptr, nullptr);
-        return null_out;
+// begin returns an output stream for a message without checking its severity against the
+// minimum severity; the caller has already decided that the message should be logged.
+LogOutput Logger::begin(LogSeverity sev)
+{
+    LogOutput out(this, sev);
+    std::string &line = out.m_line;
+    if(m_color_enabled) {
+        line.append(ANSI_DARK_GREY);
+        line.push_back('[');
+        thread_state().timestamp.append_to(line);
+        line.append("] ");
+        line.append(get_severity_color(sev));
+        line.append(get_severity_text(sev));
+        line.append(": ");
+        line.append(ANSI_RESET);
+    } else {
+        line.push_back('[');
+        thread_state().timestamp.append_to(line);
+        line.append("] ");
+        line.append(get_severity_text(sev));
+        line.append(": ");
     }
 
-    switch(sev) {
-    case LSEVERITY_PACKET:
-        sevtext = "PACKET";
-        break;
-    case LSEVERITY_TRACE:
-        sevtext = "TRACE";
-        break;
-    case LSEVERITY_DEBUG:
-        sevtext = "DEBUG";
-        break;
-    case LSEVERITY_INFO:
-        sevtext = "INFO";
-        break;
-    case LSEVERITY_WARNING:
-        sevtext = "WARNING";
-        break;
-    case LSEVERITY_SECURITY:
-        sevtext = "SECURITY";
-        break;
-    case LSEVERITY_ERROR:
-        sevtext = "ERROR";
-        break;
-    case LSEVERITY_FATAL:
-        sevtext = "FATAL";
-        break;
+    return out;
+}
+
+// submit queues a finished message to be written out.
+void Logger::submit(LogSeverity sev, const std::string &line)
+{
+    LogRing *ring = local_ring();
+    unsigned int dropped = ring->push(m_sequence++, line.data(), line.size());
+    if(dropped > 0) {
+        m_dropped += dropped;
     }
 
-    time_t rawtime;
-    time(&rawtime);
-    char timetext[1024];
-    strftime(timetext, 1024, "%Y-%m-%d %H:%M:%S", localtime(&rawtime));
+    if(sev == LSEVERITY_FATAL) {
+        // The daemon is probably about to exit; don't leave this in a ring.
+        flush();
+        return;
+    }
 
-    LockedLogOutput out(&m_output, &m_lock);
+    // Only the first message since the writer last woke needs to wake it up again.
+    if(!m_pending.load(std::memory_order_relaxed) && !m_pending.exchange(true)) {
+        std::lock_guard<std::mutex> lock(m_wake_lock);
+        m_wake.notify_one();
+    }
+}
 
-    if(m_color_enabled) {
-        out << ANSI_DARK_GREY
-            << "[" << timetext << "] "
-            << get_severity_color(sev)
-            << sevtext
-            << ": "
-            << ANSI_RESET;
-    } else {
-        out << "[" << timetext << "] "
-            << sevtext
-            << ": ";
+// local_ring returns the calling thread's ring, registering a new one if need be.
+LogRing *Logger::local_ring()
+{
+    LogThreadState &state = thread_state();
+    if(state.logger_id != m_id) {
+        state.ring = std::make_shared<LogRing>();
+        state.logger_id = m_id;
+
+        std::lock_guard<std::mutex> lock(m_rings_lock);
+        m_rings.push_back(state.ring);
     }
+    return state.ring.get();
+}
 
+void Logger::flush()
+{
+    drain();
+}
 
-    return out;
+// drain collects every queued message from every ring, and writes them out in the order
+// they were logged.
+void Logger::drain()
+{
+    struct Entry {
+        uint64_t seq;
+        size_t offset;
+        size_t length;
+
+        bool operator<(const Entry &other) const
+        {
+            return seq < other.seq;
+        }
+    };
+
+    std::lock_guard<std::mutex> lock(m_write_lock);
+
+    std::string collected;
+    std::vector<Entry> entries;
+    {
+        std::lock_guard<std::mutex> rings_lock(m_rings_lock);
+        for(auto it = m_rings.begin(); it != m_rings.end();) {
+            Entry entry;
+            entry.offset = collected.size();
+            while((*it)->pop(entry.seq, collected)) {
+                entry.length = collected.size() - entry.offset;
+                entries.push_back(entry);
+                entry.offset = collected.size();
+            }
+
+            // Forget the rings of threads which have exited, once they're empty.
+            if(it->use_count() == 1 && (*it)->empty()) {
+                it = m_rings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::sort(entries.begin(), entries.end());
+    m_batch.clear();
+    for(const Entry &entry : entries) {
+        m_batch.append(collected, entry.offset, entry.length);
+    }
+
+    uint64_t dropped = m_dropped.load();
+    if(dropped != m_reported_dropped) {
+        TimestampCache timestamp;
+        m_batch.push_back('[');
+        timestamp.append_to(m_batch);
+        m_batch.append("] WARNING: Logger: Dropped ");
+        m_batch.append(std::to_string(dropped - m_reported_dropped));
+        m_batch.append(" messages; the log could not keep up.\n");
+        m_reported_dropped = dropped;
+    }
+
+    if(!m_batch.empty()) {
+        write(m_batch.data(), m_batch.size());
+    }
+}
+
+void Logger::write(const char *data, size_t length)
+{
+    if(m_output_to_console) {
+        fwrite(data, 1, length, stdout);
+        fflush(stdout);
+    }
+    if(m_file != nullptr) {
+        fwrite(data, 1, length, m_file);
+        fflush(m_file);
+    }
+}
+
+void Logger::run_writer()
+{
+    std::unique_lock<std::mutex> lock(m_wake_lock);
+    while(!m_stopping) {
+        m_wake.wait_for(lock, std::chrono::milliseconds(WRITER_INTERVAL), [this] {
+            return m_stopping || m_pending.load();
+        });
+
+        m_pending = false;
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
 }
 
 
@@ -140,47 +437,68 @@ void Logger::set_min_severity(LogSeverity sev)
     m_severity = sev;
 }
 
-// get_min_severity returns the current minimum severity that will be logged by the logger.
-LogSeverity Logger::get_min_severity()
+// get_dropped returns the number of messages that have been dropped because the writer
+// could not keep up with them.
+uint64_t Logger::get_dropped()
 {
-    return m_severity;
+    return m_dropped;
 }
 
-LoggerBuf::LoggerBuf() : std::streambuf(), m_has_file(false), m_output_to_console(true)
+
+// The levels of every category id ever used.  Levels are never removed, so LogCategories can
+// keep pointers to them; there are only as many as there are distinct ids in the code.
+static std::mutex category_levels_lock;
+static std::unordered_map<std::string, std::unique_ptr<std::atomic<int> > > &category_levels()
 {
-    std::cout << std::unitbuf;
+    // Constructed on first use, as LogCategories are often static.
+    static std::unordered_map<std::string, std::unique_ptr<std::atomic<int> > > levels;
+    return levels;
 }
 
-LoggerBuf::LoggerBuf(const std::string &file_name, bool output_to_console) :
-    m_file(file_name), m_has_file(true), m_output_to_console(output_to_console)
+// get_category_level returns the runtime level shared by all LogCategories with the given id.
+std::atomic<int> *get_category_level(const std::string &id)
 {
-    if(m_output_to_console) {
-        std::cout << std::unitbuf;
+    std::lock_guard<std::mutex> lock(category_levels_lock);
+    std::unique_ptr<std::atomic<int> > &level = category_levels()[id];
+    if(!level) {
+        level.reset(new std::atomic<int>(LOG_LEVEL_DEFAULT));
     }
+    return level.get();
+}
 
-    if(!m_file.is_open()) {
-        m_has_file = false;
+// set_category_level sets the minimum severity logged for every LogCategory with the given id.
+void set_category_level(const std::string &id, LogSeverity sev)
+{
+    if(id.empty() || id == "*") {
+        g_logger->set_min_severity(sev);
+        return;
     }
+    get_category_level(id)->store(sev, std::memory_order_relaxed);
 }
 
-int LoggerBuf::overflow(int c)
+// reset_category_level makes LogCategories with the given id follow the Logger's minimum
+// severity again.
+void reset_category_level(const std::string &id)
 {
-    if(m_output_to_console) {
-        std::cout.put(c);
-    }
-    if(m_has_file) {
-        m_file.put(c);
-    }
-    return c;
+    get_category_level(id)->store(LOG_LEVEL_DEFAULT, std::memory_order_relaxed);
 }
 
-std::streamsize LoggerBuf::xsputn(const char* s, std::streamsize n)
+// parse_log_severity converts a severity name (eg. "debug") into a LogSeverity.
+bool parse_log_severity(const std::string &name, LogSeverity &sev)
 {
-    if(m_output_to_console) {
-        std::cout.write(s, n);
-    }
-    if(m_has_file) {
-        m_file.write(s, n);
+    static const struct {
+        const char *name;
+        LogSeverity sev;
+    } severities[] = {
+        {"packet", LSEVERITY_PACKET}, {"trace", LSEVERITY_TRACE}, {"debug", LSEVERITY_DEBUG},
+        {"info", LSEVERITY_INFO}, {"warning", LSEVERITY_WARNING},
+        {"security", LSEVERITY_SECURITY}, {"error", LSEVERITY_ERROR}, {"fatal", LSEVERITY_FATAL}
+    };
+    for(const auto &candidate : severities) {
+        if(name == candidate.name) {
+            sev = candidate.sev;
+            return true;
+        }
     }
-    return n;
+    return false;
 }
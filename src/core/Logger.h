@@ -1,10 +1,15 @@
 #pragma once
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
 #include <string>
 #include <iostream>
-#include <fstream>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 // The LogSeverity represents the importance and usage of a log message.
 // LogSeverities advance numerically such that a more important serverity is
@@ -51,87 +56,125 @@ extern std::unique_ptr<Logger> g_logger; // forward declaration from "global.h"
 extern NullStream null_stream;
 extern NullBuffer null_buffer;
 
-// A LoggerBuf is a stream buffer that outputs to either a file or the console (std::cout).
-class LoggerBuf : public std::streambuf
-{
-  public:
-    LoggerBuf();
-    LoggerBuf(const std::string &file_name, bool output_to_console = true);
-  protected:
-    int overflow(int c = EOF);
-    std::streamsize xsputn(const char* s, std::streamsize n);
-  private:
-    std::ofstream m_file;
-    bool m_has_file;
-    bool m_output_to_console;
-};
+class LogRing;
 
-class LockedLogOutput
+// A LogOutput collects a single log message as it is streamed into it, and hands it off to the
+// Logger when it goes out of scope.  Nothing is locked while the message is being formatted;
+// a LogOutput for a message below the Logger's minimum severity does nothing at all.
+class LogOutput
 {
   public:
-    LockedLogOutput(std::ostream *stream, std::recursive_mutex *lock) : m_stream(stream), m_lock(lock)
+    LogOutput() : m_logger(nullptr), m_severity(LSEVERITY_INFO)
     {
-        if(m_lock) {
-            m_lock->lock();
-        }
     }
+    LogOutput(Logger *logger, LogSeverity sev);
+    LogOutput(LogOutput &&other);
+    LogOutput(const LogOutput&) = delete;
+    LogOutput& operator=(const LogOutput&) = delete;
+    ~LogOutput();
 
-    LockedLogOutput(const LockedLogOutput& other) : m_stream(other.m_stream), m_lock(other.m_lock)
+    template <typename T>
+    LogOutput &operator<<(const T &x)
     {
-        if(m_lock) {
-            m_lock->lock();
+        if(m_logger) {
+            LogStream stream(m_line);
+            stream.get() << x;
         }
+        return *this;
     }
 
-    LockedLogOutput& operator=(const LockedLogOutput&) = delete;   // non copyable
+    LogOutput &operator<<(const std::string &x)
+    {
+        if(m_logger) {
+            m_line.append(x);
+        }
+        return *this;
+    }
 
-    ~LockedLogOutput()
+    LogOutput &operator<<(const char *x)
     {
-        if(m_lock) {
-            m_lock->unlock();
+        if(m_logger) {
+            m_line.append(x);
         }
+        return *this;
     }
 
-    template <typename T>
-    LockedLogOutput &operator<<(const T &x)
+    LogOutput &operator<<(char x)
     {
-        if(m_stream) {
-            *m_stream << x;
+        if(m_logger) {
+            m_line.push_back(x);
         }
         return *this;
     }
 
-    LockedLogOutput& operator<<(std::ostream & (*pf)(std::ostream&))
+    LogOutput& operator<<(std::ostream & (*pf)(std::ostream&))
     {
-        if(m_stream) {
-            *m_stream << pf;
+        if(m_logger) {
+            LogStream stream(m_line);
+            stream.get() << pf;
         }
         return *this;
     }
 
-    LockedLogOutput& operator<<(std::basic_ios<char>& (*pf)(std::basic_ios<char>&))
+    LogOutput& operator<<(std::basic_ios<char>& (*pf)(std::basic_ios<char>&))
     {
-        if(m_stream) {
-            *m_stream << pf;
+        if(m_logger) {
+            LogStream stream(m_line);
+            stream.get() << pf;
         }
         return *this;
     }
 
   private:
-    std::ostream *m_stream;
-    std::recursive_mutex *m_lock;
+    friend class Logger;
+
+    // A LogStream points the calling thread's formatting stream at a message for as long as it
+    // is in scope, so that values with their own operator<< can be formatted without allocating
+    // a new std::ostream for every message.
+    class LogStream
+    {
+      public:
+        LogStream(std::string &line);
+        ~LogStream();
+
+        inline std::ostream &get()
+        {
+            return *m_stream;
+        }
+
+      private:
+        std::ostream *m_stream;
+        std::string *m_previous;
+    };
+
+    Logger *m_logger;
+    LogSeverity m_severity;
+    std::string m_line;
 };
 
 // A Logger is an object that allows configuration of the output destination of log messages.
 // It provides a stream as an output mechanism.
+//
+// Logging is asynchronous: each thread appends finished messages to its own lock-free ring, and
+// a background thread collects them from every ring and writes them out in batches.  If a thread
+// logs faster than the writer can keep up, its oldest unwritten messages are dropped, and the
+// number of dropped messages is reported in the log.  Fatal messages are written out immediately.
 class Logger
 {
   public:
     Logger(const std::string &log_file, LogSeverity sev, bool console_output = true);
     Logger();
+    ~Logger();
 
     // log returns an output stream for C++ style stream operations.
-    LockedLogOutput log(LogSeverity sev);
+    LogOutput log(LogSeverity sev);
+
+    // begin returns an output stream for a message without checking its severity against the
+    // minimum severity; the caller has already decided that the message should be logged.
+    LogOutput begin(LogSeverity sev);
+
+    // flush synchronously writes out every message that has been logged so far.
+    void flush();
 
     // set_color_enabled turns ANSI colorized output on or off.
     void set_color_enabled(bool enabled);
@@ -141,32 +184,88 @@ class Logger
     void set_min_severity(LogSeverity sev);
 
     // get_min_severity returns the current minimum severity that will be logged by the logger.
-    LogSeverity get_min_severity();
+    inline LogSeverity get_min_severity() const
+    {
+        return m_severity.load(std::memory_order_relaxed);
+    }
+
+    // get_dropped returns the number of messages that have been dropped because the writer
+    // could not keep up with them.
+    uint64_t get_dropped();
 
   private:
-    const char* get_severity_color(LogSeverity sev);
+    friend class LogOutput;
 
-    LoggerBuf m_buf;
-    LogSeverity m_severity;
-    std::ostream m_output;
-    std::recursive_mutex m_lock;
+    const char* get_severity_color(LogSeverity sev);
+    void start();
+    void submit(LogSeverity sev, const std::string &line);
+    LogRing *local_ring();
+    void drain();
+    void write(const char *data, size_t length);
+    void run_writer();
+
+    uint64_t m_id; // Distinguishes this Logger from any that it replaces, for per-thread state.
+    std::atomic<LogSeverity> m_severity;
     bool m_color_enabled;
+    bool m_output_to_console;
+    FILE *m_file;
+
+    std::mutex m_rings_lock;
+    std::vector<std::shared_ptr<LogRing> > m_rings;
+    std::atomic<uint64_t> m_sequence;
+    std::atomic<uint64_t> m_dropped;
+    uint64_t m_reported_dropped;
+
+    std::mutex m_write_lock; // Held while collecting messages from the rings and writing them.
+    std::string m_batch;
+
+    std::mutex m_wake_lock;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_pending;
+    bool m_stopping;
+    std::thread m_writer;
 };
 
+// LOG_LEVEL_DEFAULT is the level of a category which has no level of its own; messages in it
+// are filtered with the Logger's minimum severity instead.
+const int LOG_LEVEL_DEFAULT = -1;
+
+// get_category_level returns the runtime level shared by all LogCategories with the given id.
+// The level holds either a LogSeverity or LOG_LEVEL_DEFAULT.
+std::atomic<int> *get_category_level(const std::string &id);
+
+// set_category_level sets the minimum severity logged for every LogCategory with the given id,
+// overriding the Logger's minimum severity in either direction.  An empty id or "*" sets the
+// Logger's minimum severity instead.
+void set_category_level(const std::string &id, LogSeverity sev);
+
+// reset_category_level makes LogCategories with the given id follow the Logger's minimum
+// severity again.
+void reset_category_level(const std::string &id);
+
+// parse_log_severity converts a severity name (eg. "debug") into a LogSeverity.
+bool parse_log_severity(const std::string &name, LogSeverity &sev);
+
 // A LogCategory is a wrapper for a Logger object that specially formats the output
 // for consistency, parsability, and ease of convenience with LogSeverities.
+//
+// Each category id has a runtime level (see set_category_level), which is checked before
+// a message is formatted; a message which is filtered out costs a couple of atomic loads.
 class LogCategory
 {
   public:
-    LogCategory(const std::string &id, const std::string &name) : m_id(id), m_name(name)
+    LogCategory(const std::string &id, const std::string &name) : m_id(id), m_name(name),
+        m_level(get_category_level(m_id))
     {
     }
 
-    LogCategory(const char* id, const std::string &name) : m_id(id), m_name(name)
+    LogCategory(const char* id, const std::string &name) : m_id(id), m_name(name),
+        m_level(get_category_level(m_id))
     {
     }
 
-    LogCategory(const char* id, const char* name) : m_id(id), m_name(name)
+    LogCategory(const char* id, const char* name) : m_id(id), m_name(name),
+        m_level(get_category_level(m_id))
     {
     }
 
@@ -175,45 +274,37 @@ class LogCategory
         m_name = name;
     }
 
+    // is_enabled returns true if messages of the given severity are currently logged.
+    // It can be used to skip preparing expensive log output.
+    inline bool is_enabled(LogSeverity sev) const
+    {
+        int level = m_level->load(std::memory_order_relaxed);
+        if(level == LOG_LEVEL_DEFAULT) {
+            return sev >= g_logger->get_min_severity();
+        }
+        return sev >= level;
+    }
+
 #define F(level, severity) \
-	LockedLogOutput level() \
+	LogOutput level() \
 	{ \
-		LockedLogOutput out = g_logger->log(severity); \
+		if(!is_enabled(severity)) { \
+			return LogOutput(); \
+		} \
+		LogOutput out = g_logger->begin(severity); \
 		out << m_name << ": "; \
 		return out; \
 	}
 
-#ifdef ASTRON_DEBUG_MESSAGES
     // packet() provides a stream with the time and "PACKET" severity preprended to the message.
-    // packet messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
+    // packet messages are filtered with severity LSEVERITY_PACKET.
     F(packet, LSEVERITY_PACKET)
     // trace() provides a stream with the time and "TRACE" severity preprended to the message.
-    // trace messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
+    // trace messages are filtered with severity LSEVERITY_TRACE.
     F(trace, LSEVERITY_TRACE)
     // debug() provides a stream with the time and "DEBUG" severity preprended to the message.
-    // trace messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
+    // debug messages are filtered with severity LSEVERITY_DEBUG.
     F(debug, LSEVERITY_DEBUG)
-#else
-    // packet() provides a stream with the time and "PACKET" severity preprended to the message.
-    // packet messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
-    inline NullStream &packet()
-    {
-        return null_stream;
-    }
-    // trace() provides a stream with the time and "TRACE" severity preprended to the message.
-    // trace messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
-    inline NullStream &trace()
-    {
-        return null_stream;
-    }
-    // debug() provides a stream with the time and "DEBUG" severity preprended to the message.
-    // debug messages are only output when compiled with -DASTRON_DEBUG_MESSAGES.
-    inline NullStream &debug()
-    {
-        return null_stream;
-    }
-
-#endif
     // info() provides a stream with the time and "INFO" severity preprended to the message.
     // info messages are filtered with severity LSEVERITY_INFO.
     F(info, LSEVERITY_INFO)
@@ -235,6 +326,7 @@ class LogCategory
   private:
     std::string m_id;
     std::string m_name;
+    std::atomic<int> *m_level;
 };
 
 
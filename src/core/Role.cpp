@@ -1,14 +1,24 @@
 #include "Role.h"
+#include "core/EventLoopPool.h"
 using namespace std;
 
 static KeyedConfigList roles_config("roles", "type");
 
+static bool is_event_loop(const unsigned int &index)
+{
+    return index < EventLoopPool::configured_size();
+}
+
 RoleConfigGroup::RoleConfigGroup(const string& type) :
-    ConfigGroup(type, roles_config), m_type("type", type, this)
+    ConfigGroup(type, roles_config), m_type("type", type, this),
+    m_event_loop("event_loop", 0, this),
+    m_event_loop_exists(is_event_loop, m_event_loop,
+                        "A role's event_loop must be less than event_loops/count.")
 {
 }
 
 // Constructor
-Role::Role(RoleConfig roleconfig) : m_roleconfig(roleconfig)
+Role::Role(RoleConfig roleconfig) : m_roleconfig(roleconfig),
+    m_io_service(g_loops.for_role(roleconfig).get_io_service())
 {
 }
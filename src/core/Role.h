@@ -10,6 +10,8 @@ class RoleConfigGroup : public ConfigGroup
 
   private:
     ConfigVariable<std::string> m_type;
+    ConfigVariable<unsigned int> m_event_loop;
+    ConfigConstraint<unsigned int> m_event_loop_exists;
 };
 
 // A Role is a major component of Astron which is configured in the daemon's config file.
@@ -20,4 +22,7 @@ class Role : public MDParticipantInterface
     Role(RoleConfig roleconfig);
 
     RoleConfig m_roleconfig;
+
+    // m_io_service is the event loop this role's sockets, acceptors and timers run on.
+    boost::asio::io_service &m_io_service;
 };
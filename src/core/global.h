@@ -1,5 +1,6 @@
 #pragma once
 #include "Logger.h"
+#include "EventLoopPool.h"
 #include "config/ConfigVariable.h"
 #include "dclass/dc/File.h"
 #include "util/EventSender.h"
@@ -20,5 +21,7 @@ extern const dclass::File *g_dcf;
 extern std::unique_ptr<Logger> g_logger;
 extern std::unique_ptr<ConfigFile> g_config;
 extern boost::asio::io_service io_service;
+extern EventLoopPool g_loops;
+extern ConfigGroup daemon_config;
 extern EventSender g_eventsender;
 extern std::unordered_map<doid_t, Uberdog> g_uberdogs;
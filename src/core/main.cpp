@@ -62,7 +62,7 @@ int main(int argc, char *argv[])
                 sev = LSEVERITY_INFO;
                 g_logger->set_min_severity(sev);
             } else if(llstr == "warning") {
-                sev = LSEVERITY_INFO;
+                sev = LSEVERITY_WARNING;
                 g_logger->set_min_severity(sev);
             } else if(llstr == "security") {
                 sev = LSEVERITY_SECURITY;
@@ -177,6 +177,9 @@ int main(int argc, char *argv[])
     // Now hook up our speciailize signal handler
     astron_handle_signals();
 
+    // Create the event loops before any roles or connections are assigned to them
+    g_loops.init();
+
     try {
         // Initialize configured MessageDirector
         MessageDirector::singleton.init_network();
@@ -215,13 +218,15 @@ int main(int argc, char *argv[])
     }
     // This exception is propogated if astron_shutdown is called
     catch(const ShutdownException& e) {
+        astron_run_exit_hooks();
         return e.exit_code();
     }
 
-    // Run the main event loop
+    // Run the event loops; the main loop runs on this thread
     int exit_code = 0;
     try {
-        io_service.run();
+        g_loops.run();
+        exit_code = g_loops.exit_code();
     }
 
     // This exception is propogated if astron_shutdown is called
@@ -236,6 +241,9 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    // The loops have stopped; let the roles finish up before we exit
+    astron_run_exit_hooks();
+
     return exit_code;
 }
 
@@ -256,13 +264,9 @@ void printHelp(ostream &s)
       "-b, --boring    Disables colored pretty printing. \n"
       "-l, --loglevel  Specify the minimum log level that should be logged;\n"
       "                  Security, Error, and Fatal will always be logged;\n"
-#ifdef ASTRON_DEBUG_MESSAGES
       "                (available): packet, trace, debug, info, warning, security\n"
-#else
-      "                (available): info, warning, security\n"
-      "                (unavailable): packet, trace, debug\n"
-      "                        [build with -DCMAKE_BUILD_TYPE=Debug]\n"
-#endif
+      "                The level of each category can also be changed while\n"
+      "                  running, with CONTROL_SET_LOG_LEVEL.\n"
       "\n"
       "Example:\n"
       "    astrond /tmp/my_config_file.yaml\n"
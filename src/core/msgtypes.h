@@ -34,11 +34,14 @@ enum MessageTypes {
     CONTROL_REMOVE_CHANNEL     = 9001,
     CONTROL_ADD_RANGE          = 9002,
     CONTROL_REMOVE_RANGE       = 9003,
+    CONTROL_ADD_CHANNELS       = 9004,
+    CONTROL_REMOVE_CHANNELS    = 9005,
     CONTROL_ADD_POST_REMOVE    = 9010,
     CONTROL_CLEAR_POST_REMOVES = 9011,
     CONTROL_SET_CON_NAME       = 9012,
     CONTROL_SET_CON_URL        = 9013,
     CONTROL_LOG_MESSAGE        = 9014,
+    CONTROL_SET_LOG_LEVEL      = 9015,
 
     // ClientAgent messages
     CLIENTAGENT_SET_STATE                  = 1000,
@@ -118,6 +121,7 @@ enum MessageTypes {
     // DBSS object messages
     DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS       = 2200,
     DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS_OTHER = 2201,
+    DBSS_OBJECT_ACTIVATE_MULTIPLE            = 2202,
     DBSS_OBJECT_GET_ACTIVATED                = 2207,
     DBSS_OBJECT_GET_ACTIVATED_RESP           = 2208,
     DBSS_OBJECT_DELETE_FIELD_RAM             = 2230,
@@ -133,6 +137,10 @@ enum MessageTypes {
     DBSERVER_OBJECT_GET_FIELDS_RESP           = 3013,
     DBSERVER_OBJECT_GET_ALL                   = 3014,
     DBSERVER_OBJECT_GET_ALL_RESP              = 3015,
+    DBSERVER_OBJECT_GET_ALL_MULTIPLE          = 3016,
+    DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP     = 3017,
+    DBSERVER_OBJECT_GET_FIELDS_MULTIPLE       = 3018,
+    DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP  = 3019,
     DBSERVER_OBJECT_SET_FIELD                 = 3020,
     DBSERVER_OBJECT_SET_FIELDS                = 3021,
     DBSERVER_OBJECT_SET_FIELD_IF_EQUALS       = 3022,
@@ -144,4 +152,10 @@ enum MessageTypes {
     DBSERVER_OBJECT_DELETE_FIELD              = 3030,
     DBSERVER_OBJECT_DELETE_FIELDS             = 3031,
     DBSERVER_OBJECT_DELETE                    = 3032,
+    DBSERVER_OBJECT_SET_FIELDS_MULTIPLE       = 3040,
+    DBSERVER_OBJECT_SET_FIELDS_MULTIPLE_RESP  = 3041,
+    DBSERVER_OBJECT_DELETE_MULTIPLE           = 3042,
+    DBSERVER_OBJECT_DELETE_MULTIPLE_RESP      = 3043,
+    DBSERVER_CHECKPOINT                       = 3050,
+    DBSERVER_CHECKPOINT_RESP                  = 3051,
 };
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <mutex>
+#include <vector>
 #ifdef _WIN32
 #  ifndef WIN32_LEAN_AND_MEAN
 #    define WIN32_LEAN_AND_MEAN
@@ -23,6 +24,8 @@ static int exit_code = 0;
 static int interrupts = 0;
 static mutex exit_mtx;
 static mutex ctrlc_mtx;
+static mutex hooks_mtx;
+static vector<function<void()> > exit_hooks;
 
 
 #ifdef _WIN32 /* Handle Windows signals */
@@ -80,12 +83,32 @@ void astron_shutdown(int code, bool throw_exception)
     /*log->info()*/
     cerr << "Exiting...\n";
     exit_code = code;
-    io_service.stop();
+    g_loops.stop();
     if(throw_exception) {
         throw ShutdownException(code);
     }
 }
 
+// astron_at_exit registers a function to be called when astron exits gracefully
+void astron_at_exit(function<void()> hook)
+{
+    lock_guard<mutex> guard(hooks_mtx);
+    exit_hooks.push_back(hook);
+}
+
+// astron_run_exit_hooks calls the functions registered with astron_at_exit
+void astron_run_exit_hooks()
+{
+    vector<function<void()> > hooks;
+    {
+        lock_guard<mutex> guard(hooks_mtx);
+        hooks.swap(exit_hooks);
+    }
+    for(auto it = hooks.rbegin(); it != hooks.rend(); ++it) {
+        (*it)();
+    }
+}
+
 // astron_exit_code returns the exit code astron should exit with
 int astron_exit_code()
 {
@@ -1,5 +1,6 @@
 #pragma once
 #include <exception>
+#include <functional>
 
 // astron_handle_signals sets up signal handlers for the native OS
 void astron_handle_signals();
@@ -7,6 +8,14 @@ void astron_handle_signals();
 // astron_shutdown tells astron to exit gracefully with a given error code
 void astron_shutdown(int exit_code, bool throw_exception = true);
 
+// astron_at_exit registers a function to be called when astron exits gracefully, once the
+// event loops have stopped, for anything which must be finished before the process is gone.
+void astron_at_exit(std::function<void()> hook);
+
+// astron_run_exit_hooks calls the functions registered with astron_at_exit, the most recently
+// registered first.
+void astron_run_exit_hooks();
+
 // ShutdownException is thrown by astron_shutdown to prevent
 // the current thread from continuing execution.
 class ShutdownException : public std::exception
@@ -0,0 +1,122 @@
+#include "DBObjectCache.h"
+using namespace std;
+
+// The rough overhead of an object and of each of its fields, on top of the field values.
+static const size_t OBJECT_OVERHEAD = 128;
+static const size_t FIELD_OVERHEAD = 64;
+
+DBObjectCache::DBObjectCache(size_t max_bytes) : m_max_bytes(max_bytes), m_bytes(0),
+    m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+bool DBObjectCache::get(doid_t doid, const dclass::Class *&dclass, FieldValues &fields)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    m_lru.splice(m_lru.begin(), m_lru, found->second);
+    dclass = found->second->dclass;
+    fields = found->second->fields;
+    return true;
+}
+
+void DBObjectCache::store(doid_t doid, const dclass::Class *dclass, const FieldValues &fields)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        Entry entry;
+        entry.doid = doid;
+        entry.bytes = 0;
+        m_lru.push_front(entry);
+        found = m_entries.emplace(doid, m_lru.begin()).first;
+    } else {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+    }
+
+    Entry &entry = *found->second;
+    entry.dclass = dclass;
+    entry.fields = fields;
+    resize(entry);
+    evict();
+}
+
+void DBObjectCache::update(doid_t doid, const FieldValues &changes)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        return;
+    }
+
+    Entry &entry = *found->second;
+    for(auto it = changes.begin(); it != changes.end(); ++it) {
+        if(it->second.empty()) {
+            entry.fields.erase(it->first);
+        } else {
+            entry.fields[it->first] = it->second;
+        }
+    }
+    resize(entry);
+    evict();
+}
+
+void DBObjectCache::erase(doid_t doid)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        return;
+    }
+
+    m_bytes -= found->second->bytes;
+    m_lru.erase(found->second);
+    m_entries.erase(found);
+}
+
+DBObjectCache::Stats DBObjectCache::get_stats()
+{
+    lock_guard<mutex> guard(m_lock);
+
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.objects = m_entries.size();
+    stats.bytes = m_bytes;
+    return stats;
+}
+
+// resize recomputes the size of an entry whose fields have changed.
+void DBObjectCache::resize(Entry &entry)
+{
+    size_t bytes = OBJECT_OVERHEAD;
+    for(auto it = entry.fields.begin(); it != entry.fields.end(); ++it) {
+        bytes += FIELD_OVERHEAD + it->second.size();
+    }
+
+    m_bytes = m_bytes - entry.bytes + bytes;
+    entry.bytes = bytes;
+}
+
+// evict drops the least recently used objects until the cache fits in its size.
+void DBObjectCache::evict()
+{
+    while(m_bytes > m_max_bytes && !m_lru.empty()) {
+        Entry &oldest = m_lru.back();
+        m_bytes -= oldest.bytes;
+        m_entries.erase(oldest.doid);
+        m_lru.pop_back();
+        ++m_evictions;
+    }
+}
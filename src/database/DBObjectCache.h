@@ -0,0 +1,60 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "core/types.h"
+#include "core/objtypes.h"
+
+// A DBObjectCache holds complete copies of recently used database objects, so that reads can
+// be answered without going to the backend.  When the cache grows past its size in bytes, the
+// least recently used objects are evicted.
+//
+// The cache only knows what it's told; the Database Server keeps it in step with the backend
+// by updating it as each change to an object completes.
+class DBObjectCache
+{
+  public:
+    DBObjectCache(size_t max_bytes);
+
+    // get copies out a cached object, returning false if it isn't cached.
+    bool get(doid_t doid, const dclass::Class *&dclass, FieldValues &fields);
+
+    // store caches a complete copy of an object, replacing any copy already cached.
+    void store(doid_t doid, const dclass::Class *dclass, const FieldValues &fields);
+
+    // update applies a change to a cached object; an empty value deletes the field.
+    // Objects which aren't cached are left alone.
+    void update(doid_t doid, const FieldValues &changes);
+
+    // erase drops an object from the cache.
+    void erase(doid_t doid);
+
+    struct Stats {
+        uint64_t hits;      // The number of reads answered from the cache.
+        uint64_t misses;    // The number of reads which had to go to the backend.
+        uint64_t evictions; // The number of objects dropped to make room for others.
+        uint64_t objects;   // The number of objects cached.
+        uint64_t bytes;     // The approximate memory used by the cached objects.
+    };
+    Stats get_stats();
+
+  private:
+    struct Entry {
+        doid_t doid;
+        const dclass::Class *dclass = nullptr;
+        FieldValues fields;
+        size_t bytes;
+    };
+    typedef std::list<Entry> lru_t; // Most recently used first.
+
+    std::mutex m_lock;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    lru_t m_lru;
+    std::unordered_map<doid_t, lru_t::iterator> m_entries;
+    uint64_t m_hits, m_misses, m_evictions;
+
+    void resize(Entry &entry);
+    void evict();
+};
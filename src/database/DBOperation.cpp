@@ -15,6 +15,72 @@ void DBOperation::cleanup()
     delete this;
 }
 
+void DBOperation::join_batch(shared_ptr<DBOperationBatch> batch)
+{
+    m_batch = batch;
+    m_batch->add();
+}
+
+// report_result passes the result of the operation on to its batch, if it's in one.
+void DBOperation::report_result(bool success)
+{
+    if(m_batch) {
+        m_batch->finish(m_doid, success);
+    }
+}
+
+// The response has a server header, the context and a count, then a doid and result for each
+// object; the count can't go past a uint16 either.
+static const size_t BATCH_RESPONSE_HEADER = 1 + 2 * sizeof(channel_t) + sizeof(uint16_t) +
+        sizeof(uint32_t) + sizeof(uint16_t);
+static const size_t BATCH_RESPONSE_RESULTS = (DGSIZE_MAX - BATCH_RESPONSE_HEADER) /
+        (sizeof(doid_t) + sizeof(uint8_t));
+const size_t DBOperationBatch::MAX_RESULTS = BATCH_RESPONSE_RESULTS < UINT16_MAX ?
+        BATCH_RESPONSE_RESULTS : UINT16_MAX;
+
+DBOperationBatch::DBOperationBatch(DatabaseServer *db, channel_t sender, uint32_t context,
+                                   uint16_t resp_msgtype) :
+    m_dbserver(db), m_sender(sender), m_context(context), m_resp_msgtype(resp_msgtype),
+    m_pending(1)
+{
+}
+
+void DBOperationBatch::add()
+{
+    lock_guard<mutex> guard(m_lock);
+    ++m_pending;
+}
+
+void DBOperationBatch::finish(doid_t doid, bool success)
+{
+    lock_guard<mutex> guard(m_lock);
+    m_results.push_back(make_pair(doid, success));
+    if(!--m_pending) {
+        respond();
+    }
+}
+
+void DBOperationBatch::seal()
+{
+    lock_guard<mutex> guard(m_lock);
+    if(!--m_pending) {
+        respond();
+    }
+}
+
+void DBOperationBatch::respond()
+{
+    DatagramPtr resp = Datagram::create();
+    resp->add_server_header(m_sender, m_dbserver->m_control_channel, m_resp_msgtype);
+    resp->add_uint32(m_context);
+    resp->add_uint16(m_results.size());
+    for(auto it = m_results.begin(); it != m_results.end(); ++it) {
+        resp->add_doid(it->first);
+        resp->add_uint8(it->second ? SUCCESS : FAILURE);
+    }
+    m_dbserver->route_datagram(resp);
+}
+
 void DBOperation::announce_fields(const FieldValues& fields)
 {
     // Calculate the fields that we are sending in our response:
@@ -223,6 +289,11 @@ void DBOperationCreate::on_complete(doid_t doid)
     resp->add_doid(doid);
     m_dbserver->route_datagram(resp);
 
+    // In case a deleted object's id has been reused:
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->erase(doid);
+    }
+
     cleanup();
 }
 
@@ -244,11 +315,21 @@ bool DBOperationDelete::initialize(channel_t sender, uint16_t, DatagramIterator
 
 void DBOperationDelete::on_failure()
 {
+    // Whatever the backend did, the cached object can't be trusted.
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->erase(m_doid);
+    }
+
+    report_result(false);
     cleanup();
 }
 
 void DBOperationDelete::on_complete()
 {
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->erase(m_doid);
+    }
+
     // Broadcast update to object's channel
     if(m_dbserver->m_broadcast) {
         DatagramPtr update = Datagram::create();
@@ -256,6 +337,8 @@ void DBOperationDelete::on_complete()
         update->add_doid(m_doid);
         m_dbserver->route_datagram(update);
     }
+
+    report_result(true);
     cleanup();
 }
 
@@ -285,6 +368,24 @@ bool DBOperationGet::initialize(channel_t sender, uint16_t msg_type, DatagramIte
     return populate_get_fields(dgi, field_count);
 }
 
+void DBOperationGet::initialize_multiple(channel_t sender, uint32_t context, doid_t doid,
+        const FieldSet &fields)
+{
+    m_sender = sender;
+    m_context = context;
+    m_doid = doid;
+    m_multiple = true;
+
+    if(fields.empty()) {
+        m_type = GET_OBJECT;
+        m_resp_msgtype = DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP;
+    } else {
+        m_type = GET_FIELDS;
+        m_resp_msgtype = DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP;
+        m_get_fields = fields;
+    }
+}
+
 bool DBOperationGet::verify_class(const dclass::Class *dclass)
 {
     // If request is of type GET_OBJECT don't expect a class, so no need to verify it.
@@ -345,23 +446,45 @@ void DBOperationGet::on_failure()
     resp->add_server_header(m_sender, m_dbserver->m_control_channel,
                             m_resp_msgtype);
     resp->add_uint32(m_context);
+    if(m_multiple) {
+        resp->add_doid(m_doid);
+    }
     resp->add_uint8(FAILURE);
     m_dbserver->route_datagram(resp);
 
     cleanup();
 }
 
+void DBOperationGet::complete_from_cache(DBObjectSnapshot *snapshot)
+{
+    m_from_cache = true;
+    if(!verify_class(snapshot->m_dclass)) {
+        delete snapshot;
+        on_failure();
+        return;
+    }
+    on_complete(snapshot);
+}
+
 void DBOperationGet::on_complete(DBObjectSnapshot *snapshot)
 {
+    // Only a GET_OBJECT is certain to have been given the whole object.
+    if(m_type == GET_OBJECT && !m_from_cache && m_dbserver->m_cache) {
+        m_dbserver->m_cache->store(m_doid, snapshot->m_dclass, snapshot->m_fields);
+    }
+
     DatagramPtr resp = Datagram::create();
     resp->add_server_header(m_sender, m_dbserver->m_control_channel,
                             m_resp_msgtype);
     resp->add_uint32(m_context);
+    if(m_multiple) {
+        resp->add_doid(m_doid);
+    }
     resp->add_uint8(SUCCESS);
 
     // Calculate the fields that we are sending in our response:
     FieldValues response_fields;
-    if(m_resp_msgtype == DBSERVER_OBJECT_GET_ALL_RESP) {
+    if(m_type == GET_OBJECT) {
         // Send everything:
         response_fields = snapshot->m_fields;
     } else {
@@ -393,7 +516,7 @@ void DBOperationGet::on_complete(DBObjectSnapshot *snapshot)
         return;
     }
 
-    if(m_resp_msgtype == DBSERVER_OBJECT_GET_ALL_RESP) {
+    if(m_type == GET_OBJECT) {
         resp->add_uint16(snapshot->m_dclass->get_id());
     }
 
@@ -438,11 +561,42 @@ bool DBOperationSet::initialize(channel_t sender, uint16_t msg_type, DatagramIte
 
 bool DBOperationSet::verify_class(const dclass::Class *dclass)
 {
-    if(!verify_fields(dclass, m_set_fields)) {
-        m_dbserver->m_log->warning() << "Attempted to modify invalid field for " << m_doid
-                                     << "(" << dclass->get_name() << ")\n";
+    if(m_merged.empty()) {
+        if(!verify_fields(dclass, m_set_fields)) {
+            m_dbserver->m_log->warning() << "Attempted to modify invalid field for " << m_doid
+                                         << "(" << dclass->get_name() << ")\n";
+            return false;
+        }
+        return true;
+    }
+
+    vector<pair<channel_t, FieldValues> > valid;
+    for(auto it = m_merged.begin(); it != m_merged.end(); ++it) {
+        if(verify_fields(dclass, it->second)) {
+            valid.push_back(*it);
+        } else {
+            m_dbserver->m_log->warning() << "Attempted to modify invalid field for " << m_doid
+                                         << "(" << dclass->get_name() << "); dropping the SET"
+                                         " from " << it->first << "\n";
+        }
+    }
+    if(valid.empty()) {
         return false;
     }
+
+    if(valid.size() != m_merged.size()) {
+        FieldValues fields;
+        for(auto it = valid.begin(); it != valid.end(); ++it) {
+            for(auto field = it->second.begin(); field != it->second.end(); ++field) {
+                fields[field->first] = field->second;
+            }
+        }
+
+        // The frontend reads the fields of running operations, to order the ones after them.
+        lock_guard<recursive_mutex> guard(m_dbserver->m_lock);
+        m_set_fields.swap(fields);
+        m_merged.swap(valid);
+    }
     return true;
 }
 
@@ -493,19 +647,56 @@ bool DBOperationSet::is_independent_of(const DBOperation *other) const
 
 void DBOperationSet::on_complete()
 {
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->update(m_doid, m_set_fields);
+    }
+
     // Broadcast update to object's channel
     if(m_dbserver->m_broadcast) {
-        announce_fields(m_set_fields);
+        if(m_merged.empty()) {
+            announce_fields(m_set_fields);
+        }
+
+        // Each run of merged SETs from the same sender is broadcast as one, from that sender.
+        for(size_t i = 0; i < m_merged.size();) {
+            m_sender = m_merged[i].first;
+            FieldValues fields;
+            for(; i < m_merged.size() && m_merged[i].first == m_sender; ++i) {
+                for(auto it = m_merged[i].second.begin(); it != m_merged[i].second.end(); ++it) {
+                    fields[it->first] = it->second;
+                }
+            }
+            announce_fields(fields);
+        }
     }
 
+    report_result(true);
     cleanup();
 }
 
 void DBOperationSet::on_failure()
 {
+    // Whatever the backend did, the cached object can't be trusted.
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->erase(m_doid);
+    }
+
+    report_result(false);
     cleanup();
 }
 
+void DBOperationSet::merge(const DBOperationSet *later)
+{
+    if(m_merged.empty()) {
+        m_merged.push_back(make_pair(m_sender, m_set_fields));
+    }
+    m_merged.push_back(make_pair(later->m_sender, later->m_set_fields));
+
+    for(auto it = later->m_set_fields.begin(); it != later->m_set_fields.end(); ++it) {
+        m_set_fields[it->first] = it->second;
+    }
+}
+
 bool DBOperationUpdate::initialize(channel_t sender, uint16_t msg_type, DatagramIterator &dgi)
 {
     m_sender = sender;
@@ -606,6 +797,10 @@ bool DBOperationUpdate::is_independent_of(const DBOperation *other) const
 
 void DBOperationUpdate::on_complete()
 {
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->update(m_doid, m_set_fields);
+    }
+
     // Broadcast update to object's channel
     if(m_dbserver->m_broadcast) {
         announce_fields(m_set_fields);
@@ -624,6 +819,11 @@ void DBOperationUpdate::on_complete()
 
 void DBOperationUpdate::on_failure()
 {
+    // Whatever the backend did, the cached object can't be trusted.
+    if(m_dbserver->m_cache) {
+        m_dbserver->m_cache->erase(m_doid);
+    }
+
     DatagramPtr resp = Datagram::create();
     resp->add_server_header(m_sender, m_dbserver->m_control_channel,
                             m_resp_msgtype);
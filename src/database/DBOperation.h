@@ -1,6 +1,10 @@
 #pragma once
 #include <set>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 #include "core/types.h"
 #include "core/objtypes.h"
@@ -8,6 +12,7 @@
 
 // Foward declarations
 class DatabaseServer;
+class DBOperationBatch;
 
 // This represents a "snapshot" of a particular object. It is essentially just a
 // dclass and a map of fields.
@@ -30,6 +35,14 @@ class DBOperation
     virtual ~DBOperation() { }
     virtual bool initialize(channel_t sender, uint16_t msg_type, DatagramIterator &dgi) = 0;
 
+    // join_batch makes the operation one of the objects of a request on many objects, which
+    // it reports its result to when it finishes, instead of answering anyone itself.
+    void join_batch(std::shared_ptr<DBOperationBatch> batch);
+    bool in_batch() const
+    {
+        return bool(m_batch);
+    }
+
     enum OperationType {
         // CREATE_OBJECT operations create a new object on the database.
         // These require that the class be specified, but do not require a doid.
@@ -197,8 +210,11 @@ class DBOperation
     FieldValues m_set_fields;
     // The fields that must be equal (or absent) for the change to complete atomically.
     FieldValues m_criteria_fields;
+    // The request on many objects which this operation is a part of, if any.
+    std::shared_ptr<DBOperationBatch> m_batch;
 
     void cleanup();
+    void report_result(bool success);
     bool verify_fields(const dclass::Class *dclass, const FieldSet& fields);
     bool verify_fields(const dclass::Class *dclass, const FieldValues& fields);
     void announce_fields(const FieldValues& fields);
@@ -207,6 +223,40 @@ class DBOperation
     bool populate_get_fields(DatagramIterator &dgi, uint16_t field_count);
 };
 
+// A DBOperationBatch gathers the results of the operations making up a request on many
+// objects, such as a SET_FIELDS_MULTIPLE, and answers the request with all of them at once
+// when the last one finishes.  The operations may finish on any of the backend's threads.
+class DBOperationBatch
+{
+  public:
+    DBOperationBatch(DatabaseServer *db, channel_t sender, uint32_t context,
+                     uint16_t resp_msgtype);
+
+    // add expects one more result, from an operation joining the batch.
+    void add();
+    // finish records the result for one of the objects.
+    void finish(doid_t doid, bool success);
+    // seal is called once every operation has joined the batch; the response can't be sent
+    // before then, even if all of the operations so far have already finished.
+    void seal();
+
+    // MAX_RESULTS is the most objects whose results fit in the response, and so the most a
+    // request on many objects may name.
+    static const size_t MAX_RESULTS;
+
+  private:
+    DatabaseServer *m_dbserver;
+    channel_t m_sender;
+    uint32_t m_context;
+    uint16_t m_resp_msgtype;
+
+    std::mutex m_lock;
+    std::vector<std::pair<doid_t, bool> > m_results;
+    size_t m_pending; // Operations yet to finish, plus one until the batch is sealed.
+
+    void respond(); // Requires m_lock.
+};
+
 class DBOperationCreate : public DBOperation
 {
   public:
@@ -229,16 +279,28 @@ class DBOperationDelete : public DBOperation
 class DBOperationGet : public DBOperation
 {
   public:
-    DBOperationGet(DatabaseServer *db) : DBOperation(db) { }
+    DBOperationGet(DatabaseServer *db) : DBOperation(db), m_multiple(false),
+        m_from_cache(false) { }
     virtual bool initialize(channel_t sender, uint16_t msg_type, DatagramIterator &dgi);
+    // initialize_multiple sets the operation up to get one of the objects of a
+    // GET_ALL_MULTIPLE, which is answered with a GET_ALL_MULTIPLE_RESP of its own; or, if
+    // given fields, of a GET_FIELDS_MULTIPLE.
+    void initialize_multiple(channel_t sender, uint32_t context, doid_t doid,
+                             const FieldSet &fields = FieldSet());
     virtual bool verify_class(const dclass::Class *dclass);
     virtual bool is_independent_of(const DBOperation *other) const;
     virtual void on_complete(DBObjectSnapshot *snapshot);
     virtual void on_failure();
 
+    // complete_from_cache answers the operation with a snapshot from the Database Server's
+    // object cache, instead of one from the backend.
+    void complete_from_cache(DBObjectSnapshot *snapshot);
+
   private:
     uint32_t m_context;
     uint16_t m_resp_msgtype;
+    bool m_multiple; // Whether the response names the object, as it's one of many.
+    bool m_from_cache;
 };
 class DBOperationSet : public DBOperation
 {
@@ -249,6 +311,16 @@ class DBOperationSet : public DBOperation
     virtual bool is_independent_of(const DBOperation *other) const;
     virtual void on_complete();
     virtual void on_failure();
+
+    // merge folds a later SET on the same object into this one, as if they had run one after
+    // the other; where both change a field, the later value wins.
+    void merge(const DBOperationSet *later);
+
+  private:
+    // The sender and fields of each of the SETs merged into this one, in order; empty unless
+    // a SET has been merged.  The object's class is only known once the backend has it, so
+    // verify_class checks each of them on its own, and drops only those which are invalid.
+    std::vector<std::pair<channel_t, FieldValues> > m_merged;
 };
 class DBOperationUpdate : public DBOperation
 {
@@ -1,4 +1,6 @@
 #pragma once
+#include <functional>
+#include <vector>
 #include "DBOperation.h"
 #include "config/ConfigVariable.h"
 
@@ -22,6 +24,32 @@ class DatabaseBackend
     // same database object.
     virtual void submit(DBOperation *operation) = 0;
 
+    // submit_batch submits a batch of operations at once, such as the SETs flushed together
+    // by write-behind or the GETs of a GET_ALL_MULTIPLE.  They are all safe to run
+    // concurrently.  By default, each is simply submitted in turn.
+    virtual void submit_batch(const std::vector<DBOperation*> &operations)
+    {
+        for(auto it = operations.begin(); it != operations.end(); ++it) {
+            submit(*it);
+        }
+    }
+
+    // checkpoint asks the backend to write out everything it has in a form which is quick to
+    // start back up from, once the operations submitted before it are done, and then to call
+    // done with whether it could.  Backends which write everything out as they go have
+    // nothing to do.
+    virtual void checkpoint(std::function<void(bool)> done)
+    {
+        done(true);
+    }
+
+    // shutdown is called when Astron exits gracefully, once the event loops have stopped.
+    // Backends which hold anything that must be given back before the process is gone, such
+    // as ids set aside for their own creates, do so here.
+    virtual void shutdown()
+    {
+    }
+
   protected:
     ConfigNode m_config;
     doid_t m_min_id;
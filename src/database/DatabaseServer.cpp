@@ -1,5 +1,6 @@
 #include "DatabaseServer.h"
 
+#include <boost/bind.hpp>
 #include "core/global.h"
 #include "core/msgtypes.h"
 #include "core/shutdown.h"
@@ -17,6 +18,14 @@ static ConfigVariable<bool> broadcast_updates("broadcast", true, dbserver_config
 static InvalidChannelConstraint control_not_invalid(control_channel);
 static ReservedChannelConstraint control_not_reserved(control_channel);
 static BooleanValueConstraint broadcast_is_boolean(broadcast_updates);
+// The time, in ms, that SETs are held back for so they can be merged; 0 disables write-behind.
+static ConfigVariable<unsigned int> write_behind("write_behind", 0, dbserver_config);
+
+static ConfigGroup cache_config("cache", dbserver_config);
+static ConfigVariable<bool> cache_enabled("enabled", false, cache_config);
+static ConfigVariable<unsigned long> cache_size("size", 64 << 20, cache_config);
+static ConfigVariable<unsigned long> cache_stats_interval("stats_interval", 0, cache_config);
+static BooleanValueConstraint cache_enabled_is_boolean(cache_enabled);
 
 static ConfigGroup generate_config("generate", dbserver_config);
 static ConfigVariable<doid_t> min_id("min", INVALID_DO_ID, generate_config);
@@ -30,7 +39,9 @@ DatabaseServer::DatabaseServer(RoleConfig roleconfig) : Role(roleconfig),
     m_control_channel(control_channel.get_rval(roleconfig)),
     m_min_id(min_id.get_rval(roleconfig)),
     m_max_id(max_id.get_rval(roleconfig)),
-    m_broadcast(broadcast_updates.get_rval(roleconfig))
+    m_broadcast(broadcast_updates.get_rval(roleconfig)),
+    m_write_behind(write_behind.get_rval(roleconfig)),
+    m_cache_stats_interval(0)
 {
     ConfigNode generate = dbserver_config.get_child_node(generate_config, roleconfig);
     ConfigNode backend = dbserver_config.get_child_node(db_backend_config, roleconfig);
@@ -50,6 +61,24 @@ DatabaseServer::DatabaseServer(RoleConfig roleconfig) : Role(roleconfig),
                        << db_backend_type.get_rval(backend) << "' exists." << endl;
         astron_shutdown(1);
     }
+    astron_at_exit([this]() {
+        // The SETs held back for write-behind go to the backend before it shuts down.
+        if(m_write_behind_timeout) {
+            m_write_behind_timeout->cancel();
+        }
+        flush_deferred_sets();
+        m_db_backend->shutdown();
+    });
+
+    ConfigNode cache = dbserver_config.get_child_node(cache_config, roleconfig);
+    if(cache_enabled.get_rval(cache)) {
+        m_cache.reset(new DBObjectCache(cache_size.get_rval(cache)));
+        m_cache_stats_interval = cache_stats_interval.get_rval(cache);
+        if(m_cache_stats_interval > 0) {
+            m_cache_stats_timer.reset(new boost::asio::deadline_timer(m_io_service));
+            schedule_cache_stats();
+        }
+    }
 
     // Listen on control channel
     subscribe_channel(m_control_channel);
@@ -72,6 +101,26 @@ void DatabaseServer::handle_datagram(DatagramHandle, DatagramIterator &dgi)
         op = new DBOperationDelete(this);
     }
     break;
+    case DBSERVER_OBJECT_GET_ALL_MULTIPLE: {
+        handle_get_all_multiple(sender, dgi);
+        return;
+    }
+    case DBSERVER_OBJECT_GET_FIELDS_MULTIPLE: {
+        handle_get_fields_multiple(sender, dgi);
+        return;
+    }
+    case DBSERVER_OBJECT_SET_FIELDS_MULTIPLE: {
+        handle_set_fields_multiple(sender, dgi);
+        return;
+    }
+    case DBSERVER_OBJECT_DELETE_MULTIPLE: {
+        handle_delete_multiple(sender, dgi);
+        return;
+    }
+    case DBSERVER_CHECKPOINT: {
+        handle_checkpoint(sender, dgi);
+        return;
+    }
     case DBSERVER_OBJECT_GET_ALL:
     case DBSERVER_OBJECT_GET_FIELD:
     case DBSERVER_OBJECT_GET_FIELDS: {
@@ -101,6 +150,157 @@ void DatabaseServer::handle_datagram(DatagramHandle, DatagramIterator &dgi)
     }
 }
 
+void DatabaseServer::handle_get_all_multiple(channel_t sender, DatagramIterator &dgi)
+{
+    uint32_t context = dgi.read_uint32();
+    uint16_t count = dgi.read_uint16();
+
+    vector<DBOperation*> ops;
+    ops.reserve(count);
+    for(uint16_t i = 0; i < count; ++i) {
+        DBOperationGet *op = new DBOperationGet(this);
+        op->initialize_multiple(sender, context, dgi.read_doid());
+        ops.push_back(op);
+    }
+
+    handle_operations(ops);
+}
+
+void DatabaseServer::handle_get_fields_multiple(channel_t sender, DatagramIterator &dgi)
+{
+    uint32_t context = dgi.read_uint32();
+
+    bool valid = true;
+    FieldSet fields;
+    uint16_t field_count = dgi.read_uint16();
+    for(uint16_t i = 0; i < field_count; ++i) {
+        uint16_t field_id = dgi.read_uint16();
+        const dclass::Field *field = g_dcf->get_field_by_id(field_id);
+        if(!field) {
+            m_log->error() << "Get fields request included invalid field #" << field_id << "\n";
+            valid = false;
+        } else if(!field->has_keyword("db")) {
+            m_log->error() << "Get fields request included non-DB field "
+                           << field->get_name() << "\n";
+        } else {
+            fields.insert(field);
+        }
+    }
+
+    uint16_t count = dgi.read_uint16();
+    vector<DBOperation*> ops;
+    ops.reserve(count);
+    for(uint16_t i = 0; i < count; ++i) {
+        DBOperationGet *op = new DBOperationGet(this);
+        op->initialize_multiple(sender, context, dgi.read_doid(), fields);
+        ops.push_back(op);
+    }
+
+    if(!valid || fields.empty()) {
+        // Like a GET_FIELDS, the request fails as a whole; each object is still answered.
+        for(auto it = ops.begin(); it != ops.end(); ++it) {
+            (*it)->on_failure();
+        }
+        return;
+    }
+
+    handle_operations(ops);
+}
+
+void DatabaseServer::handle_set_fields_multiple(channel_t sender, DatagramIterator &dgi)
+{
+    uint32_t context = dgi.read_uint32();
+    uint16_t count = dgi.read_uint16();
+
+    auto batch = make_shared<DBOperationBatch>(this, sender, context,
+                 DBSERVER_OBJECT_SET_FIELDS_MULTIPLE_RESP);
+    if(count > DBOperationBatch::MAX_RESULTS) {
+        // The results wouldn't all fit in the response, so none of the objects are handled,
+        // and it's answered with no results.
+        m_log->error() << "Received SET_FIELDS_MULTIPLE for " << count << " objects; at most "
+                       << DBOperationBatch::MAX_RESULTS << " are allowed.\n";
+        batch->seal();
+        return;
+    }
+
+    vector<DBOperation*> ops;
+    ops.reserve(count);
+    try {
+        for(uint16_t i = 0; i < count; ++i) {
+            DBOperationSet *op = new DBOperationSet(this);
+            op->join_batch(batch);
+
+            // Each object is laid out just like a SET_FIELDS.  One which fails has reported
+            // its failure; since we can't tell how much of it was read, the objects after
+            // it are left out of the response.
+            if(!op->initialize(sender, DBSERVER_OBJECT_SET_FIELDS, dgi)) {
+                break;
+            }
+            ops.push_back(op);
+        }
+    } catch(DatagramIteratorEOF &) {
+        // The request is truncated, so none of it is run (and it's never answered).
+        for(auto it = ops.begin(); it != ops.end(); ++it) {
+            delete *it;
+        }
+        throw;
+    }
+
+    handle_operations(ops);
+    batch->seal();
+}
+
+void DatabaseServer::handle_delete_multiple(channel_t sender, DatagramIterator &dgi)
+{
+    uint32_t context = dgi.read_uint32();
+    uint16_t count = dgi.read_uint16();
+
+    auto batch = make_shared<DBOperationBatch>(this, sender, context,
+                 DBSERVER_OBJECT_DELETE_MULTIPLE_RESP);
+    if(count > DBOperationBatch::MAX_RESULTS) {
+        // The results wouldn't all fit in the response, so none of the objects are handled,
+        // and it's answered with no results.
+        m_log->error() << "Received DELETE_MULTIPLE for " << count << " objects; at most "
+                       << DBOperationBatch::MAX_RESULTS << " are allowed.\n";
+        batch->seal();
+        return;
+    }
+
+    vector<DBOperation*> ops;
+    ops.reserve(count);
+    try {
+        for(uint16_t i = 0; i < count; ++i) {
+            DBOperationDelete *op = new DBOperationDelete(this);
+            op->join_batch(batch);
+            op->initialize(sender, DBSERVER_OBJECT_DELETE, dgi);
+            ops.push_back(op);
+        }
+    } catch(DatagramIteratorEOF &) {
+        for(auto it = ops.begin(); it != ops.end(); ++it) {
+            delete *it;
+        }
+        throw;
+    }
+
+    handle_operations(ops);
+    batch->seal();
+}
+
+void DatabaseServer::handle_checkpoint(channel_t sender, DatagramIterator &dgi)
+{
+    uint32_t context = dgi.read_uint32();
+
+    // The held back SETs have been received, so they belong in the checkpoint.
+    flush_deferred_sets();
+
+    m_db_backend->checkpoint([this, sender, context](bool success) {
+        DatagramPtr resp = Datagram::create(sender, m_control_channel, DBSERVER_CHECKPOINT_RESP);
+        resp->add_uint32(context);
+        resp->add_uint8(success ? SUCCESS : FAILURE);
+        route_datagram(resp);
+    });
+}
+
 void DatabaseServer::handle_operation(DBOperation *op)
 {
     if(op->type() == DBOperation::OperationType::CREATE_OBJECT) {
@@ -110,15 +310,171 @@ void DatabaseServer::handle_operation(DBOperation *op)
     }
 
     unique_lock<recursive_mutex> guard(m_lock);
+    if(admit_operation(op)) {
+        m_db_backend->submit(op);
+    }
+}
+
+void DatabaseServer::handle_operations(const vector<DBOperation*> &ops)
+{
+    unique_lock<recursive_mutex> guard(m_lock);
+
+    vector<DBOperation*> batch;
+    batch.reserve(ops.size());
+    for(auto it = ops.begin(); it != ops.end(); ++it) {
+        if(admit_operation(*it)) {
+            batch.push_back(*it);
+        }
+    }
+
+    if(!batch.empty()) {
+        m_db_backend->submit_batch(batch);
+    }
+}
+
+bool DatabaseServer::admit_operation(DBOperation *op)
+{
+    if(op->type() == DBOperation::OperationType::CREATE_OBJECT) {
+        return true;
+    }
+
+    if(m_write_behind) {
+        // The SETs of a SET_FIELDS_MULTIPLE are already batched, and their results are
+        // awaited; they aren't held back.
+        if(op->type() == DBOperation::OperationType::SET_FIELDS && !op->in_batch()) {
+            defer_set(static_cast<DBOperationSet*>(op));
+            return false;
+        }
+
+        // Anything else must see the object as it would be after the held back SET.
+        release_deferred_set(op->doid());
+    }
 
+    if(m_cache && answer_from_cache(op)) {
+        return false;
+    }
+
+    return start_operation(op);
+}
+
+bool DatabaseServer::start_operation(DBOperation *op)
+{
     DBOperationQueue &queue = m_queues[op->doid()];
 
     if(!queue.enqueue_operation(op)) {
         queue.begin_operation(op);
+        return true;
+    }
+    return false;
+}
+
+bool DatabaseServer::answer_from_cache(DBOperation *op)
+{
+    if(op->type() != DBOperation::OperationType::GET_OBJECT &&
+       op->type() != DBOperation::OperationType::GET_FIELDS) {
+        return false;
+    }
+
+    // The cache is only brought up to date as operations complete, so while any are queued or
+    // running on the object, the backend must answer.
+    if(m_queues.find(op->doid()) != m_queues.end()) {
+        return false;
+    }
+
+    DBObjectSnapshot *snapshot = new DBObjectSnapshot();
+    if(!m_cache->get(op->doid(), snapshot->m_dclass, snapshot->m_fields)) {
+        delete snapshot;
+        return false;
+    }
+
+    static_cast<DBOperationGet*>(op)->complete_from_cache(snapshot);
+    return true;
+}
+
+void DatabaseServer::schedule_cache_stats()
+{
+    m_cache_stats_timer->expires_from_now(boost::posix_time::milliseconds(m_cache_stats_interval));
+    m_cache_stats_timer->async_wait(boost::bind(&DatabaseServer::handle_cache_stats, this,
+                                    boost::asio::placeholders::error));
+}
+
+// handle_cache_stats reports the object cache's hit rate to the log and the event logger.
+void DatabaseServer::handle_cache_stats(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return;
+    }
+
+    DBObjectCache::Stats stats = m_cache->get_stats();
+    uint64_t reads = stats.hits + stats.misses;
+    double hit_rate = reads ? 100.0 * stats.hits / reads : 0.0;
+    m_log->info() << "Cache: " << stats.objects << " objects in " << stats.bytes << " bytes, "
+                  << stats.hits << " hits, " << stats.misses << " misses (" << hit_rate
+                  << "% hit rate), " << stats.evictions << " evictions.\n";
+
+    stringstream sender;
+    sender << "Database(" << m_control_channel << ")";
+    LoggedEvent event("cache-stats", sender.str());
+    event.add("objects", to_string(stats.objects));
+    event.add("bytes", to_string(stats.bytes));
+    event.add("hits", to_string(stats.hits));
+    event.add("misses", to_string(stats.misses));
+    event.add("evictions", to_string(stats.evictions));
+    g_eventsender.send(event);
+
+    schedule_cache_stats();
+}
+
+void DatabaseServer::defer_set(DBOperationSet *op)
+{
+    auto found = m_deferred_sets.find(op->doid());
+    if(found != m_deferred_sets.end()) {
+        found->second->merge(op);
+        delete op;
+        return;
+    }
+
+    if(m_deferred_sets.empty()) {
+        m_write_behind_timeout = make_shared<Timeout>(m_write_behind,
+                                 bind(&DatabaseServer::flush_deferred_sets, this));
+        m_write_behind_timeout->start();
+    }
+    m_deferred_sets[op->doid()] = op;
+}
+
+void DatabaseServer::release_deferred_set(doid_t doid)
+{
+    auto found = m_deferred_sets.find(doid);
+    if(found == m_deferred_sets.end()) {
+        return;
+    }
+
+    DBOperationSet *op = found->second;
+    m_deferred_sets.erase(found);
+    if(start_operation(op)) {
         m_db_backend->submit(op);
     }
 }
 
+void DatabaseServer::flush_deferred_sets()
+{
+    unique_lock<recursive_mutex> guard(m_lock);
+
+    vector<DBOperation*> batch;
+    batch.reserve(m_deferred_sets.size());
+    for(auto it = m_deferred_sets.begin(); it != m_deferred_sets.end(); ++it) {
+        if(start_operation(it->second)) {
+            batch.push_back(it->second);
+        }
+    }
+    m_deferred_sets.clear();
+
+    m_log->trace() << "Flushing " << batch.size() << " held back SETs." << endl;
+    if(!batch.empty()) {
+        m_db_backend->submit_batch(batch);
+    }
+}
+
 void DatabaseServer::clear_operation(const DBOperation *op)
 {
     if(op->type() == DBOperation::OperationType::CREATE_OBJECT) {
@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include <unordered_map>
 
 #include "core/Role.h"
@@ -6,6 +7,8 @@
 #include "DatabaseBackend.h"
 #include "DBOperation.h"
 #include "DBOperationQueue.h"
+#include "DBObjectCache.h"
+#include "util/Timeout.h"
 
 extern RoleConfigGroup dbserver_config;
 
@@ -18,10 +21,25 @@ class DatabaseServer : public Role
 
   private:
     void handle_operation(DBOperation *op);
+    // handle_operations handles the operations of a request on many objects, submitting
+    // those which can start right away to the backend as one batch.
+    void handle_operations(const std::vector<DBOperation*> &ops);
+    void handle_get_all_multiple(channel_t sender, DatagramIterator &dgi);
+    void handle_get_fields_multiple(channel_t sender, DatagramIterator &dgi);
+    void handle_set_fields_multiple(channel_t sender, DatagramIterator &dgi);
+    void handle_delete_multiple(channel_t sender, DatagramIterator &dgi);
+    void handle_checkpoint(channel_t sender, DatagramIterator &dgi);
     void clear_operation(const DBOperation *op);
     std::unordered_map<doid_t, DBOperationQueue> m_queues;
     std::recursive_mutex m_lock;
 
+    // start_operation queues an operation on its object, returning true if it can be
+    // submitted to the backend right away.
+    bool start_operation(DBOperation *op);
+    // admit_operation decides what happens to a new operation, returning true if it
+    // should be submitted to the backend now.  Requires m_lock, except for CREATEs.
+    bool admit_operation(DBOperation *op);
+
     DatabaseBackend *m_db_backend;
     LogCategory *m_log;
 
@@ -29,7 +47,26 @@ class DatabaseServer : public Role
     doid_t m_min_id, m_max_id;
     bool m_broadcast;
 
+    // With write-behind, SETs are held back for up to m_write_behind ms, and the SETs to an
+    // object in that time are merged into one.  A SET is released early when any other
+    // operation arrives for its object, so it still runs in order with the other operations.
+    unsigned int m_write_behind;
+    std::unordered_map<doid_t, DBOperationSet*> m_deferred_sets;
+    std::shared_ptr<Timeout> m_write_behind_timeout;
+    void defer_set(DBOperationSet *op);
+    void release_deferred_set(doid_t doid);
+    void flush_deferred_sets();
+
+    // The object cache, if enabled, answers GETs on objects with no operations in progress.
+    std::unique_ptr<DBObjectCache> m_cache;
+    unsigned long m_cache_stats_interval;
+    std::unique_ptr<boost::asio::deadline_timer> m_cache_stats_timer;
+    bool answer_from_cache(DBOperation *op);
+    void schedule_cache_stats();
+    void handle_cache_stats(const boost::system::error_code &ec);
+
     friend class DBOperation;
+    friend class DBOperationBatch;
     friend class DBOperationCreate;
     friend class DBOperationDelete;
     friend class DBOperationGet;
@@ -0,0 +1,254 @@
+#include "EmbeddedDatabase.h"
+
+#include "core/shutdown.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+#include <sstream>
+
+using dclass::Class;
+using namespace std;
+
+EmbeddedDatabase::EmbeddedDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id,
+                                   const string &log_name, const string &log_title) :
+    DatabaseBackend(dbeconfig, min_id, max_id), m_next_id(min_id), m_stopping(false),
+    m_failed(false)
+{
+    stringstream title;
+    title << "Database-" << log_title << "(Range: [" << min_id << ", " << max_id << "])";
+    m_log = new LogCategory(log_name, title.str());
+}
+
+EmbeddedDatabase::~EmbeddedDatabase()
+{
+    delete m_log;
+}
+
+void EmbeddedDatabase::submit(DBOperation *operation)
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_queue.push_back(operation);
+    }
+    m_cv.notify_one();
+}
+
+void EmbeddedDatabase::submit_batch(const vector<DBOperation*> &operations)
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_queue.insert(m_queue.end(), operations.begin(), operations.end());
+    }
+    m_cv.notify_one();
+}
+
+void EmbeddedDatabase::checkpoint(function<void(bool)> done)
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_checkpoints.push_back(done);
+    }
+    m_cv.notify_one();
+}
+
+void EmbeddedDatabase::start()
+{
+    m_thread = thread(&EmbeddedDatabase::run, this);
+}
+
+void EmbeddedDatabase::shutdown()
+{
+    stop();
+}
+
+void EmbeddedDatabase::stop()
+{
+    {
+        lock_guard<mutex> guard(m_lock);
+        m_stopping = true;
+    }
+    m_cv.notify_one();
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void EmbeddedDatabase::replay_created(doid_t doid)
+{
+    if(doid >= m_next_id) {
+        m_next_id = uint64_t(doid) + 1;
+    } else {
+        m_free_ids.erase(doid); // It was given a freed id.
+    }
+}
+
+void EmbeddedDatabase::replay_deleted(doid_t doid)
+{
+    m_free_ids.insert(doid);
+}
+
+void EmbeddedDatabase::clamp_ids()
+{
+    if(m_next_id < m_min_id) {
+        m_next_id = m_min_id;
+    }
+    m_free_ids.erase(m_free_ids.begin(), m_free_ids.lower_bound(m_min_id));
+    m_free_ids.erase(m_free_ids.upper_bound(m_max_id), m_free_ids.end());
+}
+
+void EmbeddedDatabase::run()
+{
+    vector<DBOperation*> operations;
+    vector<function<void(bool)> > checkpoints;
+    vector<pair<DBOperation*, doid_t> > changes; // The changes waiting on the commit.
+    while(true) {
+        {
+            unique_lock<mutex> guard(m_lock);
+            while(m_queue.empty() && m_checkpoints.empty() && !m_stopping) {
+                m_cv.wait(guard);
+            }
+            if(m_queue.empty() && m_checkpoints.empty()) {
+                return;
+            }
+            operations.swap(m_queue);
+            checkpoints.swap(m_checkpoints);
+        }
+
+        for(DBOperation *operation : operations) {
+            handle_operation(operation, changes);
+        }
+        operations.clear();
+
+        if(!m_failed && !commit()) {
+            m_failed = true;
+            astron_shutdown(1, false);
+        }
+        for(auto it = changes.begin(); it != changes.end(); ++it) {
+            if(m_failed) {
+                it->first->on_failure();
+            } else if(it->first->type() == DBOperation::CREATE_OBJECT) {
+                it->first->on_complete(it->second);
+            } else {
+                it->first->on_complete();
+            }
+        }
+        changes.clear();
+
+        if(m_failed) {
+            for(auto &done : checkpoints) {
+                done(false);
+            }
+        } else {
+            this->committed();
+            if(!checkpoints.empty()) {
+                bool written = write_checkpoint();
+                for(auto &done : checkpoints) {
+                    done(written);
+                }
+            }
+        }
+        checkpoints.clear();
+    }
+}
+
+void EmbeddedDatabase::handle_operation(DBOperation *operation,
+                                        vector<pair<DBOperation*, doid_t> > &changes)
+{
+    if(m_failed) {
+        operation->on_failure();
+        return;
+    }
+
+    switch(operation->type()) {
+    case DBOperation::CREATE_OBJECT: {
+        doid_t doid = next_id();
+        if(doid == INVALID_DO_ID) {
+            m_log->error() << "There are no ids left to create an object with." << endl;
+            operation->on_failure();
+            return;
+        }
+
+        write_object(doid, operation->dclass(), operation->set_fields());
+        changes.push_back(make_pair(operation, doid));
+        return;
+    }
+    case DBOperation::DELETE_OBJECT: {
+        if(!has_object(operation->doid())) {
+            operation->on_failure(); // There's no such object.
+            return;
+        }
+
+        remove_object(operation->doid());
+        if(operation->doid() >= m_min_id && operation->doid() <= m_max_id) {
+            m_free_ids.insert(operation->doid());
+        }
+        changes.push_back(make_pair(operation, operation->doid()));
+        return;
+    }
+    case DBOperation::GET_OBJECT:
+    case DBOperation::GET_FIELDS: {
+        DBObjectSnapshot *snap = new DBObjectSnapshot();
+        if(!read_object(operation->doid(), snap->m_dclass, snap->m_fields) ||
+           !operation->verify_class(snap->m_dclass)) {
+            delete snap;
+            operation->on_failure();
+            return;
+        }
+
+        operation->on_complete(snap);
+        return;
+    }
+    case DBOperation::SET_FIELDS:
+    case DBOperation::UPDATE_FIELDS: {
+        const Class *dclass;
+        FieldValues fields;
+        if(!read_object(operation->doid(), dclass, fields) ||
+           !operation->verify_class(dclass)) {
+            operation->on_failure();
+            return;
+        }
+
+        // Check the criteria of an update; a set has none.  An absent field is empty.
+        const vector<uint8_t> empty;
+        for(auto it = operation->criteria_fields().begin();
+            it != operation->criteria_fields().end(); ++it) {
+            auto current = fields.find(it->first);
+            const vector<uint8_t> &value = current == fields.end() ? empty : current->second;
+            if(value != it->second) {
+                DBObjectSnapshot *snap = new DBObjectSnapshot();
+                snap->m_dclass = dclass;
+                snap->m_fields = fields;
+                operation->on_criteria_mismatch(snap);
+                return;
+            }
+        }
+
+        // An empty value deletes the field.
+        for(auto it = operation->set_fields().begin(); it != operation->set_fields().end();
+            ++it) {
+            if(it->second.empty()) {
+                fields.erase(it->first);
+            } else {
+                fields[it->first] = it->second;
+            }
+        }
+
+        write_object(operation->doid(), dclass, fields);
+        changes.push_back(make_pair(operation, operation->doid()));
+        return;
+    }
+    }
+}
+
+doid_t EmbeddedDatabase::next_id()
+{
+    if(m_next_id <= m_max_id) {
+        return doid_t(m_next_id++);
+    }
+    if(m_free_ids.empty()) {
+        return INVALID_DO_ID;
+    }
+
+    doid_t doid = *m_free_ids.begin();
+    m_free_ids.erase(m_free_ids.begin());
+    return doid;
+}
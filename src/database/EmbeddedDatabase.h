@@ -0,0 +1,97 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "DatabaseBackend.h"
+#include "core/Logger.h"
+
+// An EmbeddedDatabase is the base of the backends which keep their objects in files of their
+// own, as records of packed field values (see RecordFile.h), rather than in a database server.
+//
+// Operations run on a thread of their own.  It takes everything submitted since it last looked
+// and runs it, with the subclass appending a record of each change to a buffer of its own.
+// Then the subclass commits the buffer, writing out all of the records at once and syncing
+// them a single time (a group commit), and only then are the operations which changed
+// anything told that they are done.  Reads are answered straight away: the frontend never
+// runs a read alongside a change to the same fields, so a read can't see a change which isn't
+// yet on disk.  If a commit fails, nothing more can be written, so Astron is shut down.
+//
+// The subclass opens its files, reads in its objects and ids, and then calls start; its
+// destructor must call stop, before its files are closed.  Everything else, from the
+// subclass interface below to the ids, is only used on the thread once it has started.
+class EmbeddedDatabase : public DatabaseBackend
+{
+  public:
+    EmbeddedDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id,
+                     const std::string &log_name, const std::string &log_title);
+    virtual ~EmbeddedDatabase();
+
+    virtual void submit(DBOperation *operation);
+    virtual void submit_batch(const std::vector<DBOperation*> &operations);
+    virtual void checkpoint(std::function<void(bool)> done);
+    // shutdown commits the queued operations before Astron exits.
+    virtual void shutdown();
+
+  protected:
+    LogCategory *m_log;
+
+    // The next id to create an object with; it's wider than a doid, so that it can't wrap
+    // around past the max id.  Once all of the ids have been used, the free ids are reused.
+    uint64_t m_next_id;
+    std::set<doid_t> m_free_ids;
+
+    void start();
+    void stop();
+
+    // replay_created and replay_deleted keep the ids up to date with the records read back in
+    // when the backend starts up: a record of an object which doesn't yet exist created it.
+    void replay_created(doid_t doid);
+    void replay_deleted(doid_t doid);
+    // clamp_ids drops the ids which are outside of the range, which may have changed since
+    // the records were written.
+    void clamp_ids();
+
+    // has_object returns true if an object exists.
+    virtual bool has_object(doid_t doid) = 0;
+    // read_object reads the class and fields of an object, returning false if it can't.
+    virtual bool read_object(doid_t doid, const dclass::Class *&dclass, FieldValues &fields) = 0;
+    // write_object records the new state of an object, which is created if it doesn't exist.
+    virtual void write_object(doid_t doid, const dclass::Class *dclass,
+                              const FieldValues &fields) = 0;
+    // remove_object records that an object has been deleted.
+    virtual void remove_object(doid_t doid) = 0;
+    // commit writes out and syncs the changes recorded since the last commit, logging why
+    // if it can't.
+    virtual bool commit() = 0;
+    // committed is called after each group of operations has been committed and completed.
+    virtual void committed()
+    {
+    }
+    // write_checkpoint writes out everything the backend has, in a form which is quick to
+    // start back up from, logging why if it can't.
+    virtual bool write_checkpoint() = 0;
+
+  private:
+    std::mutex m_lock; // Protects m_queue, m_checkpoints and m_stopping.
+    std::condition_variable m_cv;
+    std::vector<DBOperation*> m_queue;
+    std::vector<std::function<void(bool)> > m_checkpoints;
+    bool m_stopping;
+    bool m_failed; // Set once a commit has failed; every operation fails after that.
+    std::thread m_thread;
+
+    void run();
+    // handle_operation runs an operation.  Those which change an object are added to changes,
+    // to be completed once they have been committed.
+    void handle_operation(DBOperation *operation,
+                          std::vector<std::pair<DBOperation*, doid_t> > &changes);
+    // next_id takes the next id to create an object with, or returns INVALID_DO_ID if all
+    // of them are in use.
+    doid_t next_id();
+};
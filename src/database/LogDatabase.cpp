@@ -0,0 +1,434 @@
+#include "EmbeddedDatabase.h"
+#include "RecordFile.h"
+#include "DBBackendFactory.h"
+#include "DatabaseServer.h"
+
+#include "core/global.h"
+#include "core/shutdown.h"
+#include "config/constraints.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using dclass::Class;
+using dclass::Field;
+using namespace std;
+
+static ConfigGroup log_backend_config("log", db_backend_config);
+static ConfigVariable<string> log_filename("filename", "objects.log", log_backend_config);
+static ConfigVariable<bool> log_sync("sync", true, log_backend_config);
+static BooleanValueConstraint log_sync_is_boolean(log_sync);
+static ConfigVariable<unsigned int> compact_size("compact_size", 16777216, log_backend_config);
+static ConfigVariable<double> compact_garbage("compact_garbage", 0.5, log_backend_config);
+static bool is_garbage_fraction(const double &garbage)
+{
+    return 0.0 < garbage && garbage < 1.0;
+}
+static ConfigConstraint<double> valid_compact_garbage(is_garbage_fraction, compact_garbage,
+        "The compact_garbage of the log backend must be greater than 0, and less than 1.");
+
+// NOTES:
+// The log backend keeps all of its objects in a single file of records (see RecordFile.h),
+// which is only ever appended to.  Each change to an object appends a record of the whole
+// object as it now stands, and deleting an object appends a tombstone.  An index in memory
+// points each object at its latest record, so a read is a single pread, and the file is only
+// read through from the start when the backend starts up.
+//
+// The records left behind by later changes are garbage.  Once the file is big enough, and
+// enough of it is garbage, the live records are copied into a new file, which is then
+// renamed over the old one.  A compacted file starts with a record of the free ids, since
+// the tombstones they came from are gone.  A checkpoint compacts the file straight away.
+//
+// After a crash, the file may end with a record which was only partly written; the file is
+// read up to the first record which doesn't check out, and cut off there.
+
+// Compaction writes out its file in pieces of this size.
+static const size_t COMPACT_WRITE_SIZE = 1 << 20;
+
+class LogDatabase : public EmbeddedDatabase
+{
+  public:
+    LogDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id) :
+        EmbeddedDatabase(dbeconfig, min_id, max_id, "logdb", "Log"),
+        m_filename(log_filename.get_rval(m_config)),
+        m_sync(log_sync.get_rval(m_config)),
+        m_compact_size(compact_size.get_rval(m_config)),
+        m_compact_garbage(compact_garbage.get_rval(m_config)),
+        m_compact_at(m_compact_size),
+        m_fd(-1), m_end(0), m_live(0)
+    {
+        build_schema(m_schema);
+        open_log();
+        start();
+    }
+
+    ~LogDatabase()
+    {
+        stop();
+        if(m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+  private:
+    // A Location is where an object's latest record is in the file.
+    struct Location {
+        uint64_t offset;
+        uint32_t size; // Of the whole record, header and all.
+    };
+
+    string m_filename;
+    bool m_sync;
+    uint64_t m_compact_size;
+    double m_compact_garbage;
+    uint64_t m_compact_at; // The size the file must reach before it's next compacted.
+
+    int m_fd;
+    uint64_t m_end;  // The size of the file on disk.
+    uint64_t m_live; // The bytes of the file, and of m_pending, which are still in use.
+    vector<uint8_t> m_pending; // The records appended since the last commit, which follow m_end.
+    unordered_map<doid_t, Location> m_index;
+    vector<uint8_t> m_schema; // The schema record for the current DC file.
+
+    // open_log opens the file, reading in the index from it; a new file is started with just
+    // the schema record.
+    void open_log()
+    {
+        // A compaction which was cut short leaves the new file behind; the old one still stands.
+        unlink((m_filename + ".compact").c_str());
+
+        m_fd = open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(m_fd < 0) {
+            m_log->fatal() << "Could not open " << m_filename << ": " << strerror(errno) << endl;
+            astron_shutdown(1);
+        }
+
+        struct stat info;
+        if(fstat(m_fd, &info) < 0) {
+            m_log->fatal() << "Could not stat " << m_filename << ": " << strerror(errno) << endl;
+            astron_shutdown(1);
+        }
+
+        if(info.st_size == 0) {
+            if(!write_all(m_fd, m_schema.data(), m_schema.size(), 0) || !sync(m_fd)) {
+                m_log->fatal() << "Could not write to " << m_filename << ": "
+                               << strerror(errno) << endl;
+                astron_shutdown(1);
+            }
+            m_end = m_live = m_schema.size();
+            return;
+        }
+
+        RecordSchema schema;
+        bool translate = false;
+        recover(info.st_size, schema, translate);
+        clamp_ids();
+
+        m_log->info() << "Loaded " << m_index.size() << " objects from " << m_filename
+                      << " (" << m_end << " bytes, " << m_end - m_live << " of them garbage)."
+                      << endl;
+
+        if(translate) {
+            m_log->info() << "The DC file has changed since " << m_filename
+                          << " was written; rewriting it." << endl;
+            if(!compact(&schema)) {
+                m_log->fatal() << "Could not rewrite " << m_filename
+                               << " for the new DC file." << endl;
+                astron_shutdown(1);
+            }
+        }
+    }
+
+    // recover reads through the file, rebuilding the index and ids from its records, and cuts
+    // off any partly written record at its end.
+    void recover(uint64_t file_size, RecordSchema &schema, bool &translate)
+    {
+        bool first = true;
+        auto replay = [&](const uint8_t *record, size_t size, uint64_t offset) {
+            if(first) {
+                first = false;
+                if(record_type(record) != RECORD_SCHEMA) {
+                    m_log->fatal() << m_filename << " is not a log database." << endl;
+                    astron_shutdown(1);
+                }
+            }
+
+            try {
+                this->replay(record, size, offset, schema, translate);
+            } catch(CorruptRecord &) {
+                m_log->fatal() << "The record at offset " << offset << " of " << m_filename
+                               << " is corrupt." << endl;
+                astron_shutdown(1);
+            }
+        };
+        if(!scan_records(m_fd, file_size, m_end, replay)) {
+            m_log->fatal() << "Could not read " << m_filename << ": " << strerror(errno) << endl;
+            astron_shutdown(1);
+        }
+
+        if(first) {
+            m_log->fatal() << m_filename << " is not a log database." << endl;
+            astron_shutdown(1);
+        }
+        if(m_end < file_size) {
+            m_log->warning() << m_filename << " ends with " << file_size - m_end
+                             << " bytes which aren't a whole record, most likely one which was"
+                             " being written when Astron stopped; dropping them." << endl;
+            if(ftruncate(m_fd, m_end) < 0 || !sync(m_fd)) {
+                m_log->fatal() << "Could not truncate " << m_filename << ": "
+                               << strerror(errno) << endl;
+                astron_shutdown(1);
+            }
+        }
+    }
+
+    // replay applies a record read in from the file to the index and ids.
+    void replay(const uint8_t *record, size_t size, uint64_t offset, RecordSchema &schema,
+                bool &translate)
+    {
+        RecordReader reader(record, size);
+        switch(record_type(record)) {
+        case RECORD_SCHEMA: {
+            m_live += size;
+            translate = read_schema(record, size, m_schema, schema);
+        }
+        break;
+        case RECORD_STATE: {
+            m_live += size;
+            m_next_id = reader.read<uint64_t>();
+            m_free_ids.clear();
+            uint32_t free_count = reader.read<uint32_t>();
+            for(uint32_t i = 0; i < free_count; ++i) {
+                m_free_ids.insert(reader.read<doid_t>());
+            }
+        }
+        break;
+        case RECORD_OBJECT: {
+            doid_t doid = reader.read<doid_t>();
+            auto found = m_index.find(doid);
+            if(found != m_index.end()) {
+                m_live -= found->second.size;
+            } else {
+                replay_created(doid);
+            }
+            Location &location = m_index[doid];
+            location.offset = offset;
+            location.size = size;
+            m_live += size;
+        }
+        break;
+        case RECORD_DELETE: {
+            doid_t doid = reader.read<doid_t>();
+            auto found = m_index.find(doid);
+            if(found != m_index.end()) {
+                m_live -= found->second.size;
+                m_index.erase(found);
+                replay_deleted(doid);
+            }
+        }
+        break;
+        default:
+            m_log->fatal() << "The record at offset " << offset << " of " << m_filename
+                           << " is of an unknown type." << endl;
+            astron_shutdown(1);
+        }
+    }
+
+    virtual bool has_object(doid_t doid)
+    {
+        return m_index.find(doid) != m_index.end();
+    }
+
+    virtual bool read_object(doid_t doid, const Class *&dclass, FieldValues &fields)
+    {
+        auto found = m_index.find(doid);
+        if(found == m_index.end()) {
+            return false;
+        }
+
+        vector<uint8_t> record;
+        doid_t record_doid;
+        return read_record(found->second, record) &&
+               decode_object(record.data(), record.size(), nullptr, m_log, record_doid, dclass,
+                             fields);
+    }
+
+    virtual void write_object(doid_t doid, const Class *dclass, const FieldValues &fields)
+    {
+        auto found = m_index.find(doid);
+        if(found != m_index.end()) {
+            m_live -= found->second.size;
+        }
+
+        Location &location = m_index[doid];
+        location.offset = m_end + m_pending.size();
+        location.size = encode_object(m_pending, doid, dclass, fields);
+        m_live += location.size;
+    }
+
+    virtual void remove_object(doid_t doid)
+    {
+        auto found = m_index.find(doid);
+        m_live -= found->second.size;
+        m_index.erase(found);
+
+        RecordWriter tombstone(m_pending, RECORD_DELETE);
+        tombstone.add<doid_t>(doid);
+        tombstone.finish();
+    }
+
+    virtual bool commit()
+    {
+        if(m_pending.empty()) {
+            return true;
+        }
+
+        if(!write_all(m_fd, m_pending.data(), m_pending.size(), m_end) || !sync(m_fd)) {
+            m_log->fatal() << "Could not write to " << m_filename << ": "
+                           << strerror(errno) << endl;
+            return false;
+        }
+
+        m_end += m_pending.size();
+        m_pending.clear();
+        return true;
+    }
+
+    virtual void committed()
+    {
+        if(m_end >= m_compact_at && double(m_end - m_live) > m_end * m_compact_garbage) {
+            if(!compact(nullptr)) {
+                m_compact_at = m_end * 2; // Don't try again straight away.
+            }
+        }
+    }
+
+    virtual bool write_checkpoint()
+    {
+        return compact(nullptr);
+    }
+
+    // read_record reads in a whole record, from the file or from m_pending.
+    bool read_record(const Location &location, vector<uint8_t> &record)
+    {
+        record.resize(location.size);
+        if(location.offset >= m_end) {
+            auto start = m_pending.begin() + (location.offset - m_end);
+            copy(start, start + location.size, record.begin());
+            return true;
+        }
+
+        if(!read_all(m_fd, record.data(), location.size, location.offset) ||
+           check_record(record.data(), record.size()) != location.size) {
+            m_log->error() << "Could not read the record at offset " << location.offset
+                           << " of " << m_filename << "." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // sync syncs a file, if the backend is set to.
+    bool sync(int fd)
+    {
+        return !m_sync || sync_data(fd);
+    }
+
+    // compact copies the live records into a new file, which replaces the old one.  With a
+    // schema, the records are rewritten with the ids of the current DC file.
+    bool compact(const RecordSchema *schema)
+    {
+        string temp = m_filename + ".compact";
+        int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            m_log->error() << "Could not open " << temp << ": " << strerror(errno) << endl;
+            return false;
+        }
+
+        // Copy the records in the order they're in the old file, so it's read straight through.
+        vector<pair<uint64_t, doid_t> > order;
+        order.reserve(m_index.size());
+        for(auto it = m_index.begin(); it != m_index.end(); ++it) {
+            order.push_back(make_pair(it->second.offset, it->first));
+        }
+        sort(order.begin(), order.end());
+
+        vector<uint8_t> buffer(m_schema);
+        RecordWriter state(buffer, RECORD_STATE);
+        state.add<uint64_t>(m_next_id);
+        state.add<uint32_t>(m_free_ids.size());
+        for(doid_t doid : m_free_ids) {
+            state.add<doid_t>(doid);
+        }
+        state.finish();
+
+        unordered_map<doid_t, Location> index;
+        index.reserve(m_index.size());
+        uint64_t written = 0;
+        bool ok = true;
+        vector<uint8_t> record;
+        for(auto it = order.begin(); it != order.end(); ++it) {
+            ok = read_record(m_index[it->second], record);
+            if(!ok) {
+                break;
+            }
+
+            Location &location = index[it->second];
+            location.offset = written + buffer.size();
+            if(schema) {
+                doid_t doid;
+                const Class *dclass;
+                FieldValues fields;
+                ok = decode_object(record.data(), record.size(), schema, m_log, doid, dclass,
+                                   fields);
+                if(!ok) {
+                    break;
+                }
+                location.size = encode_object(buffer, doid, dclass, fields);
+            } else {
+                buffer.insert(buffer.end(), record.begin(), record.end());
+                location.size = record.size();
+            }
+
+            if(buffer.size() >= COMPACT_WRITE_SIZE) {
+                ok = write_all(fd, buffer.data(), buffer.size(), written);
+                written += buffer.size();
+                buffer.clear();
+            }
+        }
+
+        ok = ok && write_all(fd, buffer.data(), buffer.size(), written) && sync(fd);
+        written += buffer.size();
+        if(ok && rename(temp.c_str(), m_filename.c_str()) < 0) {
+            ok = false;
+        }
+        if(!ok) {
+            m_log->error() << "Could not compact " << m_filename << ": " << strerror(errno)
+                           << endl;
+            close(fd);
+            unlink(temp.c_str());
+            return false;
+        }
+        if(m_sync && !sync_directory(m_filename)) {
+            m_log->warning() << "Could not sync the directory of " << m_filename << ": "
+                             << strerror(errno) << endl;
+        }
+
+        m_log->info() << "Compacted " << m_filename << " from " << m_end << " to " << written
+                      << " bytes." << endl;
+        close(m_fd);
+        m_fd = fd;
+        m_index.swap(index);
+        m_end = m_live = written;
+        m_compact_at = m_compact_size;
+        return true;
+    }
+};
+
+DBBackendFactoryItem<LogDatabase> logdb_factory("log");
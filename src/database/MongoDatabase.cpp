@@ -19,11 +19,15 @@
 #include <mongocxx/instance.hpp>
 #include <mongocxx/uri.hpp>
 #include <mongocxx/client.hpp>
+#include <mongocxx/bulk_write.hpp>
+#include <mongocxx/model/update_one.hpp>
 #include <mongocxx/exception/operation_exception.hpp>
 #include <mongocxx/exception/logic_error.hpp>
 
+#include <algorithm>
 #include <limits>
 #include <list>
+#include <unordered_map>
 
 using namespace std;
 using namespace bsoncxx::builder::stream;
@@ -32,6 +36,14 @@ static ConfigGroup mongodb_backend_config("mongodb", db_backend_config);
 static ConfigVariable<string> db_server("server", "mongodb://127.0.0.1/test",
                                         mongodb_backend_config);
 static ConfigVariable<int> num_workers("workers", 8, mongodb_backend_config);
+static ConfigVariable<unsigned int> doid_block("doid_block", 1, mongodb_backend_config);
+
+static bool is_positive(const unsigned int &block)
+{
+    return block > 0;
+}
+static ConfigConstraint<unsigned int> positive_doid_block(is_positive, doid_block,
+        "The doid_block of the mongodb backend must be at least 1.");
 
 // These are helper functions to convert between BSON values and packed Bamboo
 // field values.
@@ -468,6 +480,8 @@ class MongoDatabase : public DatabaseBackend
         DatabaseBackend(dbeconfig, min_id, max_id),
         m_shutdown(false)
     {
+        m_doid_block = doid_block.get_rval(m_config);
+
         stringstream log_name;
         log_name << "Database-MongoDB" << "(Range: [" << min_id << ", " << max_id << "])";
         m_log = new LogCategory("mongodb", log_name.str());
@@ -501,7 +515,14 @@ class MongoDatabase : public DatabaseBackend
 
     ~MongoDatabase()
     {
-        // Shutdown threads:
+        shutdown();
+        delete m_log;
+    }
+
+    // shutdown stops the workers once they have run what's queued; as each one stops, it hands
+    // back what's left of its doid lease.
+    virtual void shutdown()
+    {
         {
             lock_guard<mutex> guard(m_lock);
             m_shutdown = true;
@@ -511,29 +532,78 @@ class MongoDatabase : public DatabaseBackend
             it->join();
             delete it;
         }
-
-        delete m_log;
+        m_threads.clear();
     }
 
     virtual void submit(DBOperation *operation)
     {
         lock_guard<mutex> guard(m_lock);
-        m_operation_queue.push(operation);
+        m_operation_queue.push(vector<DBOperation*> {operation});
         m_cv.notify_one();
     }
 
+    // submit_batch queues the batch's GETs, SETs and DELETEs in groups of the same kind, each
+    // to be run by a worker with a single query or bulk write; anything else is queued one
+    // operation at a time, as with submit.
+    virtual void submit_batch(const vector<DBOperation*> &operations)
+    {
+        lock_guard<mutex> guard(m_lock);
+        vector<DBOperation*> gets, sets, deletes;
+        for(DBOperation *operation : operations) {
+            vector<DBOperation*> *group;
+            switch(operation->type()) {
+            case DBOperation::OperationType::GET_OBJECT:
+            case DBOperation::OperationType::GET_FIELDS:
+                group = &gets;
+                break;
+            case DBOperation::OperationType::SET_FIELDS:
+                group = &sets;
+                break;
+            case DBOperation::OperationType::DELETE_OBJECT:
+                group = &deletes;
+                break;
+            default:
+                m_operation_queue.push(vector<DBOperation*> {operation});
+                continue;
+            }
+
+            group->push_back(operation);
+            if(group->size() == MAX_BATCH) {
+                m_operation_queue.push(move(*group));
+                group->clear();
+            }
+        }
+        for(vector<DBOperation*> *group : {&gets, &sets, &deletes}) {
+            if(!group->empty()) {
+                m_operation_queue.push(move(*group));
+            }
+        }
+        m_cv.notify_all();
+    }
+
   private:
     LogCategory *m_log;
 
     mongocxx::uri m_uri;
 
-    queue<DBOperation *> m_operation_queue;
+    // Each entry is either a single operation, or a group of GETs, SETs or DELETEs from a batch.
+    queue<vector<DBOperation*> > m_operation_queue;
+    // The most objects read or written by a single query.
+    static const size_t MAX_BATCH = 1000;
     condition_variable m_cv;
 
     mutex m_lock;
     vector<thread *> m_threads;
     bool m_shutdown;
 
+    // Each worker leases blocks of doid_block doids from the monotonic counter at a time, and
+    // hands them out to its own creates without going back to the globals document.
+    struct DoidLease {
+        doid_t next;
+        doid_t remaining;
+    };
+    doid_t m_doid_block;
+
     mongocxx::client new_connection()
     {
         return (mongocxx::client {m_uri});
@@ -545,14 +615,23 @@ class MongoDatabase : public DatabaseBackend
 
         auto client = new_connection();
         mongocxx::database db = client[m_uri.database()];
+        DoidLease lease = {0, 0};
 
         while(true) {
             if(m_operation_queue.size() > 0) {
-                DBOperation *op = m_operation_queue.front();
+                vector<DBOperation*> ops = move(m_operation_queue.front());
                 m_operation_queue.pop();
 
                 guard.unlock();
-                handle_operation(db, op);
+                if(ops.size() == 1) {
+                    handle_operation(db, lease, ops.front());
+                } else if(ops.front()->type() == DBOperation::OperationType::SET_FIELDS) {
+                    handle_modify_multiple(db, ops);
+                } else if(ops.front()->type() == DBOperation::OperationType::DELETE_OBJECT) {
+                    handle_delete_multiple(db, ops);
+                } else {
+                    handle_get_multiple(db, ops);
+                }
                 guard.lock();
             } else if(m_shutdown) {
                 break;
@@ -560,14 +639,18 @@ class MongoDatabase : public DatabaseBackend
                 m_cv.wait(guard);
             }
         }
+        guard.unlock();
+
+        // Hand back what's left of our lease, so those doids aren't lost.
+        free_doids(db, lease);
     }
 
-    void handle_operation(mongocxx::database &db, DBOperation *operation)
+    void handle_operation(mongocxx::database &db, DoidLease &lease, DBOperation *operation)
     {
         // First, figure out what kind of operation it is, and dispatch:
         switch(operation->type()) {
         case DBOperation::OperationType::CREATE_OBJECT: {
-            handle_create(db, operation);
+            handle_create(db, lease, operation);
         }
         break;
         case DBOperation::OperationType::DELETE_OBJECT: {
@@ -587,7 +670,7 @@ class MongoDatabase : public DatabaseBackend
         }
     }
 
-    void handle_create(mongocxx::database &db, DBOperation *operation)
+    void handle_create(mongocxx::database &db, DoidLease &lease, DBOperation *operation)
     {
         // First, let's convert the requested object into BSON; this way, if
         // a failure happens, it happens before we waste a doid.
@@ -609,7 +692,7 @@ class MongoDatabase : public DatabaseBackend
         }
         auto fields = builder << finalize;
 
-        doid_t doid = assign_doid(db);
+        doid_t doid = assign_doid(db, lease);
         if(doid == INVALID_DO_ID) {
             // The error will already have been emitted at this point, so
             // all that's left for us to do is fail silently:
@@ -692,9 +775,64 @@ class MongoDatabase : public DatabaseBackend
         }
     }
 
-    void handle_modify(mongocxx::database &db, DBOperation *operation)
+    // find_multiple fetches the objects of a group of operations with one $in query.
+    bool find_multiple(mongocxx::database &db, const vector<DBOperation*> &operations,
+                       unordered_map<doid_t, bsoncxx::document::value> &objs)
+    {
+        bsoncxx::builder::basic::array doids;
+        for(DBOperation *operation : operations) {
+            doids.append(static_cast<int64_t>(operation->doid()));
+        }
+
+        try {
+            auto cursor = db["astron.objects"].find(document {}
+                          << "_id" << open_document
+                          << "$in" << bsoncxx::types::b_array {doids.view()}
+                          << close_document << finalize);
+            for(const auto &it : cursor) {
+                doid_t doid = static_cast<doid_t>(it["_id"].get_int64().value);
+                objs.emplace(doid, bsoncxx::document::value(it));
+            }
+        } catch(mongocxx::operation_exception &e) {
+            m_log->error() << "Unexpected error occurred while trying to retrieve "
+                           << operations.size() << " objects: " << e.what() << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // handle_get_multiple answers a group of GETs with one $in query.
+    void handle_get_multiple(mongocxx::database &db, const vector<DBOperation*> &operations)
+    {
+        unordered_map<doid_t, bsoncxx::document::value> objs;
+        if(!find_multiple(db, operations, objs)) {
+            for(DBOperation *operation : operations) {
+                operation->on_failure();
+            }
+            return;
+        }
+
+        for(DBOperation *operation : operations) {
+            auto obj = objs.find(operation->doid());
+            if(obj == objs.end()) {
+                m_log->warning() << "Got queried for non-existent object with DOID "
+                                 << operation->doid() << endl;
+                operation->on_failure();
+                continue;
+            }
+
+            DBObjectSnapshot *snap = format_snapshot(operation->doid(), obj->second.view());
+            if(!snap || !operation->verify_class(snap->m_dclass)) {
+                operation->on_failure();
+            } else {
+                operation->on_complete(snap);
+            }
+        }
+    }
+
+    // format_updates formats an operation's changes as a $set and an $unset.
+    bsoncxx::document::value format_updates(DBOperation *operation)
     {
-        // Format the changes to be made:
         document sets_builder {};
         document unsets_builder {};
         for(const auto& it : operation->set_fields()) {
@@ -715,7 +853,13 @@ class MongoDatabase : public DatabaseBackend
         auto updates_builder = document {};
         if(!sets.view().empty()) updates_builder << "$set" << sets;
         if(!unsets.view().empty()) updates_builder << "$unset" << unsets;
-        auto updates = updates_builder << finalize;
+        return updates_builder << finalize;
+    }
+
+    void handle_modify(mongocxx::database &db, DBOperation *operation)
+    {
+        // Format the changes to be made:
+        auto updates = format_updates(operation);
 
         // Also format any criteria for the change:
         document query {};
@@ -835,6 +979,138 @@ class MongoDatabase : public DatabaseBackend
         operation->on_failure();
     }
 
+    // handle_modify_multiple writes a group of SETs with one bulk write.  Their objects are
+    // fetched first, with one $in query, so that each SET's fields can be checked against its
+    // object's class before anything is written, instead of reverting it afterwards.
+    void handle_modify_multiple(mongocxx::database &db, const vector<DBOperation*> &operations)
+    {
+        unordered_map<doid_t, bsoncxx::document::value> objs;
+        if(!find_multiple(db, operations, objs)) {
+            for(DBOperation *operation : operations) {
+                operation->on_failure();
+            }
+            return;
+        }
+
+        vector<DBOperation*> valid;
+        vector<bsoncxx::document::value> updates;
+        for(DBOperation *operation : operations) {
+            auto obj = objs.find(operation->doid());
+            if(obj == objs.end()) {
+                m_log->error() << "Attempted to modify unknown DOID: "
+                               << operation->doid() << endl;
+                operation->on_failure();
+                continue;
+            }
+
+            string dclass_name = obj->second.view()["dclass"].get_utf8().value.to_string();
+            const dclass::Class *dclass = g_dcf->get_class_by_name(dclass_name);
+            if(!dclass) {
+                m_log->error() << "Encountered unknown database object: "
+                               << dclass_name << "(" << operation->doid() << ")" << endl;
+                operation->on_failure();
+                continue;
+            }
+            if(!operation->verify_class(dclass)) {
+                operation->on_failure();
+                continue;
+            }
+
+            valid.push_back(operation);
+            updates.push_back(format_updates(operation));
+        }
+        if(valid.empty()) {
+            return;
+        }
+
+        m_log->trace() << "Performing updates to " << valid.size() << " objects." << endl;
+        try {
+            mongocxx::options::bulk_write options;
+            options.ordered(false);
+            auto bulk = db["astron.objects"].create_bulk_write(options);
+            for(size_t i = 0; i < valid.size(); ++i) {
+                auto filter = document {} << "_id" << static_cast<int64_t>(valid[i]->doid())
+                              << finalize;
+                bulk.append(mongocxx::model::update_one(filter.view(), updates[i].view()));
+            }
+            bulk.execute();
+        } catch(mongocxx::operation_exception &e) {
+            // We can't tell which of the updates went through, so fall back to running each
+            // one on its own; setting the same fields again is harmless.
+            m_log->error() << "Unexpected error while modifying " << valid.size()
+                           << " objects, retrying them one at a time: " << e.what() << endl;
+            for(DBOperation *operation : valid) {
+                handle_modify(db, operation);
+            }
+            return;
+        }
+
+        for(DBOperation *operation : valid) {
+            operation->on_complete();
+        }
+    }
+
+    // handle_delete_multiple deletes a group of objects with one query.  Which of them exist
+    // is found out first, so that each DELETE gets a result of its own.
+    void handle_delete_multiple(mongocxx::database &db, const vector<DBOperation*> &operations)
+    {
+        unordered_map<doid_t, bsoncxx::document::value> objs;
+        if(!find_multiple(db, operations, objs)) {
+            for(DBOperation *operation : operations) {
+                operation->on_failure();
+            }
+            return;
+        }
+
+        vector<DBOperation*> existing;
+        bsoncxx::builder::basic::array doids;
+        for(DBOperation *operation : operations) {
+            if(objs.find(operation->doid()) == objs.end()) {
+                m_log->error() << "Tried to delete non-existent doid "
+                               << operation->doid() << endl;
+                operation->on_failure();
+                continue;
+            }
+            existing.push_back(operation);
+            doids.append(static_cast<int64_t>(operation->doid()));
+        }
+        if(existing.empty()) {
+            return;
+        }
+
+        try {
+            db["astron.objects"].delete_many(document {}
+                                             << "_id" << open_document
+                                             << "$in" << bsoncxx::types::b_array {doids.view()}
+                                             << close_document << finalize);
+        } catch(mongocxx::operation_exception &e) {
+            m_log->error() << "Unexpected error while deleting " << existing.size()
+                           << " objects, retrying them one at a time: " << e.what() << endl;
+            for(DBOperation *operation : existing) {
+                handle_delete(db, operation);
+            }
+            return;
+        }
+
+        m_log->trace() << "Returning " << existing.size() << " doids to the free pool..." << endl;
+        try {
+            db["astron.globals"].update_one(
+                document {} << "_id" << "GLOBALS" << finalize,
+                document {} << "$push" << open_document
+                << "doid.free" << open_document
+                << "$each" << bsoncxx::types::b_array {doids.view()}
+                << close_document
+                << close_document << finalize);
+        } catch(mongocxx::operation_exception &e) {
+            m_log->error() << "Could not return " << existing.size() << " doids to free pool: "
+                           << e.what() << endl;
+        }
+
+        for(DBOperation *operation : existing) {
+            operation->on_complete();
+        }
+    }
+
     // Get a DBObjectSnapshot from a MongoDB BSON object; returns nullptr if failure.
     DBObjectSnapshot *format_snapshot(doid_t doid, bsoncxx::document::view obj)
     {
@@ -882,12 +1158,15 @@ class MongoDatabase : public DatabaseBackend
     }
 
     // This function is used by handle_create to get a fresh DOID assignment.
-    doid_t assign_doid(mongocxx::database &db)
+    doid_t assign_doid(mongocxx::database &db, DoidLease &lease)
     {
         try {
-            doid_t doid = assign_doid_monotonic(db);
-            if(doid != INVALID_DO_ID) {
-                return doid;
+            if(!lease.remaining) {
+                lease_doids_monotonic(db, lease);
+            }
+            if(lease.remaining) {
+                --lease.remaining;
+                return lease.next++;
             }
 
             // We've exhausted our supply of doids from the monotonic counter.
@@ -900,7 +1179,9 @@ class MongoDatabase : public DatabaseBackend
         }
     }
 
-    doid_t assign_doid_monotonic(mongocxx::database &db)
+    // This leases the next block of doids from the monotonic counter, leaving the
+    // lease empty if the counter is exhausted:
+    void lease_doids_monotonic(mongocxx::database &db, DoidLease &lease)
     {
         auto obj = db["astron.globals"].find_one_and_update(
                        document {} << "_id" << "GLOBALS"
@@ -908,20 +1189,24 @@ class MongoDatabase : public DatabaseBackend
                        << "doid.monotonic" << open_document << "$lte" << static_cast<int64_t>(m_max_id) << close_document
                        << finalize,
                        document {} << "$inc" << open_document
-                       << "doid.monotonic" << 1
+                       << "doid.monotonic" << static_cast<int64_t>(m_doid_block)
                        << close_document << finalize);
 
         // If the findandmodify command failed, the document either doesn't
         // exist, or we ran out of monotonic doids.
         if(!obj) {
-            return INVALID_DO_ID;
+            return;
         }
 
-        m_log->trace() << "assign_doid_monotonic: got globals element: "
+        m_log->trace() << "lease_doids_monotonic: got globals element: "
                        << bsoncxx::to_json(*obj) << endl;
 
-        doid_t doid = handle_bson_number<doid_t>(obj->view()["doid"]["monotonic"].get_value());
-        return doid;
+        // The document is returned as it was before the increment, so the
+        // block starts at the old counter; the last block may be cut short
+        // by the end of our range.
+        doid_t first = handle_bson_number<doid_t>(obj->view()["doid"]["monotonic"].get_value());
+        lease.next = first;
+        lease.remaining = doid_t(min<uint64_t>(m_doid_block, uint64_t(m_max_id) - first + 1));
     }
 
     // This is used when the monotonic counter is exhausted:
@@ -968,6 +1253,36 @@ class MongoDatabase : public DatabaseBackend
                            << " to free pool: " << e.what() << endl;
         }
     }
+
+    // This returns the unused part of a lease to the free list:
+    void free_doids(mongocxx::database &db, DoidLease &lease)
+    {
+        if(!lease.remaining) {
+            return;
+        }
+
+        m_log->trace() << "Returning " << lease.remaining << " leased doids from "
+                       << lease.next << " to the free pool..." << endl;
+
+        bsoncxx::builder::basic::array doids;
+        for(doid_t i = 0; i < lease.remaining; ++i) {
+            doids.append(static_cast<int64_t>(lease.next + i));
+        }
+
+        try {
+            db["astron.globals"].update_one(
+                document {} << "_id" << "GLOBALS" << finalize,
+                document {} << "$push" << open_document
+                << "doid.free" << open_document
+                << "$each" << bsoncxx::types::b_array {doids.view()}
+                << close_document
+                << close_document << finalize);
+            lease.remaining = 0;
+        } catch(mongocxx::operation_exception &e) {
+            m_log->error() << "Could not return " << lease.remaining << " leased doids to"
+                           " free pool: " << e.what() << endl;
+        }
+    }
 };
 
 DBBackendFactoryItem<MongoDatabase> mongodb_factory("mongodb");
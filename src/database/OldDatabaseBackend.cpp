@@ -1,9 +1,138 @@
 #include "OldDatabaseBackend.h"
 #include "core/global.h"
+#include <algorithm>
+
+static thread_local unsigned int current_worker_index = 0;
+
+OldDatabaseBackend::OldDatabaseBackend(ConfigNode dbeconfig, doid_t min_id, doid_t max_id,
+                                       unsigned int num_workers) :
+    DatabaseBackend(dbeconfig, min_id, max_id), m_num_workers(std::max(num_workers, 1u)),
+    m_next_create(0), m_stopping(false)
+{
+    for(unsigned int i = 0; i < m_num_workers; ++i) {
+        m_workers.emplace_back(new Worker);
+    }
+}
+
+OldDatabaseBackend::~OldDatabaseBackend()
+{
+    stop_workers();
+}
+
+unsigned int OldDatabaseBackend::current_worker()
+{
+    return current_worker_index;
+}
 
 void OldDatabaseBackend::submit(DBOperation *operation)
 {
-    std::lock_guard<std::mutex> lock(m_submit_lock);
+    // The workers are started on first use, once the derived backend is fully constructed.
+    std::call_once(m_started, &OldDatabaseBackend::start_workers, this);
+
+    Worker &worker = *m_workers[worker_for(operation)];
+    {
+        std::lock_guard<std::mutex> lock(worker.lock);
+        worker.operations.push(std::vector<DBOperation*> {operation});
+    }
+    worker.cv.notify_one();
+}
+
+void OldDatabaseBackend::submit_batch(const std::vector<DBOperation*> &operations)
+{
+    std::call_once(m_started, &OldDatabaseBackend::start_workers, this);
+
+    std::vector<std::vector<DBOperation*> > shares(m_num_workers);
+    for(DBOperation *operation : operations) {
+        shares[worker_for(operation)].push_back(operation);
+    }
+
+    for(unsigned int i = 0; i < m_num_workers; ++i) {
+        if(shares[i].empty()) {
+            continue;
+        }
+
+        Worker &worker = *m_workers[i];
+        {
+            std::lock_guard<std::mutex> lock(worker.lock);
+            worker.operations.push(std::move(shares[i]));
+        }
+        worker.cv.notify_one();
+    }
+}
+
+// worker_for picks the worker to run an operation on.
+unsigned int OldDatabaseBackend::worker_for(DBOperation *operation)
+{
+    if(operation->type() == DBOperation::OperationType::CREATE_OBJECT) {
+        return m_next_create++ % m_num_workers;
+    }
+    return operation->doid() % m_num_workers;
+}
+
+void OldDatabaseBackend::shutdown()
+{
+    stop_workers();
+}
+
+void OldDatabaseBackend::start_workers()
+{
+    for(unsigned int i = 0; i < m_num_workers; ++i) {
+        m_workers[i]->thread = std::thread(&OldDatabaseBackend::run_worker, this, i);
+    }
+}
+
+void OldDatabaseBackend::stop_workers()
+{
+    m_stopping = true;
+    for(auto &worker : m_workers) {
+        // Taking the lock makes sure the worker is either waiting already, or will see that
+        // it's time to stop before it waits.
+        std::lock_guard<std::mutex> lock(worker->lock);
+        worker->cv.notify_one();
+    }
+    for(auto &worker : m_workers) {
+        if(worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void OldDatabaseBackend::run_worker(unsigned int index)
+{
+    current_worker_index = index;
+    start_worker(index);
+
+    Worker &worker = *m_workers[index];
+    std::unique_lock<std::mutex> guard(worker.lock);
+    while(true) {
+        if(!worker.operations.empty()) {
+            std::vector<DBOperation*> ops = std::move(worker.operations.front());
+            worker.operations.pop();
+
+            guard.unlock();
+            if(ops.size() == 1) {
+                handle_operation(ops.front());
+            } else {
+                handle_batch(ops);
+            }
+            guard.lock();
+        } else if(m_stopping) {
+            break;
+        } else {
+            worker.cv.wait(guard);
+        }
+    }
+}
+
+void OldDatabaseBackend::handle_batch(const std::vector<DBOperation*> &operations)
+{
+    for(DBOperation *operation : operations) {
+        handle_operation(operation);
+    }
+}
+
+void OldDatabaseBackend::handle_operation(DBOperation *operation)
+{
     switch(operation->type()) {
     case DBOperation::OperationType::CREATE_OBJECT: {
         ObjectData dbo(operation->dclass()->get_id());
@@ -19,6 +148,11 @@ void OldDatabaseBackend::submit(DBOperation *operation)
     }
     break;
     case DBOperation::OperationType::DELETE_OBJECT: {
+        if(!get_class(operation->doid())) {
+            operation->on_failure(); // There's no such object.
+            return;
+        }
+
         delete_object(operation->doid());
         operation->on_complete();
         return;
@@ -55,13 +189,7 @@ void OldDatabaseBackend::submit(DBOperation *operation)
         }
 
         // If everthing checks out, update our fields
-        for(auto it = operation->set_fields().begin(); it != operation->set_fields().end(); ++it) {
-            if(!it->second.empty()) {
-                set_field(operation->doid(), it->first, it->second);
-            } else {
-                del_field(operation->doid(), it->first);
-            }
-        }
+        set_fields(operation->doid(), operation->set_fields());
 
         operation->on_complete();
         return;
@@ -94,13 +222,7 @@ void OldDatabaseBackend::submit(DBOperation *operation)
         }
 
         // Everything checks out, so update the fields
-        for(auto it = operation->set_fields().begin(); it != operation->set_fields().end(); ++it) {
-            if(!it->second.empty()) {
-                set_field(operation->doid(), it->first, it->second);
-            } else {
-                del_field(operation->doid(), it->first);
-            }
-        }
+        set_fields(operation->doid(), operation->set_fields());
 
         operation->on_complete();
         return;
@@ -3,8 +3,13 @@
 #include "core/types.h"
 #include "dclass/dc/Class.h"
 #include "dclass/dc/Field.h"
-#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
 
 typedef std::vector<uint8_t> FieldValue;
 typedef std::vector<const dclass::Field*> FieldList;
@@ -25,15 +30,56 @@ struct ObjectData {
 // interface to the backends built on the old-style synchronous interface.
 // It's largely temporary; once the other backends are moved to the asynchronous
 // architecture, this will be removed.
+//
+// Operations are run on a pool of worker threads, rather than on the thread which submits them.
+// Every operation on a given object runs on the same worker, in the order it was submitted, so
+// a backend never sees two operations on one object at once; operations on different objects
+// (and creates) are spread across the workers and run concurrently.  A backend must therefore
+// protect any state shared between objects (such as its free ids), and keep per-worker state
+// (such as its connection) separately for each worker; see start_worker and current_worker.
+//
+// A batch is split up by worker, and each worker is handed its share of the batch in one go,
+// so the shares run in parallel; see handle_batch.
 class OldDatabaseBackend : public DatabaseBackend
 {
   public:
-    OldDatabaseBackend(ConfigNode dbeconfig, doid_t min_id, doid_t max_id) :
-        DatabaseBackend(dbeconfig, min_id, max_id) {}
+    OldDatabaseBackend(ConfigNode dbeconfig, doid_t min_id, doid_t max_id,
+                       unsigned int num_workers = 1);
+    virtual ~OldDatabaseBackend();
 
     virtual void submit(DBOperation *operation);
+    virtual void submit_batch(const std::vector<DBOperation*> &operations);
+    // shutdown finishes the queued operations before Astron exits.
+    virtual void shutdown();
 
   protected:
+    // start_worker is called on each worker thread when it starts, before it runs any operations,
+    // so that the backend can set up the worker's own connection.
+    virtual void start_worker(unsigned int)
+    {
+    }
+
+    // current_worker returns the index of the worker running on this thread; any other thread
+    // (such as the one constructing the backend) gets 0.
+    static unsigned int current_worker();
+
+    inline unsigned int get_num_workers() const
+    {
+        return m_num_workers;
+    }
+
+    // handle_batch runs a worker's share of a batch, whose operations may run in any order.
+    // By default, they are simply run one after the other; a backend may instead run them
+    // together, e.g. in a single transaction.
+    virtual void handle_batch(const std::vector<DBOperation*> &operations);
+    // handle_operation runs a single operation through the synchronous interface below.
+    void handle_operation(DBOperation *operation);
+
+    // stop_workers waits for the workers to finish their queued operations, and stops them.
+    // Backends with per-worker state must call it from their destructor, before that state
+    // goes away.
+    void stop_workers();
+
     virtual doid_t create_object(const ObjectData &dbo) = 0;
     virtual void delete_object(doid_t do_id) = 0;
     virtual bool get_object(doid_t do_id, ObjectData &dbo) = 0;
@@ -46,6 +92,7 @@ class OldDatabaseBackend : public DatabaseBackend
 
     virtual void set_field(doid_t do_id, const dclass::Field* field,
                            const std::vector<uint8_t> &value) = 0;
+    // set_fields writes all of the fields at once; a field with an empty value is deleted.
     virtual void set_fields(doid_t do_id, const FieldValues &fields) = 0;
 
     // If not-equals/-empty, current are returned using value(s)
@@ -62,5 +109,20 @@ class OldDatabaseBackend : public DatabaseBackend
                             FieldValues &values) = 0;
 
   private:
-    std::mutex m_submit_lock;
+    struct Worker {
+        std::mutex lock;
+        std::condition_variable cv;
+        std::queue<std::vector<DBOperation*> > operations; // Single operations, or a batch.
+        std::thread thread;
+    };
+
+    unsigned int m_num_workers;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::once_flag m_started;
+    std::atomic<unsigned int> m_next_create;
+    std::atomic<bool> m_stopping;
+
+    void start_workers();
+    void run_worker(unsigned int index);
+    unsigned int worker_for(DBOperation *operation);
 };
@@ -0,0 +1,254 @@
+#include "RecordFile.h"
+
+#include "core/global.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using dclass::Class;
+using dclass::Field;
+using namespace std;
+
+// scan_records reads in the file in pieces of this size, or of the next record if it's bigger.
+static const size_t SCAN_READ_SIZE = 1 << 20;
+
+uint32_t RecordWriter::finish()
+{
+    uint32_t size = m_buffer.size() - m_start - RECORD_HEADER_SIZE;
+    boost::crc_32_type crc;
+    crc.process_bytes(&m_buffer[m_start + 8], size + 1);
+    uint32_t checksum = crc.checksum();
+    memcpy(&m_buffer[m_start], &size, sizeof(size));
+    memcpy(&m_buffer[m_start + 4], &checksum, sizeof(checksum));
+    return size + RECORD_HEADER_SIZE;
+}
+
+size_t check_record(const uint8_t *data, size_t available)
+{
+    if(available < RECORD_HEADER_SIZE) {
+        return 0;
+    }
+
+    uint32_t size, checksum;
+    memcpy(&size, data, sizeof(size));
+    memcpy(&checksum, data + 4, sizeof(checksum));
+    if(size > available - RECORD_HEADER_SIZE) {
+        return 0;
+    }
+
+    boost::crc_32_type crc;
+    crc.process_bytes(data + 8, size + 1);
+    if(crc.checksum() != checksum) {
+        return 0;
+    }
+    return size + RECORD_HEADER_SIZE;
+}
+
+bool scan_records(int fd, uint64_t file_size, uint64_t &end,
+                  const function<void(const uint8_t*, size_t, uint64_t)> &handle)
+{
+    vector<uint8_t> buffer;
+    size_t pos = 0;      // The start of the next record in the buffer.
+    uint64_t base = 0;   // The offset of the start of the buffer in the file.
+    uint64_t loaded = 0; // How much of the file has been read into the buffer.
+    while(true) {
+        size_t size = check_record(buffer.data() + pos, buffer.size() - pos);
+        if(size == 0) {
+            if(loaded == file_size) {
+                break; // There's no more to read, so the rest is a broken record.
+            }
+
+            // Read in more of the file, after whatever's left of the buffer.
+            buffer.erase(buffer.begin(), buffer.begin() + pos);
+            base += pos;
+            pos = 0;
+
+            size_t wanted = SCAN_READ_SIZE;
+            if(buffer.size() >= RECORD_HEADER_SIZE) {
+                uint32_t record_size;
+                memcpy(&record_size, buffer.data(), sizeof(record_size));
+                wanted = max<uint64_t>(wanted, RECORD_HEADER_SIZE + uint64_t(record_size));
+            }
+            wanted = min<uint64_t>(wanted, file_size - loaded);
+
+            size_t at = buffer.size();
+            buffer.resize(at + wanted);
+            if(!read_all(fd, buffer.data() + at, wanted, loaded)) {
+                return false;
+            }
+            loaded += wanted;
+            continue;
+        }
+
+        handle(buffer.data() + pos, size, base + pos);
+        pos += size;
+    }
+
+    end = base + pos;
+    return true;
+}
+
+void build_schema(vector<uint8_t> &buffer)
+{
+    RecordWriter schema(buffer, RECORD_SCHEMA);
+    schema.add<uint16_t>(g_dcf->get_num_classes());
+    for(unsigned int i = 0; i < g_dcf->get_num_classes(); ++i) {
+        const Class *dclass = g_dcf->get_class(i);
+        schema.add<uint16_t>(dclass->get_id());
+        schema.add_string(dclass->get_name());
+        schema.add<uint16_t>(dclass->get_num_fields());
+        for(unsigned int j = 0; j < dclass->get_num_fields(); ++j) {
+            const Field *field = dclass->get_field(j);
+            schema.add<uint16_t>(field->get_id());
+            schema.add_string(field->get_name());
+        }
+    }
+    schema.finish();
+}
+
+bool read_schema(const uint8_t *record, size_t size, const vector<uint8_t> &current,
+                 RecordSchema &schema)
+{
+    if(size == current.size() && equal(record, record + size, current.begin())) {
+        return false;
+    }
+
+    RecordReader reader(record, size);
+    uint16_t class_count = reader.read<uint16_t>();
+    for(uint16_t i = 0; i < class_count; ++i) {
+        uint16_t class_id = reader.read<uint16_t>();
+        schema.class_names[class_id] = reader.read_string();
+        uint16_t field_count = reader.read<uint16_t>();
+        for(uint16_t j = 0; j < field_count; ++j) {
+            uint16_t field_id = reader.read<uint16_t>();
+            schema.field_names[field_id] = reader.read_string();
+        }
+    }
+    return true;
+}
+
+uint32_t encode_object(vector<uint8_t> &buffer, doid_t doid, const Class *dclass,
+                       const FieldValues &fields)
+{
+    RecordWriter record(buffer, RECORD_OBJECT);
+    record.add<doid_t>(doid);
+    record.add<uint16_t>(dclass->get_id());
+    record.add<uint16_t>(fields.size());
+    for(auto it = fields.begin(); it != fields.end(); ++it) {
+        record.add<uint16_t>(it->first->get_id());
+        record.add_blob(it->second);
+    }
+    return record.finish();
+}
+
+bool decode_object(const uint8_t *record, size_t size, const RecordSchema *schema,
+                   LogCategory *log, doid_t &doid, const Class *&dclass, FieldValues &fields)
+{
+    doid = INVALID_DO_ID;
+    try {
+        RecordReader reader(record, size);
+        doid = reader.read<doid_t>();
+        uint16_t class_id = reader.read<uint16_t>();
+        if(schema) {
+            auto name = schema->class_names.find(class_id);
+            dclass = name == schema->class_names.end() ? nullptr :
+                     g_dcf->get_class_by_name(name->second);
+        } else {
+            dclass = g_dcf->get_class_by_id(class_id);
+        }
+        if(!dclass) {
+            log->error() << "obj-" << doid << " is of class #" << class_id
+                         << ", which is not in the DC file." << endl;
+            return false;
+        }
+
+        uint16_t field_count = reader.read<uint16_t>();
+        for(uint16_t i = 0; i < field_count; ++i) {
+            uint16_t field_id = reader.read<uint16_t>();
+            vector<uint8_t> value = reader.read_blob();
+
+            const Field *field;
+            if(schema) {
+                auto name = schema->field_names.find(field_id);
+                field = name == schema->field_names.end() ? nullptr :
+                        dclass->get_field_by_name(name->second);
+            } else {
+                field = g_dcf->get_field_by_id(field_id);
+            }
+            if(!field) {
+                log->warning() << "Field #" << field_id << " of obj-" << doid
+                               << " is no longer in the DC file; dropping it." << endl;
+                continue;
+            }
+            fields[field] = value;
+        }
+        return true;
+    } catch(CorruptRecord &) {
+        log->error() << "The record of obj-" << doid << " is corrupt." << endl;
+        return false;
+    }
+}
+
+bool write_all(int fd, const uint8_t *data, size_t size, uint64_t offset)
+{
+    while(size > 0) {
+        ssize_t written = pwrite(fd, data, size, offset);
+        if(written < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+bool read_all(int fd, uint8_t *data, size_t size, uint64_t offset)
+{
+    while(size > 0) {
+        ssize_t got = pread(fd, data, size, offset);
+        if(got < 0 && errno == EINTR) {
+            continue;
+        }
+        if(got <= 0) {
+            return false;
+        }
+        data += got;
+        size -= got;
+        offset += got;
+    }
+    return true;
+}
+
+bool sync_data(int fd)
+{
+#if defined(ASTRON_HAVE_FDATASYNC)
+    return fdatasync(fd) == 0;
+#elif defined(F_FULLFSYNC)
+    // On macOS, fsync only hands the data to the drive, which may hold it in its cache.
+    return fcntl(fd, F_FULLFSYNC) == 0 || fsync(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+}
+
+bool sync_directory(const string &filename)
+{
+    size_t slash = filename.rfind('/');
+    string directory = slash == string::npos ? "." : filename.substr(0, slash + 1);
+    int fd = open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+}
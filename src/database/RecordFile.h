@@ -0,0 +1,180 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/types.h"
+#include "core/objtypes.h"
+
+class LogCategory;
+
+// NOTES:
+// The embedded backends (see EmbeddedDatabase.h) keep their objects in files of records.
+// Each record has a header of its payload's size and a CRC-32 of its type and payload,
+// followed by its type and its payload.  Everything is in the host's byte order.
+//
+// An object's record holds its class and its fields, with their values packed just as they
+// are on the wire, so reading one back is a matter of copying out the values.  Records refer
+// to classes and fields by their ids in the DC file.  So that the DC file can change between
+// runs, every file of records also holds a schema record, of the names behind the ids; if
+// they no longer match the DC file, the backend rewrites its records with the new ids.
+static const size_t RECORD_HEADER_SIZE = 9; // uint32 size, uint32 checksum, uint8 type
+enum RecordType : uint8_t {
+    // SCHEMA: uint16 class count, [uint16 id, string name, uint16 field count,
+    //                              [uint16 id, string name]]
+    RECORD_SCHEMA = 1,
+    // STATE: uint64 next id, uint32 free id count, [doid free id]
+    RECORD_STATE = 2,
+    // OBJECT: doid, uint16 class id, uint16 field count, [uint16 field id, uint32 size, value]
+    RECORD_OBJECT = 3,
+    // DELETE: doid
+    RECORD_DELETE = 4,
+    // GENERATION: uint64 generation
+    RECORD_GENERATION = 5,
+};
+
+// A CorruptRecord is thrown when a record's payload doesn't hold what its type says it does.
+class CorruptRecord : public std::exception
+{
+  public:
+    virtual const char *what() const throw()
+    {
+        return "The record is corrupt.";
+    }
+};
+
+// A RecordWriter builds a record onto the end of a buffer.
+class RecordWriter
+{
+  public:
+    RecordWriter(std::vector<uint8_t> &buffer, RecordType type) : m_buffer(buffer),
+        m_start(buffer.size())
+    {
+        m_buffer.resize(m_start + RECORD_HEADER_SIZE);
+        m_buffer[m_start + 8] = type;
+    }
+
+    template<typename T>
+    void add(T value)
+    {
+        size_t at = m_buffer.size();
+        m_buffer.resize(at + sizeof(T));
+        memcpy(&m_buffer[at], &value, sizeof(T));
+    }
+    void add_string(const std::string &value)
+    {
+        add<uint16_t>(value.size());
+        m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+    }
+    void add_blob(const std::vector<uint8_t> &value)
+    {
+        add<uint32_t>(value.size());
+        m_buffer.insert(m_buffer.end(), value.begin(), value.end());
+    }
+
+    // finish fills in the header, and returns the size of the whole record.
+    uint32_t finish();
+
+  private:
+    std::vector<uint8_t> &m_buffer;
+    size_t m_start;
+};
+
+// A RecordReader reads the payload of a record which has already been checked.
+class RecordReader
+{
+  public:
+    RecordReader(const uint8_t *record, size_t size) : m_data(record + RECORD_HEADER_SIZE),
+        m_size(size - RECORD_HEADER_SIZE), m_offset(0)
+    {
+    }
+
+    template<typename T>
+    T read()
+    {
+        check(sizeof(T));
+        T value;
+        memcpy(&value, m_data + m_offset, sizeof(T));
+        m_offset += sizeof(T);
+        return value;
+    }
+    std::string read_string()
+    {
+        uint16_t size = read<uint16_t>();
+        check(size);
+        std::string value((const char*)m_data + m_offset, size);
+        m_offset += size;
+        return value;
+    }
+    std::vector<uint8_t> read_blob()
+    {
+        uint32_t size = read<uint32_t>();
+        check(size);
+        std::vector<uint8_t> value(m_data + m_offset, m_data + m_offset + size);
+        m_offset += size;
+        return value;
+    }
+
+  private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_offset;
+
+    void check(size_t size)
+    {
+        if(m_offset + size > m_size) {
+            throw CorruptRecord();
+        }
+    }
+};
+
+inline RecordType record_type(const uint8_t *record)
+{
+    return RecordType(record[8]);
+}
+
+// check_record returns the size of the whole record at the start of a buffer, or 0 if the
+// buffer doesn't start with a whole, intact record.
+size_t check_record(const uint8_t *data, size_t available);
+
+// scan_records reads through a file of records, passing each intact record, and its offset,
+// to handle.  It stops at the first record which isn't whole and intact, setting end to where
+// it starts, and returns false if the file can't be read.
+bool scan_records(int fd, uint64_t file_size, uint64_t &end,
+                  const std::function<void(const uint8_t*, size_t, uint64_t)> &handle);
+
+// A RecordSchema maps the ids of a file written with another DC file onto the current one.
+struct RecordSchema {
+    std::unordered_map<uint16_t, std::string> class_names;
+    std::unordered_map<uint16_t, std::string> field_names;
+};
+
+// build_schema builds the schema record for the current DC file onto the end of a buffer.
+void build_schema(std::vector<uint8_t> &buffer);
+// read_schema reads in a schema record, returning false if it is the same as the current
+// one; otherwise, schema is filled in to translate the file's ids.
+bool read_schema(const uint8_t *record, size_t size, const std::vector<uint8_t> &current,
+                 RecordSchema &schema);
+
+// encode_object builds the record of an object onto the end of a buffer, returning its size.
+uint32_t encode_object(std::vector<uint8_t> &buffer, doid_t doid, const dclass::Class *dclass,
+                       const FieldValues &fields);
+// decode_object reads the class and fields out of the record of an object.  With a schema,
+// the record's ids are looked up by name in the current DC file.  Fields which are no longer
+// in the DC file are dropped, but an object whose class is gone can't be read.
+bool decode_object(const uint8_t *record, size_t size, const RecordSchema *schema,
+                   LogCategory *log, doid_t &doid, const dclass::Class *&dclass,
+                   FieldValues &fields);
+
+// write_all writes out the whole of a buffer at the given offset of a file.
+bool write_all(int fd, const uint8_t *data, size_t size, uint64_t offset);
+// read_all reads in the given range of a file, returning false if it can't all be read.
+bool read_all(int fd, uint8_t *data, size_t size, uint64_t offset);
+// sync_data syncs the contents of a file to disk.
+bool sync_data(int fd);
+// sync_directory syncs the directory holding a file, so that a rename of it is on disk.
+bool sync_directory(const std::string &filename);
@@ -0,0 +1,655 @@
+#include "EmbeddedDatabase.h"
+#include "RecordFile.h"
+#include "DBBackendFactory.h"
+#include "DatabaseServer.h"
+
+#include "core/global.h"
+#include "core/shutdown.h"
+#include "config/constraints.h"
+#include "dclass/dc/Class.h"
+#include "dclass/dc/Field.h"
+
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using dclass::Class;
+using namespace std;
+
+static ConfigGroup snapshot_backend_config("snapshot", db_backend_config);
+static ConfigVariable<string> snapshot_directory("directory", "snapshot_db",
+        snapshot_backend_config);
+static ConfigVariable<bool> snapshot_sync("sync", true, snapshot_backend_config);
+static BooleanValueConstraint snapshot_sync_is_boolean(snapshot_sync);
+static ConfigVariable<unsigned int> checkpoint_size("checkpoint_size", 67108864,
+        snapshot_backend_config);
+
+// NOTES:
+// The snapshot backend keeps its objects in a snapshot file, which is mapped into memory,
+// and a write-ahead log of the changes made since the snapshot was written.
+//
+// The snapshot holds the record of each object (see RecordFile.h), in order of their ids,
+// followed by an index of where each one is; the index is sorted, so an object is found by
+// a binary search of it.  Starting up is only a matter of mapping the snapshot and reading
+// in the write-ahead log, and nothing is parsed until an object is read.
+//
+// A change to an object appends a record of the whole object as it now stands to the log,
+// and deleting an object appends a tombstone.  The latest record of each changed object is
+// also kept in memory, and is read in place of the one in the snapshot.
+//
+// A checkpoint merges the changed objects into a new snapshot, which is renamed over the old
+// one, and then starts a new, empty log.  This happens once the log reaches checkpoint_size
+// bytes, or when the database is asked to.  Each snapshot has a generation, which its log
+// starts with; a log left over from an older generation, by a crash between writing out a
+// snapshot and starting its log, holds nothing the snapshot doesn't already have.
+//
+// After a crash, the log may end with a record which was only partly written; it is read
+// up to the first record which doesn't check out, and cut off there.
+
+// The header at the start of a snapshot file.  It's followed by the schema record of the DC
+// file the records were written with, the records of the objects, the index and the free ids.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t doid_size; // Snapshots can only be read by builds with the same size of doid.
+    uint64_t generation;
+    uint64_t next_id;
+    uint64_t index_offset; // Aligned to 8 bytes.
+    uint64_t object_count;
+    uint64_t free_offset;
+    uint64_t free_count;
+    uint32_t reserved;
+    uint32_t checksum; // A CRC-32 of the header before it.
+};
+// An entry of the index of a snapshot.
+struct SnapshotEntry {
+    uint64_t doid;
+    uint64_t offset;
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'A', 'S', 'T', 'R', 'O', 'N', 'S', 'S'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+// A checkpoint writes out its snapshot in pieces of this size.
+static const size_t CHECKPOINT_WRITE_SIZE = 1 << 20;
+
+static uint32_t header_checksum(const SnapshotHeader &header)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(&header, offsetof(SnapshotHeader, checksum));
+    return crc.checksum();
+}
+
+class SnapshotDatabase : public EmbeddedDatabase
+{
+  public:
+    SnapshotDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id) :
+        EmbeddedDatabase(dbeconfig, min_id, max_id, "snapshotdb", "Snapshot"),
+        m_directory(snapshot_directory.get_rval(m_config)),
+        m_snapshot_path(m_directory + "/objects.snapshot"),
+        m_wal_path(m_directory + "/objects.wal"),
+        m_sync(snapshot_sync.get_rval(m_config)),
+        m_checkpoint_size(checkpoint_size.get_rval(m_config)),
+        m_checkpoint_at(m_checkpoint_size),
+        m_snapshot_fd(-1), m_map(nullptr), m_map_size(0), m_entries(nullptr),
+        m_entry_count(0), m_index_offset(0), m_generation(0),
+        m_wal_fd(-1), m_wal_end(0), m_broken(false)
+    {
+        build_schema(m_schema);
+        open_database();
+        start();
+    }
+
+    ~SnapshotDatabase()
+    {
+        stop();
+        unmap_snapshot();
+        if(m_wal_fd >= 0) {
+            close(m_wal_fd);
+        }
+    }
+
+  private:
+    string m_directory;
+    string m_snapshot_path;
+    string m_wal_path;
+    bool m_sync;
+    uint64_t m_checkpoint_size;
+    uint64_t m_checkpoint_at; // The size the log must reach before the next checkpoint.
+    vector<uint8_t> m_schema; // The schema record for the current DC file.
+
+    // The snapshot, mapped into memory.
+    int m_snapshot_fd;
+    const uint8_t *m_map;
+    size_t m_map_size;
+    const SnapshotEntry *m_entries;
+    uint64_t m_entry_count;
+    uint64_t m_index_offset; // The end of the records.
+    uint64_t m_generation;
+
+    // The write-ahead log.
+    int m_wal_fd;
+    uint64_t m_wal_end;
+    vector<uint8_t> m_pending; // The records appended since the last commit.
+    // The latest record of each object changed since the snapshot; empty if it was deleted.
+    unordered_map<doid_t, vector<uint8_t> > m_changes;
+    // Set if a checkpoint fails after its snapshot has replaced the old one, but before its
+    // log has been started; nothing more can be written.
+    bool m_broken;
+
+    // open_database maps the snapshot and reads in the log; a new database starts with an
+    // empty snapshot.
+    void open_database()
+    {
+        if(mkdir(m_directory.c_str(), 0755) < 0 && errno != EEXIST) {
+            m_log->fatal() << "Could not create " << m_directory << ": " << strerror(errno)
+                           << endl;
+            astron_shutdown(1);
+        }
+
+        // A checkpoint which was cut short leaves its new files behind; the old ones stand.
+        unlink((m_snapshot_path + ".tmp").c_str());
+        unlink((m_wal_path + ".tmp").c_str());
+
+        int fd = open(m_snapshot_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0 && errno == ENOENT) {
+            if(!checkpoint_to(nullptr)) {
+                m_log->fatal() << "Could not create a snapshot in " << m_directory << "."
+                               << endl;
+                astron_shutdown(1);
+            }
+            return;
+        }
+        if(fd < 0) {
+            m_log->fatal() << "Could not open " << m_snapshot_path << ": " << strerror(errno)
+                           << endl;
+            astron_shutdown(1);
+        }
+        if(!map_snapshot(fd)) {
+            close(fd);
+            astron_shutdown(1);
+        }
+
+        const uint8_t *schema_record = m_map + sizeof(SnapshotHeader);
+        size_t schema_size = check_record(schema_record, m_index_offset - sizeof(SnapshotHeader));
+        if(!schema_size || record_type(schema_record) != RECORD_SCHEMA) {
+            m_log->fatal() << m_snapshot_path << " is corrupt." << endl;
+            astron_shutdown(1);
+        }
+        RecordSchema schema;
+        bool translate = read_schema(schema_record, schema_size, m_schema, schema);
+
+        const SnapshotHeader *header = (const SnapshotHeader*)m_map;
+        m_next_id = header->next_id;
+        const uint8_t *free_ids = m_map + header->free_offset;
+        for(uint64_t i = 0; i < header->free_count; ++i) {
+            doid_t doid;
+            memcpy(&doid, free_ids + i * sizeof(doid_t), sizeof(doid_t));
+            m_free_ids.insert(doid);
+        }
+
+        open_wal();
+        clamp_ids();
+
+        m_log->info() << "Loaded " << m_entry_count << " objects from " << m_snapshot_path
+                      << ", and " << m_changes.size() << " changed objects from "
+                      << m_wal_path << "." << endl;
+
+        if(translate) {
+            m_log->info() << "The DC file has changed since " << m_snapshot_path
+                          << " was written; rewriting it." << endl;
+            if(!checkpoint_to(&schema)) {
+                m_log->fatal() << "Could not rewrite " << m_snapshot_path
+                               << " for the new DC file." << endl;
+                astron_shutdown(1);
+            }
+        }
+    }
+
+    // map_snapshot maps a snapshot into memory, after checking its header.
+    bool map_snapshot(int fd)
+    {
+        struct stat info;
+        if(fstat(fd, &info) < 0) {
+            m_log->fatal() << "Could not stat " << m_snapshot_path << ": " << strerror(errno)
+                           << endl;
+            return false;
+        }
+        if(size_t(info.st_size) < sizeof(SnapshotHeader)) {
+            m_log->fatal() << m_snapshot_path << " is not a snapshot." << endl;
+            return false;
+        }
+
+        void *map = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED) {
+            m_log->fatal() << "Could not map " << m_snapshot_path << ": " << strerror(errno)
+                           << endl;
+            return false;
+        }
+
+        const SnapshotHeader *header = (const SnapshotHeader*)map;
+        uint64_t size = info.st_size;
+        const char *problem = nullptr;
+        if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+            problem = " is not a snapshot.";
+        } else if(header->checksum != header_checksum(*header)) {
+            problem = " is corrupt.";
+        } else if(header->version != SNAPSHOT_VERSION) {
+            problem = " is of a version this build can't read.";
+        } else if(header->doid_size != sizeof(doid_t)) {
+            problem = " was written by a build with a different size of doid.";
+        } else if(header->index_offset % alignof(SnapshotEntry) != 0 ||
+                  header->index_offset < sizeof(SnapshotHeader) ||
+                  header->index_offset > size ||
+                  header->object_count > (size - header->index_offset) / sizeof(SnapshotEntry) ||
+                  header->free_offset > size ||
+                  header->free_count > (size - header->free_offset) / sizeof(doid_t)) {
+            problem = " is corrupt.";
+        }
+        if(problem) {
+            m_log->fatal() << m_snapshot_path << problem << endl;
+            munmap(map, info.st_size);
+            return false;
+        }
+
+        m_snapshot_fd = fd;
+        m_map = (const uint8_t*)map;
+        m_map_size = info.st_size;
+        m_entries = (const SnapshotEntry*)(m_map + header->index_offset);
+        m_entry_count = header->object_count;
+        m_index_offset = header->index_offset;
+        m_generation = header->generation;
+        return true;
+    }
+
+    void unmap_snapshot()
+    {
+        if(m_map) {
+            munmap((void*)m_map, m_map_size);
+            m_map = nullptr;
+            m_entries = nullptr;
+            m_entry_count = 0;
+        }
+        if(m_snapshot_fd >= 0) {
+            close(m_snapshot_fd);
+            m_snapshot_fd = -1;
+        }
+    }
+
+    // open_wal reads in the log of the current snapshot, or starts one if there isn't one.
+    void open_wal()
+    {
+        m_wal_fd = open(m_wal_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        struct stat info;
+        if(m_wal_fd < 0 || fstat(m_wal_fd, &info) < 0) {
+            m_log->fatal() << "Could not open " << m_wal_path << ": " << strerror(errno) << endl;
+            astron_shutdown(1);
+        }
+
+        bool first = true, current = false;
+        auto handle = [&](const uint8_t *record, size_t size, uint64_t offset) {
+            try {
+                RecordReader reader(record, size);
+                if(first) {
+                    first = false;
+                    current = record_type(record) == RECORD_GENERATION &&
+                              reader.read<uint64_t>() == m_generation;
+                } else if(current) {
+                    replay(record, size);
+                }
+            } catch(CorruptRecord &) {
+                m_log->fatal() << "The record at offset " << offset << " of " << m_wal_path
+                               << " is corrupt." << endl;
+                astron_shutdown(1);
+            }
+        };
+        if(!scan_records(m_wal_fd, info.st_size, m_wal_end, handle)) {
+            m_log->fatal() << "Could not read " << m_wal_path << ": " << strerror(errno) << endl;
+            astron_shutdown(1);
+        }
+
+        if(!current) {
+            if(!first) {
+                m_log->info() << m_wal_path << " is from before " << m_snapshot_path
+                              << " was written; starting a new one." << endl;
+            }
+            if(!start_wal(m_generation)) {
+                astron_shutdown(1);
+            }
+            return;
+        }
+        if(m_wal_end < uint64_t(info.st_size)) {
+            m_log->warning() << m_wal_path << " ends with " << info.st_size - m_wal_end
+                             << " bytes which aren't a whole record, most likely one which was"
+                             " being written when Astron stopped; dropping them." << endl;
+            if(ftruncate(m_wal_fd, m_wal_end) < 0 || !sync(m_wal_fd)) {
+                m_log->fatal() << "Could not truncate " << m_wal_path << ": "
+                               << strerror(errno) << endl;
+                astron_shutdown(1);
+            }
+        }
+    }
+
+    // replay applies a record read in from the log to the changed objects and the ids.
+    void replay(const uint8_t *record, size_t size)
+    {
+        RecordReader reader(record, size);
+        switch(record_type(record)) {
+        case RECORD_OBJECT: {
+            doid_t doid = reader.read<doid_t>();
+            if(!has_object(doid)) {
+                replay_created(doid);
+            }
+            m_changes[doid].assign(record, record + size);
+        }
+        break;
+        case RECORD_DELETE: {
+            doid_t doid = reader.read<doid_t>();
+            if(has_object(doid)) {
+                replay_deleted(doid);
+            }
+            m_changes[doid].clear();
+        }
+        break;
+        default:
+            throw CorruptRecord();
+        }
+    }
+
+    // start_wal starts a new, empty log for the given generation of the snapshot.
+    bool start_wal(uint64_t generation)
+    {
+        string temp = m_wal_path + ".tmp";
+        vector<uint8_t> record;
+        RecordWriter start(record, RECORD_GENERATION);
+        start.add<uint64_t>(generation);
+        start.finish();
+
+        int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0 || !write_all(fd, record.data(), record.size(), 0) || !sync(fd) ||
+           rename(temp.c_str(), m_wal_path.c_str()) < 0) {
+            m_log->error() << "Could not start a new " << m_wal_path << ": "
+                           << strerror(errno) << endl;
+            if(fd >= 0) {
+                close(fd);
+                unlink(temp.c_str());
+            }
+            return false;
+        }
+        if(m_sync && !sync_directory(m_wal_path)) {
+            m_log->warning() << "Could not sync " << m_directory << ": " << strerror(errno)
+                             << endl;
+        }
+
+        if(m_wal_fd >= 0) {
+            close(m_wal_fd);
+        }
+        m_wal_fd = fd;
+        m_wal_end = record.size();
+        return true;
+    }
+
+    // snapshot_record returns the record of an entry of the snapshot's index, or nullptr if
+    // it doesn't fit in the snapshot.
+    const uint8_t *snapshot_record(const SnapshotEntry &entry, size_t &size)
+    {
+        uint32_t payload;
+        if(entry.offset > m_index_offset || m_index_offset - entry.offset < RECORD_HEADER_SIZE) {
+            return nullptr;
+        }
+        memcpy(&payload, m_map + entry.offset, sizeof(payload));
+        size = RECORD_HEADER_SIZE + size_t(payload);
+        if(size > m_index_offset - entry.offset) {
+            return nullptr;
+        }
+        return m_map + entry.offset;
+    }
+
+    // find_record finds the latest record of an object, returning false if it doesn't exist.
+    bool find_record(doid_t doid, const uint8_t *&record, size_t &size)
+    {
+        auto changed = m_changes.find(doid);
+        if(changed != m_changes.end()) {
+            record = changed->second.data();
+            size = changed->second.size();
+            return size > 0;
+        }
+
+        const SnapshotEntry *end = m_entries + m_entry_count;
+        const SnapshotEntry *found = lower_bound(m_entries, end, uint64_t(doid),
+        [](const SnapshotEntry &entry, uint64_t doid) {
+            return entry.doid < doid;
+        });
+        if(found == end || found->doid != doid) {
+            return false;
+        }
+
+        record = snapshot_record(*found, size);
+        if(!record) {
+            m_log->error() << "The record of obj-" << doid << " in " << m_snapshot_path
+                           << " is corrupt." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    virtual bool has_object(doid_t doid)
+    {
+        const uint8_t *record;
+        size_t size;
+        return find_record(doid, record, size);
+    }
+
+    virtual bool read_object(doid_t doid, const Class *&dclass, FieldValues &fields)
+    {
+        const uint8_t *record;
+        size_t size;
+        doid_t record_doid;
+        return find_record(doid, record, size) &&
+               decode_object(record, size, nullptr, m_log, record_doid, dclass, fields);
+    }
+
+    virtual void write_object(doid_t doid, const Class *dclass, const FieldValues &fields)
+    {
+        size_t start = m_pending.size();
+        encode_object(m_pending, doid, dclass, fields);
+        m_changes[doid].assign(m_pending.begin() + start, m_pending.end());
+    }
+
+    virtual void remove_object(doid_t doid)
+    {
+        RecordWriter tombstone(m_pending, RECORD_DELETE);
+        tombstone.add<doid_t>(doid);
+        tombstone.finish();
+        m_changes[doid].clear();
+    }
+
+    virtual bool commit()
+    {
+        if(m_pending.empty()) {
+            return true;
+        }
+
+        if(m_broken) {
+            m_log->fatal() << "There is no write-ahead log to write to." << endl;
+            return false;
+        }
+        if(!write_all(m_wal_fd, m_pending.data(), m_pending.size(), m_wal_end) ||
+           !sync(m_wal_fd)) {
+            m_log->fatal() << "Could not write to " << m_wal_path << ": "
+                           << strerror(errno) << endl;
+            return false;
+        }
+
+        m_wal_end += m_pending.size();
+        m_pending.clear();
+        return true;
+    }
+
+    virtual void committed()
+    {
+        if(m_checkpoint_size && m_wal_end >= m_checkpoint_at && !checkpoint_to(nullptr)) {
+            m_checkpoint_at = m_wal_end * 2; // Don't try again straight away.
+        }
+    }
+
+    virtual bool write_checkpoint()
+    {
+        return checkpoint_to(nullptr);
+    }
+
+    // sync syncs a file, if the backend is set to.
+    bool sync(int fd)
+    {
+        return !m_sync || sync_data(fd);
+    }
+
+    // checkpoint_to merges the changed objects into a new snapshot, and starts a new log.
+    // With a schema, the records are rewritten with the ids of the current DC file.
+    bool checkpoint_to(const RecordSchema *schema)
+    {
+        auto started = chrono::steady_clock::now();
+        string temp = m_snapshot_path + ".tmp";
+        int fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            m_log->error() << "Could not open " << temp << ": " << strerror(errno) << endl;
+            return false;
+        }
+
+        vector<doid_t> changed;
+        changed.reserve(m_changes.size());
+        for(auto it = m_changes.begin(); it != m_changes.end(); ++it) {
+            changed.push_back(it->first);
+        }
+        sort(changed.begin(), changed.end());
+
+        // The header is filled in once the snapshot is written; the schema follows it.
+        vector<uint8_t> buffer(sizeof(SnapshotHeader) + m_schema.size(), 0);
+        if(!m_schema.empty()) {
+            memcpy(buffer.data() + sizeof(SnapshotHeader), m_schema.data(), m_schema.size());
+        }
+        vector<SnapshotEntry> index;
+        index.reserve(m_entry_count + changed.size());
+        uint64_t written = 0;
+
+        // add adds the record of an object to the new snapshot.
+        auto add = [&](doid_t doid, const uint8_t *record, size_t size) -> bool {
+            SnapshotEntry entry;
+            entry.doid = doid;
+            entry.offset = written + buffer.size();
+            if(schema) {
+                doid_t record_doid;
+                const Class *dclass;
+                FieldValues fields;
+                if(!decode_object(record, size, schema, m_log, record_doid, dclass, fields)) {
+                    return false;
+                }
+                encode_object(buffer, doid, dclass, fields);
+            } else {
+                buffer.insert(buffer.end(), record, record + size);
+            }
+            index.push_back(entry);
+
+            if(buffer.size() >= CHECKPOINT_WRITE_SIZE) {
+                if(!write_all(fd, buffer.data(), buffer.size(), written)) {
+                    return false;
+                }
+                written += buffer.size();
+                buffer.clear();
+            }
+            return true;
+        };
+
+        // Merge the changed objects with the snapshot's, in order of their ids.
+        bool ok = true;
+        uint64_t i = 0;
+        size_t j = 0;
+        while(ok && (i < m_entry_count || j < changed.size())) {
+            if(j == changed.size() || (i < m_entry_count && m_entries[i].doid < changed[j])) {
+                size_t size;
+                const uint8_t *record = snapshot_record(m_entries[i], size);
+                if(!record || check_record(record, size) != size) {
+                    m_log->error() << "The record of obj-" << m_entries[i].doid << " in "
+                                   << m_snapshot_path << " is corrupt." << endl;
+                    ok = false;
+                    break;
+                }
+                ok = add(m_entries[i].doid, record, size);
+                ++i;
+            } else {
+                if(i < m_entry_count && m_entries[i].doid == changed[j]) {
+                    ++i; // The change replaces the snapshot's record.
+                }
+                const vector<uint8_t> &record = m_changes[changed[j]];
+                if(!record.empty()) {
+                    ok = add(changed[j], record.data(), record.size());
+                }
+                ++j;
+            }
+        }
+
+        SnapshotHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = SNAPSHOT_VERSION;
+        header.doid_size = sizeof(doid_t);
+        header.generation = m_generation + 1;
+        header.next_id = m_next_id;
+        while((written + buffer.size()) % alignof(SnapshotEntry) != 0) {
+            buffer.push_back(0);
+        }
+        header.index_offset = written + buffer.size();
+        header.object_count = index.size();
+        const uint8_t *entries = (const uint8_t*)index.data();
+        buffer.insert(buffer.end(), entries, entries + index.size() * sizeof(SnapshotEntry));
+        header.free_offset = written + buffer.size();
+        header.free_count = m_free_ids.size();
+        for(doid_t doid : m_free_ids) {
+            const uint8_t *bytes = (const uint8_t*)&doid;
+            buffer.insert(buffer.end(), bytes, bytes + sizeof(doid));
+        }
+        header.checksum = header_checksum(header);
+
+        ok = ok && write_all(fd, buffer.data(), buffer.size(), written);
+        written += buffer.size();
+        ok = ok && write_all(fd, (const uint8_t*)&header, sizeof(header), 0) && sync(fd);
+        if(ok && rename(temp.c_str(), m_snapshot_path.c_str()) < 0) {
+            ok = false;
+        }
+        if(!ok) {
+            m_log->error() << "Could not write a snapshot to " << m_snapshot_path << ": "
+                           << strerror(errno) << endl;
+            close(fd);
+            unlink(temp.c_str());
+            return false;
+        }
+        if(m_sync && !sync_directory(m_snapshot_path)) {
+            m_log->warning() << "Could not sync " << m_directory << ": " << strerror(errno)
+                             << endl;
+        }
+
+        // The new snapshot has replaced the old one, so the old log's changes are in it.
+        unmap_snapshot();
+        m_changes.clear();
+        if(!map_snapshot(fd) || !start_wal(header.generation)) {
+            m_broken = true;
+            return false;
+        }
+
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        m_log->info() << "Wrote a snapshot of " << m_entry_count << " objects (" << written
+                      << " bytes) to " << m_snapshot_path << " in " << ms << " ms." << endl;
+        m_checkpoint_at = m_checkpoint_size;
+        return true;
+    }
+};
+
+DBBackendFactoryItem<SnapshotDatabase> snapshotdb_factory("snapshot");
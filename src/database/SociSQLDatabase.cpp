@@ -4,6 +4,7 @@
 
 #include "core/global.h"
 #include "core/shutdown.h"
+#include "config/constraints.h"
 #include "dclass/value/parse.h"
 #include "dclass/value/format.h"
 #include "dclass/dc/Class.h"
@@ -11,6 +12,8 @@
 
 #include <soci.h>
 #include <boost/icl/interval_set.hpp>
+#include <algorithm>
+#include <unordered_map>
 
 using namespace std;
 using namespace soci;
@@ -25,14 +28,68 @@ static ConfigVariable<string> database_name("database", "", soci_backend_config)
 static ConfigVariable<string> database_address("address", "", soci_backend_config);
 static ConfigVariable<string> database_username("username", "", soci_backend_config);
 static ConfigVariable<string> database_password("password", "", soci_backend_config);
+// Each worker runs operations on a connection of its own.
+static ConfigVariable<unsigned int> num_workers("workers", 4, soci_backend_config);
+
+// split_address splits a database address into its host and, if it has one, its port.
+// Returns false if the port isn't a number from 1 to 65535.
+static bool split_address(const string &address, string &host, unsigned int &port)
+{
+    host = address;
+    port = 0;
+
+    // The port follows the last colon, unless that's inside the brackets of an IPv6 address.
+    size_t col_index = address.find_last_of(":");
+    size_t sqr_index = address.find_last_of("]");
+    if(col_index == string::npos || (sqr_index != string::npos && col_index < sqr_index)) {
+        return true;
+    }
+
+    host = address.substr(0, col_index);
+    string digits = address.substr(col_index + 1);
+    if(digits.empty() || digits.size() > 5 ||
+       digits.find_first_not_of("0123456789") != string::npos) {
+        return false;
+    }
+    port = stoul(digits);
+    return port >= 1 && port <= 65535;
+}
+static bool is_database_address(const string &address)
+{
+    string host;
+    unsigned int port;
+    return split_address(address, host, port);
+}
+static ConfigConstraint<string> valid_database_address(is_database_address, database_address,
+        "The database address must be a host, optionally followed by :<port>.");
+
+// worker_count returns the number of workers to use with a driver.
+static unsigned int worker_count(ConfigNode dbeconfig)
+{
+    // SQLite only allows one writer at a time; more connections would just fail with SQLITE_BUSY.
+    if(database_driver.get_rval(dbeconfig) == "sqlite3") {
+        return 1;
+    }
+    return num_workers.get_rval(dbeconfig);
+}
+
+// prepare finishes a statement whose values have all been exchanged, preparing its query on
+// the database so that it can be executed repeatedly.
+static void prepare(statement &st, const string &query)
+{
+    st.alloc();
+    st.prepare(query);
+    st.define_and_bind();
+}
 
 class SociSQLDatabase : public OldDatabaseBackend
 {
   public:
     SociSQLDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id) :
-        OldDatabaseBackend(dbeconfig, min_id, max_id), m_min_id(min_id), m_max_id(max_id),
+        OldDatabaseBackend(dbeconfig, min_id, max_id, worker_count(dbeconfig)),
+        m_min_id(min_id), m_max_id(max_id),
         m_backend(database_driver.get_rval(dbeconfig)),
-        m_db_name(database_name.get_rval(dbeconfig)),
+        m_db_name(database_name.get_rval(dbeconfig)), m_db_port(0),
         m_sess_user(database_username.get_rval(dbeconfig)),
         m_sess_passwd(database_password.get_rval(dbeconfig))
     {
@@ -41,48 +98,66 @@ class SociSQLDatabase : public OldDatabaseBackend
         m_log = new LogCategory(m_backend, log_name.str());
 
         string server = database_address.get_rval(dbeconfig);
-        size_t col_index = server.find_last_of(":");
-        size_t sqr_index = server.find_last_of("]");
-        if(col_index != string::npos && col_index > sqr_index) {
-            m_db_host = server.substr(0, col_index);
-            m_db_port = stoi(server.substr(col_index + 1));
-        } else {
-            m_db_host = server;
+        unsigned int port;
+        if(!split_address(server, m_db_host, port)) {
+            m_log->fatal() << "Invalid database address '" << server << "'." << endl;
+            astron_shutdown(1);
         }
+        m_db_port = port;
 
-        connect();
+        build_tables();
+
+        // The first worker's connection is also used to set up the database.
+        m_connections.resize(get_num_workers());
+        m_connections[0].reset(new Connection);
+        connect(m_connections[0]->sql);
         check_tables();
         check_classes();
         check_ids();
+        prepare_statements(*m_connections[0]);
+    }
+
+    ~SociSQLDatabase()
+    {
+        stop_workers();
     }
 
     virtual doid_t create_object(const ObjectData& dbo)
     {
-        string field_name;
-        vector<uint8_t> field_value;
         const Class *dcc = g_dcf->get_class_by_id(dbo.dc_id);
-        bool storable = is_storable(dbo.dc_id);
+        ClassStatements *st = statements(dbo.dc_id);
 
         doid_t do_id = pop_next_id();
         if(!do_id) {
             return 0;
         }
 
+        Connection &c = conn();
         try {
-            m_sql.begin(); // Start transaction
-            m_sql << "INSERT INTO objects VALUES (" << do_id << "," << dbo.dc_id << ");";
-
-            if(storable) {
-                // TODO: This would probably be a lot faster if it was all one statement.
-                //       Go ahead and simplify to one statement if you see a good way to do so.
-                m_sql << "INSERT INTO fields_" << dcc->get_name() << "(object_id)"
-                      " VALUES(" << do_id << ");";
-                set_fields_in_table(do_id, dcc, dbo.fields);
+            c.sql.begin(); // Start transaction
+            c.id = do_id;
+            c.class_id = dbo.dc_id;
+            c.insert_object->execute(true);
+
+            if(st) {
+                // The whole row is written in one go; fields without a value are left NULL.
+                const ClassTable &table = m_tables.at(dbo.dc_id);
+                for(size_t i = 0; i < table.columns.size(); ++i) {
+                    st->indicators[i] = i_null;
+                }
+                for(auto it = dbo.fields.begin(); it != dbo.fields.end(); ++it) {
+                    stage(*st, table, it->first, it->second);
+                }
+                st->id = do_id;
+                st->insert.execute(true);
             }
 
-            m_sql.commit(); // End transaction
+            c.sql.commit(); // End transaction
         } catch(const soci_error &e) {
-            m_sql.rollback(); // Revert transaction
+            c.sql.rollback(); // Revert transaction
+            m_log->error() << "Failed to create object of class " << dcc->get_name()
+                           << ": " << e.what() << endl;
+            push_id(do_id);
             return 0;
         }
 
@@ -90,20 +165,25 @@ class SociSQLDatabase : public OldDatabaseBackend
     }
     virtual void delete_object(doid_t do_id)
     {
-        bool storable = false;
         const Class* dcc = get_class(do_id);
-        if(dcc) {
-            // Note: needs to be called outside the transaction so it doesn't prevent deletion
-            //       of the object in the `objects` table
-            storable = is_storable(dcc->get_id());
-        }
+        ClassStatements *st = dcc ? statements(dcc->get_id()) : nullptr;
 
         m_log->debug() << "Deleting object with id " << do_id << "..." << endl;
-        m_sql << "DELETE FROM objects WHERE id=" << do_id;
-
-        if(dcc && storable) {
-            m_log->trace() << "... object has stored field, also deleted." << endl;
-            m_sql << "DELETE FROM fields_" << dcc->get_name() << " WHERE object_id=:id;", use(do_id);
+        Connection &c = conn();
+        try {
+            c.sql.begin(); // Start transaction
+            c.id = do_id;
+            c.delete_object->execute(true);
+            if(st) {
+                m_log->trace() << "... object has stored field, also deleted." << endl;
+                st->id = do_id;
+                st->remove.execute(true);
+            }
+            c.sql.commit(); // End transaction
+        } catch(const soci_error &e) {
+            c.sql.rollback(); // Revert transaction
+            m_log->error() << "Failed to delete object " << do_id << ": " << e.what() << endl;
+            return;
         }
 
         push_id(do_id);
@@ -119,122 +199,84 @@ class SociSQLDatabase : public OldDatabaseBackend
         }
         dbo.dc_id = dcc->get_id();
 
-        bool stored = is_storable(dcc->get_id());
-        if(stored) {
-            get_all_from_table(do_id, dcc, dbo.fields);
+        ClassStatements *st = statements(dcc->get_id());
+        if(st && read_row(*st, do_id)) {
+            const ClassTable &table = m_tables.at(dcc->get_id());
+            for(size_t i = 0; i < table.columns.size(); ++i) {
+                read_column(*st, table, i, do_id, dbo.fields);
+            }
         }
 
         return true;
     }
     virtual const Class* get_class(doid_t do_id)
     {
-        int dc_id = -1;
-        indicator ind;
-
+        Connection &c = conn();
+        c.id = do_id;
         try {
-            m_sql << "SELECT class_id FROM objects WHERE id=" << do_id << ";", into(dc_id, ind);
+            if(!c.get_class->execute(true)) {
+                return nullptr;
+            }
         } catch(const soci_error &e) {
             return nullptr;
         }
 
-        if(ind != i_ok || dc_id == -1) {
+        if(c.class_indicator != i_ok || c.class_id == -1) {
             return nullptr;
         }
 
-        return g_dcf->get_class_by_id(dc_id);
+        return g_dcf->get_class_by_id(c.class_id);
     }
     virtual void del_field(doid_t do_id, const Field* field)
     {
-        const Class *dcc = get_class(do_id);
-        bool storable = is_storable(dcc->get_id());
-
-        if(storable) {
-            FieldList fields;
-            fields.push_back(field);
-            del_fields_in_table(do_id, dcc, fields);
-        }
+        FieldValues fields;
+        fields[field] = vector<uint8_t>();
+        set_fields(do_id, fields);
     }
     virtual void del_fields(doid_t do_id, const FieldList &fields)
     {
-        const Class *dcc = get_class(do_id);
-        bool storable = is_storable(dcc->get_id());
-
-        if(storable) {
-            del_fields_in_table(do_id, dcc, fields);
+        FieldValues values;
+        for(auto it = fields.begin(); it != fields.end(); ++it) {
+            values[*it] = vector<uint8_t>();
         }
+        set_fields(do_id, values);
     }
     virtual void set_field(doid_t do_id, const Field* field, const vector<uint8_t> &value)
     {
-        const Class *dcc = get_class(do_id);
-        bool storable = is_storable(dcc->get_id());
-
-        if(storable) {
-            FieldValues fields;
-            fields[field] = value;
-            try {
-                m_sql.begin(); // Start transaction
-                set_fields_in_table(do_id, dcc, fields);
-                m_sql.commit(); // End transaction
-            } catch(const soci_error &e) {
-                m_sql.rollback(); // Revert transaction
-            }
-        }
+        FieldValues fields;
+        fields[field] = value;
+        set_fields(do_id, fields);
     }
     virtual void set_fields(doid_t do_id, const FieldValues &fields)
     {
         const Class *dcc = get_class(do_id);
-        bool storable = is_storable(dcc->get_id());
+        ClassStatements *st = dcc ? statements(dcc->get_id()) : nullptr;
+        if(!st) {
+            return;
+        }
 
-        if(storable) {
-            try {
-                m_sql.begin(); // Start transaction
-                set_fields_in_table(do_id, dcc, fields);
-                m_sql.commit(); // End transaction
-            } catch(const soci_error &e) {
-                m_sql.rollback(); // Revert transaction
-            }
+        const ClassTable &table = m_tables.at(dcc->get_id());
+        unstage(*st);
+        for(auto it = fields.begin(); it != fields.end(); ++it) {
+            stage(*st, table, it->first, it->second);
         }
+        write_row(*st, do_id);
     }
     virtual bool set_field_if_empty(doid_t do_id, const Field* field, vector<uint8_t> &value)
     {
-        // Get class from the objects table
-        const Class* dcc = get_class(do_id);
-        if(!dcc) {
-            value.clear();
-            return false; // Object does not exist
-        }
-
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
-            value.clear();
-            return false; // Class has no database fields
+        FieldValues values;
+        values[field] = value;
+        if(set_fields_if_empty(do_id, values)) {
+            return true;
         }
 
-        if(!field->has_keyword("db")) {
+        auto found = values.find(field);
+        if(found != values.end()) {
+            value = found->second;
+        } else {
             value.clear();
-            return false;
-        }
-
-        string val;
-        indicator ind;
-        m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-              << " WHERE object_id=" << do_id << ";", into(val, ind);
-        if(ind != i_null) {
-            bool parse_err;
-            string packed_data = parse_value(field->get_type(), val, parse_err);
-            if(parse_err) {
-                m_log->error() << "Failed parsing value for field '" << field->get_name()
-                               << "' of object " << do_id << "' from database.\n";
-                return false;
-            }
-            value = vector<uint8_t>(packed_data.begin(), packed_data.end());
-            return false;
         }
-
-        val = format_value(field->get_type(), value);
-        m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << field->get_name()
-              << "='" << val << "' WHERE object_id=" << do_id << ";";
-        return true;
+        return false;
     }
     virtual bool set_fields_if_empty(doid_t do_id, FieldValues &values)
     {
@@ -245,97 +287,49 @@ class SociSQLDatabase : public OldDatabaseBackend
             return false; // Object does not exist
         }
 
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
+        ClassStatements *st = statements(dcc->get_id());
+        if(!st || !read_row(*st, do_id)) {
             values.clear();
             return false; // Class has no database fields
         }
 
-        bool failed = false;
-        string value;
-        indicator ind;
-        try {
-            m_sql.begin(); // Start transaction
-            for(auto it = values.begin(); it != values.end(); ++it) {
-                const Field* field = it->first;
-                if(field->has_keyword("db")) {
-                    m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-                          << " WHERE object_id=" << do_id << ";", into(value, ind);
-                    if(ind != i_null) {
-                        bool parse_err;
-                        failed = true;
-                        string packed_data = parse_value(field->get_type(), value, parse_err);
-                        if(parse_err) {
-                            m_log->error() << "Failed parsing value for field '" << field->get_name()
-                                           << "' of object " << do_id << "' from database.\n";
-                            continue;
-                        }
-                        values[field] = vector<uint8_t>(packed_data.begin(), packed_data.end());
-                        continue;
-                    }
-
-                    value = format_value(it->first->get_type(), it->second);
-                    m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << field->get_name()
-                          << "='" << value << "' WHERE object_id=" << do_id << ";";
-                }
-            }
-
-            if(failed) {
-                m_sql.rollback(); // Revert transaction
-            } else {
-                m_sql.commit(); // End transaction
+        // Any field which already has a value fails the whole update, and is returned instead.
+        const ClassTable &table = m_tables.at(dcc->get_id());
+        FieldValues stored_values;
+        for(auto it = values.begin(); it != values.end(); ++it) {
+            auto column = table.column_index.find(it->first);
+            if(column != table.column_index.end() && st->row_indicators[column->second] != i_null) {
+                read_column(*st, table, column->second, do_id, stored_values);
             }
-        } catch(const soci_error &e) {
-            m_sql.rollback(); // Revert transaction
-            values.clear();
+        }
+        if(!stored_values.empty()) {
+            values = stored_values;
             return false;
         }
-        return true;
+
+        unstage(*st);
+        for(auto it = values.begin(); it != values.end(); ++it) {
+            stage(*st, table, it->first, it->second);
+        }
+        return write_row(*st, do_id);
     }
     virtual bool set_field_if_equals(doid_t do_id, const Field* field,
                                      const vector<uint8_t> &equal, vector<uint8_t> &value)
     {
-        // Get class from the objects table
-        const Class* dcc = get_class(do_id);
-        if(!dcc) {
-            return false; // Object does not exist
-        }
-
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
-            return false; // Class has no database fields
-        }
-
-        if(!field->has_keyword("db")) {
-            return false;
+        FieldValues equals, values;
+        equals[field] = equal;
+        values[field] = value;
+        if(set_fields_if_equals(do_id, equals, values)) {
+            return true;
         }
 
-        string val;
-        indicator ind;
-        m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-              << " WHERE object_id=" << do_id << ";", into(val, ind);
-        if(ind != i_ok) {
+        auto found = values.find(field);
+        if(found != values.end()) {
+            value = found->second;
+        } else {
             value.clear();
-            return false;
         }
-
-        string eql = format_value(field->get_type(), equal);
-        if(val != eql) {
-            bool parse_err;
-            val = parse_value(field->get_type(), val, parse_err);
-            if(parse_err) {
-                m_log->error() << "Failed parsing value for field '" << field->get_name()
-                               << "' of object " << do_id << "' from database.\n";
-                return false;
-            }
-            value = vector<uint8_t>(val.begin(), val.end());
-            return false;
-        }
-
-        val = format_value(field->get_type(), value);
-        m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << field->get_name()
-              << "='" << val << "' WHERE object_id=" << do_id << ";";
-        return true;
+        return false;
     }
     virtual bool set_fields_if_equals(doid_t do_id, const FieldValues &equals,
                                       FieldValues &values)
@@ -346,79 +340,55 @@ class SociSQLDatabase : public OldDatabaseBackend
             return false; // Object does not exist
         }
 
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
+        ClassStatements *st = statements(dcc->get_id());
+        if(!st || !read_row(*st, do_id)) {
             return false; // Class has no database fields
         }
 
+        // Compare the stored values in their text form, so only a mismatch needs parsing.
+        const ClassTable &table = m_tables.at(dcc->get_id());
         bool failed = false;
-        string value;
-        indicator ind;
         FieldValues stored_values;
-        try {
-            m_sql.begin(); // Start transaction
-            for(auto it = equals.begin(); it != equals.end(); ++it) {
-                const Field* field = it->first;
-                if(field->has_keyword("db")) {
-                    m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-                          << " WHERE object_id=" << do_id << ";", into(value, ind);
-                    if(ind != i_ok) {
-                        failed = true;
-                        continue;
-                    }
-
-                    string equal = format_value(field->get_type(), it->second);
-                    if(value == equal) {
-                        string insert = format_value(field->get_type(), values[field]);
-                        m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << field->get_name()
-                              << "='" << insert << "' WHERE object_id=" << do_id << ";";
-                    } else {
-                        failed = true;
-                    }
-
-                    bool parse_err;
-                    value = parse_value(field->get_type(), value, parse_err);
-                    if(parse_err) {
-                        m_log->error() << "Failed parsing value for field '" << field->get_name()
-                                       << "' of object " << do_id << "' from database.\n";
-                        continue;
-                    }
-                    stored_values[field] = vector<uint8_t>(value.begin(), value.end());
-                }
+        for(auto it = equals.begin(); it != equals.end(); ++it) {
+            auto column = table.column_index.find(it->first);
+            if(column == table.column_index.end()) {
+                continue;
             }
 
-            if(failed) {
-                values = stored_values;
-                m_sql.rollback(); // Revert transaction
-                return false;
-            } else {
-                m_sql.commit(); // End transaction
-                return true;
+            size_t i = column->second;
+            if(st->row_indicators[i] != i_ok) {
+                failed = true;
+                continue;
             }
-        } catch(const soci_error &e) {
-            m_sql.rollback(); // Revert transaction
+            if(st->row[i] != format_value(it->first->get_type(), it->second)) {
+                failed = true;
+            }
+            read_column(*st, table, i, do_id, stored_values);
+        }
+
+        if(failed) {
+            values = stored_values;
+            return false;
+        }
+
+        unstage(*st);
+        for(auto it = values.begin(); it != values.end(); ++it) {
+            stage(*st, table, it->first, it->second);
+        }
+        if(!write_row(*st, do_id)) {
             values.clear();
             return false;
         }
+        return true;
     }
     virtual bool get_field(doid_t do_id, const Field* field, vector<uint8_t> &value)
     {
-        // Get class from the objects table
-        const Class* dcc = get_class(do_id);
-        if(!dcc) {
-            return false; // Object does not exist
-        }
-
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
-            return false; // Class has no database fields
-        }
-
         FieldList fields;
         fields.push_back(field);
         FieldValues values;
-
-        get_fields_from_table(do_id, dcc, fields, values);
+        if(!get_fields(do_id, fields, values)) {
+            return false;
+        }
 
         auto val_it = values.find(field);
         if(val_it == values.end()) {
@@ -438,18 +408,166 @@ class SociSQLDatabase : public OldDatabaseBackend
             return false; // Object does not exist
         }
 
-        bool stored = is_storable(dcc->get_id());
-        if(!stored) {
+        ClassStatements *st = statements(dcc->get_id());
+        if(!st) {
             return false; // Class has no database fields
         }
 
-        get_fields_from_table(do_id, dcc, fields, values);
+        if(read_row(*st, do_id)) {
+            const ClassTable &table = m_tables.at(dcc->get_id());
+            for(auto it = fields.begin(); it != fields.end(); ++it) {
+                auto column = table.column_index.find(*it);
+                if(column != table.column_index.end()) {
+                    read_column(*st, table, column->second, do_id, values);
+                }
+            }
+        }
 
         return true;
     }
 
   protected:
-    void connect()
+    void start_worker(unsigned int worker)
+    {
+        if(!m_connections[worker]) {
+            m_connections[worker].reset(new Connection);
+            connect(m_connections[worker]->sql);
+            prepare_statements(*m_connections[worker]);
+        }
+    }
+
+    // handle_batch writes a batch's SETs in a single transaction, and deletes its objects with
+    // a single statement per table, rather than committing each object on its own.
+    void handle_batch(const vector<DBOperation*> &operations)
+    {
+        vector<DBOperation*> sets, deletes;
+        for(DBOperation *operation : operations) {
+            if(operation->type() == DBOperation::OperationType::SET_FIELDS) {
+                sets.push_back(operation);
+            } else if(operation->type() == DBOperation::OperationType::DELETE_OBJECT) {
+                deletes.push_back(operation);
+            } else {
+                handle_operation(operation);
+            }
+        }
+
+        if(!sets.empty()) {
+            set_objects(sets);
+        }
+        if(!deletes.empty()) {
+            delete_objects(deletes);
+        }
+    }
+
+    // set_objects writes the fields of many objects in one transaction.  The operations only
+    // complete once it commits; if anything goes wrong, it's rolled back and each operation
+    // is run again on its own, so that it gets a result of its own.
+    void set_objects(const vector<DBOperation*> &operations)
+    {
+        vector<DBOperation*> written, invalid;
+        Connection &c = conn();
+        try {
+            c.sql.begin(); // Start transaction
+            for(DBOperation *operation : operations) {
+                const Class *dcc = get_class(operation->doid());
+                if(!dcc || !operation->verify_class(dcc)) {
+                    invalid.push_back(operation);
+                    continue;
+                }
+
+                ClassStatements *st = statements(dcc->get_id());
+                if(st) {
+                    const ClassTable &table = m_tables.at(dcc->get_id());
+                    unstage(*st);
+                    for(auto it = operation->set_fields().begin();
+                        it != operation->set_fields().end(); ++it) {
+                        stage(*st, table, it->first, it->second);
+                    }
+                    st->id = operation->doid();
+                    st->update.execute(true);
+                }
+                written.push_back(operation);
+            }
+            c.sql.commit(); // End transaction
+        } catch(const soci_error &e) {
+            c.sql.rollback(); // Revert transaction
+            m_log->error() << "Failed to write fields of " << operations.size()
+                           << " objects together, writing them one at a time: " << e.what()
+                           << endl;
+            for(DBOperation *operation : operations) {
+                handle_operation(operation);
+            }
+            return;
+        }
+
+        for(DBOperation *operation : invalid) {
+            operation->on_failure();
+        }
+        for(DBOperation *operation : written) {
+            operation->on_complete();
+        }
+    }
+
+    // delete_objects deletes many objects in one transaction, with one statement per table.
+    void delete_objects(const vector<DBOperation*> &operations)
+    {
+        vector<DBOperation*> existing, missing;
+        vector<doid_t> ids;
+        unordered_map<uint16_t, vector<doid_t> > ids_by_class;
+        for(DBOperation *operation : operations) {
+            const Class *dcc = get_class(operation->doid());
+            if(!dcc) {
+                missing.push_back(operation);
+                continue;
+            }
+            existing.push_back(operation);
+            ids.push_back(operation->doid());
+            if(m_tables.find(dcc->get_id()) != m_tables.end()) {
+                ids_by_class[dcc->get_id()].push_back(operation->doid());
+            }
+        }
+
+        if(!ids.empty()) {
+            Connection &c = conn();
+            try {
+                c.sql.begin(); // Start transaction
+                c.sql << "DELETE FROM objects WHERE id IN (" << id_list(ids) << ")";
+                for(auto it = ids_by_class.begin(); it != ids_by_class.end(); ++it) {
+                    c.sql << "DELETE FROM fields_" << g_dcf->get_class_by_id(it->first)->get_name()
+                          << " WHERE object_id IN (" << id_list(it->second) << ")";
+                }
+                c.sql.commit(); // End transaction
+            } catch(const soci_error &e) {
+                c.sql.rollback(); // Revert transaction
+                m_log->error() << "Failed to delete " << ids.size() << " objects together, "
+                               "deleting them one at a time: " << e.what() << endl;
+                for(DBOperation *operation : operations) {
+                    handle_operation(operation);
+                }
+                return;
+            }
+        }
+
+        for(DBOperation *operation : missing) {
+            operation->on_failure();
+        }
+        for(DBOperation *operation : existing) {
+            push_id(operation->doid());
+            operation->on_complete();
+        }
+    }
+
+    // id_list formats ids as a comma-separated list, for an IN clause.
+    static string id_list(const vector<doid_t> &ids)
+    {
+        stringstream ss;
+        for(size_t i = 0; i < ids.size(); ++i) {
+            ss << (i ? "," : "") << ids[i];
+        }
+        return ss.str();
+    }
+
+    void connect(session &sql)
     {
         // Prepare database, username, password, etc for connection
         stringstream connstring;
@@ -476,21 +594,21 @@ class SociSQLDatabase : public OldDatabaseBackend
         }
 
         // Connect to database
-        m_sql.open(m_backend, connstring.str());
+        sql.open(m_backend, connstring.str());
     }
 
     void check_tables()
     {
         if(sizeof(doid_t) <= sizeof(uint32_t)) {
-            m_sql << "CREATE TABLE IF NOT EXISTS objects ("
+            sql() << "CREATE TABLE IF NOT EXISTS objects ("
                   "id INT NOT NULL PRIMARY KEY, class_id INT NOT NULL);";
             //"CONSTRAINT check_object CHECK (id BETWEEN " << m_min_id << " AND " << m_max_id << "));";
         } else {
-            m_sql << "CREATE TABLE IF NOT EXISTS objects ("
+            sql() << "CREATE TABLE IF NOT EXISTS objects ("
                   "id BIGINT NOT NULL PRIMARY KEY, class_id INT NOT NULL);";
             //"CONSTRAINT check_object CHECK (id BETWEEN " << m_min_id << " AND " << m_max_id << "));";
         }
-        m_sql << "CREATE TABLE IF NOT EXISTS classes ("
+        sql() << "CREATE TABLE IF NOT EXISTS classes ("
               "id INT NOT NULL PRIMARY KEY, name VARCHAR(32) NOT NULL,"
               "storable BOOLEAN NOT NULL);";//, CONSTRAINT check_class CHECK (id BETWEEN 0 AND "
         //<< g_dcf->get_num_types()-1 << "));";
@@ -503,16 +621,16 @@ class SociSQLDatabase : public OldDatabaseBackend
         string dc_name;
 
         // Prepare sql statements
-        statement get_row_by_id = (m_sql.prepare << "SELECT name FROM classes WHERE id=:id",
+        statement get_row_by_id = (sql().prepare << "SELECT name FROM classes WHERE id=:id",
                                    into(dc_name), use(dc_id));
-        statement insert_class = (m_sql.prepare << "INSERT INTO classes VALUES (:id,:name,:stored)",
+        statement insert_class = (sql().prepare << "INSERT INTO classes VALUES (:id,:name,:stored)",
                                   use(dc_id), use(dc_name), use(storable));
 
         // For each class, verify an entry exists and has the correct name and value
         for(unsigned int i = 0; i < g_dcf->get_num_classes(); ++i) {
             dc_id = g_dcf->get_class(i)->get_id();
             get_row_by_id.execute(true);
-            if(m_sql.got_data()) {
+            if(sql().got_data()) {
                 check_class(dc_id, dc_name);
             } else {
                 const Class* dcc = g_dcf->get_class(i);
@@ -535,7 +653,7 @@ class SociSQLDatabase : public OldDatabaseBackend
         doid_t id;
 
         // Get all ids from the database at once
-        statement st = (m_sql.prepare << "SELECT id FROM objects;", into(id));
+        statement st = (sql().prepare << "SELECT id FROM objects;", into(id));
         st.execute();
 
         // Iterate through the result set, removing used ids from the free ids
@@ -546,6 +664,8 @@ class SociSQLDatabase : public OldDatabaseBackend
 
     doid_t pop_next_id()
     {
+        lock_guard<mutex> guard(m_ids_lock);
+
         // Check to make sure any free ids exist
         if(!m_free_ids.size()) {
             return INVALID_DO_ID;
@@ -571,15 +691,70 @@ class SociSQLDatabase : public OldDatabaseBackend
 
     void push_id(doid_t id)
     {
+        lock_guard<mutex> guard(m_ids_lock);
         m_free_ids += interval_t::closed(id, id);
     }
   private:
+    // A ClassTable describes the fields table of a class with db fields, along with the queries
+    // used to access it.  The queries are built once at startup from the class definition.
+    struct ClassTable {
+        vector<const Field*> columns; // The class's (non-molecular) db fields.
+        unordered_map<const Field*, size_t> column_index;
+        string select_sql; // Reads every column.
+        string update_sql; // Writes any subset of the columns, chosen by their "set" flags.
+        string insert_sql; // Writes every column.
+        string delete_sql;
+    };
+
+    // A ClassStatements holds one connection's prepared statements for a class's fields table,
+    // along with the values bound to them.  The vectors are sized once, before binding, so
+    // their elements never move.
+    struct ClassStatements {
+        ClassStatements(session &sql, size_t columns) : row(columns), row_indicators(columns),
+            values(columns), indicators(columns), set(columns), select(sql), update(sql),
+            insert(sql), remove(sql)
+        {
+        }
+
+        doid_t id;
+        vector<string> row; // The values read by select.
+        vector<indicator> row_indicators;
+        vector<string> values; // The values written by update and insert.
+        vector<indicator> indicators;
+        vector<int> set; // Whether update writes each column.
+
+        statement select, update, insert, remove;
+    };
+
+    // A Connection is a worker's session, with its prepared statements.
+    struct Connection {
+        session sql;
+
+        doid_t id;
+        int class_id;
+        indicator class_indicator;
+        unique_ptr<statement> get_class, insert_object, delete_object;
+        unordered_map<uint16_t, unique_ptr<ClassStatements> > classes;
+    };
+
     doid_t m_min_id, m_max_id;
     string m_backend, m_db_name, m_db_host;
     uint16_t m_db_port;
     string m_sess_user, m_sess_passwd;
-    session m_sql;
+    unordered_map<uint16_t, ClassTable> m_tables; // Only classes with db fields have a table.
+    vector<unique_ptr<Connection> > m_connections; // One for each worker.
+    mutex m_ids_lock; // Protects m_free_ids.
     set_t m_free_ids;
+
+    // conn returns the connection belonging to the worker running on this thread.
+    inline Connection &conn()
+    {
+        return *m_connections[current_worker()];
+    }
+    inline session &sql()
+    {
+        return conn().sql;
+    }
     LogCategory* m_log;
 
     void check_class(uint16_t id, string name)
@@ -597,9 +772,119 @@ class SociSQLDatabase : public OldDatabaseBackend
 
     }
 
+    // build_tables works out the columns of each class's fields table, and the queries on it.
+    void build_tables()
+    {
+        for(unsigned int i = 0; i < g_dcf->get_num_classes(); ++i) {
+            const Class* dcc = g_dcf->get_class(i);
+
+            ClassTable table;
+            for(unsigned int j = 0; j < dcc->get_num_fields(); ++j) {
+                const Field* field = dcc->get_field(j);
+                if(field->has_keyword("db") && !field->as_molecular()) {
+                    table.column_index[field] = table.columns.size();
+                    table.columns.push_back(field);
+                }
+            }
+            if(table.columns.empty()) {
+                continue;
+            }
+
+            string name = "fields_" + dcc->get_name();
+            stringstream select, update, insert;
+            select << "SELECT ";
+            update << "UPDATE " << name << " SET ";
+            insert << "INSERT INTO " << name << " (object_id";
+            for(size_t j = 0; j < table.columns.size(); ++j) {
+                const string &column = table.columns[j]->get_name();
+                const char *sep = j ? "," : "";
+                select << sep << column;
+                update << sep << column << "=CASE WHEN :s" << j << "=1 THEN :v" << j
+                       << " ELSE " << column << " END";
+                insert << "," << column;
+            }
+            select << " FROM " << name << " WHERE object_id=:id";
+            update << " WHERE object_id=:id";
+            insert << ") VALUES (:id";
+            for(size_t j = 0; j < table.columns.size(); ++j) {
+                insert << ",:v" << j;
+            }
+            insert << ")";
+
+            table.select_sql = select.str();
+            table.update_sql = update.str();
+            table.insert_sql = insert.str();
+            table.delete_sql = "DELETE FROM " + name + " WHERE object_id=:id";
+            m_tables[dcc->get_id()] = table;
+        }
+    }
+
+    // prepare_statements prepares all of the statements used by a connection.
+    void prepare_statements(Connection &c)
+    {
+        c.get_class.reset(new statement(c.sql));
+        c.get_class->exchange(into(c.class_id, c.class_indicator));
+        c.get_class->exchange(use(c.id));
+        prepare(*c.get_class, "SELECT class_id FROM objects WHERE id=:id");
+
+        c.insert_object.reset(new statement(c.sql));
+        c.insert_object->exchange(use(c.id));
+        c.insert_object->exchange(use(c.class_id));
+        prepare(*c.insert_object, "INSERT INTO objects VALUES (:id,:class)");
+
+        c.delete_object.reset(new statement(c.sql));
+        c.delete_object->exchange(use(c.id));
+        prepare(*c.delete_object, "DELETE FROM objects WHERE id=:id");
+
+        for(auto it = m_tables.begin(); it != m_tables.end(); ++it) {
+            const ClassTable &table = it->second;
+            size_t columns = table.columns.size();
+            ClassStatements *st = new ClassStatements(c.sql, columns);
+            c.classes[it->first].reset(st);
+
+            for(size_t i = 0; i < columns; ++i) {
+                st->select.exchange(into(st->row[i], st->row_indicators[i]));
+            }
+            st->select.exchange(use(st->id));
+            prepare(st->select, table.select_sql);
+
+            for(size_t i = 0; i < columns; ++i) {
+                st->update.exchange(use(st->set[i]));
+                st->update.exchange(use(st->values[i], st->indicators[i]));
+            }
+            st->update.exchange(use(st->id));
+            prepare(st->update, table.update_sql);
+
+            st->insert.exchange(use(st->id));
+            for(size_t i = 0; i < columns; ++i) {
+                st->insert.exchange(use(st->values[i], st->indicators[i]));
+            }
+            prepare(st->insert, table.insert_sql);
+
+            st->remove.exchange(use(st->id));
+            prepare(st->remove, table.delete_sql);
+        }
+    }
+
+    // statements returns this worker's statements for a class, or nullptr if it has no db fields.
+    ClassStatements *statements(uint16_t dc_id)
+    {
+        Connection &c = conn();
+        auto found = c.classes.find(dc_id);
+        if(found == c.classes.end()) {
+            return nullptr;
+        }
+        return found->second.get();
+    }
+
     // returns true if class has db fields
     bool create_fields_table(const Class* dcc)
     {
+        auto found = m_tables.find(dcc->get_id());
+        if(found == m_tables.end()) {
+            return false;
+        }
+
         stringstream ss;
         if(sizeof(doid_t) <= sizeof(uint32_t)) {
             ss << "CREATE TABLE IF NOT EXISTS fields_" << dcc->get_name()
@@ -609,112 +894,93 @@ class SociSQLDatabase : public OldDatabaseBackend
                << "(object_id BIGINT NOT NULL PRIMARY KEY";
         }
 
-        int db_field_count = 0;
-        for(unsigned int i = 0; i < dcc->get_num_fields(); ++i) {
-            const Field* field = dcc->get_field(i);
-            if(field->has_keyword("db") && !field->as_molecular()) {
-                db_field_count += 1;
-                // TODO: Store SimpleParameters and fields with 1 SimpleParameter
-                //       as a simpler type.
-                // NOTE: This might be a lot easier if the Parser was modified
-                //       such that atomic fields containing only 1 SimpleParameter
-                //       element are initialized as a SimpleField subclass of AtomicField.
-                // TODO: Also see if you can't find a convenient way to get the max length of
-                //       for example a string field, and use a VARCHAR(len) instead of TEXT.
-                //       Same for blobs with VARBINARY.
-                ss << "," << field->get_name() << " TEXT";
-            }
+        for(const Field* field : found->second.columns) {
+            // TODO: Store SimpleParameters and fields with 1 SimpleParameter
+            //       as a simpler type.
+            // NOTE: This might be a lot easier if the Parser was modified
+            //       such that atomic fields containing only 1 SimpleParameter
+            //       element are initialized as a SimpleField subclass of AtomicField.
+            // TODO: Also see if you can't find a convenient way to get the max length of
+            //       for example a string field, and use a VARCHAR(len) instead of TEXT.
+            //       Same for blobs with VARBINARY.
+            ss << "," << field->get_name() << " TEXT";
         }
 
-        if(db_field_count > 0) {
-            ss << ");";
-            m_sql << ss.str();
-            return true;
-        }
-
-        return false;
+        ss << ");";
+        sql() << ss.str();
+        return true;
     }
 
-    bool is_storable(uint16_t dc_id)
+    // read_row fetches an object's whole row of fields with a single query.
+    // Returns false if the object has no row.
+    bool read_row(ClassStatements &st, doid_t id)
     {
-        uint8_t storable;
-        m_sql << "SELECT storable FROM classes WHERE id=:id", into(storable), use(dc_id);
-        return storable;
-    }
-
-    void get_all_from_table(doid_t id, const Class* dcc, FieldValues &fields)
-    {
-        string value;
-        indicator ind;
-        for(unsigned int i = 0; i < dcc->get_num_fields(); ++i) {
-            const Field* field = dcc->get_field(i);
-            if(field->has_keyword("db")) {
-                m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-                      << " WHERE object_id=" << id << ";", into(value, ind);
-
-                if(ind == i_ok) {
-                    bool parse_err;
-                    string packed_data = parse_value(field->get_type(), value, parse_err);
-                    if(parse_err) {
-                        m_log->error() << "Failed parsing value for field '" << field->get_name()
-                                       << "' of object " << id << "' from database.\n";
-                        continue;
-                    }
-                    fields[field] = vector<uint8_t>(packed_data.begin(), packed_data.end());
-                }
-            }
+        st.id = id;
+        try {
+            return st.select.execute(true);
+        } catch(const soci_error &e) {
+            m_log->error() << "Failed to read fields of object " << id << ": " << e.what() << endl;
+            return false;
         }
     }
 
-    void get_fields_from_table(doid_t id, const Class* dcc, const FieldList &fields,
-                               FieldValues &values)
+    // read_column parses a column of the row last read, adding its value to values if it has one.
+    void read_column(const ClassStatements &st, const ClassTable &table, size_t column,
+                     doid_t id, FieldValues &values)
     {
-        string value;
-        indicator ind;
-        for(auto it = fields.begin(); it != fields.end(); ++it) {
-            const Field* field = *it;
-            if(field->has_keyword("db")) {
-                m_sql << "SELECT " << field->get_name() << " FROM fields_" << dcc->get_name()
-                      << " WHERE object_id=" << id << ";", into(value, ind);
-
-                if(ind == i_ok) {
-                    bool parse_err;
-                    string packed_data = parse_value(field->get_type(), value, parse_err);
-                    if(parse_err) {
-                        m_log->error() << "Failed parsing value for field '" << field->get_name()
-                                       << "' of object " << id << "' from database.\n";
-                        continue;
-                    }
-                    values[field] = vector<uint8_t>(packed_data.begin(), packed_data.end());
-                }
-            }
+        if(st.row_indicators[column] != i_ok) {
+            return;
         }
+
+        const Field* field = table.columns[column];
+        bool parse_err;
+        string packed_data = parse_value(field->get_type(), st.row[column], parse_err);
+        if(parse_err) {
+            m_log->error() << "Failed parsing value for field '" << field->get_name()
+                           << "' of object " << id << "' from database.\n";
+            return;
+        }
+        values[field] = vector<uint8_t>(packed_data.begin(), packed_data.end());
     }
 
-    void set_fields_in_table(doid_t id, const Class* dcc,
-                             const FieldValues &fields)
+    // unstage clears the columns to be written by the next write_row.
+    void unstage(ClassStatements &st)
     {
-        string name, value;
-        for(auto it = fields.begin(); it != fields.end(); ++it) {
-            if(it->first->has_keyword("db")) {
-                name = it->first->get_name();
-                value = format_value(it->first->get_type(), it->second);
-                m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << name << "='" << value
-                      << "' WHERE object_id=" << id << ";";
-            }
+        fill(st.set.begin(), st.set.end(), 0);
+    }
+
+    // stage sets a column to be written by the next write_row or insert; an empty value is
+    // written as NULL, deleting the field.  Fields which aren't columns are ignored.
+    void stage(ClassStatements &st, const ClassTable &table, const Field* field,
+               const vector<uint8_t> &value)
+    {
+        auto column = table.column_index.find(field);
+        if(column == table.column_index.end()) {
+            return;
+        }
+
+        size_t i = column->second;
+        st.set[i] = 1;
+        if(value.empty()) {
+            st.values[i].clear();
+            st.indicators[i] = i_null;
+        } else {
+            st.values[i] = format_value(field->get_type(), value);
+            st.indicators[i] = i_ok;
         }
     }
 
-    void del_fields_in_table(doid_t id, const Class* dcc, const FieldList &fields)
+    // write_row writes all of the staged columns of an object's row with a single query.
+    bool write_row(ClassStatements &st, doid_t id)
     {
-        string name;
-        for(auto it = fields.begin(); it != fields.end(); ++it) {
-            const Field* field = *it;
-            if(field->has_keyword("db")) {
-                m_sql << "UPDATE fields_" << dcc->get_name() << " SET " << field->get_name()
-                      << "=NULL WHERE object_id=" << id << ";";
-            }
+        st.id = id;
+        try {
+            st.update.execute(true);
+        } catch(const soci_error &e) {
+            m_log->error() << "Failed to write fields of object " << id << ": " << e.what() << endl;
+            return false;
         }
+        return true;
     }
 };
 
@@ -17,10 +17,12 @@ using namespace std;
 
 static ConfigGroup yaml_backend_config("yaml", db_backend_config);
 static ConfigVariable<string> directory("directory", "yaml_db", yaml_backend_config);
+static ConfigVariable<unsigned int> num_workers("workers", 4, yaml_backend_config);
 
 class YAMLDatabase : public OldDatabaseBackend
 {
   private:
+    mutex m_ids_lock; // Protects m_next_id, m_free_ids and info.yaml.
     doid_t m_next_id;
     list<doid_t> m_free_ids;
     string m_directory;
@@ -88,6 +90,7 @@ class YAMLDatabase : public OldDatabaseBackend
     // get_next_id returns the next available id to be used in object creation
     doid_t get_next_id()
     {
+        lock_guard<mutex> guard(m_ids_lock);
         doid_t do_id;
         if(m_next_id <= m_max_id) {
             do_id = m_next_id++;
@@ -156,7 +159,7 @@ class YAMLDatabase : public OldDatabaseBackend
     }
   public:
     YAMLDatabase(ConfigNode dbeconfig, doid_t min_id, doid_t max_id) :
-        OldDatabaseBackend(dbeconfig, min_id, max_id),
+        OldDatabaseBackend(dbeconfig, min_id, max_id, num_workers.get_rval(dbeconfig)),
         m_next_id(min_id),
         m_free_ids(),
         m_directory(directory.get_rval(m_config))
@@ -189,6 +192,11 @@ class YAMLDatabase : public OldDatabaseBackend
         infostream.close();
     }
 
+    ~YAMLDatabase()
+    {
+        stop_workers();
+    }
+
     doid_t create_object(const ObjectData &dbo)
     {
         doid_t do_id = get_next_id();
@@ -209,6 +217,7 @@ class YAMLDatabase : public OldDatabaseBackend
     {
         m_log->debug() << "Deleting file: " << filename(do_id) << endl;
         if(!remove(filename(do_id).c_str())) {
+            lock_guard<mutex> guard(m_ids_lock);
             m_free_ids.insert(m_free_ids.end(), do_id);
             update_info();
         }
@@ -390,9 +399,11 @@ class YAMLDatabase : public OldDatabaseBackend
             }
         }
 
-        // Add in the fields that are being updated:
+        // Add in the fields that are being updated, leaving out those being deleted:
         for(auto it = fields.begin(); it != fields.end(); ++it) {
-            dbo.fields[it->first] = it->second;
+            if(!it->second.empty()) {
+                dbo.fields[it->first] = it->second;
+            }
         }
 
         write_yaml_object(do_id, dcc, dbo);
@@ -1,5 +1,6 @@
 // Filename: parse.cpp
 #include <sstream>  // std::istringstream
+#include <mutex>    // std::mutex
 #include "dc/DistributedType.h"
 #include "file/parserDefs.h"
 
@@ -9,6 +10,9 @@ namespace dclass   // open namespace dclass
 {
 
 
+// The lexer and parser keep their state in globals, so only one value can be parsed at a time.
+static mutex parser_lock;
+
 // parse_value reads a .dc-formatted parameter value and outputs the data in packed form matching
 //     the appropriate DistributedType and suitable for a default parameter value.
 //     If an error occurs, the error reason is returned instead of the parsed value.
@@ -21,6 +25,7 @@ string parse_value(const DistributedType* dtype, const string &formatted, bool &
 string parse_value(const DistributedType* dtype, istream &in, bool &err)
 {
     string value;
+    lock_guard<mutex> guard(parser_lock);
     try {
         init_value_parser(in, "parse_value()", dtype, value);
         run_parser();
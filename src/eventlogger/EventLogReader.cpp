@@ -0,0 +1,209 @@
+// eventlog_reader prints the events in Event Logger segments as lines of JSON, in the same form
+// as the Event Logger's json format.  Only the blocks which may hold events matching the filters
+// are decompressed.
+//
+// Usage: eventlog_reader [--type TYPE]... [--from TIME] [--to TIME] [--index] SEGMENT...
+//
+// Times are either seconds since the Unix epoch or local times like "2014-01-31 23:59:59".
+// With --index, the summaries of the matching blocks are printed instead of their events.
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "EventSegment.h"
+#include "msgpack_decode.h"
+using namespace std;
+
+static const char *codec_names[] = { "none", "zlib", "lz4", "zstd" };
+
+static void usage()
+{
+    cerr << "Usage: eventlog_reader [--type TYPE]... [--from TIME] [--to TIME] [--index] "
+            "SEGMENT...\n"
+            "  TIME is seconds since the epoch, or a local time like \"2014-01-31 23:59:59\".\n";
+}
+
+// parse_time converts a time given on the command line to milliseconds since the epoch.
+static bool parse_time(const string &text, uint64_t &ms)
+{
+    if(!text.empty() && text.find_first_not_of("0123456789") == string::npos) {
+        ms = strtoull(text.c_str(), nullptr, 10) * 1000;
+        return true;
+    }
+
+    tm parsed = {};
+    istringstream in(text);
+    in >> get_time(&parsed, "%Y-%m-%d %H:%M:%S");
+    if(in.fail()) {
+        return false;
+    }
+    parsed.tm_isdst = -1;
+    time_t seconds = mktime(&parsed);
+    if(seconds < 0) {
+        return false;
+    }
+    ms = uint64_t(seconds) * 1000;
+    return true;
+}
+
+// format_event appends the event as a line of JSON, with the time it was logged merged in.
+static bool format_event(string &out, const SegmentRecord &record)
+{
+    time_t seconds = time_t(record.time_ms / 1000);
+    char timestamp[64];
+    strftime(timestamp, 64, "{\"_time\": \"%Y-%m-%d %H:%M:%S%z\"", localtime(&seconds));
+
+    size_t start = out.size();
+    out.append(timestamp);
+    size_t body = out.size();
+
+    MsgpackReader reader(record.data, record.length);
+    try {
+        msgpack_decode(out, reader);
+    } catch(MsgpackEOF&) {
+        out.resize(start);
+        return false;
+    }
+    if(out[body] != '{') {
+        out.resize(start);
+        return false;
+    }
+
+    if(out[body + 1] == '}') {
+        out.erase(body, 1);
+    } else {
+        out.replace(body, 1, ", ");
+    }
+    out.push_back('\n');
+    return true;
+}
+
+static bool wanted_type(const set<string> &types, const SegmentRecord &record)
+{
+    if(types.empty()) {
+        return true;
+    }
+
+    MsgpackReader reader(record.data, record.length);
+    string type;
+    try {
+        msgpack_scan_event(reader, type);
+    } catch(MsgpackEOF&) {
+        return false;
+    }
+    return types.count(type) > 0;
+}
+
+static void print_index(const string &filename, const EventSegmentReader &segment,
+                        const set<string> &types, uint64_t from_ms, uint64_t to_ms)
+{
+    cout << filename << ": " << codec_names[segment.get_codec()] << ", "
+         << segment.blocks().size() << " blocks"
+         << (segment.has_index() ? "" : " (no index; segment was not closed)") << "\n";
+
+    for(const SegmentBlockInfo &block : segment.blocks()) {
+        if(!block.may_contain(types, from_ms, to_ms)) {
+            continue;
+        }
+
+        cout << "  @" << block.offset << ": " << block.events << " events, "
+             << block.compressed_size << "/" << block.raw_size << " bytes, "
+             << block.first_ms << "-" << block.last_ms << " ms, types:";
+        if(block.any_type) {
+            cout << " (any)";
+        }
+        for(const string &type : block.types) {
+            cout << " " << type;
+        }
+        cout << "\n";
+    }
+}
+
+static bool print_events(EventSegmentReader &segment, const set<string> &types,
+                         uint64_t from_ms, uint64_t to_ms)
+{
+    string raw, out;
+    for(const SegmentBlockInfo &block : segment.blocks()) {
+        if(!block.may_contain(types, from_ms, to_ms)) {
+            continue;
+        }
+        if(!segment.read_block(block, raw)) {
+            return false;
+        }
+
+        size_t offset = 0;
+        SegmentRecord record;
+        out.clear();
+        while(next_segment_record(raw, offset, record)) {
+            if(record.time_ms < from_ms || record.time_ms > to_ms || !wanted_type(types, record)) {
+                continue;
+            }
+            format_event(out, record);
+        }
+        cout.write(out.data(), out.size());
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    set<string> types;
+    uint64_t from_ms = 0, to_ms = UINT64_MAX;
+    bool index = false;
+    vector<string> files;
+
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if(arg == "--type" && has_value) {
+            types.insert(argv[++i]);
+        } else if(arg == "--from" && has_value) {
+            if(!parse_time(argv[++i], from_ms)) {
+                cerr << "Invalid time: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if(arg == "--to" && has_value) {
+            if(!parse_time(argv[++i], to_ms)) {
+                cerr << "Invalid time: " << argv[i] << "\n";
+                return 1;
+            }
+            to_ms += 999; // Include the whole of the last second.
+        } else if(arg == "--index") {
+            index = true;
+        } else if(arg == "--help" || arg == "-h" || (arg.size() > 1 && arg[0] == '-')) {
+            usage();
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if(files.empty()) {
+        usage();
+        return 1;
+    }
+
+    int status = 0;
+    for(const string &filename : files) {
+        EventSegmentReader segment;
+        if(!segment.open(filename)) {
+            cerr << filename << ": " << segment.get_error() << "\n";
+            status = 1;
+            continue;
+        }
+
+        if(index) {
+            print_index(filename, segment, types, from_ms, to_ms);
+        } else if(!print_events(segment, types, from_ms, to_ms)) {
+            cerr << filename << ": " << segment.get_error() << "\n";
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -1,5 +1,6 @@
-#include <ctime>
 #include <cctype>
+#include <cerrno>
+#include <cstdlib>
 
 #include "core/RoleFactory.h"
 #include "config/constraints.h"
@@ -12,12 +13,124 @@ static RoleConfigGroup el_config("eventlogger");
 static ConfigVariable<std::string> bind_addr("bind", "0.0.0.0:7197", el_config);
 static ConfigVariable<std::string> output_format("output", "events-%Y%m%d-%H%M%S.log", el_config);
 static ConfigVariable<std::string> rotate_interval("rotate_interval", "0", el_config);
+// Events are written either as lines of JSON ("json") or as compressed segments ("segments").
+static ConfigVariable<std::string> log_format("format", "json", el_config);
+// The compression used by segments; by default, the best this build supports.
+static ConfigVariable<std::string> compression("compression", "", el_config);
+// A segment block is compressed and written out once it has this many bytes of events...
+static ConfigVariable<unsigned long> block_size("block_size", 256 * 1024, el_config);
+// ... or once the oldest has waited this many milliseconds.
+static ConfigVariable<unsigned long> block_interval("block_interval", 1000, el_config);
+// Buffered events are written out once there are this many bytes of them...
+static ConfigVariable<unsigned long> flush_size("flush_size", 65536, el_config);
+// ... or once the oldest has waited this many milliseconds.
+static ConfigVariable<unsigned long> flush_interval("flush_interval", 50, el_config);
+// The size of the socket's receive buffer in the kernel, which absorbs bursts of events.
+static ConfigVariable<unsigned long> receive_buffer("receive_buffer", 4 * 1024 * 1024, el_config);
+// If enabled, the Event Logger receives and writes events on an event loop of its own.
+static ConfigVariable<bool> dedicated_thread("dedicated_thread", true, el_config);
 static ValidAddressConstraint valid_bind_addr(bind_addr);
+static BooleanValueConstraint dedicated_thread_is_boolean(dedicated_thread);
+
+// parse_interval parses an interval such as "30s", "15m", "12h" or "1d" into seconds.
+// A plain number is in seconds.
+static bool parse_interval(const std::string &interval, unsigned long &seconds)
+{
+    char *end;
+    unsigned long value = strtoul(interval.c_str(), &end, 10);
+    if(end == interval.c_str()) {
+        return false;
+    }
+
+    std::string unit(end);
+    if(unit.empty() || unit == "s") {
+        seconds = value;
+    } else if(unit == "m") {
+        seconds = value * 60;
+    } else if(unit == "h") {
+        seconds = value * 60 * 60;
+    } else if(unit == "d") {
+        seconds = value * 60 * 60 * 24;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool is_interval(const std::string &interval)
+{
+    unsigned long seconds;
+    return parse_interval(interval, seconds);
+}
+static ConfigConstraint<std::string> valid_rotate_interval(is_interval, rotate_interval,
+        "Rotate interval must be a number of seconds, optionally followed by s, m, h or d.");
+
+static bool is_log_format(const std::string &format)
+{
+    return format == "json" || format == "segments";
+}
+static ConfigConstraint<std::string> valid_log_format(is_log_format, log_format,
+        "Event log format must be one of 'json', 'segments'.");
+
+static bool is_available_codec(const std::string &name)
+{
+    SegmentCodec codec;
+    return name.empty() || (segment_codec_from_name(name, codec) &&
+                            segment_codec_available(codec));
+}
+static ConfigConstraint<std::string> valid_compression(is_available_codec, compression,
+        "Compression must be one of 'none', 'zlib', 'lz4', 'zstd', and supported by this build.");
+
+// The most batches of packets read from the socket before checking on the flush timer.
+static const unsigned int MAX_BATCHES_PER_WAKEUP = 16;
 
 EventLogger::EventLogger(RoleConfig roleconfig) : Role(roleconfig),
-    m_log("eventlogger", "Event Logger"), m_file(nullptr)
+    m_log("eventlogger", "Event Logger"), m_service(&m_io_service), m_file(nullptr),
+    m_codec(segment_default_codec()), m_buffers(EVENTLOG_BATCH * EVENTLOG_BUFSIZE)
 {
+    if(dedicated_thread.get_rval(roleconfig)) {
+        m_service = &g_loops.add_dedicated().get_io_service();
+    }
+
+    m_use_segments = log_format.get_rval(roleconfig) == "segments";
+    if(m_use_segments) {
+        std::string codec = compression.get_rval(roleconfig);
+        if(!codec.empty()) {
+            segment_codec_from_name(codec, m_codec);
+        }
+        m_block_size = block_size.get_rval(roleconfig);
+
+        // A block is the unit that is compressed, so it's written out whole.
+        m_flush_size = m_block_size;
+        m_flush_interval = block_interval.get_rval(roleconfig);
+    } else {
+        m_flush_size = flush_size.get_rval(roleconfig);
+        m_flush_interval = flush_interval.get_rval(roleconfig);
+    }
+    m_flush_timer.reset(new boost::asio::steady_timer(*m_service));
+
+    parse_interval(rotate_interval.get_rval(roleconfig), m_rotate_interval);
+    m_rotate_timer.reset(new boost::asio::steady_timer(*m_service));
+
+#ifdef __linux__
+    m_msgs.resize(EVENTLOG_BATCH);
+    m_iovecs.resize(EVENTLOG_BATCH);
+    m_addrs.resize(EVENTLOG_BATCH);
+    for(unsigned int i = 0; i < EVENTLOG_BATCH; ++i) {
+        m_iovecs[i].iov_base = &m_buffers[i * EVENTLOG_BUFSIZE];
+        m_iovecs[i].iov_len = EVENTLOG_BUFSIZE;
+        m_msgs[i].msg_hdr.msg_iov = &m_iovecs[i];
+        m_msgs[i].msg_hdr.msg_iovlen = 1;
+        m_msgs[i].msg_hdr.msg_name = &m_addrs[i];
+        m_msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        m_msgs[i].msg_hdr.msg_control = nullptr;
+        m_msgs[i].msg_hdr.msg_controllen = 0;
+        m_msgs[i].msg_hdr.msg_flags = 0;
+    }
+#endif
+
     bind(bind_addr.get_rval(roleconfig));
+    set_receive_buffer(receive_buffer.get_rval(roleconfig));
 
     m_file_format = output_format.get_rval(roleconfig);
     open_log();
@@ -25,7 +138,9 @@ EventLogger::EventLogger(RoleConfig roleconfig) : Role(roleconfig),
     LoggedEvent event("log-opened", "EventLogger");
     event.add("msg", "Log opened upon Event Logger startup.");
     process_packet(event.make_datagram());
+    flush();
 
+    schedule_rotate();
     start_receive();
 }
 
@@ -33,14 +148,30 @@ void EventLogger::bind(const std::string &addr)
 {
     m_log.info() << "Opening UDP socket..." << std::endl;
     boost::system::error_code ec;
-    auto addresses = resolve_address(addr, 7197, io_service, ec);
+    auto addresses = resolve_address(addr, 7197, *m_service, ec);
     if(ec.value() != 0) {
         m_log.fatal() << "Couldn't resolve " << addr << std::endl;
         exit(1);
     }
 
-    m_socket.reset((new udp::socket(io_service,
+    m_socket.reset((new udp::socket(*m_service,
                         udp::endpoint(addresses[0].address(), addresses[0].port()))));
+    m_socket->non_blocking(true);
+}
+
+void EventLogger::set_receive_buffer(unsigned long size)
+{
+    boost::system::error_code ec;
+    m_socket->set_option(udp::socket::receive_buffer_size(int(size)), ec);
+
+    // The kernel is free to cap the size (eg. at net.core.rmem_max on Linux).
+    udp::socket::receive_buffer_size actual;
+    m_socket->get_option(actual, ec);
+    if(ec || (unsigned long)actual.value() < size) {
+        m_log.warning() << "Asked for a " << size << " byte receive buffer, but got "
+                        << actual.value() << " bytes.  Bursts of events may be dropped."
+                        << std::endl;
+    }
 }
 
 void EventLogger::open_log()
@@ -48,11 +179,34 @@ void EventLogger::open_log()
     time_t rawtime;
     time(&rawtime);
 
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &rawtime);
+#else
+    localtime_r(&rawtime, &local);
+#endif
+
     char filename[1024];
-    strftime(filename, 1024, m_file_format.c_str(), localtime(&rawtime));
+    strftime(filename, 1024, m_file_format.c_str(), &local);
     m_log.debug() << "New log filename: " << filename << std::endl;
 
+    if(m_use_segments) {
+        // Closing the old segment writes out its index.
+        if(m_segment) {
+            flush();
+            m_segment.reset();
+        }
+
+        m_segment.reset(new EventSegmentWriter(filename, m_codec, m_block_size));
+        if(!m_segment->is_open()) {
+            m_log.error() << "Could not open " << filename << " for writing." << std::endl;
+        }
+        m_log.info() << "Opened new log." << std::endl;
+        return;
+    }
+
     if(m_file) {
+        flush();
         m_file->close();
     }
 
@@ -70,74 +224,292 @@ void EventLogger::cycle_log()
     process_packet(event.make_datagram());
 }
 
+void EventLogger::schedule_rotate()
+{
+    if(m_rotate_interval == 0) {
+        return;
+    }
+
+    m_rotate_timer->expires_from_now(std::chrono::seconds(m_rotate_interval));
+    m_rotate_timer->async_wait(boost::bind(&EventLogger::handle_rotate, this,
+                                           boost::asio::placeholders::error));
+}
+
+void EventLogger::handle_rotate(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return;
+    }
+
+    cycle_log();
+    flush();
+    schedule_rotate();
+}
+
+void EventLogger::update_time_prefix()
+{
+    time_t rawtime;
+    time(&rawtime);
+    if(rawtime == m_time_second && !m_time_prefix.empty()) {
+        return;
+    }
+
+    struct tm local;
+#ifdef _WIN32
+    localtime_s(&local, &rawtime);
+#else
+    localtime_r(&rawtime, &local);
+#endif
+
+    char timestamp[64];
+    strftime(timestamp, 64, "{\"_time\": \"%Y-%m-%d %H:%M:%S%z\"", &local);
+    m_time_prefix = timestamp;
+    m_time_second = rawtime;
+}
+
 void EventLogger::process_packet(DatagramHandle dg)
 {
-    DatagramIterator dgi(dg);
-    std::stringstream stream;
+    process_packet(dg->get_data(), dg->size());
+}
+
+// process_packet logs the event in a packet, or each of the events in a packed one; see
+// EventSender for their format.
+void EventLogger::process_packet(const uint8_t *data, size_t length)
+{
+    MsgpackReader reader(data, length);
+    uint32_t count;
+    try {
+        if(length == 0 || !msgpack_read_array_header(reader, count)) {
+            process_event(data, length);
+            return;
+        }
+
+        for(uint32_t i = 0; i < count; ++i) {
+            const uint8_t *event;
+            uint32_t event_length;
+            if(!msgpack_read_bin(reader, event, event_length)) {
+                m_log.error() << "Received malformed packed events from "
+                              << m_remote.address() << ":" << m_remote.port() << std::endl;
+                return;
+            }
+            process_event(event, event_length);
+        }
+    } catch(MsgpackEOF&) {
+        m_log.error() << "Received truncated packed events from "
+                      << m_remote.address() << ":" << m_remote.port() << std::endl;
+    }
+}
+
+// process_event decodes an event straight onto the end of the output buffer.
+void EventLogger::process_event(const uint8_t *data, size_t length)
+{
+    if(m_use_segments) {
+        store_event(data, length);
+        return;
+    }
 
+    update_time_prefix();
+    size_t start = m_output.size();
+    m_output.append(m_time_prefix);
+    size_t body = m_output.size();
+
+    MsgpackReader reader(data, length);
     try {
-        msgpack_decode(stream, dgi);
-    } catch(DatagramIteratorEOF&) {
+        msgpack_decode(m_output, reader);
+    } catch(MsgpackEOF&) {
+        m_output.resize(start);
         m_log.error() << "Received truncated packet from "
                       << m_remote.address() << ":" << m_remote.port() << std::endl;
         return;
     }
 
-    if(dgi.tell() != dg->size()) {
+    if(reader.remaining() != 0) {
+        m_output.resize(start);
         m_log.error() << "Received packet with extraneous data from "
                       << m_remote.address() << ":" << m_remote.port() << std::endl;
         return;
     }
 
-    std::string data = stream.str();
-    m_log.trace() << "Received: " << data << std::endl;
+    if(m_log.is_enabled(LSEVERITY_TRACE)) {
+        m_log.trace() << "Received: " << m_output.substr(body) << std::endl;
+    }
 
     // This is a little bit of a kludge, but we should make sure we got a
     // MessagePack map as the event log element, and not some other type. The
     // easiest way to do this is to make sure that the JSON representation
     // begins with {
-    if(data[0] != '{') {
+    if(m_output[body] != '{') {
         m_log.error() << "Received non-map event log from "
                       << m_remote.address() << ":" << m_remote.port()
-                      << ": " << data << std::endl;
+                      << ": " << m_output.substr(body) << std::endl;
+        m_output.resize(start);
         return;
     }
 
-    // Now let's insert our timestamp:
-    time_t rawtime;
-    time(&rawtime);
+    // Now merge the event's map into the one our timestamp was started in.
+    if(m_output[body + 1] == '}') {
+        m_output.erase(body, 1);
+    } else {
+        m_output.replace(body, 1, ", ");
+    }
+    m_output.push_back('\n');
+}
 
-    char timestamp[64];
-    strftime(timestamp, 64, "{\"_time\": \"%Y-%m-%d %H:%M:%S%z\", ", localtime(&rawtime));
+// store_event checks an event and adds it, as is, to the current segment.
+void EventLogger::store_event(const uint8_t *data, size_t length)
+{
+    MsgpackReader reader(data, length);
+    try {
+        if(!msgpack_scan_event(reader, m_event_type)) {
+            m_log.error() << "Received non-map event log (or one with extraneous data) from "
+                          << m_remote.address() << ":" << m_remote.port() << std::endl;
+            return;
+        }
+    } catch(MsgpackEOF&) {
+        m_log.error() << "Received truncated packet from "
+                      << m_remote.address() << ":" << m_remote.port() << std::endl;
+        return;
+    }
 
-    *m_file.get() << timestamp << data.substr(1) << std::endl;
+    if(m_log.is_enabled(LSEVERITY_TRACE)) {
+        m_log.trace() << "Received event of type '" << m_event_type << "'" << std::endl;
+    }
+
+    uint64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          std::chrono::system_clock::now().time_since_epoch()).count();
+    m_segment->add(now_ms, m_event_type, data, length);
+}
+
+size_t EventLogger::buffered() const
+{
+    return m_use_segments ? m_segment->buffered() : m_output.size();
 }
 
 void EventLogger::start_receive()
 {
-    m_socket->async_receive_from(boost::asio::buffer(m_buffer, EVENTLOG_BUFSIZE),
-                                 m_remote, boost::bind(&EventLogger::handle_receive, this,
-                                         boost::asio::placeholders::error,
-                                         boost::asio::placeholders::bytes_transferred));
+#if BOOST_VERSION >= 106600
+    m_socket->async_wait(udp::socket::wait_read,
+                         boost::bind(&EventLogger::handle_receive, this,
+                                     boost::asio::placeholders::error));
+#else
+    m_socket->async_receive(boost::asio::null_buffers(),
+                            boost::bind(&EventLogger::handle_receive, this,
+                                        boost::asio::placeholders::error));
+#endif
 }
 
-void EventLogger::handle_receive(const boost::system::error_code &ec, std::size_t bytes)
+void EventLogger::handle_receive(const boost::system::error_code &ec)
 {
     if(ec.value()) {
-        m_log.warning() << "While receiving packet from "
-                        << m_remote.address() << ":" << m_remote.port()
-                        << ", an error occurred: "
+        m_log.warning() << "While waiting for packets, an error occurred: "
                         << ec.value() << std::endl;
         return;
     }
 
-    m_log.trace() << "Got packet from "
-                  << m_remote.address() << ":" << m_remote.port() << std::endl;
+    receive_batch();
 
-    DatagramPtr dg = Datagram::create(m_buffer, bytes);
-    process_packet(dg);
+    size_t pending = buffered();
+    if(pending >= m_flush_size || m_flush_interval == 0) {
+        flush();
+    } else if(pending > 0 && !m_flush_scheduled) {
+        m_flush_scheduled = true;
+        m_flush_timer->expires_from_now(std::chrono::milliseconds(m_flush_interval));
+        m_flush_timer->async_wait(boost::bind(&EventLogger::handle_flush, this,
+                                              boost::asio::placeholders::error));
+    }
 
     start_receive();
 }
 
+// receive_batch reads packets until the socket has none left (or we've read plenty for now).
+void EventLogger::receive_batch()
+{
+    for(unsigned int batch = 0; batch < MAX_BATCHES_PER_WAKEUP; ++batch) {
+#ifdef __linux__
+        int count = recvmmsg(m_socket->native_handle(), m_msgs.data(), EVENTLOG_BATCH,
+                             MSG_DONTWAIT, nullptr);
+        if(count < 0) {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                m_log.warning() << "While receiving packets, an error occurred: "
+                                << errno << std::endl;
+            }
+            return;
+        }
+
+        for(int i = 0; i < count; ++i) {
+            msghdr &hdr = m_msgs[i].msg_hdr;
+            memcpy(m_remote.data(), hdr.msg_name, hdr.msg_namelen);
+            m_remote.resize(hdr.msg_namelen);
+            if(m_log.is_enabled(LSEVERITY_TRACE)) {
+                m_log.trace() << "Got packet from "
+                              << m_remote.address() << ":" << m_remote.port() << std::endl;
+            }
+
+            if(hdr.msg_flags & MSG_TRUNC) {
+                m_log.error() << "Received oversized packet from "
+                              << m_remote.address() << ":" << m_remote.port() << std::endl;
+            } else {
+                process_packet(&m_buffers[i * EVENTLOG_BUFSIZE], m_msgs[i].msg_len);
+            }
+
+            // recvmmsg overwrites these; reset them for the next batch.
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_flags = 0;
+        }
+
+        if(count < EVENTLOG_BATCH) {
+            return;
+        }
+#else
+        for(unsigned int i = 0; i < EVENTLOG_BATCH; ++i) {
+            boost::system::error_code ec;
+            size_t bytes = m_socket->receive_from(boost::asio::buffer(m_buffers.data(),
+                                                  EVENTLOG_BUFSIZE), m_remote, 0, ec);
+            if(ec == boost::asio::error::would_block) {
+                return;
+            } else if(ec) {
+                m_log.warning() << "While receiving packet from "
+                                << m_remote.address() << ":" << m_remote.port()
+                                << ", an error occurred: "
+                                << ec.value() << std::endl;
+                return;
+            }
+
+            if(m_log.is_enabled(LSEVERITY_TRACE)) {
+                m_log.trace() << "Got packet from "
+                              << m_remote.address() << ":" << m_remote.port() << std::endl;
+            }
+            process_packet(m_buffers.data(), bytes);
+        }
+#endif
+    }
+}
+
+void EventLogger::flush()
+{
+    if(m_use_segments) {
+        if(!m_segment->flush()) {
+            m_log.error() << "Could not compress a block of events; they have been lost."
+                          << std::endl;
+        }
+        return;
+    }
+
+    if(!m_output.empty()) {
+        m_file->write(m_output.data(), m_output.size());
+        m_file->flush();
+        m_output.clear();
+    }
+}
+
+void EventLogger::handle_flush(const boost::system::error_code &ec)
+{
+    m_flush_scheduled = false;
+    if(ec) {
+        return;
+    }
+
+    flush();
+}
+
 static RoleFactoryItem<EventLogger> el_fact("eventlogger");
@@ -1,21 +1,40 @@
 #pragma once
+#include <ctime>
 #include <fstream>
 #include <memory>
+#include <string>
+#include <vector>
 #include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/bind.hpp>
+#ifdef __linux__
+#  include <sys/socket.h>
+#endif
 
 #include "core/global.h"
 #include "core/Role.h"
 #include "util/Datagram.h"
+#include "EventSegment.h"
 
 using boost::asio::ip::udp;
 
 // There will typically only be one Event Logger, so we can afford to make the
-// receive buffer pretty big.
+// receive buffers pretty big.
 #define EVENTLOG_BUFSIZE 8192
 
+// The number of packets received with a single call, where the platform supports it.
+#define EVENTLOG_BATCH 64
+
 // An EventLogger is a role in the daemon that opens up a local socket and reads UDP packets from
 // that socket.  Received UDP packets will be logged as configured by the daemon config file.
+//
+// A packet holds either a single event, or several packed together by an EventSender.
+// Every packet waiting on the socket is read whenever it becomes readable, and the events are
+// appended to an output buffer which is written to the log once it is large enough, or once
+// the flush interval has passed.  By default the Event Logger runs on an event loop of its own.
+//
+// Events are written either as lines of JSON, or (with the "segments" format) as compressed
+// blocks of the original MessagePack, which eventlog_reader can search and convert to JSON.
 class EventLogger final : public Role
 {
   public:
@@ -25,16 +44,52 @@ class EventLogger final : public Role
 
   private:
     LogCategory m_log;
+    boost::asio::io_service *m_service; // The loop the socket and flush timer run on.
     std::unique_ptr<udp::socket> m_socket;
     udp::endpoint m_remote;
     std::string m_file_format;
     std::unique_ptr<std::ofstream> m_file;
-    uint8_t m_buffer[EVENTLOG_BUFSIZE];
+    std::unique_ptr<EventSegmentWriter> m_segment; // Replaces m_file with the segments format.
+    bool m_use_segments;
+    SegmentCodec m_codec;
+    unsigned long m_block_size;
+    std::string m_event_type;
+
+    unsigned long m_rotate_interval; // In seconds; 0 if the log is never rotated.
+    std::unique_ptr<boost::asio::steady_timer> m_rotate_timer;
+
+    std::vector<uint8_t> m_buffers; // EVENTLOG_BATCH receive buffers of EVENTLOG_BUFSIZE.
+#ifdef __linux__
+    std::vector<mmsghdr> m_msgs;
+    std::vector<iovec> m_iovecs;
+    std::vector<sockaddr_storage> m_addrs;
+#endif
+
+    std::string m_output; // Events which have not been written to the file yet.
+    unsigned long m_flush_size;
+    unsigned long m_flush_interval;
+    std::unique_ptr<boost::asio::steady_timer> m_flush_timer;
+    bool m_flush_scheduled = false;
+
+    // The start of every event's JSON, including the current time; reformatted once a second.
+    time_t m_time_second = 0;
+    std::string m_time_prefix;
 
     void bind(const std::string &addr);
+    void set_receive_buffer(unsigned long size);
     void open_log();
     void cycle_log();
+    void schedule_rotate();
+    void handle_rotate(const boost::system::error_code &error);
     void start_receive();
-    void handle_receive(const boost::system::error_code &error, std::size_t bytes);
+    void handle_receive(const boost::system::error_code &error);
+    void receive_batch();
+    void process_packet(const uint8_t *data, size_t length);
     void process_packet(DatagramHandle dg);
+    void process_event(const uint8_t *data, size_t length);
+    void store_event(const uint8_t *data, size_t length);
+    size_t buffered() const;
+    void update_time_prefix();
+    void flush();
+    void handle_flush(const boost::system::error_code &error);
 };
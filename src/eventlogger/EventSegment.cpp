@@ -0,0 +1,519 @@
+#include "EventSegment.h"
+#include <string.h>
+#include <algorithm>
+#ifdef ASTRON_WITH_ZLIB
+#  include <zlib.h>
+#endif
+#ifdef ASTRON_WITH_LZ4
+#  include <lz4.h>
+#endif
+#ifdef ASTRON_WITH_ZSTD
+#  include <zstd.h>
+#endif
+using namespace std;
+
+static const char SEGMENT_MAGIC[] = "ASTEVSEG";
+static const char SEGMENT_END_MAGIC[] = "ASTEVEND";
+static const char BLOCK_MAGIC[] = "EBLK";
+static const char INDEX_MAGIC[] = "EIDX";
+static const uint32_t SEGMENT_VERSION = 1;
+static const size_t SEGMENT_HEADER_SIZE = 8 + 4 + 1;
+static const size_t SEGMENT_FOOTER_SIZE = 8 + 8;
+static const size_t BLOCK_FIXED_SIZE = 4 + 4 + 4 + 4 + 8 + 8 + 2;
+static const size_t RECORD_HEADER_SIZE = 8 + 4;
+
+// A block stops listing its event types once it has more than this many distinct ones.
+static const size_t MAX_BLOCK_TYPES = 64;
+
+static void put_uint16(string &out, uint16_t value)
+{
+    out.push_back(char(value));
+    out.push_back(char(value >> 8));
+}
+
+static void put_uint32(string &out, uint32_t value)
+{
+    for(int i = 0; i < 4; ++i) {
+        out.push_back(char(value >> (8 * i)));
+    }
+}
+
+static void put_uint64(string &out, uint64_t value)
+{
+    for(int i = 0; i < 8; ++i) {
+        out.push_back(char(value >> (8 * i)));
+    }
+}
+
+static uint64_t get_uint(const uint8_t *data, size_t bytes)
+{
+    uint64_t value = 0;
+    for(size_t i = 0; i < bytes; ++i) {
+        value |= uint64_t(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+// read_exactly reads length bytes from the file into out, returning false if there aren't enough.
+static bool read_exactly(FILE *file, size_t length, string &out)
+{
+    out.resize(length);
+    return length == 0 || fread(&out[0], 1, length, file) == length;
+}
+
+static uint64_t file_size(FILE *file)
+{
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    return size < 0 ? 0 : uint64_t(size);
+}
+
+// write_block_header serializes the summary of a block, as found at the start of the block.
+static void write_block_header(string &out, const SegmentBlockInfo &block)
+{
+    out.append(BLOCK_MAGIC, 4);
+    put_uint32(out, block.compressed_size);
+    put_uint32(out, block.raw_size);
+    put_uint32(out, block.events);
+    put_uint64(out, block.first_ms);
+    put_uint64(out, block.last_ms);
+    if(block.any_type) {
+        put_uint16(out, SEGMENT_ANY_TYPE);
+    } else {
+        put_uint16(out, uint16_t(block.types.size()));
+        for(const string &type : block.types) {
+            out.push_back(char(type.size()));
+            out.append(type);
+        }
+    }
+}
+
+// read_block_header reads a block header from the file's current position.
+static bool read_block_header(FILE *file, SegmentBlockInfo &block)
+{
+    string fixed;
+    if(!read_exactly(file, BLOCK_FIXED_SIZE, fixed) || fixed.compare(0, 4, BLOCK_MAGIC) != 0) {
+        return false;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(fixed.data());
+    block.compressed_size = uint32_t(get_uint(data + 4, 4));
+    block.raw_size = uint32_t(get_uint(data + 8, 4));
+    block.events = uint32_t(get_uint(data + 12, 4));
+    block.first_ms = get_uint(data + 16, 8);
+    block.last_ms = get_uint(data + 24, 8);
+    uint16_t type_count = uint16_t(get_uint(data + 32, 2));
+
+    uint64_t header_size = BLOCK_FIXED_SIZE;
+    block.types.clear();
+    block.any_type = type_count == SEGMENT_ANY_TYPE;
+    if(!block.any_type) {
+        string type;
+        for(uint16_t i = 0; i < type_count; ++i) {
+            int length = fgetc(file);
+            if(length == EOF || !read_exactly(file, length, type)) {
+                return false;
+            }
+            block.types.insert(type);
+            header_size += 1 + length;
+        }
+    }
+
+    block.data_offset = block.offset + header_size;
+    return true;
+}
+
+bool segment_codec_from_name(const string &name, SegmentCodec &codec)
+{
+    if(name == "none") {
+        codec = SEGMENT_CODEC_NONE;
+    } else if(name == "zlib") {
+        codec = SEGMENT_CODEC_ZLIB;
+    } else if(name == "lz4") {
+        codec = SEGMENT_CODEC_LZ4;
+    } else if(name == "zstd") {
+        codec = SEGMENT_CODEC_ZSTD;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool segment_codec_available(SegmentCodec codec)
+{
+    switch(codec) {
+    case SEGMENT_CODEC_NONE:
+        return true;
+#ifdef ASTRON_WITH_ZLIB
+    case SEGMENT_CODEC_ZLIB:
+        return true;
+#endif
+#ifdef ASTRON_WITH_LZ4
+    case SEGMENT_CODEC_LZ4:
+        return true;
+#endif
+#ifdef ASTRON_WITH_ZSTD
+    case SEGMENT_CODEC_ZSTD:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+SegmentCodec segment_default_codec()
+{
+    static const SegmentCodec preferred[] = {
+        SEGMENT_CODEC_ZSTD, SEGMENT_CODEC_LZ4, SEGMENT_CODEC_ZLIB
+    };
+    for(SegmentCodec codec : preferred) {
+        if(segment_codec_available(codec)) {
+            return codec;
+        }
+    }
+    return SEGMENT_CODEC_NONE;
+}
+
+static bool compress_block(SegmentCodec codec, const string &raw, string &out)
+{
+    switch(codec) {
+    case SEGMENT_CODEC_NONE:
+        out = raw;
+        return true;
+#ifdef ASTRON_WITH_ZLIB
+    case SEGMENT_CODEC_ZLIB: {
+        uLongf length = compressBound(raw.size());
+        out.resize(length);
+        int err = compress2(reinterpret_cast<Bytef*>(&out[0]), &length,
+                            reinterpret_cast<const Bytef*>(raw.data()), raw.size(), Z_BEST_SPEED);
+        out.resize(length);
+        return err == Z_OK;
+    }
+#endif
+#ifdef ASTRON_WITH_LZ4
+    case SEGMENT_CODEC_LZ4: {
+        out.resize(LZ4_compressBound(int(raw.size())));
+        int length = LZ4_compress_default(raw.data(), &out[0], int(raw.size()), int(out.size()));
+        out.resize(max(length, 0));
+        return length > 0;
+    }
+#endif
+#ifdef ASTRON_WITH_ZSTD
+    case SEGMENT_CODEC_ZSTD: {
+        out.resize(ZSTD_compressBound(raw.size()));
+        size_t length = ZSTD_compress(&out[0], out.size(), raw.data(), raw.size(), 1);
+        if(ZSTD_isError(length)) {
+            return false;
+        }
+        out.resize(length);
+        return true;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+static bool decompress_block(SegmentCodec codec, const string &compressed, size_t raw_size,
+                             string &out)
+{
+    out.resize(raw_size);
+    switch(codec) {
+    case SEGMENT_CODEC_NONE:
+        out = compressed;
+        return compressed.size() == raw_size;
+#ifdef ASTRON_WITH_ZLIB
+    case SEGMENT_CODEC_ZLIB: {
+        uLongf length = raw_size;
+        int err = uncompress(reinterpret_cast<Bytef*>(&out[0]), &length,
+                             reinterpret_cast<const Bytef*>(compressed.data()), compressed.size());
+        return err == Z_OK && length == raw_size;
+    }
+#endif
+#ifdef ASTRON_WITH_LZ4
+    case SEGMENT_CODEC_LZ4: {
+        int length = LZ4_decompress_safe(compressed.data(), &out[0], int(compressed.size()),
+                                         int(raw_size));
+        return length == int(raw_size);
+    }
+#endif
+#ifdef ASTRON_WITH_ZSTD
+    case SEGMENT_CODEC_ZSTD: {
+        size_t length = ZSTD_decompress(&out[0], raw_size, compressed.data(), compressed.size());
+        return !ZSTD_isError(length) && length == raw_size;
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+
+bool SegmentBlockInfo::may_contain(const set<string> &wanted, uint64_t from_ms,
+                                   uint64_t to_ms) const
+{
+    if(last_ms < from_ms || first_ms > to_ms) {
+        return false;
+    }
+    if(wanted.empty() || any_type) {
+        return true;
+    }
+    for(const string &type : wanted) {
+        if(types.count(type)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+EventSegmentWriter::EventSegmentWriter(const string &filename, SegmentCodec codec,
+                                       size_t block_size) :
+    m_file(fopen(filename.c_str(), "wb")), m_codec(codec), m_block_size(block_size)
+{
+    if(m_file == nullptr) {
+        return;
+    }
+
+    string header(SEGMENT_MAGIC, 8);
+    put_uint32(header, SEGMENT_VERSION);
+    header.push_back(char(m_codec));
+    write(header);
+    fflush(m_file);
+}
+
+EventSegmentWriter::~EventSegmentWriter()
+{
+    close();
+}
+
+void EventSegmentWriter::add(uint64_t time_ms, const string &type, const uint8_t *data,
+                             size_t length)
+{
+    if(m_file == nullptr) {
+        return;
+    }
+
+    put_uint64(m_raw, time_ms);
+    put_uint32(m_raw, uint32_t(length));
+    m_raw.append(reinterpret_cast<const char*>(data), length);
+
+    if(m_block.events++ == 0) {
+        m_block.first_ms = m_block.last_ms = time_ms;
+    } else {
+        m_block.first_ms = min(m_block.first_ms, time_ms);
+        m_block.last_ms = max(m_block.last_ms, time_ms);
+    }
+    if(!m_block.any_type) {
+        m_block.types.insert(type);
+        if(m_block.types.size() > MAX_BLOCK_TYPES || type.size() > 255) {
+            m_block.any_type = true;
+            m_block.types.clear();
+        }
+    }
+
+    if(m_raw.size() >= m_block_size) {
+        flush();
+    }
+}
+
+bool EventSegmentWriter::flush()
+{
+    if(m_file == nullptr || m_raw.empty()) {
+        return true;
+    }
+
+    bool compressed = compress_block(m_codec, m_raw, m_compressed);
+    if(compressed) {
+        m_block.offset = m_offset;
+        m_block.compressed_size = uint32_t(m_compressed.size());
+        m_block.raw_size = uint32_t(m_raw.size());
+
+        m_header.clear();
+        write_block_header(m_header, m_block);
+        m_block.data_offset = m_offset + m_header.size();
+        write(m_header);
+        write(m_compressed);
+        fflush(m_file);
+        m_blocks.push_back(m_block);
+    }
+
+    m_raw.clear();
+    m_block = SegmentBlockInfo();
+    return compressed;
+}
+
+void EventSegmentWriter::close()
+{
+    if(m_file == nullptr) {
+        return;
+    }
+
+    flush();
+
+    uint64_t index_offset = m_offset;
+    string index(INDEX_MAGIC, 4);
+    put_uint32(index, uint32_t(m_blocks.size()));
+    for(const SegmentBlockInfo &block : m_blocks) {
+        put_uint64(index, block.offset);
+        write_block_header(index, block);
+    }
+    put_uint64(index, index_offset);
+    index.append(SEGMENT_END_MAGIC, 8);
+    write(index);
+
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void EventSegmentWriter::write(const string &data)
+{
+    fwrite(data.data(), 1, data.size(), m_file);
+    m_offset += data.size();
+}
+
+
+EventSegmentReader::EventSegmentReader() : m_file(nullptr), m_codec(SEGMENT_CODEC_NONE),
+    m_has_index(false)
+{
+}
+
+EventSegmentReader::~EventSegmentReader()
+{
+    if(m_file != nullptr) {
+        fclose(m_file);
+    }
+}
+
+bool EventSegmentReader::open(const string &filename)
+{
+    m_file = fopen(filename.c_str(), "rb");
+    if(m_file == nullptr) {
+        m_error = "could not open file";
+        return false;
+    }
+
+    string header;
+    if(!read_exactly(m_file, SEGMENT_HEADER_SIZE, header) ||
+       header.compare(0, 8, SEGMENT_MAGIC) != 0) {
+        m_error = "not an event log segment";
+        return false;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(header.data());
+    if(get_uint(data + 8, 4) != SEGMENT_VERSION) {
+        m_error = "unsupported segment version";
+        return false;
+    }
+
+    m_codec = SegmentCodec(data[12]);
+    if(!segment_codec_available(m_codec)) {
+        m_error = "segment is compressed with a codec this build does not support";
+        return false;
+    }
+
+    // A segment which is still being written (or whose writer died) has no index yet.
+    uint64_t size = file_size(m_file);
+    m_has_index = read_index(size);
+    if(!m_has_index) {
+        m_blocks.clear();
+        return scan_blocks(size);
+    }
+    return true;
+}
+
+bool EventSegmentReader::read_index(uint64_t size)
+{
+    if(size < SEGMENT_HEADER_SIZE + SEGMENT_FOOTER_SIZE) {
+        return false;
+    }
+
+    string footer;
+    fseek(m_file, long(size - SEGMENT_FOOTER_SIZE), SEEK_SET);
+    if(!read_exactly(m_file, SEGMENT_FOOTER_SIZE, footer) ||
+       footer.compare(8, 8, SEGMENT_END_MAGIC) != 0) {
+        return false;
+    }
+
+    uint64_t index_offset = get_uint(reinterpret_cast<const uint8_t*>(footer.data()), 8);
+    string index_header;
+    fseek(m_file, long(index_offset), SEEK_SET);
+    if(index_offset >= size || !read_exactly(m_file, 8, index_header) ||
+       index_header.compare(0, 4, INDEX_MAGIC) != 0) {
+        return false;
+    }
+
+    uint32_t count = uint32_t(get_uint(reinterpret_cast<const uint8_t*>(index_header.data()) + 4,
+                                       4));
+    string offset;
+    for(uint32_t i = 0; i < count; ++i) {
+        SegmentBlockInfo block;
+        if(!read_exactly(m_file, 8, offset)) {
+            return false;
+        }
+        block.offset = get_uint(reinterpret_cast<const uint8_t*>(offset.data()), 8);
+        // The copy of the header in the index is the same size as the one before the block's
+        // data, so read_block_header works out where the data starts from it just the same.
+        if(!read_block_header(m_file, block)) {
+            return false;
+        }
+        m_blocks.push_back(block);
+    }
+    return true;
+}
+
+bool EventSegmentReader::scan_blocks(uint64_t size)
+{
+    uint64_t offset = SEGMENT_HEADER_SIZE;
+    while(offset + BLOCK_FIXED_SIZE <= size) {
+        SegmentBlockInfo block;
+        block.offset = offset;
+        fseek(m_file, long(offset), SEEK_SET);
+        if(!read_block_header(m_file, block)) {
+            break; // The index, or a header which is still being written.
+        }
+
+        uint64_t end = block.data_offset + block.compressed_size;
+        if(end > size) {
+            break; // A block which is still being written.
+        }
+
+        m_blocks.push_back(block);
+        offset = end;
+    }
+    return true;
+}
+
+bool EventSegmentReader::read_block(const SegmentBlockInfo &block, string &raw)
+{
+    string compressed;
+    fseek(m_file, long(block.data_offset), SEEK_SET);
+    if(!read_exactly(m_file, block.compressed_size, compressed)) {
+        m_error = "block is truncated";
+        return false;
+    }
+    if(!decompress_block(m_codec, compressed, block.raw_size, raw)) {
+        m_error = "block could not be decompressed";
+        return false;
+    }
+    return true;
+}
+
+
+bool next_segment_record(const string &raw, size_t &offset, SegmentRecord &record)
+{
+    if(raw.size() - offset < RECORD_HEADER_SIZE) {
+        return false;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t*>(raw.data()) + offset;
+    record.time_ms = get_uint(data, 8);
+    record.length = uint32_t(get_uint(data + 8, 4));
+    if(raw.size() - offset - RECORD_HEADER_SIZE < record.length) {
+        return false;
+    }
+
+    record.data = data + RECORD_HEADER_SIZE;
+    offset += RECORD_HEADER_SIZE + record.length;
+    return true;
+}
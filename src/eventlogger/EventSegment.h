@@ -0,0 +1,161 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <set>
+#include <string>
+#include <vector>
+
+// Event log segments are an alternative to the Event Logger's line-delimited JSON output.  A
+// segment keeps each event's original MessagePack payload, along with the time it was received,
+// in blocks which are compressed independently of each other.
+//
+// Every block begins with a header summarizing it (the time range and the event types in it),
+// so a reader looking for particular events can skip straight over the blocks which have none,
+// without decompressing them.  When a segment is closed, an index of all its block headers is
+// appended to it as well, so that they don't have to be found by walking the whole file.
+//
+// All integers are stored little-endian.
+//
+//   Segment:  "ASTEVSEG" uint32 version, uint8 codec, Block*, [Index]
+//   Block:    "EBLK" uint32 compressed_size, uint32 raw_size, uint32 events,
+//             uint64 first_ms, uint64 last_ms, uint16 type_count, (uint8 length, type)*,
+//             compressed data
+//   Raw data: (uint64 time_ms, uint32 length, MessagePack map)*
+//   Index:    "EIDX" uint32 blocks, (uint64 offset, block header)*,
+//             uint64 index_offset, "ASTEVEND"
+//
+// Times are milliseconds since the Unix epoch.  A type_count of SEGMENT_ANY_TYPE means the block
+// had too many distinct event types to list, and may contain events of any type.
+
+// A SegmentCodec is the compression used for a segment's blocks.
+enum SegmentCodec {
+    SEGMENT_CODEC_NONE = 0,
+    SEGMENT_CODEC_ZLIB = 1,
+    SEGMENT_CODEC_LZ4 = 2,
+    SEGMENT_CODEC_ZSTD = 3,
+};
+
+const uint16_t SEGMENT_ANY_TYPE = 0xFFFF;
+
+// segment_codec_from_name converts a codec name ("none", "zlib", "lz4" or "zstd") to a codec.
+bool segment_codec_from_name(const std::string &name, SegmentCodec &codec);
+
+// segment_codec_available returns true if this build can compress and decompress the codec.
+bool segment_codec_available(SegmentCodec codec);
+
+// segment_default_codec returns the best codec available in this build.
+SegmentCodec segment_default_codec();
+
+// A SegmentBlockInfo is the summary of a block held in its header.
+struct SegmentBlockInfo {
+    uint64_t offset = 0; // The position of the block header in the file.
+    uint64_t data_offset = 0; // The position of the block's compressed data in the file.
+    uint32_t compressed_size = 0;
+    uint32_t raw_size = 0;
+    uint32_t events = 0;
+    uint64_t first_ms = 0;
+    uint64_t last_ms = 0;
+    bool any_type = false;
+    std::set<std::string> types;
+
+    // may_contain returns false if the block certainly has no event matching the filter.
+    // An empty set of types matches events of every type.
+    bool may_contain(const std::set<std::string> &types, uint64_t from_ms, uint64_t to_ms) const;
+};
+
+// An EventSegmentWriter appends events to a new segment file.
+class EventSegmentWriter
+{
+  public:
+    EventSegmentWriter(const std::string &filename, SegmentCodec codec, size_t block_size);
+    ~EventSegmentWriter();
+
+    inline bool is_open() const
+    {
+        return m_file != nullptr;
+    }
+
+    // add buffers an event, compressing and writing out the current block once it's full.
+    void add(uint64_t time_ms, const std::string &type, const uint8_t *data, size_t length);
+
+    // buffered returns the number of bytes of events waiting in the current block.
+    inline size_t buffered() const
+    {
+        return m_raw.size();
+    }
+
+    // flush compresses and writes out the current block, even if it isn't full.
+    // Returns false if the block could not be compressed, in which case its events are lost.
+    bool flush();
+
+    // close flushes the current block, writes the segment's index and closes the file.
+    void close();
+
+  private:
+    FILE *m_file;
+    SegmentCodec m_codec;
+    size_t m_block_size;
+    uint64_t m_offset = 0;
+
+    std::string m_raw; // The current block's records, before compression.
+    std::string m_compressed;
+    std::string m_header;
+    SegmentBlockInfo m_block;
+    std::vector<SegmentBlockInfo> m_blocks;
+
+    void write(const std::string &data);
+};
+
+// An EventSegmentReader reads the blocks of a segment file, including one that is still being
+// written to or which was never closed properly.
+class EventSegmentReader
+{
+  public:
+    EventSegmentReader();
+    ~EventSegmentReader();
+
+    // open opens a segment, and finds its blocks from its index or by walking through its
+    // block headers.  Returns false (see get_error) if the file isn't a readable segment.
+    bool open(const std::string &filename);
+
+    inline const std::vector<SegmentBlockInfo> &blocks() const
+    {
+        return m_blocks;
+    }
+    inline SegmentCodec get_codec() const
+    {
+        return m_codec;
+    }
+    inline bool has_index() const
+    {
+        return m_has_index;
+    }
+    inline const std::string &get_error() const
+    {
+        return m_error;
+    }
+
+    // read_block decompresses a block's records into raw.
+    bool read_block(const SegmentBlockInfo &block, std::string &raw);
+
+  private:
+    FILE *m_file;
+    SegmentCodec m_codec;
+    bool m_has_index;
+    std::vector<SegmentBlockInfo> m_blocks;
+    std::string m_error;
+
+    bool read_index(uint64_t file_size);
+    bool scan_blocks(uint64_t file_size);
+};
+
+// A SegmentRecord is one event within a decompressed block.
+struct SegmentRecord {
+    uint64_t time_ms;
+    const uint8_t *data;
+    uint32_t length;
+};
+
+// next_segment_record reads the record at offset in a block's raw data, advancing offset past
+// it.  Returns false at the end of the data (or if the remainder is malformed).
+bool next_segment_record(const std::string &raw, size_t &offset, SegmentRecord &record);
@@ -1,209 +1,455 @@
-#include <iomanip>
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <string>
 
-// These are helpers for decoding MessagePack data:
-template<typename T>
-static inline T msgpack_swap(T value)
+// These are helpers for decoding MessagePack data into JSON.  The decoder reads straight from
+// a received packet and appends to a caller-provided string, so that a buffer can be reused
+// from one event to the next without any allocation.
+
+// A MsgpackEOF is thrown when the MessagePack data ends before the value being decoded does.
+struct MsgpackEOF {};
+
+// A MsgpackReader reads big-endian values from a buffer of MessagePack data.
+class MsgpackReader
 {
-    if(sizeof(value) == 1) {
-        return value;
-    } else if(sizeof(value) == 2) {
-        uint16_t *x = (uint16_t*)&value;
-        uint16_t y;
-        y = (*x & 0x00ff) << 8 |
-            (*x & 0xff00) >> 8;
-        return ((T)y);
-    } else if(sizeof(value) == 4) {
-        uint32_t *x = (uint32_t*)&value;
-        uint32_t y;
-        y = (*x & 0x000000ff) << 24 |
-            (*x & 0x0000ff00) <<  8 |
-            (*x & 0x00ff0000) >>  8 |
-            (*x & 0xff000000) >> 24;
-        return ((T)y);
-    } else if(sizeof(value) == 8) {
-        uint64_t *x = (uint64_t*)&value;
-        uint64_t y;
-        y = (*x & 0x00000000000000ff) << 56 |
-            (*x & 0x000000000000ff00) << 40 |
-            (*x & 0x0000000000ff0000) << 24 |
-            (*x & 0x00000000ff000000) <<  8 |
-            (*x & 0x000000ff00000000) >>  8 |
-            (*x & 0x0000ff0000000000) >> 24 |
-            (*x & 0x00ff000000000000) >> 40 |
-            (*x & 0xff00000000000000) >> 56;
-        return ((T)y);
+  public:
+    MsgpackReader(const uint8_t *data, size_t length) : m_data(data), m_length(length),
+        m_offset(0)
+    {
     }
-}
 
-static void msgpack_decode(std::ostream &out, DatagramIterator &dgi);
+    inline size_t tell() const
+    {
+        return m_offset;
+    }
+    inline size_t remaining() const
+    {
+        return m_length - m_offset;
+    }
+
+    inline uint8_t peek_uint8() const
+    {
+        if(remaining() == 0) {
+            throw MsgpackEOF();
+        }
+        return m_data[m_offset];
+    }
+
+    inline const uint8_t *read_bytes(size_t length)
+    {
+        if(length > remaining()) {
+            throw MsgpackEOF();
+        }
+        const uint8_t *bytes = m_data + m_offset;
+        m_offset += length;
+        return bytes;
+    }
+
+    inline uint8_t read_uint8()
+    {
+        return *read_bytes(1);
+    }
+    inline uint16_t read_uint16()
+    {
+        const uint8_t *b = read_bytes(2);
+        return uint16_t(b[0] << 8 | b[1]);
+    }
+    inline uint32_t read_uint32()
+    {
+        const uint8_t *b = read_bytes(4);
+        return uint32_t(b[0]) << 24 | uint32_t(b[1]) << 16 | uint32_t(b[2]) << 8 | b[3];
+    }
+    inline uint64_t read_uint64()
+    {
+        uint64_t hi = read_uint32();
+        return hi << 32 | read_uint32();
+    }
+
+  private:
+    const uint8_t *m_data;
+    size_t m_length;
+    size_t m_offset;
+};
+
+static inline void msgpack_append_uint(std::string &out, uint64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+    do {
+        digits[count++] = char('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    while(count > 0) {
+        out.push_back(digits[--count]);
+    }
+}
 
-static void msgpack_decode_container(std::ostream &out, DatagramIterator &dgi, int length, bool map)
+static inline void msgpack_append_int(std::string &out, int64_t value)
 {
-    if(map) {
-        out << "{";
+    if(value < 0) {
+        out.push_back('-');
+        msgpack_append_uint(out, uint64_t(0) - uint64_t(value));
     } else {
-        out << "[";
+        msgpack_append_uint(out, uint64_t(value));
     }
+}
+
+static inline void msgpack_append_float(std::string &out, double value)
+{
+    char text[32];
+    int length = snprintf(text, sizeof(text), "%g", value);
+    out.append(text, length);
+}
+
+static inline void msgpack_decode(std::string &out, MsgpackReader &in);
+
+static inline void msgpack_decode_container(std::string &out, MsgpackReader &in, uint32_t length,
+                                            bool map)
+{
+    out.push_back(map ? '{' : '[');
 
-    for(int i = 0; i < length; ++i) {
+    for(uint32_t i = 0; i < length; ++i) {
         if(i != 0) {
-            out << ", ";
+            out.append(", ");
         }
 
         if(map) {
-            msgpack_decode(out, dgi);
-            out << ": ";
+            msgpack_decode(out, in);
+            out.append(": ");
         }
 
-        msgpack_decode(out, dgi);
+        msgpack_decode(out, in);
     }
 
-    if(map) {
-        out << "}";
-    } else {
-        out << "]";
-    }
+    out.push_back(map ? '}' : ']');
 }
 
-static char json_escapes[32] = {
+static const char json_escapes[32] = {
     0, 0, 0, 0, 0, 0, 0, 0, 'b', 't', 'n', 'v', 'f', 'r', 0, 0,
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
 };
 
-static void msgpack_decode_string(std::ostream &out, DatagramIterator &dgi, int length)
+static inline void msgpack_decode_string(std::string &out, MsgpackReader &in, uint32_t length)
 {
-    out << '"';
+    static const char hex_digits[] = "0123456789abcdef";
+
+    const uint8_t *bytes = in.read_bytes(length);
+    out.reserve(out.size() + length + 2);
+    out.push_back('"');
 
-    for(int i = 0; i < length; ++i) {
-        unsigned char output = dgi.read_uint8();
+    for(uint32_t i = 0; i < length; ++i) {
+        unsigned char output = bytes[i];
         if(output < 0x20) {
             if(json_escapes[output]) {
-                out << '\\' << json_escapes[output];
+                out.push_back('\\');
+                out.push_back(json_escapes[output]);
                 continue;
             }
         } else if(output == '"') {
-            out << "\\\"";
+            out.append("\\\"");
             continue;
         } else if(output == '\\') {
-            out << "\\\\";
+            out.append("\\\\");
             continue;
         } else if(output < 0x7F) {
-            out << output;
+            out.push_back(char(output));
             continue;
         }
 
         // If we got here, we have to escape it:
-        out << "\\x" << std::hex << std::setw(2) << std::setfill('0') << (int)output;
+        out.append("\\x");
+        out.push_back(hex_digits[output >> 4]);
+        out.push_back(hex_digits[output & 0xf]);
     }
 
-    out << '"';
+    out.push_back('"');
 }
 
-static void msgpack_decode_ext(std::ostream &out, DatagramIterator &dgi, int length)
+static inline void msgpack_decode_ext(std::string &out, MsgpackReader &in, uint32_t length)
 {
-    out << "ext(" << dgi.read_uint8() << ", ";
-    msgpack_decode_string(out, dgi, length);
-    out << ")";
+    out.append("ext(");
+    msgpack_append_int(out, int8_t(in.read_uint8()));
+    out.append(", ");
+    msgpack_decode_string(out, in, length);
+    out.push_back(')');
 }
 
-static void msgpack_decode(std::ostream &out, DatagramIterator &dgi)
+static inline void msgpack_decode(std::string &out, MsgpackReader &in)
 {
-    uint8_t msg = dgi.read_uint8();
+    uint8_t msg = in.read_uint8();
     if(msg < 0x80) {
         // fixint8
-        out << (int)msg;
+        msgpack_append_uint(out, msg);
     } else if(msg <= 0x8f) {
         // fixmap
-        msgpack_decode_container(out, dgi, msg - 0x80, true);
+        msgpack_decode_container(out, in, msg - 0x80, true);
     } else if(msg <= 0x9f) {
         // fixarray
-        msgpack_decode_container(out, dgi, msg - 0x90, false);
+        msgpack_decode_container(out, in, msg - 0x90, false);
     } else if(msg <= 0xbf) {
         // fixstr
-        msgpack_decode_string(out, dgi, msg - 0xa0);
+        msgpack_decode_string(out, in, msg - 0xa0);
     } else if(msg == 0xc0) {
-        out << "null";
+        out.append("null");
     } else if(msg == 0xc1) {
-        out << "*INVALID*";
+        out.append("*INVALID*");
     } else if(msg == 0xc2) {
-        out << "false";
+        out.append("false");
     } else if(msg == 0xc3) {
-        out << "true";
+        out.append("true");
     } else if(msg == 0xc4) {
         // bin8
-        msgpack_decode_string(out, dgi, dgi.read_uint8());
+        msgpack_decode_string(out, in, in.read_uint8());
     } else if(msg == 0xc5) {
         // bin16
-        msgpack_decode_string(out, dgi, msgpack_swap(dgi.read_uint16()));
+        msgpack_decode_string(out, in, in.read_uint16());
     } else if(msg == 0xc6) {
         // bin32
-        msgpack_decode_string(out, dgi, msgpack_swap(dgi.read_uint32()));
+        msgpack_decode_string(out, in, in.read_uint32());
     } else if(msg == 0xc7) {
         // ext8
-        msgpack_decode_ext(out, dgi, dgi.read_uint8());
+        msgpack_decode_ext(out, in, in.read_uint8());
     } else if(msg == 0xc8) {
         // ext16
-        msgpack_decode_ext(out, dgi, msgpack_swap(dgi.read_uint16()));
+        msgpack_decode_ext(out, in, in.read_uint16());
     } else if(msg == 0xc9) {
         // ext32
-        msgpack_decode_ext(out, dgi, msgpack_swap(dgi.read_uint32()));
+        msgpack_decode_ext(out, in, in.read_uint32());
     } else if(msg == 0xca) {
         // float32
-        out << msgpack_swap(dgi.read_float32());
+        uint32_t bits = in.read_uint32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        msgpack_append_float(out, value);
     } else if(msg == 0xcb) {
         // float64
-        out << msgpack_swap(dgi.read_float64());
+        uint64_t bits = in.read_uint64();
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        msgpack_append_float(out, value);
     } else if(msg == 0xcc) {
         // uint8
-        out << dgi.read_uint8();
+        msgpack_append_uint(out, in.read_uint8());
     } else if(msg == 0xcd) {
         // uint16
-        out << msgpack_swap(dgi.read_uint16());
+        msgpack_append_uint(out, in.read_uint16());
     } else if(msg == 0xce) {
         // uint32
-        out << msgpack_swap(dgi.read_uint32());
+        msgpack_append_uint(out, in.read_uint32());
     } else if(msg == 0xcf) {
         // uint64
-        out << msgpack_swap(dgi.read_uint64());
+        msgpack_append_uint(out, in.read_uint64());
     } else if(msg == 0xd0) {
         // int8
-        out << dgi.read_int8();
+        msgpack_append_int(out, int8_t(in.read_uint8()));
     } else if(msg == 0xd1) {
         // int16
-        out << msgpack_swap(dgi.read_int16());
+        msgpack_append_int(out, int16_t(in.read_uint16()));
     } else if(msg == 0xd2) {
         // int32
-        out << msgpack_swap(dgi.read_int32());
+        msgpack_append_int(out, int32_t(in.read_uint32()));
     } else if(msg == 0xd3) {
         // int64
-        out << msgpack_swap(dgi.read_int64());
+        msgpack_append_int(out, int64_t(in.read_uint64()));
     } else if(msg <= 0xd8) {
         // fixext
-        msgpack_decode_ext(out, dgi, 1 << (msg - 0xd4));
+        msgpack_decode_ext(out, in, 1 << (msg - 0xd4));
     } else if(msg == 0xd9) {
         // str8
-        msgpack_decode_string(out, dgi, dgi.read_uint8());
+        msgpack_decode_string(out, in, in.read_uint8());
     } else if(msg == 0xda) {
         // str16
-        msgpack_decode_string(out, dgi, msgpack_swap(dgi.read_uint16()));
+        msgpack_decode_string(out, in, in.read_uint16());
     } else if(msg == 0xdb) {
         // str32
-        msgpack_decode_string(out, dgi, msgpack_swap(dgi.read_uint32()));
+        msgpack_decode_string(out, in, in.read_uint32());
     } else if(msg == 0xdc) {
         // array16
-        msgpack_decode_container(out, dgi, msgpack_swap(dgi.read_uint16()), false);
+        msgpack_decode_container(out, in, in.read_uint16(), false);
     } else if(msg == 0xdd) {
         // array32
-        msgpack_decode_container(out, dgi, msgpack_swap(dgi.read_uint32()), false);
+        msgpack_decode_container(out, in, in.read_uint32(), false);
     } else if(msg == 0xde) {
         // map16
-        msgpack_decode_container(out, dgi, msgpack_swap(dgi.read_uint16()), true);
+        msgpack_decode_container(out, in, in.read_uint16(), true);
     } else if(msg == 0xdf) {
         // map32
-        msgpack_decode_container(out, dgi, msgpack_swap(dgi.read_uint32()), true);
+        msgpack_decode_container(out, in, in.read_uint32(), true);
     } else {
         // Everything >=0xe0 is a negative fixint.
-        int8_t value = (int8_t)msg;
-        out << (int)value;
+        msgpack_append_int(out, int8_t(msg));
+    }
+}
+
+// msgpack_skip skips over the next value, including everything inside of it if it is a container.
+static inline void msgpack_skip(MsgpackReader &in)
+{
+    // Containers just add their elements to the number of values left to skip; this avoids
+    // recursing as deep as the nesting of a (possibly hostile) packet.
+    uint64_t pending = 1;
+    while(pending > 0) {
+        --pending;
+        uint8_t msg = in.read_uint8();
+        if(msg < 0x80 || msg >= 0xe0 || (msg >= 0xc0 && msg <= 0xc3)) {
+            // fixint, nil, (never used), false, true
+        } else if(msg <= 0x8f) {
+            pending += 2 * uint64_t(msg - 0x80);
+        } else if(msg <= 0x9f) {
+            pending += msg - 0x90;
+        } else if(msg <= 0xbf) {
+            in.read_bytes(msg - 0xa0);
+        } else if(msg == 0xc4 || msg == 0xd9) {
+            in.read_bytes(in.read_uint8());
+        } else if(msg == 0xc5 || msg == 0xda) {
+            in.read_bytes(in.read_uint16());
+        } else if(msg == 0xc6 || msg == 0xdb) {
+            in.read_bytes(in.read_uint32());
+        } else if(msg == 0xc7) {
+            in.read_bytes(size_t(in.read_uint8()) + 1);
+        } else if(msg == 0xc8) {
+            in.read_bytes(size_t(in.read_uint16()) + 1);
+        } else if(msg == 0xc9) {
+            in.read_bytes(size_t(in.read_uint32()) + 1);
+        } else if(msg == 0xca || msg == 0xce || msg == 0xd2) {
+            in.read_bytes(4);
+        } else if(msg == 0xcb || msg == 0xcf || msg == 0xd3) {
+            in.read_bytes(8);
+        } else if(msg == 0xcc || msg == 0xd0) {
+            in.read_bytes(1);
+        } else if(msg == 0xcd || msg == 0xd1) {
+            in.read_bytes(2);
+        } else if(msg <= 0xd8) {
+            // fixext
+            in.read_bytes(1 + (size_t(1) << (msg - 0xd4)));
+        } else if(msg == 0xdc) {
+            pending += in.read_uint16();
+        } else if(msg == 0xdd) {
+            pending += in.read_uint32();
+        } else if(msg == 0xde) {
+            pending += 2 * uint64_t(in.read_uint16());
+        } else {
+            // map32
+            pending += 2 * uint64_t(in.read_uint32());
+        }
+    }
+}
+
+// msgpack_read_map_header reads the header of a map, returning false (and reading nothing)
+// if the next value is not a map.
+static inline bool msgpack_read_map_header(MsgpackReader &in, uint32_t &length)
+{
+    uint8_t msg = in.peek_uint8();
+    if(msg >= 0x80 && msg <= 0x8f) {
+        in.read_uint8();
+        length = msg - 0x80;
+    } else if(msg == 0xde) {
+        in.read_uint8();
+        length = in.read_uint16();
+    } else if(msg == 0xdf) {
+        in.read_uint8();
+        length = in.read_uint32();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// msgpack_read_array_header reads the header of an array, returning false (and reading nothing)
+// if the next value is not an array.
+static inline bool msgpack_read_array_header(MsgpackReader &in, uint32_t &length)
+{
+    uint8_t msg = in.peek_uint8();
+    if(msg >= 0x90 && msg <= 0x9f) {
+        in.read_uint8();
+        length = msg - 0x90;
+    } else if(msg == 0xdc) {
+        in.read_uint8();
+        length = in.read_uint16();
+    } else if(msg == 0xdd) {
+        in.read_uint8();
+        length = in.read_uint32();
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// msgpack_read_bin reads a bin value, returning false (and reading nothing) if the next value
+// is not a bin.
+static inline bool msgpack_read_bin(MsgpackReader &in, const uint8_t *&data, uint32_t &length)
+{
+    uint8_t msg = in.peek_uint8();
+    if(msg == 0xc4) {
+        in.read_uint8();
+        length = in.read_uint8();
+    } else if(msg == 0xc5) {
+        in.read_uint8();
+        length = in.read_uint16();
+    } else if(msg == 0xc6) {
+        in.read_uint8();
+        length = in.read_uint32();
+    } else {
+        return false;
+    }
+    data = in.read_bytes(length);
+    return true;
+}
+
+// msgpack_read_str reads a string, returning false (and reading nothing) if the next value
+// is not a string.
+static inline bool msgpack_read_str(MsgpackReader &in, const uint8_t *&data, uint32_t &length)
+{
+    uint8_t msg = in.peek_uint8();
+    if(msg >= 0xa0 && msg <= 0xbf) {
+        in.read_uint8();
+        length = msg - 0xa0;
+    } else if(msg == 0xd9) {
+        in.read_uint8();
+        length = in.read_uint8();
+    } else if(msg == 0xda) {
+        in.read_uint8();
+        length = in.read_uint16();
+    } else if(msg == 0xdb) {
+        in.read_uint8();
+        length = in.read_uint32();
+    } else {
+        return false;
     }
+    data = in.read_bytes(length);
+    return true;
+}
+
+// msgpack_scan_event checks that the data is exactly one MessagePack map, as every event
+// must be, and finds the value of its "type" field (if it has one that is a string).
+// Throws MsgpackEOF if the data is truncated; returns false if it is otherwise unacceptable.
+static inline bool msgpack_scan_event(MsgpackReader &in, std::string &type)
+{
+    uint32_t length;
+    if(!msgpack_read_map_header(in, length)) {
+        return false;
+    }
+
+    type.clear();
+    for(uint32_t i = 0; i < length; ++i) {
+        const uint8_t *key;
+        uint32_t key_length;
+        bool is_type = false;
+        if(msgpack_read_str(in, key, key_length)) {
+            is_type = key_length == 4 && memcmp(key, "type", 4) == 0;
+        } else {
+            msgpack_skip(in); // A key which isn't a string.
+        }
+
+        const uint8_t *value;
+        uint32_t value_length;
+        if(is_type && msgpack_read_str(in, value, value_length)) {
+            type.assign(reinterpret_cast<const char*>(value), value_length);
+        } else {
+            msgpack_skip(in);
+        }
+    }
+
+    return in.remaining() == 0;
 }
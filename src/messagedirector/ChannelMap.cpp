@@ -202,3 +202,21 @@ void ChannelMap::lookup_channels(const std::list<channel_t> &cl, std::unordered_
         }
     }
 }
+
+void ChannelMap::get_subscriptions(std::vector<channel_t> &channels,
+                                   boost::icl::interval_set<channel_t> &ranges)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_lock);
+
+    for(const auto &it : m_channel_subscriptions) {
+        if(!it.second.empty()) {
+            channels.push_back(it.first);
+        }
+    }
+
+    for(const auto &it : m_range_subscriptions) {
+        if(!it.second.empty()) {
+            ranges += it.first;
+        }
+    }
+}
@@ -3,6 +3,7 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <mutex>
+#include <vector>
 #include "core/types.h"
 #include <boost/icl/interval_map.hpp>
 
@@ -74,13 +75,24 @@ class ChannelMap
 
     virtual void on_remove_range(channel_t, channel_t) { }
 
+    // get_subscriptions collects every channel and range that anything is subscribed to.
+    void get_subscriptions(std::vector<channel_t> &channels,
+                           boost::icl::interval_set<channel_t> &ranges);
+
+    // lock_subscriptions holds off any change to the subscriptions, and the on_add/on_remove
+    // calls they make, until the returned lock is released.
+    inline std::unique_lock<std::recursive_mutex> lock_subscriptions()
+    {
+        return std::unique_lock<std::recursive_mutex>(m_lock);
+    }
+
   private:
+    // In order to make this object thread-safe...
+    std::recursive_mutex m_lock;
+
     // Single channel subscriptions
     std::unordered_map<channel_t, std::unordered_set<ChannelSubscriber *> > m_channel_subscriptions;
 
     // Range channel subscriptions
     boost::icl::interval_map<channel_t, std::unordered_set<ChannelSubscriber *> > m_range_subscriptions;
-
-    // In order to make this object thread-safe...
-    std::recursive_mutex m_lock;
 };
@@ -1,15 +1,36 @@
 #include "MDNetworkParticipant.h"
 #include "core/global.h"
 #include "core/msgtypes.h"
+#include <sstream>
 #include <boost/bind.hpp>
 
 MDNetworkParticipant::MDNetworkParticipant(boost::asio::ip::tcp::socket *socket)
-    : MDParticipantInterface(), m_client(std::make_shared<NetworkClient>(this))
+    : MDParticipantInterface()
 {
     set_con_name("Network Participant");
 
-    m_client->initialize(socket);
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::endpoint endpoint = socket->remote_endpoint(ec);
+    std::stringstream remote;
+    remote << endpoint.address() << ":" << endpoint.port();
+    m_remote = remote.str();
+
+    auto client = std::make_shared<NetworkClient>(this);
+    m_client = client;
+    client->initialize(socket);
+}
+
+#ifdef __linux__
+MDNetworkParticipant::MDNetworkParticipant(const ShmLink &link) : MDParticipantInterface()
+{
+    set_con_name("Shared Memory Participant");
+
+    auto client = std::make_shared<ShmClient>(this);
+    m_remote = "shared memory";
+    m_client = client;
+    client->initialize(link);
 }
+#endif
 
 MDNetworkParticipant::~MDNetworkParticipant()
 {
@@ -43,6 +64,20 @@ void MDNetworkParticipant::receive_datagram(DatagramHandle dg)
             unsubscribe_channel(dgi.read_channel());
             break;
         }
+        case CONTROL_ADD_CHANNELS: {
+            uint16_t count = dgi.read_uint16();
+            for(uint16_t i = 0; i < count; ++i) {
+                subscribe_channel(dgi.read_channel());
+            }
+            break;
+        }
+        case CONTROL_REMOVE_CHANNELS: {
+            uint16_t count = dgi.read_uint16();
+            for(uint16_t i = 0; i < count; ++i) {
+                unsubscribe_channel(dgi.read_channel());
+            }
+            break;
+        }
         case CONTROL_ADD_RANGE: {
             channel_t lo = dgi.read_channel();
             channel_t hi = dgi.read_channel();
@@ -76,6 +111,11 @@ void MDNetworkParticipant::receive_datagram(DatagramHandle dg)
             log_message(dgi.read_blob());
             break;
         }
+        case CONTROL_SET_LOG_LEVEL: {
+            std::string category = dgi.read_string();
+            set_log_level(category, dgi.read_string());
+            break;
+        }
         default:
             logger().error() << "MDNetworkParticipant got unknown control message, type : "
                              << msg_type << std::endl;
@@ -87,9 +127,6 @@ void MDNetworkParticipant::receive_datagram(DatagramHandle dg)
 
 void MDNetworkParticipant::receive_disconnect(const boost::system::error_code &ec)
 {
-    logger().info() << "Lost connection from "
-                    << m_client->get_remote().address() << ":"
-                    << m_client->get_remote().port() << ": "
-                    << ec.message() << std::endl;
+    logger().info() << "Lost connection from " << m_remote << ": " << ec.message() << std::endl;
     terminate();
 }
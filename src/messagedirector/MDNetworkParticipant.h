@@ -1,16 +1,24 @@
 #pragma once
 #include "MessageDirector.h"
 #include "net/NetworkClient.h"
+#ifdef __linux__
+#include "net/ShmClient.h"
+#endif
 
+// An MDNetworkParticipant is a downstream MD, connected to us over TCP or shared memory.
 class MDNetworkParticipant : public MDParticipantInterface, public NetworkHandler
 {
   public:
     MDNetworkParticipant(boost::asio::ip::tcp::socket *socket);
+#ifdef __linux__
+    MDNetworkParticipant(const ShmLink &link);
+#endif
     ~MDNetworkParticipant();
     virtual void handle_datagram(DatagramHandle dg, DatagramIterator &dgi);
   private:
     virtual void receive_datagram(DatagramHandle dg);
     virtual void receive_disconnect(const boost::system::error_code &ec);
 
-    std::shared_ptr<NetworkClient> m_client;
+    std::shared_ptr<DatagramConnection> m_client;
+    std::string m_remote; // Who's on the other end, for the logs.
 };
@@ -1,62 +1,147 @@
 #include "MDNetworkUpstream.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
 #include "MessageDirector.h"
 #include "net/NetworkConnector.h"
+#ifdef __linux__
+#include "net/ShmConnector.h"
+#endif
 #include "core/global.h"
 #include "core/msgtypes.h"
 
 using boost::asio::ip::tcp;
 
+// An upstream address with this prefix names a co-located MD to link to over shared memory.
+static const std::string SHM_PREFIX = "shm://";
+
+// The most channels sent in one CONTROL_ADD_CHANNELS/CONTROL_REMOVE_CHANNELS,
+// which keeps each message well within DGSIZE_MAX.
+static const size_t MAX_CHANNELS_PER_MESSAGE = 4096;
+
+typedef boost::icl::discrete_interval<channel_t> interval_t;
+
+static void get_closed_bounds(const interval_t &interval, channel_t &lower, channel_t &upper)
+{
+    lower = interval.lower();
+    upper = interval.upper();
+
+    if(!(interval.bounds().bits() & 2)) {
+        lower += 1;
+    }
+    if(!(interval.bounds().bits() & 1)) {
+        upper -= 1;
+    }
+}
+
 MDNetworkUpstream::MDNetworkUpstream(MessageDirector *md) :
-    m_message_director(md), m_client(std::make_shared<NetworkClient>(this))
+    m_message_director(md), m_flush_scheduled(false), m_merge_min_channels(0), m_merge_max_gap(1)
 {
 
 }
 
+void MDNetworkUpstream::set_merging(unsigned int min_channels, double density)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_merge_min_channels = min_channels;
+    // Neighbours at most 1/density apart keep a run at least that dense.
+    m_merge_max_gap = std::max(channel_t(1), channel_t(1.0 / density));
+}
+
 boost::system::error_code MDNetworkUpstream::connect(const std::string &address)
 {
-    NetworkConnector connector(io_service);
     boost::system::error_code ec;
+
+    if(address.compare(0, SHM_PREFIX.size(), SHM_PREFIX) == 0) {
+#ifdef __linux__
+        ShmConnector connector(io_service);
+        ShmLink link;
+        if(connector.connect(address.substr(SHM_PREFIX.size()), link, ec)) {
+            auto client = std::make_shared<ShmClient>(this);
+            client->initialize(link);
+            m_client = client;
+        }
+#else
+        // The config rejects these; shared memory links are only supported on Linux.
+        ec = boost::system::errc::make_error_code(boost::system::errc::not_supported);
+#endif
+        return ec;
+    }
+
+    NetworkConnector connector(io_service);
     tcp::socket *socket = connector.connect(address, 7199, ec);
 
     if(socket) {
-        m_client->initialize(socket);
+        initialize(socket);
     }
 
     return ec;
 }
 
+void MDNetworkUpstream::initialize(tcp::socket *socket)
+{
+    auto client = std::make_shared<NetworkClient>(this);
+    client->initialize(socket);
+    m_client = client;
+}
+
 void MDNetworkUpstream::subscribe_channel(channel_t c)
 {
-    DatagramPtr dg = Datagram::create(CONTROL_ADD_CHANNEL);
-    dg->add_channel(c);
-    m_client->send_datagram(dg);
+    change_subscription(c, 1);
 }
 
 void MDNetworkUpstream::unsubscribe_channel(channel_t c)
 {
-    DatagramPtr dg = Datagram::create(CONTROL_REMOVE_CHANNEL);
-    dg->add_channel(c);
-    m_client->send_datagram(dg);
+    change_subscription(c, -1);
 }
 
 void MDNetworkUpstream::subscribe_range(channel_t lo, channel_t hi)
 {
+    std::lock_guard<std::mutex> lock(m_lock);
+    send_pending();
+
     DatagramPtr dg = Datagram::create(CONTROL_ADD_RANGE);
     dg->add_channel(lo);
     dg->add_channel(hi);
     m_client->send_datagram(dg);
+
+    if(m_merge_min_channels) {
+        m_ranges += interval_t::closed(lo, hi);
+    }
 }
 
 void MDNetworkUpstream::unsubscribe_range(channel_t lo, channel_t hi)
 {
+    std::lock_guard<std::mutex> lock(m_lock);
+    send_pending();
+
     DatagramPtr dg = Datagram::create(CONTROL_REMOVE_RANGE);
     dg->add_channel(lo);
     dg->add_channel(hi);
     m_client->send_datagram(dg);
+
+    if(m_merge_min_channels) {
+        // The upstream MD drops everything we held inside the range along with it,
+        // so any channels still subscribed there have to be subscribed again.
+        interval_t range = interval_t::closed(lo, hi);
+        m_ranges -= range;
+        m_upstream_blocks -= range;
+        m_upstream_channels.erase(m_upstream_channels.lower_bound(lo),
+                                  m_upstream_channels.upper_bound(hi));
+        m_dirty_channels.insert(m_channels.lower_bound(lo), m_channels.upper_bound(hi));
+        if(!m_dirty_channels.empty() && !m_flush_scheduled) {
+            m_flush_scheduled = true;
+            io_service.post(std::bind(&MDNetworkUpstream::flush_subscriptions,
+                                      shared_from_this()));
+        }
+    }
 }
 
 void MDNetworkUpstream::handle_datagram(DatagramHandle dg)
 {
+    if(m_flush_scheduled) {
+        flush_subscriptions();
+    }
     m_client->send_datagram(dg);
 }
 
@@ -67,5 +152,226 @@ void MDNetworkUpstream::receive_datagram(DatagramHandle dg)
 
 void MDNetworkUpstream::receive_disconnect(const boost::system::error_code &ec)
 {
-    m_message_director->receive_disconnect(ec);
+    m_message_director->receive_disconnect(this, ec);
+}
+
+void MDNetworkUpstream::change_subscription(channel_t c, int change)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if(m_merge_min_channels) {
+        if(change > 0) {
+            m_channels.insert(c);
+        } else {
+            m_channels.erase(c);
+        }
+        m_dirty_channels.insert(c);
+    } else {
+        int &pending = m_pending_channels[c];
+        pending += change;
+        if(pending == 0) {
+            m_pending_channels.erase(c);
+        }
+    }
+
+    if(!m_flush_scheduled) {
+        m_flush_scheduled = true;
+        io_service.post(std::bind(&MDNetworkUpstream::flush_subscriptions,
+                                  shared_from_this()));
+    }
+}
+
+void MDNetworkUpstream::flush_subscriptions()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    send_pending();
+}
+
+void MDNetworkUpstream::send_pending()
+{
+    m_flush_scheduled = false;
+    if(m_merge_min_channels) {
+        send_merged();
+        return;
+    }
+    if(m_pending_channels.empty()) {
+        return;
+    }
+
+    std::vector<channel_t> adds, removes;
+    for(const auto &it : m_pending_channels) {
+        if(it.second > 0) {
+            adds.push_back(it.first);
+        } else {
+            removes.push_back(it.first);
+        }
+    }
+    m_pending_channels.clear();
+
+    send_channels(CONTROL_REMOVE_CHANNEL, CONTROL_REMOVE_CHANNELS, removes);
+    send_channels(CONTROL_ADD_CHANNEL, CONTROL_ADD_CHANNELS, adds);
+}
+
+// send_channels sends a lone channel in the single-channel message (which any upstream
+// understands), and anything more in as few bulk messages as will hold them.
+void MDNetworkUpstream::send_channels(uint16_t single_type, uint16_t bulk_type,
+                                      const std::vector<channel_t> &channels)
+{
+    if(channels.size() == 1) {
+        DatagramPtr dg = Datagram::create(single_type);
+        dg->add_channel(channels[0]);
+        m_client->send_datagram(dg);
+        return;
+    }
+
+    for(size_t i = 0; i < channels.size(); i += MAX_CHANNELS_PER_MESSAGE) {
+        size_t count = std::min(channels.size() - i, MAX_CHANNELS_PER_MESSAGE);
+
+        DatagramPtr dg = Datagram::create(bulk_type);
+        dg->add_uint16(count);
+        for(size_t j = i; j < i + count; ++j) {
+            dg->add_channel(channels[j]);
+        }
+        m_client->send_datagram(dg);
+    }
+}
+
+// send_merged brings what we hold upstream into line with the channels changed since
+// the last flush.  New ranges and channels are subscribed before the ones they replace
+// are unsubscribed, so there's never a moment where a subscribed channel isn't covered.
+void MDNetworkUpstream::send_merged()
+{
+    boost::icl::interval_set<channel_t> add_ranges, remove_ranges, done;
+    std::vector<channel_t> adds, removes;
+
+    for(channel_t c : m_dirty_channels) {
+        if(boost::icl::contains(done, c)) {
+            continue;
+        }
+
+        channel_t lo, hi;
+        merged_span(c, lo, hi);
+        remerge(lo, hi, add_ranges, remove_ranges, adds, removes);
+        done += interval_t::closed(lo, hi);
+    }
+    m_dirty_channels.clear();
+
+    channel_t lo, hi;
+    for(const auto &range : add_ranges) {
+        get_closed_bounds(range, lo, hi);
+        DatagramPtr dg = Datagram::create(CONTROL_ADD_RANGE);
+        dg->add_channel(lo);
+        dg->add_channel(hi);
+        m_client->send_datagram(dg);
+    }
+    std::sort(adds.begin(), adds.end());
+    send_channels(CONTROL_ADD_CHANNEL, CONTROL_ADD_CHANNELS, adds);
+    std::sort(removes.begin(), removes.end());
+    send_channels(CONTROL_REMOVE_CHANNEL, CONTROL_REMOVE_CHANNELS, removes);
+    for(const auto &range : remove_ranges) {
+        get_closed_bounds(range, lo, hi);
+        DatagramPtr dg = Datagram::create(CONTROL_REMOVE_RANGE);
+        dg->add_channel(lo);
+        dg->add_channel(hi);
+        m_client->send_datagram(dg);
+    }
+}
+
+// merged_span finds the stretch of channels around c whose upstream subscriptions may
+// have to change along with c: every range we hold that overlaps it, and every channel
+// close enough to those at its ends to be merged with them.
+void MDNetworkUpstream::merged_span(channel_t c, channel_t &lo, channel_t &hi)
+{
+    lo = hi = c;
+
+    bool grown = true;
+    while(grown) {
+        grown = false;
+
+        auto blocks = m_upstream_blocks.equal_range(interval_t::closed(lo, hi));
+        for(auto it = blocks.first; it != blocks.second; ++it) {
+            channel_t first, last;
+            get_closed_bounds(*it, first, last);
+            if(first < lo) {
+                lo = first;
+                grown = true;
+            }
+            if(last > hi) {
+                hi = last;
+                grown = true;
+            }
+        }
+
+        auto below = m_channels.lower_bound(lo);
+        while(below != m_channels.begin() && lo - *std::prev(below) <= m_merge_max_gap) {
+            lo = *--below;
+            grown = true;
+        }
+        auto above = m_channels.upper_bound(hi);
+        while(above != m_channels.end() && *above - hi <= m_merge_max_gap) {
+            hi = *above++;
+            grown = true;
+        }
+    }
+}
+
+// remerge works out how the channels in [lo, hi] should be held upstream, and what has
+// to be sent to get there from what we hold now.
+void MDNetworkUpstream::remerge(channel_t lo, channel_t hi,
+                                boost::icl::interval_set<channel_t> &add_ranges,
+                                boost::icl::interval_set<channel_t> &remove_ranges,
+                                std::vector<channel_t> &adds, std::vector<channel_t> &removes)
+{
+    interval_t span = interval_t::closed(lo, hi);
+    boost::icl::interval_set<channel_t> held;
+    boost::icl::add_intersection(held, m_upstream_blocks, span);
+
+    // Runs big enough to merge become ranges.  The channels of smaller runs stay on
+    // their own, except those already covered by a range we hold; their piece of it
+    // is kept rather than dropped and subscribed again.
+    boost::icl::interval_set<channel_t> blocks;
+    std::vector<channel_t> singles;
+    auto end = m_channels.upper_bound(hi);
+    for(auto it = m_channels.lower_bound(lo); it != end;) {
+        auto first = it, last = it;
+        size_t count = 1;
+        for(++it; it != end && *it - *last <= m_merge_max_gap; ++it) {
+            last = it;
+            ++count;
+        }
+
+        if(count >= m_merge_min_channels) {
+            blocks += interval_t::closed(*first, *last);
+            continue;
+        }
+        for(auto c = first; c != it; ++c) {
+            if(boost::icl::contains(held, *c)) {
+                blocks += interval_t::closed(*c, *c);
+            } else {
+                singles.push_back(*c);
+            }
+        }
+    }
+
+    add_ranges += blocks - held;
+    remove_ranges += (held - blocks) - m_ranges;
+    m_upstream_blocks -= span;
+    m_upstream_blocks += blocks;
+
+    // The channels we hold on their own are the ones left over.
+    auto up_first = m_upstream_channels.lower_bound(lo);
+    auto up_end = m_upstream_channels.upper_bound(hi);
+    for(auto it = up_first; it != up_end;) {
+        if(!std::binary_search(singles.begin(), singles.end(), *it)) {
+            removes.push_back(*it);
+            it = m_upstream_channels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for(channel_t c : singles) {
+        if(m_upstream_channels.insert(c).second) {
+            adds.push_back(c);
+        }
+    }
 }
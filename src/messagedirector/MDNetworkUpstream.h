@@ -1,18 +1,56 @@
 #pragma once
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
 #include "MessageDirector.h"
 #include "net/NetworkClient.h"
+#ifdef __linux__
+#include "net/ShmClient.h"
+#endif
 #include <boost/asio.hpp>
 
-// All MDUpstreams must be thread-safe. This class does not need a lock, however,
-// because all of its operations are based on local variables and the functions
-// of NetworkClient (which are themselves thread-safe)
-class MDNetworkUpstream : public NetworkHandler, public MDUpstream
+// All MDUpstreams must be thread-safe. Subscription changes are coalesced: each
+// change to a channel is recorded as pending, and everything pending goes upstream
+// together when the upstream is next flushed, in as few control messages as possible.
+// An add and a remove of the same channel in between flushes cancel out.
+//
+// A flush is scheduled on the io_service by the first pending change, and pending
+// changes are also flushed before any datagram or range change is sent, so that the
+// upstream MD always sees subscriptions in the order they were made.
+//
+// With merging turned on, runs of nearby channels are subscribed upstream as a single
+// range, which keeps the upstream MD's tables small when, say, a state server below us
+// holds a dense block of doids.  When channels drop out of a merged run, the parts of
+// the range that no longer cover any channel are removed, and a run that gets too
+// small is left as it is, so the upstream MD never misses a message on a channel
+// that is still subscribed.
+//
+// The upstream MD is usually reached over TCP, but one in another process on the same
+// host can be reached over shared memory instead, with an address of "shm://<name>"
+// (on Linux only).
+//
+// In a mesh, each peer which connects to us gets an MDNetworkUpstream of its own: we
+// tell the peer what we're subscribed to over it, and the peer sends us the datagrams
+// on those channels.
+class MDNetworkUpstream : public NetworkHandler, public MDUpstream,
+    public std::enable_shared_from_this<MDNetworkUpstream>
 {
   public:
     MDNetworkUpstream(MessageDirector *md);
 
+    // connect links us to the upstream MD, over TCP or, for "shm://<name>", shared memory.
     boost::system::error_code connect(const std::string &address);
 
+    // initialize sets up the link over a connection a mesh peer has made to us.
+    void initialize(boost::asio::ip::tcp::socket *socket);
+
+    // set_merging has runs of at least min_channels channels, in which at least the
+    // given fraction of the channels are subscribed, sent upstream as a single range.
+    // A min_channels of 0 turns merging off.
+    void set_merging(unsigned int min_channels, double density);
+
     // Interfaces that MDUpstream needs us to implement:
     virtual void subscribe_channel(channel_t c);
     virtual void unsubscribe_channel(channel_t c);
@@ -26,5 +64,30 @@ class MDNetworkUpstream : public NetworkHandler, public MDUpstream
 
   private:
     MessageDirector *m_message_director;
-    std::shared_ptr<NetworkClient> m_client;
+    std::shared_ptr<DatagramConnection> m_client;
+
+    std::mutex m_lock;
+    std::map<channel_t, int> m_pending_channels; // The net change to each channel: +1 or -1.
+    std::atomic<bool> m_flush_scheduled;
+
+    // Merging state; all of it is only used with merging turned on.
+    unsigned int m_merge_min_channels;
+    channel_t m_merge_max_gap; // The largest gap between neighbours in a merged run.
+    std::set<channel_t> m_channels; // The channels subscribed below us.
+    std::set<channel_t> m_dirty_channels; // The channels changed since the last flush.
+    boost::icl::interval_set<channel_t> m_ranges; // The ranges subscribed below us.
+    std::set<channel_t> m_upstream_channels; // Channels we hold upstream on their own...
+    boost::icl::interval_set<channel_t> m_upstream_blocks; // ...and merged into ranges.
+
+    void change_subscription(channel_t c, int change);
+    void flush_subscriptions();
+    void send_pending(); // Requires m_lock.
+    void send_merged(); // Requires m_lock.
+    void merged_span(channel_t c, channel_t &lo, channel_t &hi);
+    void remerge(channel_t lo, channel_t hi,
+                 boost::icl::interval_set<channel_t> &add_ranges,
+                 boost::icl::interval_set<channel_t> &remove_ranges,
+                 std::vector<channel_t> &adds, std::vector<channel_t> &removes);
+    void send_channels(uint16_t single_type, uint16_t bulk_type,
+                       const std::vector<channel_t> &channels);
 };
@@ -0,0 +1,128 @@
+#include "MDPeer.h"
+#include <functional>
+#include "core/global.h"
+#include "core/msgtypes.h"
+#include "net/NetworkConnector.h"
+#include "util/DatagramIterator.h"
+
+// How long to wait between attempts to connect to a peer.
+static const long RETRY_INTERVAL = 1000; // ms
+
+MDPeer::MDPeer(ChannelMap &peer_map, const std::string &address) :
+    m_peer_map(peer_map), m_address(address), m_log("mdpeer", "MD Peer(" + address + ")"),
+    m_connected(false), m_retry_timer(io_service)
+{
+}
+
+void MDPeer::start()
+{
+    io_service.post(std::bind(&MDPeer::connect, this));
+}
+
+void MDPeer::send_datagram(DatagramHandle dg)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if(m_connected) {
+        m_client->send_datagram(dg);
+    }
+}
+
+void MDPeer::connect()
+{
+    // The connect runs on the io_service, rather than blocking it while we wait for the peer.
+    NetworkConnector connector(io_service);
+    connector.async_connect(m_address, 7299, [this](tcp::socket *socket,
+                            const boost::system::error_code &ec) {
+        if(!socket) {
+            m_log.debug() << "Could not connect: " << ec.message() << std::endl;
+            retry();
+            return;
+        }
+
+        m_log.info() << "Connected." << std::endl;
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_client = std::make_shared<NetworkClient>(this);
+        m_client->initialize(socket);
+        m_connected = true;
+    });
+}
+
+void MDPeer::retry()
+{
+    m_retry_timer.expires_from_now(boost::posix_time::milliseconds(RETRY_INTERVAL));
+    m_retry_timer.async_wait([this](const boost::system::error_code &ec) {
+        if(!ec) {
+            connect();
+        }
+    });
+}
+
+void MDPeer::receive_datagram(DatagramHandle dg)
+{
+    // The only thing a peer sends us on this link is what it's subscribed to.
+    DatagramIterator dgi(dg);
+    try {
+        if(dgi.read_uint8() != 1 || dgi.read_channel() != CONTROL_MESSAGE) {
+            m_log.error() << "Peer sent a datagram on its subscription link." << std::endl;
+            return;
+        }
+
+        uint16_t msg_type = dgi.read_uint16();
+        switch(msg_type) {
+        case CONTROL_ADD_CHANNEL: {
+            m_peer_map.subscribe_channel(this, dgi.read_channel());
+            break;
+        }
+        case CONTROL_REMOVE_CHANNEL: {
+            m_peer_map.unsubscribe_channel(this, dgi.read_channel());
+            break;
+        }
+        case CONTROL_ADD_CHANNELS: {
+            uint16_t count = dgi.read_uint16();
+            for(uint16_t i = 0; i < count; ++i) {
+                m_peer_map.subscribe_channel(this, dgi.read_channel());
+            }
+            break;
+        }
+        case CONTROL_REMOVE_CHANNELS: {
+            uint16_t count = dgi.read_uint16();
+            for(uint16_t i = 0; i < count; ++i) {
+                m_peer_map.unsubscribe_channel(this, dgi.read_channel());
+            }
+            break;
+        }
+        case CONTROL_ADD_RANGE: {
+            channel_t lo = dgi.read_channel();
+            channel_t hi = dgi.read_channel();
+            m_peer_map.subscribe_range(this, lo, hi);
+            break;
+        }
+        case CONTROL_REMOVE_RANGE: {
+            channel_t lo = dgi.read_channel();
+            channel_t hi = dgi.read_channel();
+            m_peer_map.unsubscribe_range(this, lo, hi);
+            break;
+        }
+        default:
+            m_log.error() << "Peer sent unexpected control message, type: "
+                          << msg_type << std::endl;
+        }
+    } catch(DatagramIteratorEOF &) {
+        m_log.error() << "Peer sent a truncated datagram." << std::endl;
+    }
+}
+
+void MDPeer::receive_disconnect(const boost::system::error_code &ec)
+{
+    m_log.warning() << "Lost connection: " << ec.message() << std::endl;
+
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_connected = false;
+    }
+
+    // The peer will tell us everything it's subscribed to again once we reconnect.
+    m_peer_map.unsubscribe_all(this);
+    retry();
+}
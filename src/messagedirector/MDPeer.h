@@ -0,0 +1,43 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <boost/asio.hpp>
+#include "ChannelMap.h"
+#include "core/Logger.h"
+#include "net/NetworkClient.h"
+
+// An MDPeer is our link to another Message Director in the mesh.  The peer tells us
+// which channels its own participants are subscribed to, and we send it the datagrams
+// on those channels that come from ours.  Datagrams the peer sends us go over the link
+// the peer opened to us instead (see MessageDirector::handle_peer_connection).
+//
+// The peers may come up in any order, so an MDPeer keeps trying to connect until it
+// succeeds, and again whenever the link is lost.
+class MDPeer : public NetworkHandler, public ChannelSubscriber
+{
+  public:
+    MDPeer(ChannelMap &peer_map, const std::string &address);
+
+    // start makes the first attempt to connect to the peer.
+    void start();
+
+    // send_datagram sends a datagram to the peer, if we're connected to it.
+    void send_datagram(DatagramHandle dg);
+
+  private:
+    ChannelMap &m_peer_map;
+    std::string m_address;
+    LogCategory m_log;
+
+    std::mutex m_lock;
+    std::shared_ptr<NetworkClient> m_client;
+    bool m_connected;
+    boost::asio::deadline_timer m_retry_timer;
+
+    void connect();
+    void retry();
+
+    // Interfaces that NetworkClient needs us to implement:
+    virtual void receive_datagram(DatagramHandle dg);
+    virtual void receive_disconnect(const boost::system::error_code &ec);
+};
@@ -7,9 +7,14 @@
 #include "core/msgtypes.h"
 #include "config/ConfigVariable.h"
 #include "config/constraints.h"
+#ifdef __linux__
+#include "net/ShmAcceptor.h"
+#endif
 #include "net/TcpAcceptor.h"
+#include "net/address_utils.h"
 #include "MDNetworkParticipant.h"
 #include "MDNetworkUpstream.h"
+#include "MDPeer.h"
 
 using boost::asio::ip::tcp;
 
@@ -17,10 +22,55 @@ static ConfigGroup md_config("messagedirector");
 static ConfigVariable<std::string> bind_addr("bind", "unspecified", md_config);
 static ConfigVariable<std::string> connect_addr("connect", "unspecified", md_config);
 static ValidAddressConstraint valid_bind_addr(bind_addr);
-static ValidAddressConstraint valid_connect_addr(connect_addr);
+static bool is_upstream_address(const std::string &address)
+{
+    if(address.compare(0, 6, "shm://") == 0) {
+#ifdef __linux__
+        return address.size() > 6;
+#else
+        return false; // Shared memory links are only supported on Linux.
+#endif
+    }
+    return is_valid_address(address);
+}
+static ConfigConstraint<std::string> valid_connect_addr(is_upstream_address, connect_addr,
+        "String is not a valid IPv4/IPv6 address or hostname, or shm://<name> (Linux only).");
 static ConfigVariable<bool> threaded_mode("threaded", true, md_config);
 
-static ConfigGroup daemon_config("daemon");
+static ConfigGroup shm_config("shm", md_config);
+static ConfigVariable<std::string> shm_bind_name("bind", "unspecified", shm_config);
+#ifndef __linux__
+static bool is_unspecified(const std::string &name)
+{
+    return name == "unspecified";
+}
+static ConfigConstraint<std::string> shm_unsupported(is_unspecified, shm_bind_name,
+        "Shared memory links are only supported on Linux.");
+#endif
+static ConfigVariable<unsigned int> shm_ring_size("ring_size", 4194304, shm_config);
+static bool is_ring_size(const unsigned int &size)
+{
+    return size >= 131072 && (size & (size - 1)) == 0;
+}
+static ConfigConstraint<unsigned int> valid_shm_ring_size(is_ring_size, shm_ring_size,
+        "The ring size of shared memory links must be a power of two, and at least 131072.");
+
+static ConfigGroup mesh_config("mesh", md_config);
+static ConfigVariable<std::string> mesh_bind_addr("bind", "unspecified", mesh_config);
+static ValidAddressConstraint valid_mesh_bind_addr(mesh_bind_addr);
+static ConfigVariable<std::vector<std::string> > mesh_peers("peers", std::vector<std::string>(),
+        mesh_config);
+
+static ConfigGroup merge_config("merge_subscriptions", md_config);
+static ConfigVariable<unsigned int> merge_min_channels("min_channels", 0, merge_config);
+static ConfigVariable<double> merge_density("density", 1.0, merge_config);
+static bool is_density(const double &density)
+{
+    return 0.0 < density && density <= 1.0;
+}
+static ConfigConstraint<double> valid_merge_density(is_density, merge_density,
+        "The density of merged subscriptions must be greater than 0, and at most 1.");
+
 static ConfigVariable<std::string> daemon_name("name", "<unnamed>", daemon_config);
 static ConfigVariable<std::string> daemon_url("url", "", daemon_config);
 
@@ -52,6 +102,8 @@ void MessageDirector::init_network()
             TcpAcceptorCallback callback = std::bind(&MessageDirector::handle_connection,
                                            this, std::placeholders::_1);
             m_net_acceptor = std::unique_ptr<TcpAcceptor>(new TcpAcceptor(io_service, callback));
+            // Downstream MDs are spread over the daemon's event loops.
+            m_net_acceptor->set_distribute_connections(true);
             boost::system::error_code ec;
             ec = m_net_acceptor->bind(bind_addr.get_val(), 7199);
             if(ec.value() != 0) {
@@ -65,11 +117,41 @@ void MessageDirector::init_network()
             m_net_acceptor->start();
         }
 
+#ifdef __linux__
+        // Listen for downstream servers on this host that want a shared memory link
+        if(shm_bind_name.get_val() != "unspecified") {
+            m_log.info() << "Listening for shared memory links..." << std::endl;
+
+            ShmAcceptorCallback callback = std::bind(&MessageDirector::handle_shm_connection,
+                                           this, std::placeholders::_1);
+            m_shm_acceptor = std::unique_ptr<ShmAcceptor>(new ShmAcceptor(io_service, callback));
+            m_shm_acceptor->set_distribute_connections(true);
+            boost::system::error_code ec;
+            ec = m_shm_acceptor->bind(shm_bind_name.get_val(), shm_ring_size.get_val());
+            if(ec.value() != 0) {
+                m_log.fatal() << "Could not listen for shared memory links as: "
+                              << shm_bind_name.get_val() << std::endl;
+                m_log.fatal() << "Error code: " << ec.value()
+                              << "(" << ec.category().message(ec.value()) << ")"
+                              << std::endl;
+                exit(1);
+            }
+            m_shm_acceptor->start();
+        }
+#endif
+
+        bool mesh = mesh_bind_addr.get_val() != "unspecified";
+        if(mesh && connect_addr.get_val() != "unspecified") {
+            m_log.fatal() << "A Message Director in a mesh can't also connect upstream."
+                          << std::endl;
+            exit(1);
+        }
+
         // Connect to upstream server and start handling received messages
         if(connect_addr.get_val() != "unspecified") {
             m_log.info() << "Connecting upstream..." << std::endl;
 
-            MDNetworkUpstream *upstream = new MDNetworkUpstream(this);
+            auto upstream = std::make_shared<MDNetworkUpstream>(this);
 
             boost::system::error_code ec;
             ec = upstream->connect(connect_addr.get_val());
@@ -82,9 +164,35 @@ void MessageDirector::init_network()
                 exit(1);
             }
 
+            upstream->set_merging(merge_min_channels.get_val(), merge_density.get_val());
             m_upstream = upstream;
         }
 
+        // Join the mesh: listen for our peers' links, and make links to each of them.
+        if(mesh) {
+            m_log.info() << "Opening mesh listening socket..." << std::endl;
+
+            TcpAcceptorCallback callback = std::bind(&MessageDirector::handle_peer_connection,
+                                           this, std::placeholders::_1);
+            m_mesh_acceptor = std::unique_ptr<TcpAcceptor>(new TcpAcceptor(io_service, callback));
+            boost::system::error_code ec;
+            ec = m_mesh_acceptor->bind(mesh_bind_addr.get_val(), 7299);
+            if(ec.value() != 0) {
+                m_log.fatal() << "Could not bind mesh listening port: "
+                              << mesh_bind_addr.get_val() << std::endl;
+                m_log.fatal() << "Error code: " << ec.value()
+                              << "(" << ec.category().message(ec.value()) << ")"
+                              << std::endl;
+                exit(1);
+            }
+            m_mesh_acceptor->start();
+
+            for(const auto &address : mesh_peers.get_val()) {
+                m_peers.push_back(std::unique_ptr<MDPeer>(new MDPeer(m_peer_map, address)));
+                m_peers.back()->start();
+            }
+        }
+
         if(threaded_mode.get_val()) {
             m_thread.reset(new std::thread(std::bind(&MessageDirector::routing_thread, this)));
         }
@@ -207,6 +315,17 @@ void MessageDirector::process_datagram(MDParticipantInterface *p, DatagramHandle
         }
     }
 
+    // Send the message to any peers that want it.  Only messages from our own
+    // participants go to peers; those from peers have already gone everywhere they
+    // need to, which keeps messages from looping around the mesh.
+    if(p && !m_peers.empty()) {
+        std::unordered_set<ChannelSubscriber*> receiving_peers;
+        m_peer_map.lookup_channels(channels, receiving_peers);
+        for(const auto& it : receiving_peers) {
+            static_cast<MDPeer*>(it)->send_datagram(dg);
+        }
+    }
+
     // Send message upstream, if necessary
     if(p && m_upstream) {
         m_upstream->handle_datagram(dg);
@@ -241,6 +360,9 @@ void MessageDirector::on_add_channel(channel_t c)
         // Send upstream control message
         m_upstream->subscribe_channel(c);
     }
+    for(const auto &link : m_peer_links) {
+        link->subscribe_channel(c);
+    }
 }
 
 void MessageDirector::on_remove_channel(channel_t c)
@@ -249,6 +371,9 @@ void MessageDirector::on_remove_channel(channel_t c)
         // Send upstream control message
         m_upstream->unsubscribe_channel(c);
     }
+    for(const auto &link : m_peer_links) {
+        link->unsubscribe_channel(c);
+    }
 }
 
 void MessageDirector::on_add_range(channel_t lo, channel_t hi)
@@ -257,6 +382,9 @@ void MessageDirector::on_add_range(channel_t lo, channel_t hi)
         // Send upstream control message
         m_upstream->subscribe_range(lo, hi);
     }
+    for(const auto &link : m_peer_links) {
+        link->subscribe_range(lo, hi);
+    }
 }
 
 void MessageDirector::on_remove_range(channel_t lo, channel_t hi)
@@ -265,6 +393,9 @@ void MessageDirector::on_remove_range(channel_t lo, channel_t hi)
         // Send upstream control message
         m_upstream->unsubscribe_range(lo, hi);
     }
+    for(const auto &link : m_peer_links) {
+        link->unsubscribe_range(lo, hi);
+    }
 }
 
 void MessageDirector::handle_connection(tcp::socket *socket)
@@ -276,6 +407,42 @@ void MessageDirector::handle_connection(tcp::socket *socket)
     new MDNetworkParticipant(socket); // It deletes itself when connection is lost
 }
 
+#ifdef __linux__
+void MessageDirector::handle_shm_connection(const ShmLink &link)
+{
+    m_log.info() << "Got an incoming shared memory link" << std::endl;
+    new MDNetworkParticipant(link); // It deletes itself when the link is lost
+}
+#endif
+
+void MessageDirector::handle_peer_connection(tcp::socket *socket)
+{
+    boost::asio::ip::tcp::endpoint remote;
+    remote = socket->remote_endpoint();
+    m_log.info() << "Got a mesh connection from "
+                 << remote.address() << ":" << remote.port() << std::endl;
+
+    auto link = std::make_shared<MDNetworkUpstream>(this);
+    link->set_merging(merge_min_channels.get_val(), merge_density.get_val());
+    link->initialize(socket);
+
+    // Tell the peer everything we're subscribed to, holding the map's lock until the
+    // link is in m_peer_links so that no change made in the meantime is missed.
+    auto guard = lock_subscriptions();
+
+    std::vector<channel_t> channels;
+    boost::icl::interval_set<channel_t> ranges;
+    get_subscriptions(channels, ranges);
+    for(channel_t c : channels) {
+        link->subscribe_channel(c);
+    }
+    for(const auto &range : ranges) {
+        link->subscribe_range(boost::icl::first(range), boost::icl::last(range));
+    }
+
+    m_peer_links.push_back(link);
+}
+
 void MessageDirector::add_participant(MDParticipantInterface* p)
 {
     std::lock_guard<std::mutex> lock(m_participants_lock);
@@ -333,8 +500,23 @@ void MessageDirector::receive_datagram(DatagramHandle dg)
     route_datagram(nullptr, dg);
 }
 
-void MessageDirector::receive_disconnect(const boost::system::error_code &ec)
+void MessageDirector::receive_disconnect(MDUpstream *link, const boost::system::error_code &ec)
 {
-    m_log.fatal() << "Lost connection to upstream md: " << ec.message() << std::endl;
-    exit(1);
+    if(link == m_upstream.get()) {
+        m_log.fatal() << "Lost connection to upstream md: " << ec.message() << std::endl;
+        exit(1);
+    }
+
+    m_log.warning() << "Lost mesh connection from a peer: " << ec.message() << std::endl;
+
+    auto guard = lock_subscriptions();
+    for(auto it = m_peer_links.begin(); it != m_peer_links.end(); ++it) {
+        if(it->get() == link) {
+            // Let go of the link once it's done handling the disconnect.
+            std::shared_ptr<MDUpstream> lost = *it;
+            io_service.post([lost]() {});
+            m_peer_links.erase(it);
+            break;
+        }
+    }
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <list>
 #include <unordered_set>
+#include <vector>
 #include <string>
 #include <queue>
 #include <thread>
@@ -18,6 +19,9 @@
 
 class MDParticipantInterface;
 class MDUpstream;
+class MDPeer;
+class ShmAcceptor;
+struct ShmLink;
 
 // A MessageDirector is the internal networking object for an Astron server-node.
 // The MessageDirector receives message from other servers and routes them to the
@@ -45,7 +49,7 @@ class MessageDirector final : public ChannelMap
 
     // For MDUpstream (and subclasses) to call.
     void receive_datagram(DatagramHandle dg);
-    void receive_disconnect(const boost::system::error_code &ec);
+    void receive_disconnect(MDUpstream *link, const boost::system::error_code &ec);
 
   protected:
     void on_add_channel(channel_t c);
@@ -59,7 +63,18 @@ class MessageDirector final : public ChannelMap
     bool m_initialized;
 
     std::unique_ptr<NetworkAcceptor> m_net_acceptor;
-    MDUpstream *m_upstream;
+#ifdef __linux__
+    std::unique_ptr<ShmAcceptor> m_shm_acceptor;
+#endif
+    std::shared_ptr<MDUpstream> m_upstream;
+
+    // Mesh stuff: the peers we send datagrams to, what each of them is subscribed to,
+    // and the links the peers have opened to us, which we keep up to date with what
+    // we're subscribed to.  m_peer_links is guarded by the ChannelMap's lock.
+    std::unique_ptr<NetworkAcceptor> m_mesh_acceptor;
+    std::vector<std::unique_ptr<MDPeer>> m_peers;
+    ChannelMap m_peer_map;
+    std::vector<std::shared_ptr<MDUpstream>> m_peer_links;
 
     // Connected participants
     std::unordered_set<MDParticipantInterface*> m_participants;
@@ -89,6 +104,10 @@ class MessageDirector final : public ChannelMap
 
     // I/O OPERATIONS
     void handle_connection(boost::asio::ip::tcp::socket *socket);
+#ifdef __linux__
+    void handle_shm_connection(const ShmLink &link);
+#endif
+    void handle_peer_connection(boost::asio::ip::tcp::socket *socket);
 };
 
 
@@ -194,11 +213,26 @@ class MDParticipantInterface : public ChannelSubscriber
     {
         m_url = url;
     }
-    inline void log_message(std::vector<uint8_t> message)
+    inline void log_message(const std::vector<uint8_t> &message)
+    {
+        g_eventsender.send(message.data(), message.size());
+    }
+    inline void set_log_level(const std::string &category, const std::string &level)
     {
-        g_eventsender.send(Datagram::create(message));
+        LogSeverity sev;
+        if(level == "default") {
+            reset_category_level(category);
+        } else if(parse_log_severity(level, sev)) {
+            set_category_level(category, sev);
+        } else {
+            logger().warning() << "MDParticipant '" << m_name << "' tried to set unknown log level '"
+                               << level << "' for category '" << category << "'." << std::endl;
+            return;
+        }
+        logger().info() << "MDParticipant '" << m_name << "' set log level for category '"
+                        << category << "' to '" << level << "'." << std::endl;
     }
-    inline LogCategory logger()
+    inline LogCategory &logger()
     {
         return MessageDirector::singleton.logger();
     }
@@ -1,6 +1,7 @@
 #include "NetworkAcceptor.h"
 #include "address_utils.h"
 #include <boost/bind.hpp>
+#include "core/global.h"
 
 NetworkAcceptor::NetworkAcceptor(boost::asio::io_service& io_service) :
     m_io_service(io_service),
@@ -74,3 +75,11 @@ void NetworkAcceptor::stop()
 
     m_acceptor.cancel();
 }
+
+boost::asio::io_service &NetworkAcceptor::connection_io_service()
+{
+    if(m_distribute_connections) {
+        return g_loops.next().get_io_service();
+    }
+    return m_io_service;
+}
@@ -19,13 +19,24 @@ class NetworkAcceptor
         m_haproxy_mode = haproxy_mode;
     }
 
+    // set_distribute_connections controls whether accepted connections are spread
+    // across the daemon's event loops, or stay on the acceptor's own loop (the default).
+    inline void set_distribute_connections(bool distribute)
+    {
+        m_distribute_connections = distribute;
+    }
+
   protected:
     boost::asio::io_service &m_io_service;
     tcp::acceptor m_acceptor;
     bool m_started;
     bool m_haproxy_mode = false;
+    bool m_distribute_connections = false;
 
     NetworkAcceptor(boost::asio::io_service&);
 
+    // connection_io_service returns the io_service the next accepted socket should use.
+    boost::asio::io_service &connection_io_service();
+
     virtual void start_accept() = 0;
 };
@@ -8,8 +8,7 @@ using boost::asio::ip::tcp;
 namespace ssl = boost::asio::ssl;
 
 NetworkClient::NetworkClient(NetworkHandler *handler) : m_handler(handler), m_socket(nullptr),
-    m_secure_socket(nullptr),
-    m_async_timer(io_service), m_send_queue()
+    m_secure_socket(nullptr), m_send_queue()
 {
 }
 
@@ -36,6 +35,7 @@ void NetworkClient::initialize(tcp::socket *socket, std::unique_lock<std::mutex>
         throw std::logic_error("Trying to set a socket of a network client whose socket was already set.");
     }
     m_socket = socket;
+    m_async_timer.reset(new boost::asio::deadline_timer(loop_of(*m_socket)));
 
     boost::asio::socket_base::keep_alive keepalive(true);
     m_socket->set_option(keepalive);
@@ -133,6 +133,27 @@ void NetworkClient::send_datagram(DatagramHandle dg)
     }
 }
 
+void NetworkClient::send_datagrams(const std::vector<DatagramHandle> &dgs)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for(const auto &dg : dgs) {
+        m_send_queue.push(dg);
+        m_total_queue_size += dg->size();
+    }
+
+    if(!m_is_sending) {
+        if(!m_send_queue.empty()) {
+            m_is_sending = true;
+            async_send_queue(lock);
+        }
+    } else if(m_total_queue_size > m_max_queue_size && m_max_queue_size != 0) {
+        boost::system::error_code enobufs(boost::system::errc::errc_t::no_buffer_space,
+                                          boost::system::system_category());
+        disconnect(enobufs, lock);
+    }
+}
+
 bool NetworkClient::is_connected(std::unique_lock<std::mutex> &)
 {
     return m_socket && m_socket->is_open();
@@ -166,7 +187,7 @@ void NetworkClient::disconnect(const boost::system::error_code &ec, std::unique_
     m_socket->cancel();
     m_socket->close();
 
-    m_async_timer.cancel();
+    m_async_timer->cancel();
 }
 
 void NetworkClient::handle_disconnect(const boost::system::error_code &ec,
@@ -265,12 +286,36 @@ void NetworkClient::async_send(DatagramHandle dg, std::unique_lock<std::mutex> &
     }
 }
 
+void NetworkClient::async_send_queue(std::unique_lock<std::mutex> &lock)
+{
+    size_t buffer_size = m_total_queue_size + m_send_queue.size() * sizeof(dgsize_t);
+    m_send_buf = new uint8_t[buffer_size];
+
+    uint8_t *p = m_send_buf;
+    while(!m_send_queue.empty()) {
+        DatagramHandle dg = m_send_queue.front();
+        m_send_queue.pop();
+
+        dgsize_t len = swap_le(dg->size());
+        memcpy(p, (uint8_t*)&len, sizeof(dgsize_t));
+        memcpy(p + sizeof(dgsize_t), dg->get_data(), dg->size());
+        p += sizeof(dgsize_t) + dg->size();
+    }
+    m_total_queue_size = 0;
+
+    try {
+        socket_write(m_send_buf, buffer_size, lock);
+    } catch(const boost::system::system_error& err) {
+        disconnect(err.code(), lock);
+    }
+}
+
 void NetworkClient::send_finished(const boost::system::error_code &ec)
 {
     std::unique_lock<std::mutex> lock(m_mutex);
 
     // Cancel the outstanding timeout
-    m_async_timer.cancel();
+    m_async_timer->cancel();
 
     // Discard the buffer we just used:
     delete [] m_send_buf;
@@ -285,11 +330,8 @@ void NetworkClient::send_finished(const boost::system::error_code &ec)
 
     // Check if we have more items in the queue
     if(m_send_queue.size() > 0) {
-        // Send the next item in the queue
-        DatagramHandle dg = m_send_queue.front();
-        m_total_queue_size -= dg->size();
-        m_send_queue.pop();
-        async_send(dg, lock);
+        // Send everything that queued up during the last write
+        async_send_queue(lock);
         return;
     }
 
@@ -330,8 +372,8 @@ void NetworkClient::socket_write(const uint8_t* buf, size_t length, std::unique_
 {
     // Start async timeout, a value of 0 indicates the writes shouldn't timeout (used in debugging)
     if(m_write_timeout > 0) {
-        m_async_timer.expires_from_now(boost::posix_time::milliseconds(m_write_timeout));
-        m_async_timer.async_wait(boost::bind(&NetworkClient::send_expired, shared_from_this(),
+        m_async_timer->expires_from_now(boost::posix_time::milliseconds(m_write_timeout));
+        m_async_timer->async_wait(boost::bind(&NetworkClient::send_expired, shared_from_this(),
                                              boost::asio::placeholders::error));
     }
 
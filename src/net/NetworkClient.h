@@ -1,6 +1,7 @@
 #pragma once
 #include <list>
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -12,6 +13,7 @@
 // and instantiate NetworkClient with std::make_shared.
 //
 // To begin receiving, pass it an ASIO socket or SSL stream via initialize().
+// The NetworkClient's handlers run on the event loop the socket was created on.
 //
 // You must not destruct your NetworkHandler implementor until
 // receive_disconnect is called!
@@ -29,9 +31,23 @@ class NetworkHandler
     virtual void receive_disconnect(const boost::system::error_code &ec) = 0;
 
     friend class NetworkClient;
+    friend class ShmClient;
 };
 
-class NetworkClient : public std::enable_shared_from_this<NetworkClient>
+// A DatagramConnection is anything datagrams can be sent over: a NetworkClient, or a
+// ShmClient between processes on the same host.
+class DatagramConnection
+{
+  public:
+    virtual ~DatagramConnection() {}
+
+    virtual void send_datagram(DatagramHandle dg) = 0;
+    virtual void disconnect() = 0;
+    virtual bool is_connected() = 0;
+};
+
+class NetworkClient : public DatagramConnection,
+    public std::enable_shared_from_this<NetworkClient>
 {
   public:
     NetworkClient(NetworkHandler *handler);
@@ -66,9 +82,11 @@ class NetworkClient : public std::enable_shared_from_this<NetworkClient>
     void set_write_buffer(uint64_t max_bytes);
 
     // send_datagram immediately sends the datagram over TCP (blocking).
-    void send_datagram(DatagramHandle dg);
+    virtual void send_datagram(DatagramHandle dg);
+    // send_datagrams sends several datagrams, which are written to the socket together.
+    void send_datagrams(const std::vector<DatagramHandle> &dgs);
     // disconnect closes the TCP connection
-    inline void disconnect()
+    virtual void disconnect()
     {
         boost::system::error_code ec;
         disconnect(ec);
@@ -79,7 +97,7 @@ class NetworkClient : public std::enable_shared_from_this<NetworkClient>
         disconnect(ec, lock);
     }
     // is_connected returns true if the TCP connection is active, or false otherwise
-    inline bool is_connected()
+    virtual bool is_connected()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         return is_connected(lock);
@@ -115,6 +133,8 @@ class NetworkClient : public std::enable_shared_from_this<NetworkClient>
     // async_send is called by send_datagram or send_finished when the socket is available
     //     for writing to send the next datagram in the queue.
     void async_send(DatagramHandle dg, std::unique_lock<std::mutex> &lock);
+    // async_send_queue is like async_send, but sends everything in the queue in a single write.
+    void async_send_queue(std::unique_lock<std::mutex> &lock);
     // send_finished is called when an async_send has completed
     void send_finished(const boost::system::error_code &ec);
     // send_expired is called when an async_send has expired
@@ -153,7 +173,9 @@ class NetworkClient : public std::enable_shared_from_this<NetworkClient>
     boost::asio::ssl::stream<boost::asio::ip::tcp::socket> *m_secure_socket;
     boost::asio::ip::tcp::endpoint m_remote;
     boost::asio::ip::tcp::endpoint m_local;
-    boost::asio::deadline_timer m_async_timer;
+    // The write timer is created on the socket's io_service in initialize(), so that a
+    //     NetworkClient always runs on the same event loop as its socket.
+    std::unique_ptr<boost::asio::deadline_timer> m_async_timer;
     uint8_t m_size_buf[sizeof(dgsize_t)];
     uint8_t* m_data_buf = nullptr;
     dgsize_t m_data_size = 0;
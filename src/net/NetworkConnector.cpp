@@ -51,3 +51,33 @@ ssl::stream<tcp::socket> *NetworkConnector::connect(const std::string &address,
 
     return socket;
 }
+
+void NetworkConnector::async_connect(const std::string &address, unsigned int default_port,
+                                     ConnectCallback callback)
+{
+    boost::asio::io_service *io_service = &m_io_service;
+    async_resolve_address(address, default_port, m_io_service,
+                          [io_service, callback](const boost::system::error_code &ec,
+                                  const std::vector<tcp::endpoint> &addresses) {
+        if(ec.value() != 0) {
+            callback(nullptr, ec);
+            return;
+        }
+
+        // Each address is tried in turn, until one of them connects.
+        auto endpoints = std::make_shared<std::vector<tcp::endpoint> >(addresses);
+        tcp::socket *socket = new tcp::socket(*io_service);
+        boost::asio::async_connect(*socket, endpoints->begin(), endpoints->end(),
+                                   [socket, endpoints, callback](
+                                       const boost::system::error_code &ec,
+                                       std::vector<tcp::endpoint>::iterator) {
+            if(ec.value() != 0) {
+                delete socket;
+                callback(nullptr, ec);
+                return;
+            }
+
+            callback(socket, ec);
+        });
+    });
+}
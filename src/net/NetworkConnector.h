@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 
@@ -19,6 +20,15 @@ class NetworkConnector
                          boost::system::error_code &ec);
     ssl::stream<tcp::socket> *connect(const std::string &address, unsigned int default_port,
                                       ssl::context *ctx, boost::system::error_code &ec);
+
+    // async_connect is the same as the first connect, but it doesn't block: it returns at
+    // once, and callback is called from the io_service with the freshly-allocated socket
+    // once it's connected, or with nullptr and the reason the connect failed.
+    // The connector doesn't have to outlive the connect.
+    typedef std::function<void(tcp::socket *, const boost::system::error_code &)>
+    ConnectCallback;
+    void async_connect(const std::string &address, unsigned int default_port,
+                       ConnectCallback callback);
   private:
     boost::asio::io_service &m_io_service;
 
@@ -0,0 +1,153 @@
+#include "ShmAcceptor.h"
+#include <cstring>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/bind.hpp>
+#include "core/global.h"
+using boost::asio::local::stream_protocol;
+
+ShmAcceptor::ShmAcceptor(boost::asio::io_service &io_service, ShmAcceptorCallback &callback) :
+    m_io_service(io_service), m_acceptor(io_service), m_callback(callback), m_ring_size(0),
+    m_started(false), m_distribute_connections(false)
+{
+}
+
+std::string ShmAcceptor::socket_name(const std::string &name)
+{
+    // The leading NUL puts the socket in the abstract namespace.
+    return std::string(1, '\0') + "astron-md/" + name;
+}
+
+bool ShmAcceptor::same_user(int socket)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if(getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) != 0) {
+        return false;
+    }
+    return cred_len == sizeof(cred) && cred.uid == geteuid();
+}
+
+boost::system::error_code ShmAcceptor::bind(const std::string &name, size_t ring_size)
+{
+    boost::system::error_code ec;
+    m_ring_size = ring_size;
+
+    m_acceptor.open(stream_protocol(), ec);
+    if(ec.value() != 0) {
+        return ec;
+    }
+    m_acceptor.bind(stream_protocol::endpoint(socket_name(name)), ec);
+    if(ec.value() != 0) {
+        return ec;
+    }
+    m_acceptor.listen(stream_protocol::socket::max_connections, ec);
+    return ec;
+}
+
+void ShmAcceptor::start()
+{
+    if(m_started) {
+        return;
+    }
+
+    m_started = true;
+    start_accept();
+}
+
+void ShmAcceptor::stop()
+{
+    if(!m_started) {
+        return;
+    }
+
+    m_started = false;
+    m_acceptor.cancel();
+}
+
+void ShmAcceptor::start_accept()
+{
+    boost::asio::io_service &io = m_distribute_connections ? g_loops.next().get_io_service()
+                                  : m_io_service;
+    stream_protocol::socket *socket = new stream_protocol::socket(io);
+    m_acceptor.async_accept(*socket,
+                            boost::bind(&ShmAcceptor::handle_accept, this,
+                                        socket, boost::asio::placeholders::error));
+}
+
+void ShmAcceptor::handle_accept(stream_protocol::socket *socket,
+                                const boost::system::error_code &ec)
+{
+    if(!m_started) {
+        // We were turned off sometime before this operation completed; ignore.
+        delete socket;
+        return;
+    }
+
+    // Start accepting another link now:
+    start_accept();
+
+    if(ec || !same_user(socket->native_handle())) {
+        delete socket;
+        return;
+    }
+
+    // Make the shared memory (which starts out zeroed, so both rings are empty) and the
+    // two doorbells.
+    int memory = memfd_create("astron-md", MFD_CLOEXEC);
+    int doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int peer_doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    bool ok = memory >= 0 && doorbell >= 0 && peer_doorbell >= 0 &&
+              ftruncate(memory, ShmClient::segment_size(m_ring_size)) == 0;
+
+    // Hand them over, along with the size of the rings.
+    if(ok) {
+        uint64_t ring_size = m_ring_size;
+        struct iovec iov;
+        iov.iov_base = &ring_size;
+        iov.iov_len = sizeof(ring_size);
+
+        int fds[3] = {memory, doorbell, peer_doorbell};
+        union {
+            struct cmsghdr header;
+            char buf[CMSG_SPACE(sizeof(fds))];
+        } control;
+        memset(&control, 0, sizeof(control));
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        ok = sendmsg(socket->native_handle(), &msg, MSG_NOSIGNAL) == sizeof(ring_size);
+    }
+
+    if(!ok) {
+        for(int fd : {memory, doorbell, peer_doorbell}) {
+            if(fd >= 0) {
+                close(fd);
+            }
+        }
+        delete socket;
+        return;
+    }
+
+    ShmLink link;
+    link.socket = socket;
+    link.memory = memory;
+    link.ring_size = m_ring_size;
+    link.doorbell = doorbell;
+    link.peer_doorbell = peer_doorbell;
+    link.acceptor = true;
+    m_callback(link);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <boost/asio.hpp>
+#include "ShmClient.h"
+
+typedef std::function<void(const ShmLink&)> ShmAcceptorCallback;
+
+// A ShmAcceptor listens for processes on the same host which want a shared memory link
+// to us (see ShmClient).  It listens on a Unix socket in the abstract namespace, named
+// after the link's name, so there's no file to clean up.  For each process that
+// connects, as long as it runs as the same user, it makes the shared memory and eventfds,
+// and passes them over the socket.
+class ShmAcceptor
+{
+  public:
+    ShmAcceptor(boost::asio::io_service &io_service, ShmAcceptorCallback &callback);
+
+    // bind listens under the given name, for links with rings of ring_size bytes each.
+    boost::system::error_code bind(const std::string &name, size_t ring_size);
+
+    void start();
+    void stop();
+
+    // set_distribute_connections controls whether accepted links are spread across the
+    // daemon's event loops, or stay on the acceptor's own loop (the default).
+    inline void set_distribute_connections(bool distribute)
+    {
+        m_distribute_connections = distribute;
+    }
+
+    // socket_name returns the name of the Unix socket for a shared memory link's name.
+    static std::string socket_name(const std::string &name);
+
+    // same_user returns whether the process at the other end of a Unix socket runs as the
+    // same user as we do.  The abstract namespace has no file permissions, so any process on
+    // the host can reach a socket there; only our own user's may link to us.
+    static bool same_user(int socket);
+
+  private:
+    boost::asio::io_service &m_io_service;
+    boost::asio::local::stream_protocol::acceptor m_acceptor;
+    ShmAcceptorCallback m_callback;
+    size_t m_ring_size;
+    bool m_started;
+    bool m_distribute_connections;
+
+    void start_accept();
+    void handle_accept(boost::asio::local::stream_protocol::socket *socket,
+                       const boost::system::error_code &ec);
+};
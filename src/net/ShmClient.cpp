@@ -0,0 +1,330 @@
+#include "ShmClient.h"
+#include <cstring>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "core/global.h"
+using namespace std;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2,
+              "The rings' positions have to be lock-free to be shared between processes.");
+
+// The most datagrams received in one go, before other handlers on the loop get a turn.
+static const unsigned int MAX_RECEIVE_BATCH = 256;
+
+// Each datagram in a ring is preceded by its length.
+typedef uint32_t frame_size_t;
+
+// copy_in copies data into a ring at the given position, wrapping around its end.
+static void copy_in(uint8_t *ring, size_t ring_size, uint64_t pos, const uint8_t *data, size_t len)
+{
+    size_t offset = pos & (ring_size - 1);
+    size_t first = min(len, ring_size - offset);
+    memcpy(ring + offset, data, first);
+    memcpy(ring, data + first, len - first);
+}
+
+// copy_out copies data out of a ring from the given position, wrapping around its end.
+static void copy_out(const uint8_t *ring, size_t ring_size, uint64_t pos, uint8_t *data, size_t len)
+{
+    size_t offset = pos & (ring_size - 1);
+    size_t first = min(len, ring_size - offset);
+    memcpy(data, ring + offset, first);
+    memcpy(data + first, ring, len - first);
+}
+
+// ring_doorbell wakes up whoever is waiting on an eventfd.
+static void ring_doorbell(int doorbell)
+{
+    uint64_t one = 1;
+    ssize_t written = write(doorbell, &one, sizeof(one));
+    (void)written; // Nothing to be done if it fails; the socket will tell us why.
+}
+
+ShmClient::ShmClient(NetworkHandler *handler) : m_handler(handler)
+{
+}
+
+ShmClient::~ShmClient()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    assert(!is_connected(lock));
+
+    delete m_socket;
+    if(m_peer_doorbell >= 0) {
+        close(m_peer_doorbell);
+    }
+    if(m_memory) {
+        munmap(m_memory, segment_size(m_ring_size));
+    }
+}
+
+size_t ShmClient::segment_size(size_t ring_size)
+{
+    return 2 * (sizeof(ShmRing) + ring_size);
+}
+
+void ShmClient::initialize(const ShmLink &link)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_socket) {
+        throw std::logic_error("Trying to initialize a shared memory client twice.");
+    }
+    m_socket = link.socket;
+    m_doorbell.reset(new boost::asio::posix::stream_descriptor(loop_of(*m_socket), link.doorbell));
+    m_peer_doorbell = link.peer_doorbell;
+    m_ring_size = link.ring_size;
+
+    // Watch the socket for the other side going away.
+    m_socket->async_read_some(boost::asio::buffer(&m_socket_byte, 1),
+                              std::bind(&ShmClient::socket_closed, shared_from_this(),
+                                        std::placeholders::_1));
+
+    void *memory = mmap(nullptr, segment_size(m_ring_size), PROT_READ | PROT_WRITE, MAP_SHARED,
+                        link.memory, 0);
+    close(link.memory);
+    if(memory == MAP_FAILED) {
+        disconnect(boost::system::error_code(errno, boost::system::system_category()), lock);
+        return;
+    }
+    m_memory = (uint8_t*)memory;
+
+    // The connecting side writes to the first ring, and the accepting side to the second.
+    ShmRing *first = (ShmRing*)m_memory;
+    ShmRing *second = (ShmRing*)(m_memory + sizeof(ShmRing) + m_ring_size);
+    m_in = link.acceptor ? first : second;
+    m_out = link.acceptor ? second : first;
+    m_in_data = (uint8_t*)(m_in + 1);
+    m_out_data = (uint8_t*)(m_out + 1);
+
+    // Pick up anything the other side sent before we were listening for its doorbell.
+    boost::asio::post(loop_of(*m_socket), std::bind(&ShmClient::receive, shared_from_this()));
+}
+
+bool ShmClient::is_connected()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return is_connected(lock);
+}
+
+bool ShmClient::is_connected(std::unique_lock<std::mutex> &)
+{
+    return m_socket && m_socket->is_open() && !m_local_disconnect;
+}
+
+void ShmClient::send_datagram(DatagramHandle dg)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!is_connected(lock)) {
+        return;
+    }
+
+    if(sizeof(frame_size_t) + dg->size() > m_ring_size) {
+        disconnect(boost::system::error_code(boost::system::errc::message_size,
+                                             boost::system::system_category()), lock);
+        return;
+    }
+
+    if(m_backlog.empty() && write_datagram(dg)) {
+        ring_peer();
+        return;
+    }
+
+    // There's no room; queue it up until the other side makes some.
+    m_backlog.push(dg);
+    m_has_backlog = true;
+    flush_backlog(lock);
+}
+
+void ShmClient::disconnect()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    disconnect(boost::system::error_code(), lock);
+}
+
+void ShmClient::disconnect(const boost::system::error_code &ec, std::unique_lock<std::mutex> &)
+{
+    if(m_local_disconnect || m_disconnect_handled) {
+        return;
+    }
+
+    m_local_disconnect = true;
+    m_disconnect_error = ec;
+
+    boost::system::error_code close_ec;
+    m_socket->cancel(close_ec);
+    m_socket->close(close_ec);
+    m_doorbell->cancel(close_ec);
+}
+
+void ShmClient::handle_disconnect(const boost::system::error_code &ec,
+                                  std::unique_lock<std::mutex> &lock)
+{
+    if(m_disconnect_handled) {
+        return;
+    }
+    m_disconnect_handled = true;
+
+    boost::system::error_code close_ec;
+    m_socket->close(close_ec);
+    m_doorbell->close(close_ec);
+
+    // As in NetworkClient, the handler is called without the lock held.
+    lock.unlock();
+    if(m_local_disconnect) {
+        m_handler->receive_disconnect(m_disconnect_error);
+    } else {
+        m_handler->receive_disconnect(ec);
+    }
+}
+
+// write_datagram copies a datagram into the outgoing ring, if there's room for it.
+bool ShmClient::write_datagram(const DatagramHandle &dg)
+{
+    frame_size_t size = dg->size();
+    uint64_t tail = m_out->tail.load(std::memory_order_relaxed);
+    uint64_t head = m_out->head.load();
+    if(m_ring_size - (tail - head) < sizeof(size) + size) {
+        return false;
+    }
+
+    copy_in(m_out_data, m_ring_size, tail, (const uint8_t*)&size, sizeof(size));
+    copy_in(m_out_data, m_ring_size, tail + sizeof(size), dg->get_data(), size);
+    m_out->tail.store(tail + sizeof(size) + size);
+    return true;
+}
+
+// flush_backlog writes as much of the backlog as now fits into the outgoing ring.
+void ShmClient::flush_backlog(std::unique_lock<std::mutex> &)
+{
+    bool written = false;
+    while(!m_backlog.empty()) {
+        if(!write_datagram(m_backlog.front())) {
+            // Out of room: have the other side ring us when it makes some, and look
+            // again in case it made some before it could see that we asked.
+            m_out->writer_waiting.store(1);
+            if(!write_datagram(m_backlog.front())) {
+                break;
+            }
+        }
+        m_backlog.pop();
+        written = true;
+    }
+    if(m_backlog.empty()) {
+        m_has_backlog = false;
+        m_out->writer_waiting.store(0);
+    }
+    if(written) {
+        ring_peer();
+    }
+}
+
+// ring_peer wakes the other side if it has gone to sleep waiting for datagrams.  Its flag
+// is checked after the ring's tail was stored, and it checks the tail after setting the
+// flag, so one of us always sees the other.
+void ShmClient::ring_peer()
+{
+    if(m_out->reader_waiting.load() && m_out->reader_waiting.exchange(0)) {
+        ring_doorbell(m_peer_doorbell);
+    }
+}
+
+void ShmClient::async_wait_doorbell()
+{
+    m_doorbell->async_read_some(boost::asio::buffer(&m_doorbell_count, sizeof(m_doorbell_count)),
+                                std::bind(&ShmClient::doorbell_rung, shared_from_this(),
+                                          std::placeholders::_1));
+}
+
+void ShmClient::doorbell_rung(const boost::system::error_code &ec)
+{
+    if(ec) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        handle_disconnect(ec, lock);
+        return;
+    }
+
+    receive();
+}
+
+void ShmClient::socket_closed(const boost::system::error_code &ec)
+{
+    // The other side never writes to the socket, so this only completes when it goes away.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(ec) {
+        handle_disconnect(ec, lock);
+    } else {
+        handle_disconnect(boost::system::error_code(boost::system::errc::protocol_error,
+                          boost::system::system_category()), lock);
+    }
+}
+
+// receive hands the datagrams waiting in the incoming ring to the handler, and then either
+// goes to sleep on the doorbell or, if there are too many to handle in one go, comes back.
+void ShmClient::receive()
+{
+    // Only the loop's own handlers disconnect us, so this can be read without the lock.
+    if(m_disconnect_handled) {
+        return;
+    }
+
+    if(m_has_backlog) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(!is_connected(lock)) {
+            return;
+        }
+        flush_backlog(lock);
+    }
+
+    uint64_t head = m_in->head.load(std::memory_order_relaxed);
+    for(unsigned int received = 0; received < MAX_RECEIVE_BATCH; ++received) {
+        uint64_t tail = m_in->tail.load(std::memory_order_acquire);
+        if(tail == head) {
+            // Going to sleep: set the flag, and look again in case a datagram arrived
+            // just before the other side would have seen it.
+            m_in->reader_waiting.store(1);
+            tail = m_in->tail.load();
+            if(tail == head) {
+                async_wait_doorbell();
+                return;
+            }
+            m_in->reader_waiting.store(0);
+        }
+
+        // The other side can write anything to the ring, so the frame has to lie within
+        // what it says it has written, and that within the ring, before we copy it out.
+        // It also has to fit in a datagram.
+        frame_size_t size = 0;
+        uint64_t available = tail - head;
+        if(available >= sizeof(size) && available <= m_ring_size) {
+            copy_out(m_in_data, m_ring_size, head, (uint8_t*)&size, sizeof(size));
+        }
+        if(available < sizeof(size) || available > m_ring_size ||
+           size > available - sizeof(size) || uint64_t(size) > DGSIZE_MAX) {
+            disconnect(boost::system::error_code(boost::system::errc::protocol_error,
+                                                 boost::system::system_category()));
+            return;
+        }
+
+        DatagramPtr dg = Datagram::create();
+        if(size) {
+            uint8_t *buf = new uint8_t[size];
+            copy_out(m_in_data, m_ring_size, head + sizeof(size), buf, size);
+            dg = Datagram::create(buf, size, size); // The datagram takes the buffer.
+        }
+        head += sizeof(size) + size;
+        m_in->head.store(head);
+
+        // The other side may be waiting for the room we've just made.
+        if(m_in->writer_waiting.load() && m_in->writer_waiting.exchange(0)) {
+            ring_doorbell(m_peer_doorbell);
+        }
+
+        m_handler->receive_datagram(dg);
+        if(m_disconnect_handled) {
+            return;
+        }
+    }
+
+    boost::asio::post(loop_of(*m_socket), std::bind(&ShmClient::receive, shared_from_this()));
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <boost/asio.hpp>
+#include "NetworkClient.h"
+
+// NOTES:
+//
+// A ShmClient carries datagrams between two processes on the same host through a pair
+// of rings in shared memory, one for each direction, instead of over a TCP connection.
+// Each ring has a single producer and a single consumer, and is read and written
+// without any system calls; a process only pays for one when the other side has run
+// dry and gone to sleep on its eventfd (its "doorbell"), or when a ring is full.
+//
+// The two sides also hold a Unix socket open to each other, which carried the shared
+// memory and eventfds when the link was set up (see ShmAcceptor and ShmConnector), and
+// is then only watched so that each side notices when the other goes away.
+//
+// Like NetworkClient, a ShmClient is instantiated with std::make_shared, its handlers
+// run on the event loop of the socket it's initialized with, and its NetworkHandler
+// must not be destructed until receive_disconnect is called.
+
+// A ShmLink is one side of a freshly made shared memory link, ready to be handed to
+// ShmClient::initialize.
+struct ShmLink {
+    boost::asio::local::stream_protocol::socket *socket;
+    int memory; // The memfd holding both rings.
+    size_t ring_size; // The bytes of datagrams each ring holds; a power of two.
+    int doorbell; // The eventfd the other side rings to wake us...
+    int peer_doorbell; // ...and the one we ring to wake the other side.
+    bool acceptor; // Whether we accepted the link, which decides the ring we write to.
+};
+
+// A ShmRing is the header of a ring in the shared memory, followed by its data.  The
+// positions only ever grow; each is on a cache line of its own, so the producer and
+// consumer don't take the line back and forth from each other on every datagram.
+struct ShmRing {
+    alignas(64) std::atomic<uint64_t> head; // Read up to here; written by the consumer.
+    std::atomic<uint32_t> reader_waiting; // Set by a consumer going to sleep.
+    alignas(64) std::atomic<uint64_t> tail; // Written up to here; written by the producer.
+    std::atomic<uint32_t> writer_waiting; // Set by a producer waiting for space.
+};
+
+class ShmClient : public DatagramConnection, public std::enable_shared_from_this<ShmClient>
+{
+  public:
+    ShmClient(NetworkHandler *handler);
+    ~ShmClient();
+
+    // initialize maps the shared memory and begins receiving; the ShmClient takes
+    // ownership of the link's socket and file descriptors.
+    void initialize(const ShmLink &link);
+
+    // send_datagram copies the datagram into the ring, or queues it until there's room.
+    virtual void send_datagram(DatagramHandle dg);
+    // disconnect closes the link.
+    virtual void disconnect();
+    inline void disconnect(const boost::system::error_code &ec)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        disconnect(ec, lock);
+    }
+    virtual bool is_connected();
+
+    // segment_size returns the size of the shared memory holding two rings of ring_size.
+    static size_t segment_size(size_t ring_size);
+
+  private:
+    NetworkHandler *m_handler;
+    boost::asio::local::stream_protocol::socket *m_socket = nullptr;
+    std::unique_ptr<boost::asio::posix::stream_descriptor> m_doorbell;
+    int m_peer_doorbell = -1;
+    uint64_t m_doorbell_count = 0;
+    uint8_t m_socket_byte = 0;
+
+    uint8_t *m_memory = nullptr;
+    size_t m_ring_size = 0;
+    ShmRing *m_in = nullptr, *m_out = nullptr;
+    uint8_t *m_in_data = nullptr, *m_out_data = nullptr;
+
+    // Datagrams waiting for room in the outgoing ring; guarded by m_mutex.
+    std::queue<DatagramHandle> m_backlog;
+    std::atomic<bool> m_has_backlog {false};
+
+    std::mutex m_mutex;
+    bool m_disconnect_handled = false;
+    bool m_local_disconnect = false;
+    boost::system::error_code m_disconnect_error;
+
+    void disconnect(const boost::system::error_code &ec, std::unique_lock<std::mutex> &lock);
+    bool is_connected(std::unique_lock<std::mutex> &lock);
+    void handle_disconnect(const boost::system::error_code &ec,
+                           std::unique_lock<std::mutex> &lock);
+
+    bool write_datagram(const DatagramHandle &dg); // Requires m_mutex.
+    void flush_backlog(std::unique_lock<std::mutex> &lock);
+    void ring_peer();
+
+    void async_wait_doorbell();
+    void doorbell_rung(const boost::system::error_code &ec);
+    void socket_closed(const boost::system::error_code &ec);
+    void receive();
+};
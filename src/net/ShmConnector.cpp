@@ -0,0 +1,90 @@
+#include "ShmConnector.h"
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ShmAcceptor.h"
+using boost::asio::local::stream_protocol;
+
+ShmConnector::ShmConnector(boost::asio::io_service &io_service) : m_io_service(io_service)
+{
+}
+
+bool ShmConnector::connect(const std::string &name, ShmLink &link, boost::system::error_code &ec)
+{
+    stream_protocol::socket *socket = new stream_protocol::socket(m_io_service);
+    socket->connect(stream_protocol::endpoint(ShmAcceptor::socket_name(name)), ec);
+    if(!ec && !ShmAcceptor::same_user(socket->native_handle())) {
+        ec = boost::system::error_code(boost::system::errc::permission_denied,
+                                       boost::system::system_category());
+    }
+    if(ec) {
+        delete socket;
+        return false;
+    }
+
+    // The acceptor sends the size of the rings, with the shared memory, its own doorbell
+    // and ours.
+    uint64_t ring_size = 0;
+    struct iovec iov;
+    iov.iov_base = &ring_size;
+    iov.iov_len = sizeof(ring_size);
+
+    int fds[3];
+    union {
+        struct cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t received = recvmsg(socket->native_handle(), &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(received != sizeof(ring_size) || !cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+       cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        if(received < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+        } else {
+            ec = boost::system::error_code(boost::system::errc::protocol_error,
+                                           boost::system::system_category());
+        }
+        if(cmsg && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), std::min(count, size_t(3)) * sizeof(int));
+            for(size_t i = 0; i < std::min(count, size_t(3)); ++i) {
+                close(fds[i]);
+            }
+        }
+        delete socket;
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+    // The rings have to be a power of two in size, and all there; mapping more than the
+    // shared memory holds would crash us as soon as we touched the rest.
+    struct stat memory;
+    if(ring_size == 0 || (ring_size & (ring_size - 1)) != 0 || fstat(fds[0], &memory) != 0 ||
+       uint64_t(memory.st_size) < ShmClient::segment_size(ring_size)) {
+        ec = boost::system::error_code(boost::system::errc::protocol_error,
+                                       boost::system::system_category());
+        for(int fd : fds) {
+            close(fd);
+        }
+        delete socket;
+        return false;
+    }
+
+    link.socket = socket;
+    link.memory = fds[0];
+    link.ring_size = ring_size;
+    link.doorbell = fds[2];
+    link.peer_doorbell = fds[1];
+    link.acceptor = false;
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <boost/asio.hpp>
+#include "ShmClient.h"
+
+class ShmConnector
+{
+  public:
+    ShmConnector(boost::asio::io_service &io_service);
+
+    // connect makes a shared memory link to the process listening under the given name,
+    // filling in the link for ShmClient::initialize.  It returns false, and sets the
+    // error code to say why, if it fails.
+    bool connect(const std::string &name, ShmLink &link, boost::system::error_code &ec);
+
+  private:
+    boost::asio::io_service &m_io_service;
+};
@@ -1,6 +1,7 @@
 #include "SslAcceptor.h"
 #include "HAProxyHandler.h"
 #include <boost/bind.hpp>
+#include "core/EventLoopPool.h"
 
 SslAcceptor::SslAcceptor(boost::asio::io_service &io_service, ssl::context& ctx,
                          SslAcceptorCallback &callback) :
@@ -12,7 +13,8 @@ SslAcceptor::SslAcceptor(boost::asio::io_service &io_service, ssl::context& ctx,
 
 void SslAcceptor::start_accept()
 {
-    ssl::stream<tcp::socket> *socket = new ssl::stream<tcp::socket>(m_io_service, m_context);
+    ssl::stream<tcp::socket> *socket = new ssl::stream<tcp::socket>(connection_io_service(),
+            m_context);
     m_acceptor.async_accept(socket->next_layer(), boost::bind(&SslAcceptor::handle_accept, this,
                             socket, boost::asio::placeholders::error));
 }
@@ -63,7 +65,7 @@ void SslAcceptor::handle_endpoints(ssl::stream<tcp::socket> *socket,
 
     // Dispatch a handshake (and appropriate timeout)
     auto timeout = std::make_shared<Timeout>(
-                       m_handshake_timeout,
+                       loop_of(socket->next_layer()), m_handshake_timeout,
                        std::bind(&SslAcceptor::handle_timeout, this, socket));
     socket->async_handshake(ssl::stream<tcp::socket>::server,
                             boost::bind(&SslAcceptor::handle_handshake, this,
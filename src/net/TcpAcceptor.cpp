@@ -11,7 +11,7 @@ TcpAcceptor::TcpAcceptor(boost::asio::io_service &io_service,
 
 void TcpAcceptor::start_accept()
 {
-    tcp::socket *socket = new tcp::socket(m_io_service);
+    tcp::socket *socket = new tcp::socket(connection_io_service());
     m_acceptor.async_accept(*socket,
                             boost::bind(&TcpAcceptor::handle_accept, this,
                                         socket, boost::asio::placeholders::error));
@@ -26,7 +26,7 @@ static bool split_port(std::string &ip, uint16_t &port)
     try {
         port = std::stoi(ip.substr(last_colon + 1));
         ip = ip.substr(0, last_colon);
-    } catch(std::invalid_argument) {
+    } catch(const std::invalid_argument&) {
         return false;
     }
 
@@ -127,3 +127,38 @@ std::vector<tcp::endpoint> resolve_address(
 
     return ret;
 }
+
+void async_resolve_address(
+    const std::string &hostspec, uint16_t port, boost::asio::io_service &io_service,
+    std::function<void(const boost::system::error_code &, const std::vector<tcp::endpoint> &)>
+    callback)
+{
+    std::string host = hostspec;
+
+    if(!split_port(host, port)) {
+        io_service.post(std::bind(callback, boost::asio::error::invalid_argument,
+                                  std::vector<tcp::endpoint>()));
+        return;
+    }
+
+    boost::system::error_code ec;
+    address addr = parse_address(host, ec);
+    if(ec.value() == 0) {
+        io_service.post(std::bind(callback, ec,
+                                  std::vector<tcp::endpoint> {tcp::endpoint(addr, port)}));
+        return;
+    }
+
+    // The resolver has to live until the lookup is done, so the handler holds on to it.
+    auto resolver = std::make_shared<tcp::resolver>(io_service);
+    tcp::resolver::query query(host, std::to_string(port));
+    resolver->async_resolve(query, [resolver, callback](const boost::system::error_code &ec,
+                            tcp::resolver::iterator it) {
+        std::vector<tcp::endpoint> ret;
+        tcp::resolver::iterator end;
+        while(it != end) {
+            ret.push_back(*it++);
+        }
+        callback(ec, ret);
+    });
+}
@@ -1,3 +1,4 @@
+#include <functional>
 #include <boost/asio.hpp>
 
 using namespace boost::asio::ip;
@@ -6,3 +7,10 @@ bool is_valid_address(const std::string &hostspec);
 std::vector<tcp::endpoint> resolve_address(
     const std::string &hostspec, uint16_t port,
     boost::asio::io_service &io_service, boost::system::error_code &ec);
+
+// async_resolve_address is resolve_address without blocking on a hostname lookup; callback is
+// called from the io_service with the endpoints, or with the reason they couldn't be found.
+void async_resolve_address(
+    const std::string &hostspec, uint16_t port, boost::asio::io_service &io_service,
+    std::function<void(const boost::system::error_code &, const std::vector<tcp::endpoint> &)>
+    callback);
@@ -4,6 +4,7 @@
 #include "dclass/dc/Class.h"
 #include "dclass/dc/Field.h"
 #include <unordered_set>
+#include <boost/bind.hpp>
 
 #include "DBStateServer.h"
 #include "LoadingObject.h"
@@ -17,6 +18,8 @@ static RoleConfigGroup dbss_config("dbss");
 static ConfigVariable<channel_t> database_channel("database", INVALID_CHANNEL, dbss_config);
 static InvalidChannelConstraint db_channel_not_invalid(database_channel);
 static ReservedChannelConstraint db_channel_not_reserved(database_channel);
+static ConfigVariable<channel_t> control_channel("control", INVALID_CHANNEL, dbss_config);
+static ReservedChannelConstraint control_not_reserved(control_channel);
 
 static ConfigList ranges_config("ranges", dbss_config);
 static ConfigVariable<doid_t> range_min("min", INVALID_DO_ID, ranges_config);
@@ -26,20 +29,120 @@ static InvalidDoidConstraint max_not_invalid(range_max);
 static ReservedDoidConstraint min_not_reserved(range_min);
 static ReservedDoidConstraint max_not_reserved(range_max);
 
+static ConfigGroup cache_config("cache", dbss_config);
+static ConfigVariable<bool> cache_enabled("enabled", false, cache_config);
+static ConfigVariable<unsigned long> cache_size("size", 16 << 20, cache_config);
+static ConfigVariable<unsigned long> cache_stats_interval("stats_interval", 0, cache_config);
+static BooleanValueConstraint cache_enabled_is_boolean(cache_enabled);
+
+// is_cacheable returns true for the fields the DBSS reads from the database for inactive
+// objects, which are the ones the cache holds.
+static bool is_cacheable(const Field *field)
+{
+    return field->has_keyword("db") &&
+           (field->has_keyword("ram") || field->has_keyword("required"));
+}
+
+// add_class_fields adds an object's class, required fields and other fields to a GetAllResp.
+// Required fields which have no value are given their defaults.
+static void add_class_fields(DatagramPtr dg, const Class *dclass, const FieldValues &fields)
+{
+    dg->add_uint16(dclass->get_id());
+
+    // Add required fields to datagram
+    int dcc_field_count = dclass->get_num_fields();
+    for(int i = 0; i < dcc_field_count; ++i) {
+        const Field *field = dclass->get_field(i);
+        if(!field->as_molecular() && field->has_keyword("required")) {
+            auto req_it = fields.find(field);
+            if(req_it != fields.end()) {
+                dg->add_data(req_it->second);
+            } else {
+                dg->add_data(field->get_default_value());
+            }
+        }
+    }
+
+    // Add ram fields to datagram
+    uint16_t ram_count = 0;
+    for(const auto& it : fields) {
+        if(!it.first->has_keyword("required")) {
+            ++ram_count;
+        }
+    }
+    dg->add_uint16(ram_count);
+    for(const auto& it : fields) {
+        if(!it.first->has_keyword("required")) {
+            dg->add_uint16(it.first->get_id());
+            dg->add_data(it.second);
+        }
+    }
+}
+
 DBStateServer::DBStateServer(RoleConfig roleconfig) : StateServer(roleconfig),
-    m_db_channel(database_channel.get_rval(m_roleconfig)), m_next_context(0)
+    m_db_channel(database_channel.get_rval(m_roleconfig)),
+    m_control_channel(control_channel.get_rval(m_roleconfig)), m_next_context(0)
 {
+    if(m_control_channel != INVALID_CHANNEL) {
+        subscribe_channel(m_control_channel);
+    }
+
     ConfigNode ranges = dbss_config.get_child_node(ranges_config, roleconfig);
     for(const auto& it : ranges) {
         channel_t min = range_min.get_rval(it);
         channel_t max = range_max.get_rval(it);
         subscribe_range(min, max);
+        m_ranges.push_back(std::make_pair(min, max));
     }
 
     std::stringstream name;
     name << "DBSS(Database: " << m_db_channel << ")";
     m_log = std::unique_ptr<LogCategory>(new LogCategory("dbss", name.str()));
     set_con_name(name.str());
+
+    ConfigNode cache = dbss_config.get_child_node(cache_config, roleconfig);
+    if(cache_enabled.get_rval(cache)) {
+        m_cache.reset(new InactiveObjectCache(cache_size.get_rval(cache)));
+        m_cache_stats_interval = cache_stats_interval.get_rval(cache);
+        if(m_cache_stats_interval > 0) {
+            m_cache_stats_timer.reset(new boost::asio::deadline_timer(m_io_service));
+            schedule_cache_stats();
+        }
+    }
+}
+
+void DBStateServer::schedule_cache_stats()
+{
+    m_cache_stats_timer->expires_from_now(boost::posix_time::milliseconds(m_cache_stats_interval));
+    m_cache_stats_timer->async_wait(boost::bind(&DBStateServer::handle_cache_stats, this,
+                                    boost::asio::placeholders::error));
+}
+
+// handle_cache_stats reports the cache's hit rate to the log and the event logger.
+void DBStateServer::handle_cache_stats(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return;
+    }
+
+    InactiveObjectCache::Stats stats = m_cache->get_stats();
+    uint64_t reads = stats.hits + stats.misses;
+    double hit_rate = reads ? 100.0 * stats.hits / reads : 0.0;
+    m_log->info() << "Cache: " << stats.objects << " objects in " << stats.bytes << " bytes, "
+                  << stats.hits << " hits, " << stats.misses << " misses (" << hit_rate
+                  << "% hit rate), " << stats.evictions << " evictions.\n";
+
+    std::stringstream sender;
+    sender << "DBSS(Database: " << m_db_channel << ")";
+    LoggedEvent event("cache-stats", sender.str());
+    event.add("objects", std::to_string(stats.objects));
+    event.add("bytes", std::to_string(stats.bytes));
+    event.add("hits", std::to_string(stats.hits));
+    event.add("misses", std::to_string(stats.misses));
+    event.add("evictions", std::to_string(stats.evictions));
+    g_eventsender.send(event);
+
+    schedule_cache_stats();
 }
 
 void DBStateServer::handle_datagram(DatagramHandle, DatagramIterator &dgi)
@@ -53,6 +156,12 @@ void DBStateServer::handle_datagram(DatagramHandle, DatagramIterator &dgi)
     case DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS_OTHER:
         handle_activate(dgi, true);
         break;
+    case DBSS_OBJECT_ACTIVATE_MULTIPLE:
+        handle_activate_multiple(dgi);
+        break;
+    case DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP:
+        handle_get_all_multiple_resp(dgi);
+        break;
     case DBSS_OBJECT_DELETE_DISK:
         handle_delete_disk(sender, dgi);
         break;
@@ -100,6 +209,11 @@ void DBStateServer::handle_activate(DatagramIterator &dgi, bool has_other)
         return;
     }
 
+    // Once it's active the object's fields change without our seeing them.
+    if(m_cache) {
+        m_cache->invalidate(do_id);
+    }
+
     if(!has_other) {
         auto load_it = m_inactive_loads.find(do_id);
         if(load_it == m_inactive_loads.end()) {
@@ -132,6 +246,83 @@ void DBStateServer::handle_activate(DatagramIterator &dgi, bool has_other)
     }
 }
 
+void DBStateServer::handle_activate_multiple(DatagramIterator &dgi)
+{
+    doid_t parent_id = dgi.read_doid();
+    zone_t zone_id = dgi.read_zone();
+    uint16_t count = dgi.read_uint16();
+
+    // Every object without a GetAll of its own in flight is loaded as part of one request.
+    uint32_t db_context = m_next_context++;
+    std::vector<doid_t> batch;
+    for(uint16_t i = 0; i < count; ++i) {
+        doid_t do_id = dgi.read_doid();
+        if(!is_in_ranges(do_id)) {
+            continue; // Another DBSS's object
+        }
+
+        if(is_activated_object(do_id)) {
+            m_log->warning() << "Received activate for already-active object with id "
+                             << do_id << "\n";
+            continue;
+        }
+
+        // Once it's active the object's fields change without our seeing them.
+        if(m_cache) {
+            m_cache->invalidate(do_id);
+        }
+
+        auto load_it = m_inactive_loads.find(do_id);
+        if(load_it != m_inactive_loads.end()) {
+            m_loading[do_id] = new LoadingObject(this, do_id, parent_id, zone_id, load_it->second);
+            continue;
+        }
+
+        LoadingObject *loader = new LoadingObject(this, do_id, parent_id, zone_id);
+        m_loading[do_id] = loader;
+        if(m_control_channel == INVALID_CHANNEL) {
+            // Without a channel of our own for the responses, each object loads on its own.
+            loader->begin();
+            continue;
+        }
+        loader->m_context = db_context;
+        batch.push_back(do_id);
+    }
+
+    if(batch.empty()) {
+        return;
+    }
+
+    m_log->trace() << "Loading " << batch.size() << " objects to activate from database.\n";
+
+    // The database answers each object separately, to our control channel, and we hand
+    // each response on to its loader.
+    DatagramPtr dg = Datagram::create(m_db_channel, m_control_channel,
+                                      DBSERVER_OBJECT_GET_ALL_MULTIPLE);
+    dg->add_uint32(db_context);
+    dg->add_uint16(batch.size());
+    for(doid_t do_id : batch) {
+        dg->add_doid(do_id);
+    }
+    route_datagram(dg);
+}
+
+void DBStateServer::handle_get_all_multiple_resp(DatagramIterator &dgi)
+{
+    uint32_t db_context = dgi.read_uint32();
+    doid_t do_id = dgi.read_doid();
+
+    auto loader = m_loading.find(do_id);
+    if(loader == m_loading.end() || loader->second->m_context != db_context ||
+       loader->second->m_is_loaded) {
+        return;
+    }
+
+    m_log->trace() << "Received GetAllMultipleResp from database for object with id "
+                   << do_id << ".\n";
+    loader->second->load_object(dgi);
+}
+
 void DBStateServer::handle_get_activated(channel_t sender, DatagramIterator& dgi)
 {
     uint32_t r_context = dgi.read_uint32();
@@ -168,6 +359,11 @@ void DBStateServer::handle_delete_disk(channel_t sender, DatagramIterator& dgi)
         return;
     }
 
+    detach_reads(do_id);
+    if(m_cache) {
+        m_cache->invalidate(do_id);
+    }
+
     // If object exists broadcast the delete message
     auto obj_keyval = m_objs.find(do_id);
     if(obj_keyval != m_objs.end()) {
@@ -218,6 +414,11 @@ void DBStateServer::handle_set_field(DatagramIterator &dgi)
         m_log->trace() << "Forwarding SetField for field \"" << field->get_name()
                        << "\" on object with id " << do_id << " to database.\n";
 
+        detach_reads(do_id);
+        if(m_cache) {
+            m_cache->invalidate(do_id);
+        }
+
         DatagramPtr dg = Datagram::create(m_db_channel, do_id, DBSERVER_OBJECT_SET_FIELD);
         dg->add_doid(do_id);
         dg->add_uint16(field_id);
@@ -255,6 +456,11 @@ void DBStateServer::handle_set_fields(DatagramIterator &dgi)
     if(db_fields.size() > 0) {
         m_log->trace() << "Forwarding SetFields on object with id " << do_id << " to database.\n";
 
+        detach_reads(do_id);
+        if(m_cache) {
+            m_cache->invalidate(do_id);
+        }
+
         DatagramPtr dg = Datagram::create(m_db_channel, do_id, DBSERVER_OBJECT_SET_FIELDS);
         dg->add_doid(do_id);
         dg->add_uint16(db_fields.size());
@@ -289,13 +495,33 @@ void DBStateServer::handle_get_field(channel_t sender, DatagramIterator &dgi)
     }
 
     if(field->has_keyword("db")) {
-        // Get context for db query
-        uint32_t db_context = m_next_context++;
+        FieldValues cached;
+        if(m_cache && m_cache->get_fields(r_do_id, {field}, cached)) {
+            DatagramPtr dg = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_FIELD_RESP);
+            dg->add_uint32(r_context);
+            dg->add_bool(true);
+            dg->add_uint16(field_id);
+            dg->add_data(cached[field]);
+            route_datagram(dg);
+            return;
+        }
 
         // Prepare reponse datagram
         DatagramPtr dg_resp = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_FIELD_RESP);
         dg_resp->add_uint32(r_context);
+
+        read_key_t key(r_do_id, DBSERVER_OBJECT_GET_FIELD, {field_id});
+        if(join_read(key, dg_resp)) {
+            return;
+        }
+
+        // Get context for db query
+        uint32_t db_context = m_next_context++;
+        if(m_cache) {
+            m_cache->expect(r_do_id, db_context);
+        }
         m_context_datagrams[db_context] = dg_resp;
+        begin_read(key, db_context);
 
         // Send query to database
         DatagramPtr dg = Datagram::create(m_db_channel, r_do_id, DBSERVER_OBJECT_GET_FIELD);
@@ -325,9 +551,10 @@ void DBStateServer::handle_get_field_resp(DatagramIterator& dgi)
         return;
     }
 
-    // Get the datagram from the db_context
+    // Get the datagram from the db_context, along with those of the reads waiting on it
     DatagramPtr dg = m_context_datagrams[db_context];
     m_context_datagrams.erase(db_context);
+    std::vector<DatagramPtr> resp_dgs = end_read(db_context, dg);
 
     // Check to make sure the datagram is appropriate
     DatagramIterator check_dgi = DatagramIterator(dg);
@@ -343,9 +570,16 @@ void DBStateServer::handle_get_field_resp(DatagramIterator& dgi)
 
     m_log->trace() << "Received GetFieldResp from database." << std::endl;
 
-    // Add database field payload to response (don't know dclass, so must copy payload) and send
-    dg->add_data(dgi.read_remainder());
-    route_datagram(dg);
+    if(m_cache) {
+        fill_cache(db_context, dgi, false);
+    }
+
+    // Add database field payload to responses (don't know dclass, so must copy payload) and send
+    std::vector<uint8_t> payload = dgi.read_remainder();
+    for(const auto& it : resp_dgs) {
+        it->add_data(payload);
+        route_datagram(it);
+    }
 }
 
 void DBStateServer::handle_get_fields(channel_t sender, DatagramIterator &dgi)
@@ -379,22 +613,49 @@ void DBStateServer::handle_get_fields(channel_t sender, DatagramIterator &dgi)
         }
     }
 
-    if(db_fields.size()) {
-        // Get context for db query
-        uint32_t db_context = m_next_context++;
-
-        // Prepare reponse datagram
-        if(m_context_datagrams.find(db_context) == m_context_datagrams.end()) {
-            m_context_datagrams[db_context] = Datagram::create(sender, r_do_id,
-                                              STATESERVER_OBJECT_GET_FIELDS_RESP);
+    FieldValues cached;
+    if(db_fields.size() && m_cache &&
+       m_cache->get_fields(r_do_id, std::vector<const Field*>(db_fields.begin(), db_fields.end()),
+                           cached)) {
+        DatagramPtr dg = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_FIELDS_RESP);
+        dg->add_uint32(r_context);
+        dg->add_bool(true);
+        dg->add_uint16(ram_fields.size() + db_fields.size());
+        for(const auto& it : ram_fields) {
+            dg->add_uint16(it->get_id());
+            dg->add_data(it->get_default_value());
+        }
+        for(const auto& it : db_fields) {
+            dg->add_uint16(it->get_id());
+            dg->add_data(cached[it]);
         }
-        m_context_datagrams[db_context]->add_uint32(r_context);
-        m_context_datagrams[db_context]->add_bool(true);
-        m_context_datagrams[db_context]->add_uint16(ram_fields.size() + db_fields.size());
+        route_datagram(dg);
+    } else if(db_fields.size()) {
+        // Prepare reponse datagram
+        DatagramPtr dg_resp = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_FIELDS_RESP);
+        dg_resp->add_uint32(r_context);
+        dg_resp->add_bool(true);
+        dg_resp->add_uint16(ram_fields.size() + db_fields.size());
         for(const auto& it : ram_fields) {
-            m_context_datagrams[db_context]->add_uint16(it->get_id());
-            m_context_datagrams[db_context]->add_data(it->get_default_value());
+            dg_resp->add_uint16(it->get_id());
+            dg_resp->add_data(it->get_default_value());
+        }
+
+        read_key_t key(r_do_id, DBSERVER_OBJECT_GET_FIELDS, {});
+        for(const auto& it : db_fields) {
+            std::get<2>(key).push_back(it->get_id());
+        }
+        if(join_read(key, dg_resp)) {
+            return;
+        }
+
+        // Get context for db query
+        uint32_t db_context = m_next_context++;
+        if(m_cache) {
+            m_cache->expect(r_do_id, db_context);
         }
+        m_context_datagrams[db_context] = dg_resp;
+        begin_read(key, db_context);
 
         // Send query to database
         DatagramPtr dg = Datagram::create(m_db_channel, r_do_id, DBSERVER_OBJECT_GET_FIELDS);
@@ -425,9 +686,10 @@ void DBStateServer::handle_get_fields_resp(DatagramIterator& dgi)
         return;
     }
 
-    // Get the datagram from the db_context
+    // Get the datagram from the db_context, along with those of the reads waiting on it
     DatagramPtr dg = m_context_datagrams[db_context];
     m_context_datagrams.erase(db_context);
+    std::vector<DatagramPtr> resp_dgs = end_read(db_context, dg);
 
     // Check to make sure the datagram is appropriate
     DatagramIterator check_dgi = DatagramIterator(dg);
@@ -443,12 +705,20 @@ void DBStateServer::handle_get_fields_resp(DatagramIterator& dgi)
 
     m_log->trace() << "Received GetFieldResp from database." << std::endl;
 
-    // Add database field payload to response (don't know dclass, so must copy payload).
+    if(m_cache) {
+        fill_cache(db_context, dgi, true);
+    }
+
+    // Add database field payload to responses (don't know dclass, so must copy payload).
+    std::vector<uint8_t> payload;
     if(dgi.read_bool() == true) {
         dgi.read_uint16(); // Discard field count
-        dg->add_data(dgi.read_remainder());
+        payload = dgi.read_remainder();
+    }
+    for(const auto& it : resp_dgs) {
+        it->add_data(payload);
+        route_datagram(it);
     }
-    route_datagram(dg);
 }
 
 
@@ -462,14 +732,35 @@ void DBStateServer::handle_get_all(channel_t sender, DatagramIterator &dgi)
 
     m_log->trace() << "Received GetAll for inactive object with id " << r_do_id << std::endl;
 
-    // Get context for db query, and remember caller with it
-    uint32_t db_context = m_next_context++;
+    const Class *r_class;
+    FieldValues cached;
+    if(m_cache && m_cache->get_all(r_do_id, r_class, cached)) {
+        DatagramPtr dg = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_ALL_RESP);
+        dg->add_uint32(r_context);
+        dg->add_doid(r_do_id);
+        dg->add_channel(INVALID_CHANNEL); // Location
+        add_class_fields(dg, r_class, cached);
+        route_datagram(dg);
+        return;
+    }
 
     DatagramPtr resp_dg = Datagram::create(sender, r_do_id, STATESERVER_OBJECT_GET_ALL_RESP);
     resp_dg->add_uint32(r_context);
     resp_dg->add_doid(r_do_id);
     resp_dg->add_channel(INVALID_CHANNEL); // Location
+
+    read_key_t key(r_do_id, DBSERVER_OBJECT_GET_ALL, {});
+    if(join_read(key, resp_dg)) {
+        return;
+    }
+
+    // Get context for db query, and remember caller with it
+    uint32_t db_context = m_next_context++;
+    if(m_cache) {
+        m_cache->expect(r_do_id, db_context);
+    }
     m_context_datagrams[db_context] = resp_dg;
+    begin_read(key, db_context);
 
     // Cache the do_id --> context in case we get a dbss_activate
     m_inactive_loads[r_do_id].insert(db_context);
@@ -488,9 +779,10 @@ void DBStateServer::handle_get_all_resp(DatagramIterator& dgi)
         return;
     }
 
-    // Get the datagram from the db_context
+    // Get the datagram from the db_context, along with those of the reads waiting on it
     DatagramPtr dg = m_context_datagrams[db_context];
     m_context_datagrams.erase(db_context);
+    std::vector<DatagramPtr> resp_dgs = end_read(db_context, dg);
 
     // Check to make sure the datagram is appropriate
     DatagramIterator check_dgi = DatagramIterator(dg);
@@ -520,6 +812,9 @@ void DBStateServer::handle_get_all_resp(DatagramIterator& dgi)
 
     // If object not found, just cleanup the context map
     if(dgi.read_bool() != true) {
+        if(m_cache) {
+            m_cache->forget(db_context);
+        }
         return; // Object not found
     }
 
@@ -540,32 +835,99 @@ void DBStateServer::handle_get_all_resp(DatagramIterator& dgi)
         return;
     }
 
-    // Add class to response
-    dg->add_uint16(r_class->get_id());
+    FieldValues fields = ram_fields;
+    fields.insert(required_fields.begin(), required_fields.end());
+    if(m_cache) {
+        m_cache->fill(db_context, fields, r_class);
+    }
 
-    // Add required fields to datagram
-    int dcc_field_count = r_class->get_num_fields();
-    for(int i = 0; i < dcc_field_count; ++i) {
-        const Field *field = r_class->get_field(i);
-        if(!field->as_molecular() && field->has_keyword("required")) {
-            auto req_it = required_fields.find(field);
-            if(req_it != required_fields.end()) {
-                dg->add_data(req_it->second);
-            } else {
-                dg->add_data(field->get_default_value());
+    // Add class and fields to responses, and send them back to the callers
+    for(const auto& it : resp_dgs) {
+        add_class_fields(it, r_class, fields);
+        route_datagram(it);
+    }
+}
+
+// fill_cache caches the fields from a GetFieldResp or GetFieldsResp, without advancing dgi.
+void DBStateServer::fill_cache(uint32_t db_context, const DatagramIterator &dgi, bool has_count)
+{
+    FieldValues fields;
+    try {
+        DatagramIterator fields_dgi = dgi;
+        if(fields_dgi.read_bool()) {
+            uint16_t field_count = has_count ? fields_dgi.read_uint16() : 1;
+            for(uint16_t i = 0; i < field_count; ++i) {
+                const Field *field = g_dcf->get_field_by_id(fields_dgi.read_uint16());
+                if(!field || !is_cacheable(field)) {
+                    m_cache->forget(db_context);
+                    return;
+                }
+                fields_dgi.unpack_field(field, fields[field]);
             }
         }
+        if(fields_dgi.get_remaining()) {
+            // Whatever this is, it's not something we understand well enough to cache.
+            m_cache->forget(db_context);
+            return;
+        }
+    } catch(const DatagramIteratorEOF &) {
+        m_cache->forget(db_context);
+        return;
     }
 
-    // Add ram fields to datagram
-    dg->add_uint16(ram_fields.size());
-    for(const auto& it : ram_fields) {
-        dg->add_uint16(it.first->get_id());
-        dg->add_data(it.second);
+    if(fields.empty()) {
+        m_cache->forget(db_context);
+        return;
     }
+    m_cache->fill(db_context, fields);
+}
 
-    // Send response back to caller
-    route_datagram(dg);
+bool DBStateServer::join_read(const read_key_t &key, DatagramPtr resp_dg)
+{
+    auto inflight = m_inflight_reads.find(key);
+    if(inflight == m_inflight_reads.end()) {
+        return false;
+    }
+
+    m_log->trace() << "Waiting on read already in flight to database for object with id "
+                   << std::get<0>(key) << ".\n";
+    m_context_followers[inflight->second].push_back(resp_dg);
+    return true;
+}
+
+void DBStateServer::begin_read(const read_key_t &key, uint32_t db_context)
+{
+    m_inflight_reads[key] = db_context;
+    m_inflight_keys[db_context] = key;
+}
+
+std::vector<DatagramPtr> DBStateServer::end_read(uint32_t db_context, DatagramPtr resp_dg)
+{
+    std::vector<DatagramPtr> resp_dgs {resp_dg};
+
+    auto key = m_inflight_keys.find(db_context);
+    if(key != m_inflight_keys.end()) {
+        m_inflight_reads.erase(key->second);
+        m_inflight_keys.erase(key);
+    }
+
+    auto followers = m_context_followers.find(db_context);
+    if(followers != m_context_followers.end()) {
+        resp_dgs.insert(resp_dgs.end(), followers->second.begin(), followers->second.end());
+        m_context_followers.erase(followers);
+    }
+
+    return resp_dgs;
+}
+
+void DBStateServer::detach_reads(doid_t do_id)
+{
+    // The reads are ordered by object first, so all of an object's are together.
+    auto it = m_inflight_reads.lower_bound(read_key_t(do_id, 0, {}));
+    while(it != m_inflight_reads.end() && std::get<0>(it->first) == do_id) {
+        m_inflight_keys.erase(it->second);
+        it = m_inflight_reads.erase(it);
+    }
 }
 
 void DBStateServer::receive_object(DistributedObject* obj)
@@ -588,6 +950,16 @@ bool DBStateServer::is_activated_object(doid_t do_id)
     return m_objs.find(do_id) != m_objs.end() || m_loading.find(do_id) != m_loading.end();
 }
 
+bool DBStateServer::is_in_ranges(doid_t do_id)
+{
+    for(const auto& it : m_ranges) {
+        if(do_id >= it.first && do_id <= it.second) {
+            return true;
+        }
+    }
+    return false;
+}
+
 
 bool unpack_db_fields(DatagramIterator &dgi, const Class* dc_class,
                       UnorderedFieldValues &required, FieldValues &ram)
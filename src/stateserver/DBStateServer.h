@@ -1,6 +1,11 @@
 #pragma once
+#include <map>
+#include <memory>
+#include <tuple>
 #include <unordered_set>
+#include <boost/asio.hpp>
 #include "StateServer.h"
+#include "InactiveObjectCache.h"
 #include "core/objtypes.h"
 
 /* Helper Functions */
@@ -24,6 +29,8 @@ class DBStateServer final : public StateServer
 
   private:
     channel_t m_db_channel; // database control channel
+    channel_t m_control_channel; // our own channel, for bulk loads; may be INVALID_CHANNEL
+    std::vector<std::pair<doid_t, doid_t> > m_ranges; // the ranges of doids we handle
     std::unordered_map<doid_t, LoadingObject*> m_loading; // loading but not active objects
 
     // m_next_context is the next context to send to the db. Invariant: always post-increment.
@@ -35,8 +42,41 @@ class DBStateServer final : public StateServer
 
     std::unordered_map<doid_t, std::unordered_set<uint32_t> > m_inactive_loads;
 
+    // Reads of inactive objects are single-flight: a read which is identical to one already
+    // waiting on the db doesn't send a query of its own, but waits on the one in flight and
+    // is sent the same response.  A read is identified by its object, the query it sends to
+    // the db and the fields it asks for.
+    typedef std::tuple<doid_t, uint16_t, std::vector<uint16_t> > read_key_t;
+    std::map<read_key_t, uint32_t> m_inflight_reads; // read --> context sent to db
+    std::unordered_map<uint32_t, read_key_t> m_inflight_keys; // context --> read, if it's joinable
+    // m_context_followers holds the response stubs of the reads waiting on a context.
+    std::unordered_map<uint32_t, std::vector<DatagramPtr> > m_context_followers;
+
+    // join_read adds a response stub to an identical read in flight, if there is one.
+    // Returns false if the caller needs to send the query itself.
+    bool join_read(const read_key_t &key, DatagramPtr resp_dg);
+    // begin_read lets later reads identical to key join the query sent with db_context.
+    void begin_read(const read_key_t &key, uint32_t db_context);
+    // end_read returns the response stubs of all the reads waiting on a context, which has
+    // been answered, including the one which sent it.
+    std::vector<DatagramPtr> end_read(uint32_t db_context, DatagramPtr resp_dg);
+    // detach_reads stops later reads of an object which has been changed from joining the
+    // queries already in flight, whose responses may no longer be up to date.
+    void detach_reads(doid_t do_id);
+
+    // m_cache holds the fields of inactive objects read from the database, if it's enabled.
+    std::unique_ptr<InactiveObjectCache> m_cache;
+    unsigned long m_cache_stats_interval;
+    std::unique_ptr<boost::asio::deadline_timer> m_cache_stats_timer;
+    void schedule_cache_stats();
+    void handle_cache_stats(const boost::system::error_code &ec);
+
     // handle_activate accepts an activate message and spawns a LoadingObject to handle it.
     void handle_activate(DatagramIterator &dgi, bool has_other);
+    // handle_activate_multiple activates the objects in our ranges from a list, loading them
+    // from the database with a single request.
+    void handle_activate_multiple(DatagramIterator &dgi);
+    void handle_get_all_multiple_resp(DatagramIterator &dgi);
     void handle_delete_disk(channel_t sender, DatagramIterator &dgi);
     void handle_set_field(DatagramIterator &dgi);
     void handle_set_fields(DatagramIterator &dgi);
@@ -46,6 +86,7 @@ class DBStateServer final : public StateServer
     void handle_get_fields_resp(DatagramIterator &dgi);
     void handle_get_all(channel_t sender, DatagramIterator &dgi);
     void handle_get_all_resp(DatagramIterator &dgi);
+    void fill_cache(uint32_t db_context, const DatagramIterator &dgi, bool has_count);
     void handle_get_activated(channel_t sender, DatagramIterator &dgi);
 
     // receive_object gives responsibility of a DistributedObject to the dbss
@@ -58,4 +99,6 @@ class DBStateServer final : public StateServer
     inline bool is_expected_context(uint32_t context);
     // is_activated_object returns true if the doid is an active or loading object.
     inline bool is_activated_object(doid_t);
+    // is_in_ranges returns true if the doid is one of ours.
+    inline bool is_in_ranges(doid_t);
 };
@@ -0,0 +1,182 @@
+#include "InactiveObjectCache.h"
+using namespace std;
+
+// The rough overhead of an object and of each of its fields, on top of the field values.
+static const size_t OBJECT_OVERHEAD = 128;
+static const size_t FIELD_OVERHEAD = 64;
+
+InactiveObjectCache::InactiveObjectCache(size_t max_bytes) : m_max_bytes(max_bytes), m_bytes(0),
+    m_hits(0), m_misses(0), m_evictions(0)
+{
+}
+
+bool InactiveObjectCache::get_fields(doid_t doid, const vector<const dclass::Field*> &fields,
+                                     FieldValues &values)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto entry = find(doid);
+    bool hit = entry != m_lru.end();
+    for(auto it = fields.begin(); hit && it != fields.end(); ++it) {
+        auto value = entry->fields.find(*it);
+        if(value == entry->fields.end()) {
+            hit = false;
+        } else {
+            values[*it] = value->second;
+        }
+    }
+
+    if(!hit) {
+        values.clear();
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    return true;
+}
+
+bool InactiveObjectCache::get_all(doid_t doid, const dclass::Class *&dclass, FieldValues &values)
+{
+    lock_guard<mutex> guard(m_lock);
+
+    auto entry = find(doid);
+    if(entry == m_lru.end() || !entry->dclass) {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+    dclass = entry->dclass;
+    values = entry->fields;
+    return true;
+}
+
+void InactiveObjectCache::expect(doid_t doid, uint32_t context)
+{
+    m_expected[context] = doid;
+    m_expected_by_object[doid].insert(context);
+}
+
+void InactiveObjectCache::fill(uint32_t context, const FieldValues &values,
+                               const dclass::Class *dclass)
+{
+    auto expected = m_expected.find(context);
+    if(expected == m_expected.end()) {
+        return;
+    }
+    doid_t doid = expected->second;
+    forget(context);
+
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        Entry entry;
+        entry.doid = doid;
+        entry.dclass = nullptr;
+        entry.bytes = 0;
+        m_lru.push_front(entry);
+        found = m_entries.emplace(doid, m_lru.begin()).first;
+    } else {
+        m_lru.splice(m_lru.begin(), m_lru, found->second);
+    }
+
+    Entry &entry = *found->second;
+    if(dclass) {
+        // The whole object replaces whatever we had of it.
+        entry.dclass = dclass;
+        entry.fields = values;
+    } else {
+        for(const auto &it : values) {
+            entry.fields[it.first] = it.second;
+        }
+    }
+    resize(entry);
+    evict();
+}
+
+void InactiveObjectCache::forget(uint32_t context)
+{
+    auto expected = m_expected.find(context);
+    if(expected == m_expected.end()) {
+        return;
+    }
+
+    auto contexts = m_expected_by_object.find(expected->second);
+    contexts->second.erase(context);
+    if(contexts->second.empty()) {
+        m_expected_by_object.erase(contexts);
+    }
+    m_expected.erase(expected);
+}
+
+void InactiveObjectCache::invalidate(doid_t doid)
+{
+    auto contexts = m_expected_by_object.find(doid);
+    if(contexts != m_expected_by_object.end()) {
+        for(uint32_t context : contexts->second) {
+            m_expected.erase(context);
+        }
+        m_expected_by_object.erase(contexts);
+    }
+
+    lock_guard<mutex> guard(m_lock);
+
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        return;
+    }
+
+    m_bytes -= found->second->bytes;
+    m_lru.erase(found->second);
+    m_entries.erase(found);
+}
+
+InactiveObjectCache::Stats InactiveObjectCache::get_stats()
+{
+    lock_guard<mutex> guard(m_lock);
+
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.objects = m_entries.size();
+    stats.bytes = m_bytes;
+    return stats;
+}
+
+// find looks up an object, marking it as the most recently used.
+InactiveObjectCache::lru_t::iterator InactiveObjectCache::find(doid_t doid)
+{
+    auto found = m_entries.find(doid);
+    if(found == m_entries.end()) {
+        return m_lru.end();
+    }
+
+    m_lru.splice(m_lru.begin(), m_lru, found->second);
+    return found->second;
+}
+
+// resize recomputes the size of an entry whose fields have changed.
+void InactiveObjectCache::resize(Entry &entry)
+{
+    size_t bytes = OBJECT_OVERHEAD;
+    for(const auto &it : entry.fields) {
+        bytes += FIELD_OVERHEAD + it.second.size();
+    }
+
+    m_bytes = m_bytes - entry.bytes + bytes;
+    entry.bytes = bytes;
+}
+
+// evict drops the least recently used objects until the cache fits in its size.
+void InactiveObjectCache::evict()
+{
+    while(m_bytes > m_max_bytes && !m_lru.empty()) {
+        Entry &oldest = m_lru.back();
+        m_bytes -= oldest.bytes;
+        m_entries.erase(oldest.doid);
+        m_lru.pop_back();
+        ++m_evictions;
+    }
+}
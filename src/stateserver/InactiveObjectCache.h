@@ -0,0 +1,79 @@
+#pragma once
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "core/types.h"
+#include "core/objtypes.h"
+
+// An InactiveObjectCache holds the ram and required db fields of objects which the DBSS has
+// read from the database on behalf of someone else, without activating them, so that the
+// next read of them can be answered without going back to the database.  When the cache
+// grows past its size in bytes, the least recently used objects are evicted.
+//
+// An object's fields are cached as they come back from the database: a GetField or
+// GetFields adds the fields it read, and a GetAll all of them along with the object's
+// class.  Any change to an object which passes through the DBSS drops it from the cache,
+// along with the reads of it still waiting on the database, whose values may be out of
+// date by the time they arrive.  Changes the database gets from anywhere else aren't seen.
+class InactiveObjectCache
+{
+  public:
+    InactiveObjectCache(size_t max_bytes);
+
+    // get_fields copies out the values of the given fields, returning false unless all of
+    // them are cached.
+    bool get_fields(doid_t doid, const std::vector<const dclass::Field*> &fields,
+                    FieldValues &values);
+    // get_all copies out every cached field of an object, returning false unless the
+    // whole object (and so its class) is cached.
+    bool get_all(doid_t doid, const dclass::Class *&dclass, FieldValues &values);
+
+    // expect notes that a read of an object has gone to the database with the given
+    // context.  Only the responses to reads which are expected can fill the cache.
+    void expect(doid_t doid, uint32_t context);
+    // fill caches the fields read for an expected context; a read of the whole object
+    // also gives its class.  A context which isn't expected is ignored.
+    void fill(uint32_t context, const FieldValues &values,
+              const dclass::Class *dclass = nullptr);
+    // forget stops expecting a context, whose read failed.
+    void forget(uint32_t context);
+
+    // invalidate drops an object which has been changed, and the reads of it in flight.
+    void invalidate(doid_t doid);
+
+    struct Stats {
+        uint64_t hits;      // The number of reads answered from the cache.
+        uint64_t misses;    // The number of reads which had to go to the database.
+        uint64_t evictions; // The number of objects dropped to make room for others.
+        uint64_t objects;   // The number of objects cached.
+        uint64_t bytes;     // The approximate memory used by the cached objects.
+    };
+    Stats get_stats();
+
+  private:
+    struct Entry {
+        doid_t doid;
+        const dclass::Class *dclass; // Only set once the whole object is cached.
+        FieldValues fields;
+        size_t bytes;
+    };
+    typedef std::list<Entry> lru_t; // Most recently used first.
+
+    // The lock is only for get_stats, which is called from the role's timer.
+    std::mutex m_lock;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    lru_t m_lru;
+    std::unordered_map<doid_t, lru_t::iterator> m_entries;
+    uint64_t m_hits, m_misses, m_evictions;
+
+    std::unordered_map<uint32_t, doid_t> m_expected;
+    std::unordered_map<doid_t, std::unordered_set<uint32_t> > m_expected_by_object;
+
+    lru_t::iterator find(doid_t doid); // Requires m_lock.
+    void resize(Entry &entry); // Requires m_lock.
+    void evict(); // Requires m_lock.
+};
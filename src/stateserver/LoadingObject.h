@@ -37,6 +37,9 @@ class LoadingObject final : public MDParticipantInterface
 
     // send_get_object makes the initial request to the database for the object data
     void inline send_get_object(doid_t do_id);
+    // load_object creates the object from the database's response to our request for it,
+    // read from its success flag onwards.
+    void load_object(DatagramIterator &dgi);
     // replay_datagrams while replay the datagrams for a loaded distributed object
     void inline replay_datagrams(DistributedObject* obj);
     // forward_datagrams will replay the datagrams to the dbss for a failed load
@@ -0,0 +1,78 @@
+// ChannelTrackerTest checks the ChannelTracker's allocation, exhaustion and freeing of channels,
+// including that freeing a channel twice doesn't let it be handed out twice.
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include "util/ChannelTracker.h"
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+        ++failures; \
+    }
+
+static void test_alloc_free()
+{
+    ChannelTracker tracker(100, 199);
+    set<channel_t> channels;
+    for(int i = 0; i < 100; ++i) {
+        channel_t channel = tracker.alloc_channel();
+        CHECK(channel >= 100 && channel <= 199);
+        CHECK(channels.insert(channel).second);
+    }
+    CHECK(tracker.alloc_channel() == INVALID_CHANNEL);
+    CHECK(tracker.get_stats().allocated == 100);
+    CHECK(tracker.get_stats().failed == 1);
+
+    tracker.free_channel(150);
+    CHECK(tracker.get_stats().allocated == 99);
+    CHECK(tracker.alloc_channel() == 150);
+}
+
+static void test_double_free()
+{
+    ChannelTracker tracker(100, 199);
+    for(int i = 0; i < 100; ++i) {
+        tracker.alloc_channel();
+    }
+
+    tracker.free_channel(150);
+    tracker.free_channel(150);
+    CHECK(tracker.get_stats().allocated == 99);
+
+    // The channel is only available once.
+    CHECK(tracker.alloc_channel() == 150);
+    CHECK(tracker.alloc_channel() == INVALID_CHANNEL);
+    CHECK(tracker.get_stats().allocated == 100);
+
+    // Freeing a channel which was never allocated does nothing.
+    ChannelTracker empty(100, 199);
+    empty.free_channel(120);
+    CHECK(empty.get_stats().allocated == 0);
+}
+
+static void test_double_free_quarantined()
+{
+    ChannelTracker tracker(100, 101);
+    tracker.set_quarantine(60000);
+    channel_t channel = tracker.alloc_channel();
+    tracker.free_channel(channel);
+    tracker.free_channel(channel);
+    CHECK(tracker.get_stats().allocated == 0);
+    CHECK(tracker.get_stats().quarantined == 1);
+}
+
+int main()
+{
+    test_alloc_free();
+    test_double_free();
+    test_double_free_quarantined();
+    if(failures) {
+        cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    return 0;
+}
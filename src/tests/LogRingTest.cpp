@@ -0,0 +1,111 @@
+// LogRingTest checks that a LogRing hands back the messages pushed into it in order, drops the
+// oldest ones when it is full, and never hands back a torn message while its owning thread
+// overwrites the records being read.
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include "core/LogRing.h"
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+        ++failures; \
+    }
+
+// message returns the contents of the message with the given sequence number, which vary in
+// length so that records land at every offset in the ring.
+static string message(uint64_t seq)
+{
+    return to_string(seq) + ":" + string(seq % 300, char('a' + seq % 26));
+}
+
+static void test_push_pop()
+{
+    LogRing ring;
+    CHECK(ring.empty());
+    CHECK(ring.push(1, "hello", 5) == 0);
+    CHECK(ring.push(2, "", 0) == 0);
+    CHECK(ring.push(3, "world!!!!", 9) == 0);
+
+    uint64_t seq;
+    string out = "> ";
+    CHECK(ring.pop(seq, out) && seq == 1 && out == "> hello");
+    out.clear();
+    CHECK(ring.pop(seq, out) && seq == 2 && out.empty());
+    CHECK(ring.pop(seq, out) && seq == 3 && out == "world!!!!");
+    CHECK(ring.empty() && !ring.pop(seq, out));
+}
+
+static void test_drop_oldest()
+{
+    // Fill the ring several times over; only the newest messages are kept, and they come back
+    // intact even where they wrap around the end of the ring.
+    LogRing ring;
+    const uint64_t count = 5000;
+    unsigned int dropped = 0;
+    for(uint64_t seq = 0; seq < count; ++seq) {
+        string line = message(seq);
+        dropped += ring.push(seq, line.data(), line.size());
+    }
+    CHECK(dropped > 0);
+
+    uint64_t seq, expected = dropped;
+    string out;
+    while(ring.pop(seq, out)) {
+        CHECK(seq == expected && out == message(seq));
+        ++expected;
+        out.clear();
+    }
+    CHECK(expected == count);
+}
+
+static void test_concurrent()
+{
+    // One thread pushes far more than fits while another pops as fast as it can, so that records
+    // are regularly dropped and overwritten while they are being copied out.
+    LogRing ring;
+    const uint64_t count = 200000;
+    atomic<bool> done(false);
+    unsigned int dropped = 0;
+    thread producer([&]() {
+        for(uint64_t seq = 0; seq < count; ++seq) {
+            string line = message(seq);
+            dropped += ring.push(seq, line.data(), line.size());
+        }
+        done.store(true);
+    });
+
+    uint64_t popped = 0, last = 0, seq;
+    bool torn = false, reordered = false;
+    string out;
+    while(!done.load() || !ring.empty()) {
+        if(!ring.pop(seq, out)) {
+            continue;
+        }
+        torn = torn || out != message(seq);
+        reordered = reordered || (popped > 0 && seq <= last);
+        last = seq;
+        ++popped;
+        out.clear();
+    }
+    producer.join();
+
+    CHECK(!torn);
+    CHECK(!reordered);
+    CHECK(popped + dropped == count);
+}
+
+int main()
+{
+    test_push_pop();
+    test_drop_oldest();
+    test_concurrent();
+    if(failures) {
+        cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    return 0;
+}
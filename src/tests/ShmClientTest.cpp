@@ -0,0 +1,159 @@
+// ShmClientTest checks that a ShmClient hands on the datagrams it finds in its incoming ring,
+// and that it disconnects, rather than reading past what was written, when the other side
+// puts a bad frame there.
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "net/ShmClient.h"
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+        ++failures; \
+    }
+
+static const size_t RING_SIZE = 4096;
+
+// A Handler records what its ShmClient gives it, and disconnects after the first datagram.
+class Handler : public NetworkHandler
+{
+  public:
+    shared_ptr<ShmClient> client;
+    vector<DatagramHandle> datagrams;
+    bool disconnected = false;
+    boost::system::error_code error;
+
+    virtual void receive_datagram(DatagramHandle dg)
+    {
+        datagrams.push_back(dg);
+        client->disconnect();
+    }
+    virtual void receive_disconnect(const boost::system::error_code &ec)
+    {
+        disconnected = true;
+        error = ec;
+    }
+};
+
+// run_link has a ShmClient read an incoming ring whose tail is at the given position, with
+// the given data written at its start, until it disconnects.
+static void run_link(Handler &handler, uint64_t tail, const vector<uint8_t> &data,
+                     size_t ring_size = RING_SIZE)
+{
+    boost::asio::io_service io_service;
+
+    int sockets[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    int memory = memfd_create("astron-test", MFD_CLOEXEC);
+    CHECK(memory >= 0 && ftruncate(memory, ShmClient::segment_size(ring_size)) == 0);
+
+    // The accepting side reads from the first ring.
+    void *segment = mmap(nullptr, ShmClient::segment_size(ring_size), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, memory, 0);
+    CHECK(segment != MAP_FAILED);
+    ShmRing *ring = (ShmRing*)segment;
+    memcpy((uint8_t*)(ring + 1), data.data(), data.size());
+    ring->tail.store(tail);
+
+    ShmLink link;
+    link.socket = new boost::asio::local::stream_protocol::socket(io_service);
+    link.socket->assign(boost::asio::local::stream_protocol(), sockets[0]);
+    link.memory = memory;
+    link.ring_size = ring_size;
+    link.doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    link.peer_doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    link.acceptor = true;
+
+    handler.client = make_shared<ShmClient>(&handler);
+    handler.client->initialize(link);
+    io_service.run();
+    handler.client.reset();
+
+    munmap(segment, ShmClient::segment_size(ring_size));
+    close(sockets[1]);
+}
+
+// frame returns a ring's worth of data holding a frame of the given size and contents.
+static vector<uint8_t> frame(uint32_t size, const string &contents)
+{
+    vector<uint8_t> data(sizeof(size) + contents.size());
+    memcpy(data.data(), &size, sizeof(size));
+    memcpy(data.data() + sizeof(size), contents.data(), contents.size());
+    return data;
+}
+
+static void test_receive()
+{
+    Handler handler;
+    run_link(handler, 4 + 5, frame(5, "hello"));
+    CHECK(handler.datagrams.size() == 1 && handler.datagrams[0]->size() == 5 &&
+          memcmp(handler.datagrams[0]->get_data(), "hello", 5) == 0);
+    CHECK(handler.disconnected && !handler.error);
+}
+
+static void test_frame_past_tail()
+{
+    // A frame which claims more than was written...
+    Handler handler;
+    run_link(handler, 4 + 5, frame(1000, "hello"));
+    CHECK(handler.datagrams.empty());
+    CHECK(handler.disconnected && handler.error == boost::system::errc::protocol_error);
+
+    // ...or more than the whole ring.
+    Handler huge;
+    run_link(huge, 4 + 5, frame(0xFFFFFFFF, "hello"));
+    CHECK(huge.datagrams.empty());
+    CHECK(huge.disconnected && huge.error == boost::system::errc::protocol_error);
+}
+
+static void test_tail_past_ring()
+{
+    Handler handler;
+    run_link(handler, RING_SIZE * 2, frame(5, "hello"));
+    CHECK(handler.datagrams.empty());
+    CHECK(handler.disconnected && handler.error == boost::system::errc::protocol_error);
+}
+
+static void test_partial_size()
+{
+    Handler handler;
+    run_link(handler, 2, frame(5, "hello"));
+    CHECK(handler.datagrams.empty());
+    CHECK(handler.disconnected && handler.error == boost::system::errc::protocol_error);
+}
+
+static void test_frame_past_datagram()
+{
+    // A frame which lies within the ring, but is too big for a datagram.  With 32-bit
+    // datagrams, no ring we could map here is big enough to hold one.
+    if(sizeof(dgsize_t) > 2) {
+        return;
+    }
+    Handler handler;
+    uint32_t size = uint32_t(DGSIZE_MAX) + 1;
+    run_link(handler, sizeof(size) + size, frame(size, string(size, 'x')), size * 2);
+    CHECK(handler.datagrams.empty());
+    CHECK(handler.disconnected && handler.error == boost::system::errc::protocol_error);
+}
+
+int main()
+{
+    test_receive();
+    test_frame_past_tail();
+    test_tail_past_ring();
+    test_partial_size();
+    test_frame_past_datagram();
+    if(failures) {
+        cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+// TimerWheelTest checks that a TimerWheel fires its entries in deadline order and never early,
+// that cancelled entries never fire, and that entries rescheduled past the end of the finest
+// level of the wheel are cascaded back down and fire on time.
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "util/TimerWheel.h"
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    if(!(cond)) { \
+        cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond "\n"; \
+        ++failures; \
+    }
+
+typedef chrono::steady_clock steady_clock_t;
+
+// An Entry records the order it fires in, and how long after it was (re)scheduled it fired.
+// It reschedules itself for the same delay until it has fired `fires` times.
+class Entry : public TimerWheelEntry, public enable_shared_from_this<Entry>
+{
+  public:
+    Entry(TimerWheel &wheel, vector<int> &fired, int id, unsigned long delay, int fires = 1) :
+        m_wheel(wheel), m_fired(fired), m_id(id), m_delay(delay), m_fires(fires)
+    {
+    }
+
+    bool early = false;
+
+    void start()
+    {
+        start(m_delay);
+    }
+
+    void start(unsigned long delay)
+    {
+        m_delay = delay;
+        m_scheduled = steady_clock_t::now();
+        m_wheel.schedule(shared_from_this(), delay);
+    }
+
+  protected:
+    virtual void expire()
+    {
+        m_fired.push_back(m_id);
+
+        // Deadlines are counted in whole milliseconds, so allow for the fraction of one that
+        // had already passed when the entry was scheduled.
+        auto waited = steady_clock_t::now() - m_scheduled;
+        early = early || waited < chrono::milliseconds(m_delay) - chrono::milliseconds(1);
+
+        if(--m_fires > 0) {
+            start();
+        }
+    }
+
+  private:
+    TimerWheel &m_wheel;
+    vector<int> &m_fired;
+    int m_id;
+    unsigned long m_delay;
+    int m_fires;
+    steady_clock_t::time_point m_scheduled;
+};
+
+static void test_order()
+{
+    boost::asio::io_service io_service;
+    TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io_service);
+    wheel.set_resolution(1);
+
+    vector<int> fired;
+    vector<shared_ptr<Entry>> entries;
+    unsigned long delays[] = {30, 5, 20, 12, 1};
+    for(int i = 0; i < 5; ++i) {
+        entries.push_back(make_shared<Entry>(wheel, fired, i, delays[i]));
+        entries.back()->start();
+    }
+    CHECK(wheel.size() == 5);
+
+    // The wheel stops keeping the io_service busy once everything has fired.
+    io_service.run();
+    CHECK(wheel.size() == 0);
+    CHECK((fired == vector<int> {4, 1, 3, 2, 0}));
+    for(auto &entry : entries) {
+        CHECK(!entry->early);
+    }
+}
+
+static void test_cancel()
+{
+    boost::asio::io_service io_service;
+    TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io_service);
+    wheel.set_resolution(1);
+
+    vector<int> fired;
+    auto a = make_shared<Entry>(wheel, fired, 1, 10);
+    auto b = make_shared<Entry>(wheel, fired, 2, 20);
+    auto c = make_shared<Entry>(wheel, fired, 3, 100); // On the second level of the wheel.
+    a->start();
+    b->start();
+    c->start();
+
+    CHECK(wheel.cancel(a.get()));
+    CHECK(!wheel.cancel(a.get()));
+    CHECK(wheel.cancel(c.get()));
+    CHECK(wheel.size() == 1);
+    io_service.run();
+    CHECK((fired == vector<int> {2}));
+    CHECK(!wheel.cancel(b.get()));
+
+    // Cancelling the last entry disarms the wheel, so run() returns straight away.
+    io_service.reset();
+    a->start(1000);
+    CHECK(wheel.cancel(a.get()));
+    auto started = steady_clock_t::now();
+    io_service.run();
+    CHECK(steady_clock_t::now() - started < chrono::milliseconds(500));
+    CHECK((fired == vector<int> {2}));
+}
+
+static void test_rearm_across_wrap()
+{
+    boost::asio::io_service io_service;
+    TimerWheel &wheel = boost::asio::use_service<TimerWheel>(io_service);
+    wheel.set_resolution(1);
+
+    // With a 1ms tick the finest level covers 64ms.  The first entry keeps rescheduling itself
+    // past the end of it, so it lands on the second level and has to be cascaded back down
+    // every time; the second is moved further out before it fires, to a different slot there.
+    vector<int> fired;
+    auto repeating = make_shared<Entry>(wheel, fired, 1, 70, 3);
+    auto moved = make_shared<Entry>(wheel, fired, 2, 100);
+    repeating->start();
+    moved->start();
+    moved->start(180);
+    CHECK(wheel.size() == 2);
+
+    io_service.run();
+    CHECK((fired == vector<int> {1, 1, 2, 1}));
+    CHECK(!repeating->early);
+    CHECK(!moved->early);
+    CHECK(wheel.size() == 0);
+}
+
+int main()
+{
+    test_order();
+    test_cancel();
+    test_rearm_across_wrap();
+    if(failures) {
+        cerr << failures << " checks failed.\n";
+        return 1;
+    }
+    return 0;
+}
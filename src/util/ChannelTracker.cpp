@@ -0,0 +1,153 @@
+#include "ChannelTracker.h"
+using namespace std;
+
+static const unsigned int WORD_BITS = 64;
+
+// lowest_bit returns the index of the lowest set bit in a non-zero word.
+static inline unsigned int lowest_bit(uint64_t word)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    unsigned int bit = 0;
+    while(!(word & 1)) {
+        word >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+ChannelTracker::ChannelTracker(channel_t min, channel_t max) : m_min(min), m_size(0), m_words(0)
+{
+    if(min != INVALID_CHANNEL && max >= min) {
+        m_size = uint64_t(max - min) + 1;
+    }
+
+    m_words = (m_size + WORD_BITS - 1) / WORD_BITS;
+    m_bitmap.reset(new atomic<uint64_t>[m_words]);
+    m_allocated_bits.reset(new atomic<uint64_t>[m_words]);
+    for(size_t i = 0; i < m_words; ++i) {
+        m_bitmap[i] = 0;
+        m_allocated_bits[i] = 0;
+    }
+
+    // Mark the bits past the end of the range as permanently taken.
+    if(m_size % WORD_BITS != 0) {
+        m_bitmap[m_words - 1] = ~uint64_t(0) << (m_size % WORD_BITS);
+    }
+}
+
+void ChannelTracker::set_quarantine(unsigned long ms)
+{
+    lock_guard<mutex> lock(m_quarantine_lock);
+    m_quarantine_ms = ms;
+}
+
+channel_t ChannelTracker::alloc_channel()
+{
+    if(m_quarantined > 0) {
+        release_quarantined();
+    }
+
+    if(m_size == 0) {
+        ++m_failed;
+        return INVALID_CHANNEL;
+    }
+
+    uint64_t start = m_cursor.load(memory_order_relaxed) % m_size;
+    size_t start_word = start / WORD_BITS;
+    uint64_t start_mask = ~uint64_t(0) << (start % WORD_BITS);
+
+    // Scan every word once starting from the cursor, then finally the part of
+    // the first word that lies before the cursor.
+    for(size_t n = 0; n <= m_words; ++n) {
+        size_t w = (start_word + n) % m_words;
+        uint64_t mask = ~uint64_t(0);
+        if(n == 0) {
+            mask = start_mask;
+        } else if(n == m_words) {
+            mask = ~start_mask;
+        }
+
+        uint64_t word = m_bitmap[w].load(memory_order_relaxed);
+        uint64_t available = ~word & mask;
+        while(available != 0) {
+            uint64_t bit = uint64_t(1) << lowest_bit(available);
+            if(m_bitmap[w].compare_exchange_weak(word, word | bit, memory_order_acquire,
+                                                 memory_order_relaxed)) {
+                uint64_t index = w * WORD_BITS + lowest_bit(bit);
+                m_allocated_bits[w].fetch_or(bit, memory_order_relaxed);
+                m_cursor.store(index + 1, memory_order_relaxed);
+                ++m_allocated;
+                return m_min + index;
+            }
+
+            // Somebody else changed the word; word now holds its new value.
+            available = ~word & mask;
+        }
+    }
+
+    ++m_failed;
+    return INVALID_CHANNEL;
+}
+
+void ChannelTracker::free_channel(channel_t channel)
+{
+    if(m_size == 0 || channel < m_min || uint64_t(channel - m_min) >= m_size) {
+        return;
+    }
+
+    uint64_t index = uint64_t(channel - m_min);
+    uint64_t bit = uint64_t(1) << (index % WORD_BITS);
+    if(!(m_allocated_bits[index / WORD_BITS].fetch_and(~bit, memory_order_relaxed) & bit)) {
+        return; // It isn't allocated; freeing it again mustn't hand it out twice.
+    }
+    --m_allocated;
+
+    {
+        lock_guard<mutex> lock(m_quarantine_lock);
+        if(m_quarantine_ms > 0) {
+            steady_clock_t::time_point until = steady_clock_t::now() +
+                                               chrono::milliseconds(m_quarantine_ms);
+            m_quarantine.emplace_back(until, index);
+            ++m_quarantined;
+            return;
+        }
+    }
+
+    release(index);
+}
+
+ChannelTracker::Stats ChannelTracker::get_stats() const
+{
+    Stats stats;
+    stats.capacity = m_size;
+    stats.allocated = m_allocated;
+    stats.quarantined = m_quarantined;
+    stats.failed = m_failed;
+    return stats;
+}
+
+void ChannelTracker::release(uint64_t index)
+{
+    uint64_t bit = uint64_t(1) << (index % WORD_BITS);
+    m_bitmap[index / WORD_BITS].fetch_and(~bit, memory_order_release);
+}
+
+// release_quarantined makes the channels whose quarantine has expired available again.
+void ChannelTracker::release_quarantined()
+{
+    // If another thread is already doing this, let it.
+    unique_lock<mutex> lock(m_quarantine_lock, try_to_lock);
+    if(!lock.owns_lock()) {
+        return;
+    }
+
+    steady_clock_t::time_point now = steady_clock_t::now();
+    while(!m_quarantine.empty() && m_quarantine.front().first <= now) {
+        release(m_quarantine.front().second);
+        m_quarantine.pop_front();
+        --m_quarantined;
+    }
+}
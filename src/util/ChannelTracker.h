@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "core/types.h"
+
+// A ChannelTracker is used to keep track of available and allocated channels in a range,
+// such as the channels a ClientAgent assigns to new Clients.  Channels are tracked with a
+// bitmap of atomic words, so alloc_channel and free_channel are lock-free and safe to call
+// from any thread.  The bitmaps cost two bits per channel in the range.
+//
+// Channels are handed out in next-fit order, so a freed channel is not reused until the
+// allocator has gone around the rest of the range.  Additionally, a quarantine can be set to
+// hold freed channels back for a minimum time, so that messages still in flight to a channel's
+// previous owner can't reach its next one.
+class ChannelTracker
+{
+  public:
+    ChannelTracker(channel_t min = INVALID_CHANNEL, channel_t max = INVALID_CHANNEL);
+
+    // set_quarantine sets how long, in milliseconds, a freed channel is held back before it
+    // may be allocated again; 0 (the default) disables the quarantine.
+    void set_quarantine(unsigned long ms);
+
+    // alloc_channel returns an unused channel, or INVALID_CHANNEL if none are available.
+    channel_t alloc_channel();
+    // free_channel returns a channel to the tracker; channels outside the range, and channels
+    // which aren't allocated (such as one which has already been freed), are ignored.
+    void free_channel(channel_t channel);
+
+    // Stats are a snapshot of the tracker's utilization.
+    struct Stats {
+        uint64_t capacity;    // The number of channels in the range.
+        uint64_t allocated;   // The number of channels currently allocated.
+        uint64_t quarantined; // The number of freed channels waiting out the quarantine.
+        uint64_t failed;      // The number of allocations that found no channel available.
+    };
+    Stats get_stats() const;
+
+  private:
+    typedef std::chrono::steady_clock steady_clock_t;
+
+    channel_t m_min;
+    uint64_t m_size;
+    size_t m_words;
+    // One bit per channel; set while the channel is allocated or quarantined.
+    std::unique_ptr<std::atomic<uint64_t>[]> m_bitmap;
+    // One bit per channel; set only while the channel is allocated, so that a channel which is
+    // freed twice can be told apart from one in quarantine.
+    std::unique_ptr<std::atomic<uint64_t>[]> m_allocated_bits;
+    std::atomic<uint64_t> m_cursor {0}; // Where the next allocation starts looking.
+
+    std::atomic<uint64_t> m_allocated {0};
+    std::atomic<uint64_t> m_failed {0};
+
+    unsigned long m_quarantine_ms = 0;
+    std::mutex m_quarantine_lock;
+    std::deque<std::pair<steady_clock_t::time_point, uint64_t>> m_quarantine;
+    std::atomic<uint64_t> m_quarantined {0};
+
+    void release(uint64_t index);
+    void release_quarantined();
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <unordered_set>
 #include <string>
 #include <vector>
@@ -43,7 +44,7 @@ class Datagram
 
     void check_add_length(dgsize_t len)
     {
-        if(buf_offset + len > DGSIZE_MAX) {
+        if(uint64_t(buf_offset) + len > DGSIZE_MAX) {
             std::stringstream err_str;
             err_str << "dg tried to add data past max datagram size, buf_offset+len("
                     << buf_offset + len << ")" << " max_size(" << DGSIZE_MAX << ")" << std::endl;
@@ -51,11 +52,14 @@ class Datagram
         }
 
         if(buf_offset + len > buf_cap) {
-            uint8_t *tmp_buf = new uint8_t[buf_cap + len + 64];
+            // The extra room can't take the capacity past what a dgsize_t holds.
+            dgsize_t new_cap = dgsize_t(std::min<uint64_t>(uint64_t(buf_cap) + len + 64,
+                                                           DGSIZE_MAX));
+            uint8_t *tmp_buf = new uint8_t[new_cap];
             memcpy(tmp_buf, buf, buf_cap);
             delete [] buf;
             buf = tmp_buf;
-            buf_cap = buf_cap + len + 64;
+            buf_cap = new_cap;
         }
     }
     // default-constructor:
@@ -3,12 +3,102 @@
 #include "EventSender.h"
 #include "net/address_utils.h"
 
+// How long the flusher sleeps when nothing wakes it, in milliseconds.
+static const unsigned int FLUSHER_INTERVAL = 100;
+
+// An EventQueue is a bounded, lock-free queue of events waiting to be sent.  Any thread may push
+// events onto it; only the flusher (holding the EventSender's send lock) takes them off.
+//
+// Each slot has a sequence number saying whose turn it is: a slot is free for the producer which
+// claims position pos when its sequence is pos, and holds that producer's event once the
+// sequence is pos + 1.  The consumer hands the slot back for the next lap by setting it to
+// pos + CAPACITY.  A slot's string keeps its capacity, so events are copied without allocating.
+class EventQueue
+{
+  public:
+    static const size_t CAPACITY = 4096; // Must be a power of two.
+
+    EventQueue() : m_slots(new Slot[CAPACITY]), m_push_pos(0), m_pop_pos(0)
+    {
+        for(size_t i = 0; i < CAPACITY; ++i) {
+            m_slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // push copies an event onto the queue, returning false if the queue is full.
+    bool push(const uint8_t *data, size_t length)
+    {
+        Slot *slot;
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        for(;;) {
+            slot = &m_slots[pos & (CAPACITY - 1)];
+            size_t seq = slot->seq.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(seq) - intptr_t(pos);
+            if(diff == 0) {
+                if(m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(diff < 0) {
+                return false; // The consumer hasn't freed this slot from the last lap yet.
+            } else {
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->data.assign(reinterpret_cast<const char*>(data), length);
+        slot->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // front returns the oldest event, or nullptr if there is none.
+    const std::string *front()
+    {
+        Slot &slot = m_slots[m_pop_pos & (CAPACITY - 1)];
+        if(slot.seq.load(std::memory_order_acquire) != m_pop_pos + 1) {
+            return nullptr;
+        }
+        return &slot.data;
+    }
+
+    // pop removes the event returned by front.
+    void pop()
+    {
+        Slot &slot = m_slots[m_pop_pos & (CAPACITY - 1)];
+        slot.seq.store(m_pop_pos + CAPACITY, std::memory_order_release);
+        ++m_pop_pos;
+    }
+
+  private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        std::string data;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_push_pos;
+    size_t m_pop_pos;
+};
+
 EventSender::EventSender() : m_log("eventsender", "Event Sender"),
-    m_socket(io_service, udp::v4()), m_enabled(false)
+    m_socket(io_service, udp::v4()), m_enabled(false), m_sent(0), m_dropped(0),
+    m_datagrams(0), m_reported_dropped(0), m_pending(false), m_stopping(false)
 {
 
 }
 
+EventSender::~EventSender()
+{
+    if(m_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_wake_lock);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_flusher.join();
+        drain();
+    }
+}
+
 void EventSender::init(const std::string& target)
 {
     if(target == "") {
@@ -26,21 +116,142 @@ void EventSender::init(const std::string& target)
     }
 
     m_target = udp::endpoint(addresses[0].address(), addresses[0].port());
+    m_queue.reset(new EventQueue);
+    m_flusher = std::thread(&EventSender::run_flusher, this);
     m_enabled = true;
 
     m_log.debug() << "Initialized." << std::endl;
 }
 
-void EventSender::send(DatagramHandle dg)
+void EventSender::send(const uint8_t *data, size_t length)
 {
     if(!m_enabled) {
         m_log.trace() << "Disabled; discarding event..." << std::endl;
         return;
     }
 
-    m_log.trace() << "Sending event..." << std::endl;
-    m_socket.send_to(boost::asio::buffer(dg->get_data(), dg->size()),
-                     m_target);
+    m_log.trace() << "Queueing event..." << std::endl;
+    if(!m_queue->push(data, length)) {
+        ++m_dropped;
+        return;
+    }
+
+    // Only the first event since the flusher last woke needs to wake it up again.
+    if(!m_pending.load(std::memory_order_relaxed) && !m_pending.exchange(true)) {
+        std::lock_guard<std::mutex> lock(m_wake_lock);
+        m_wake.notify_one();
+    }
+}
+
+void EventSender::send(const LoggedEvent &event)
+{
+    static thread_local std::string packed;
+    packed.clear();
+    event.pack(packed);
+    send(reinterpret_cast<const uint8_t*>(packed.data()), packed.size());
+}
+
+void EventSender::flush()
+{
+    if(m_enabled) {
+        drain();
+    }
+}
+
+// A packed datagram starts with an array16 header, whose count is filled in once it's full.
+static const size_t PACKET_HEADER_SIZE = 3;
+
+static inline void pack_bin_header(std::string &out, size_t size)
+{
+    if(size <= 0xFF) {
+        out.push_back(char(0xc4));
+        out.push_back(char(size));
+    } else if(size <= 0xFFFF) {
+        out.push_back(char(0xc5));
+        out.push_back(char(size >> 8));
+        out.push_back(char(size));
+    } else {
+        out.push_back(char(0xc6));
+        for(int shift = 24; shift >= 0; shift -= 8) {
+            out.push_back(char(size >> shift));
+        }
+    }
+}
+
+// drain takes every queued event off of the queue, and sends them in as few datagrams as it can.
+void EventSender::drain()
+{
+    std::lock_guard<std::mutex> lock(m_send_lock);
+
+    uint32_t events = 0;
+    size_t first_offset = 0, first_length = 0;
+    m_packet.assign(PACKET_HEADER_SIZE, '\0');
+
+    const std::string *event;
+    while((event = m_queue->front()) != nullptr) {
+        if(events > 0 && (m_packet.size() + 5 + event->size() > EVENTSENDER_MTU ||
+                          events == 0xFFFF)) {
+            send_packet(events, first_offset, first_length);
+            events = 0;
+            m_packet.resize(PACKET_HEADER_SIZE);
+        }
+
+        pack_bin_header(m_packet, event->size());
+        if(events++ == 0) {
+            first_offset = m_packet.size();
+            first_length = event->size();
+        }
+        m_packet.append(*event);
+        m_queue->pop();
+    }
+    if(events > 0) {
+        send_packet(events, first_offset, first_length);
+    }
+
+    uint64_t dropped = m_dropped.load();
+    if(dropped != m_reported_dropped) {
+        m_log.warning() << "Dropped " << (dropped - m_reported_dropped)
+                        << " events; the queue was full." << std::endl;
+        m_reported_dropped = dropped;
+    }
+}
+
+// send_packet sends the packed events, or just the event itself if there is only one.
+void EventSender::send_packet(uint32_t events, size_t first_offset, size_t first_length)
+{
+    boost::system::error_code ec;
+    if(events == 1) {
+        m_socket.send_to(boost::asio::buffer(&m_packet[first_offset], first_length),
+                         m_target, 0, ec);
+    } else {
+        m_packet[0] = char(0xdc);
+        m_packet[1] = char(events >> 8);
+        m_packet[2] = char(events);
+        m_socket.send_to(boost::asio::buffer(m_packet), m_target, 0, ec);
+    }
+
+    if(ec) {
+        m_log.warning() << "Could not send " << events << " events: " << ec.message()
+                        << std::endl;
+        return;
+    }
+    m_sent += events;
+    ++m_datagrams;
+}
+
+void EventSender::run_flusher()
+{
+    std::unique_lock<std::mutex> lock(m_wake_lock);
+    while(!m_stopping) {
+        m_wake.wait_for(lock, std::chrono::milliseconds(FLUSHER_INTERVAL), [this] {
+            return m_stopping || m_pending.load();
+        });
+
+        m_pending = false;
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
 }
 
 // And now the convenience class:
@@ -72,47 +283,50 @@ void LoggedEvent::add(const std::string &key, const std::string &value)
     }
 }
 
-static inline void pack_string(DatagramPtr dg, const std::string &str)
+static inline void pack_string(std::string &out, const std::string &str)
 {
     size_t size = str.size();
 
     if(size < 32) {
         // Small enough for fixstr:
-        dg->add_uint8(0xa0 + size);
+        out.push_back(char(0xa0 + size));
     } else {
         // Use a str16.
         // We don't have to worry about str32, nothing that big will fit in a
         // single UDP packet anyway.
-        dg->add_uint8(0xda);
-        dg->add_uint8(size >> 8 & 0xFF);
-        dg->add_uint8(size & 0xFF);
+        out.push_back(char(0xda));
+        out.push_back(char(size >> 8 & 0xFF));
+        out.push_back(char(size & 0xFF));
     }
 
-    dg->add_data(str);
+    out.append(str);
 }
 
-DatagramHandle LoggedEvent::make_datagram() const
+void LoggedEvent::pack(std::string &out) const
 {
-    DatagramPtr dg = Datagram::create();
-
     // First, append the size of our map:
     size_t size = m_kv.size();
     if(size < 16) {
         // Small enough for fixmap:
-        dg->add_uint8(0x80 + size);
+        out.push_back(char(0x80 + size));
     } else {
         // Use a map16.
         // We don't have to worry about map32, nothing that big will fit in a
         // single UDP packet anyway.
-        dg->add_uint8(0xde);
-        dg->add_uint8(size >> 8 & 0xFF);
-        dg->add_uint8(size & 0xFF);
+        out.push_back(char(0xde));
+        out.push_back(char(size >> 8 & 0xFF));
+        out.push_back(char(size & 0xFF));
     }
 
     for(auto &it : m_kv) {
-        pack_string(dg, it.first);
-        pack_string(dg, it.second);
+        pack_string(out, it.first);
+        pack_string(out, it.second);
     }
+}
 
-    return dg;
+DatagramHandle LoggedEvent::make_datagram() const
+{
+    std::string packed;
+    pack(packed);
+    return Datagram::create(packed);
 }
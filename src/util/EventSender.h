@@ -1,4 +1,9 @@
 #pragma once
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <string>
@@ -19,6 +24,9 @@ class LoggedEvent
 
     void add(const std::string &key, const std::string &value);
 
+    // pack appends the event to out as a MessagePack map.
+    void pack(std::string &out) const;
+
     DatagramHandle make_datagram() const;
 
   private:
@@ -26,20 +34,76 @@ class LoggedEvent
     std::unordered_map<std::string, size_t> m_keys;
 };
 
+// The largest datagram the EventSender packs events into; a little under the payload of a
+// 1500 byte Ethernet frame.  Larger events are still sent, in a datagram of their own.
+#define EVENTSENDER_MTU 1400
+
+class EventQueue;
+
+// An EventSender sends events to the Event Logger.  Sending never blocks the caller: events are
+// copied into a lock-free queue, and a background thread takes them from the queue and sends
+// them.  If the queue is full, the event is dropped (and counted) instead.
+//
+// When several events are waiting, the sender packs as many as fit within EVENTSENDER_MTU into
+// a single datagram, as a MessagePack array of bin values each holding one event's map.
+// A datagram with only one event in it is just the event's map, as it always has been.
 class EventSender
 {
   public:
     EventSender();
+    ~EventSender();
 
     void init(const std::string &target);
-    void send(DatagramHandle dg);
-    inline void send(const LoggedEvent &event)
+
+    // send queues an event, which must be a MessagePack map, to be sent to the Event Logger.
+    void send(const uint8_t *data, size_t length);
+    inline void send(DatagramHandle dg)
     {
-        send(event.make_datagram());
+        send(dg->get_data(), dg->size());
     }
+    void send(const LoggedEvent &event);
+
+    // flush synchronously sends every event queued so far.
+    void flush();
+
+    // get_sent returns the number of events which have been sent.
+    inline uint64_t get_sent() const
+    {
+        return m_sent;
+    }
+    // get_dropped returns the number of events which were dropped because the queue was full.
+    inline uint64_t get_dropped() const
+    {
+        return m_dropped;
+    }
+    // get_datagrams returns the number of datagrams the sent events were packed into.
+    inline uint64_t get_datagrams() const
+    {
+        return m_datagrams;
+    }
+
   private:
     LogCategory m_log;
     udp::socket m_socket;
     udp::endpoint m_target;
-    bool m_enabled;
+    std::atomic<bool> m_enabled;
+
+    std::unique_ptr<EventQueue> m_queue;
+    std::atomic<uint64_t> m_sent;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_datagrams;
+    uint64_t m_reported_dropped;
+
+    std::mutex m_send_lock; // Held while taking events from the queue and sending them.
+    std::string m_packet;
+
+    std::mutex m_wake_lock;
+    std::condition_variable m_wake;
+    std::atomic<bool> m_pending;
+    bool m_stopping;
+    std::thread m_flusher;
+
+    void drain();
+    void send_packet(uint32_t events, size_t first_offset, size_t first_length);
+    void run_flusher();
 };
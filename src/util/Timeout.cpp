@@ -1,22 +1,22 @@
 #include "Timeout.h"
 #include "core/global.h"
 
-#include <boost/bind.hpp>
-
 Timeout::Timeout(unsigned long ms, std::function<void()> f) :
-    m_timer(io_service, boost::posix_time::milliseconds(ms)),
+    Timeout(g_loops.current().get_io_service(), ms, f)
+{
+}
+
+Timeout::Timeout(boost::asio::io_service &io_service, unsigned long ms,
+                 std::function<void()> f) :
+    m_wheel(boost::asio::use_service<TimerWheel>(io_service)),
     m_callback(f),
     m_timeout_interval(ms),
     m_callback_disabled(false)
 {
 }
 
-void Timeout::timer_callback(const boost::system::error_code &ec)
+void Timeout::expire()
 {
-    if(ec) {
-        return; // We were canceled.
-    }
-
     if(m_callback_disabled.exchange(true)) {
         return; // Stop m_callback running twice or after successful cancel().
     }
@@ -26,15 +26,12 @@ void Timeout::timer_callback(const boost::system::error_code &ec)
 
 void Timeout::reset()
 {
-    m_timer.cancel();
-    m_timer.expires_from_now(boost::posix_time::millisec(m_timeout_interval));
-    m_timer.async_wait(boost::bind(&Timeout::timer_callback, shared_from_this(),
-                                   boost::asio::placeholders::error));
+    m_wheel.schedule(shared_from_this(), m_timeout_interval);
 }
 
 bool Timeout::cancel()
 {
-    m_timer.cancel();
+    m_wheel.cancel(this);
     return !m_callback_disabled.exchange(true);
 }
 
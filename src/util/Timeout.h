@@ -3,20 +3,27 @@
 #include <atomic>
 #include <memory>
 #include <boost/asio.hpp>
+#include "TimerWheel.h"
 
-// This class abstracts the boost::asio timer in order to provide a generic
+// This class abstracts the event loop's TimerWheel in order to provide a generic
 // facility for timeouts. Once constructed, this class will wait a certain
 // amount of time and then call the function. The timeout must be canceled
 // with cancel() before you invalidate your callback.
 //
 // You must start the timeout with start().
 //
+// A Timeout runs on the given event loop's io_service, or when none is given,
+// on the event loop of the thread that constructs it (see EventLoopPool::current).
+// Timeouts are scheduled on that loop's TimerWheel, so they may fire up to one
+// wheel tick (event_loops/timer_resolution) late, but never early.
+//
 // NOTE: The thread that calls the function is undefined. Ensure that your
 // callback is thread-safe.
-class Timeout : public std::enable_shared_from_this<Timeout>
+class Timeout : public TimerWheelEntry, public std::enable_shared_from_this<Timeout>
 {
   public:
     Timeout(unsigned long ms, std::function<void()> f);
+    Timeout(boost::asio::io_service &io_service, unsigned long ms, std::function<void()> f);
     ~Timeout();
     inline void start()
     {
@@ -30,13 +37,13 @@ class Timeout : public std::enable_shared_from_this<Timeout>
     // running, or the callback is (about to be) called.
     bool cancel();
 
+  protected:
+    void expire() override;
 
   private:
-    boost::asio::deadline_timer m_timer;
+    TimerWheel &m_wheel;
     std::function<void()> m_callback;
-    long m_timeout_interval;
+    unsigned long m_timeout_interval;
 
     std::atomic<bool> m_callback_disabled;
-
-    void timer_callback(const boost::system::error_code &ec);
 };
@@ -0,0 +1,297 @@
+#include "TimerWheel.h"
+#include <boost/bind.hpp>
+using namespace std;
+
+boost::asio::io_service::id TimerWheel::id;
+
+TimerWheel::TimerWheel(boost::asio::io_service &io_service) :
+    boost::asio::io_service::service(io_service), m_timer(io_service),
+    m_epoch(steady_clock_t::now())
+{
+    for(unsigned int level = 0; level < LEVELS; ++level) {
+        m_occupied[level] = 0;
+        for(unsigned int slot = 0; slot < SLOTS; ++slot) {
+            m_slots[level][slot] = nullptr;
+        }
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+}
+
+#if BOOST_VERSION >= 106600
+void TimerWheel::shutdown()
+#else
+void TimerWheel::shutdown_service()
+#endif
+{
+    // Release our hold on every remaining entry; they will never fire.
+    vector<shared_ptr<TimerWheelEntry>> released;
+    {
+        lock_guard<mutex> lock(m_lock);
+        m_shutdown = true;
+        m_timer.cancel();
+
+        for(unsigned int level = 0; level < LEVELS; ++level) {
+            for(unsigned int slot = 0; slot < SLOTS; ++slot) {
+                TimerWheelEntry *entry = m_slots[level][slot];
+                while(entry != nullptr) {
+                    TimerWheelEntry *next = entry->m_next;
+                    entry->m_prev = entry->m_next = nullptr;
+                    released.push_back(move(entry->m_hold));
+                    entry = next;
+                }
+                m_slots[level][slot] = nullptr;
+            }
+            m_occupied[level] = 0;
+        }
+        m_count = 0;
+    }
+}
+
+void TimerWheel::set_resolution(unsigned long ms)
+{
+    lock_guard<mutex> lock(m_lock);
+    if(m_count > 0) {
+        return; // Existing entries were placed using the old tick length.
+    }
+
+    m_resolution = ms > 0 ? ms : 1;
+    m_next_tick = current_tick(steady_clock_t::now());
+}
+
+void TimerWheel::schedule(const shared_ptr<TimerWheelEntry> &entry, unsigned long ms)
+{
+    lock_guard<mutex> lock(m_lock);
+    if(m_shutdown) {
+        return;
+    }
+
+    steady_clock_t::time_point now = steady_clock_t::now();
+    if(m_count == 0) {
+        // The wheel is idle; skip straight to the present rather than
+        // walking every empty tick since the last entry expired.
+        m_next_tick = max(m_next_tick, current_tick(now));
+    }
+
+    if(entry->m_hold) {
+        unlink(entry.get());
+    } else {
+        entry->m_hold = entry;
+        ++m_count;
+    }
+
+    // Round the deadline up to a whole tick so that the entry never fires early.
+    uint64_t elapsed = chrono::duration_cast<chrono::milliseconds>(now - m_epoch).count();
+    entry->m_expires = (elapsed + ms + m_resolution - 1) / m_resolution;
+    link(entry.get());
+
+    uint64_t wakeup = next_wakeup();
+    if(!m_armed || wakeup < m_armed_tick) {
+        arm(wakeup);
+    }
+}
+
+bool TimerWheel::cancel(TimerWheelEntry *entry)
+{
+    // Declared before the lock, so that our hold is dropped after it is released.
+    shared_ptr<TimerWheelEntry> released;
+
+    lock_guard<mutex> lock(m_lock);
+    if(!entry->m_hold) {
+        return false;
+    }
+
+    unlink(entry);
+    --m_count;
+    released = move(entry->m_hold);
+
+    // When the wheel empties out, disarm it too so that it does not keep the
+    // io_service busy; otherwise the timer is left to find nothing due when it fires.
+    if(m_count == 0 && m_armed) {
+        m_armed = false;
+        m_timer.cancel();
+    }
+
+    return true;
+}
+
+size_t TimerWheel::size()
+{
+    lock_guard<mutex> lock(m_lock);
+    return m_count;
+}
+
+uint64_t TimerWheel::current_tick(steady_clock_t::time_point now)
+{
+    return chrono::duration_cast<chrono::milliseconds>(now - m_epoch).count() / m_resolution;
+}
+
+// link places an entry in the slot covering its expiry tick.  Entries expiring within the
+// next SLOTS ticks go into level 0; later ones go into the first level whose range covers them
+// and are cascaded down into finer levels as the wheel turns.
+void TimerWheel::link(TimerWheelEntry *entry)
+{
+    uint64_t expires = max(entry->m_expires, m_next_tick);
+    uint64_t delta = expires - m_next_tick;
+
+    unsigned int level = 0;
+    while(level < LEVELS && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    if(level == LEVELS) {
+        // Beyond the range of the wheel: park it in the furthest slot.  It keeps its
+        // real expiry, and is pushed back out again when that slot comes around.
+        level = LEVELS - 1;
+        expires = m_next_tick + (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+    }
+
+    unsigned int slot = (expires >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    entry->m_level = level;
+    entry->m_slot = slot;
+    entry->m_prev = nullptr;
+    entry->m_next = m_slots[level][slot];
+    if(entry->m_next != nullptr) {
+        entry->m_next->m_prev = entry;
+    }
+    m_slots[level][slot] = entry;
+    m_occupied[level] |= uint64_t(1) << slot;
+}
+
+void TimerWheel::unlink(TimerWheelEntry *entry)
+{
+    if(entry->m_prev != nullptr) {
+        entry->m_prev->m_next = entry->m_next;
+    } else {
+        m_slots[entry->m_level][entry->m_slot] = entry->m_next;
+    }
+    if(entry->m_next != nullptr) {
+        entry->m_next->m_prev = entry->m_prev;
+    }
+    if(m_slots[entry->m_level][entry->m_slot] == nullptr) {
+        m_occupied[entry->m_level] &= ~(uint64_t(1) << entry->m_slot);
+    }
+    entry->m_prev = entry->m_next = nullptr;
+}
+
+// process_tick advances the wheel by one tick, moving everything that expires on that tick
+// into expired.
+void TimerWheel::process_tick(vector<shared_ptr<TimerWheelEntry>> &expired)
+{
+    uint64_t tick = m_next_tick;
+    unsigned int index = tick & (SLOTS - 1);
+
+    // Each time a level wraps around, the current slot of the level above is due
+    // to be redistributed into the finer levels.
+    if(index == 0) {
+        for(unsigned int level = 1; level < LEVELS; ++level) {
+            unsigned int slot = (tick >> (LEVEL_BITS * level)) & (SLOTS - 1);
+            TimerWheelEntry *entry = m_slots[level][slot];
+            m_slots[level][slot] = nullptr;
+            m_occupied[level] &= ~(uint64_t(1) << slot);
+            while(entry != nullptr) {
+                TimerWheelEntry *next = entry->m_next;
+                link(entry);
+                entry = next;
+            }
+
+            if(slot != 0) {
+                break;
+            }
+        }
+    }
+
+    TimerWheelEntry *entry = m_slots[0][index];
+    m_slots[0][index] = nullptr;
+    m_occupied[0] &= ~(uint64_t(1) << index);
+    while(entry != nullptr) {
+        TimerWheelEntry *next = entry->m_next;
+        if(entry->m_expires > tick) {
+            link(entry); // Parked beyond the range of the wheel; not due yet.
+        } else {
+            entry->m_prev = entry->m_next = nullptr;
+            expired.push_back(move(entry->m_hold));
+            --m_count;
+        }
+        entry = next;
+    }
+
+    m_next_tick = tick + 1;
+}
+
+// next_wakeup returns the next tick on which the wheel has any work to do.
+uint64_t TimerWheel::next_wakeup()
+{
+    uint64_t wakeup = UINT64_MAX;
+
+    if(m_occupied[0] != 0) {
+        // Rotate the occupancy so that bit 0 is the slot for m_next_tick.
+        unsigned int shift = m_next_tick & (SLOTS - 1);
+        uint64_t bits = m_occupied[0];
+        if(shift != 0) {
+            bits = (bits >> shift) | (bits << (SLOTS - shift));
+        }
+#ifdef __GNUC__
+        wakeup = m_next_tick + __builtin_ctzll(bits);
+#else
+        unsigned int offset = 0;
+        while(!(bits & 1)) {
+            bits >>= 1;
+            ++offset;
+        }
+        wakeup = m_next_tick + offset;
+#endif
+    }
+
+    for(unsigned int level = 1; level < LEVELS; ++level) {
+        if(m_occupied[level] != 0) {
+            // Something needs cascading at the next level-0 wraparound.
+            uint64_t boundary = (m_next_tick + SLOTS - 1) & ~uint64_t(SLOTS - 1);
+            wakeup = min(wakeup, boundary);
+            break;
+        }
+    }
+
+    return wakeup;
+}
+
+void TimerWheel::arm(uint64_t tick)
+{
+    m_armed = true;
+    m_armed_tick = tick;
+    m_timer.expires_at(m_epoch + chrono::milliseconds(tick * m_resolution));
+    m_timer.async_wait(boost::bind(&TimerWheel::handle_timer, this,
+                                   boost::asio::placeholders::error));
+}
+
+void TimerWheel::handle_timer(const boost::system::error_code &ec)
+{
+    if(ec) {
+        return; // The timer was re-armed for an earlier tick, or the wheel is shutting down.
+    }
+
+    vector<shared_ptr<TimerWheelEntry>> expired;
+    {
+        lock_guard<mutex> lock(m_lock);
+        if(m_shutdown) {
+            return;
+        }
+
+        m_armed = false;
+        uint64_t now = current_tick(steady_clock_t::now());
+        while(m_next_tick <= now) {
+            process_tick(expired);
+        }
+
+        if(m_count > 0) {
+            arm(next_wakeup());
+        }
+    }
+
+    // Fire outside the lock; expired holds the last reference to any entry
+    // nobody else is keeping alive, so they stay valid until we're done.
+    for(auto &entry : expired) {
+        entry->expire();
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/version.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+// A TimerWheelEntry is anything that can be scheduled on a TimerWheel.  Entries are kept in
+// intrusive lists, so scheduling, rescheduling and cancelling never allocate.  While an entry
+// is scheduled the wheel holds a reference to it, so it cannot be destroyed from under the wheel.
+class TimerWheelEntry
+{
+  public:
+    virtual ~TimerWheelEntry() {}
+
+  protected:
+    // expire is called on the wheel's io_service once the entry's deadline has passed.
+    // It is called without the wheel's lock held, so it may (re)schedule entries.
+    virtual void expire() = 0;
+
+  private:
+    friend class TimerWheel;
+
+    TimerWheelEntry *m_prev = nullptr;
+    TimerWheelEntry *m_next = nullptr;
+    uint64_t m_expires = 0; // The tick the entry expires on.
+    unsigned int m_level = 0;
+    unsigned int m_slot = 0;
+    std::shared_ptr<TimerWheelEntry> m_hold; // Set while the entry is linked into the wheel.
+};
+
+// A TimerWheel is a hierarchical timing wheel attached to an io_service as an asio service.
+// Time advances in coarse ticks (see set_resolution); all entries expiring on the same tick
+// are fired together from a single wakeup of one underlying asio timer, instead of every
+// timeout owning a timer in asio's queue.  schedule() and cancel() are O(1) and thread-safe.
+//
+// Get the wheel for an io_service with boost::asio::use_service<TimerWheel>(io_service).
+class TimerWheel : public boost::asio::io_service::service
+{
+  public:
+    static boost::asio::io_service::id id;
+
+    explicit TimerWheel(boost::asio::io_service &io_service);
+    ~TimerWheel();
+
+    // set_resolution sets the length of a tick, in milliseconds.  Entries may fire up to one
+    // tick late, but never early.  It should be set before any entries are scheduled.
+    void set_resolution(unsigned long ms);
+    inline unsigned long get_resolution() const
+    {
+        return m_resolution;
+    }
+
+    // schedule (re)schedules the entry to expire after the given number of milliseconds.
+    void schedule(const std::shared_ptr<TimerWheelEntry> &entry, unsigned long ms);
+
+    // cancel unschedules the entry, returning true if it was scheduled.
+    bool cancel(TimerWheelEntry *entry);
+
+    // size returns the number of scheduled entries.
+    size_t size();
+
+  private:
+    typedef std::chrono::steady_clock steady_clock_t;
+
+    static const unsigned int LEVEL_BITS = 6;
+    static const unsigned int SLOTS = 1 << LEVEL_BITS;
+    static const unsigned int LEVELS = 4;
+
+    std::mutex m_lock;
+    boost::asio::steady_timer m_timer;
+    steady_clock_t::time_point m_epoch;
+    unsigned long m_resolution = 10;
+
+    uint64_t m_next_tick = 0; // The next tick that has not yet been processed.
+    size_t m_count = 0;
+    bool m_armed = false;
+    uint64_t m_armed_tick = 0;
+    bool m_shutdown = false;
+
+    TimerWheelEntry *m_slots[LEVELS][SLOTS];
+    uint64_t m_occupied[LEVELS]; // One bit per non-empty slot.
+
+#if BOOST_VERSION >= 106600
+    void shutdown() override;
+#else
+    void shutdown_service() override;
+#endif
+
+    uint64_t current_tick(steady_clock_t::time_point now);
+    void link(TimerWheelEntry *entry);
+    void unlink(TimerWheelEntry *entry);
+    void process_tick(std::vector<std::shared_ptr<TimerWheelEntry>> &expired);
+    uint64_t next_wakeup();
+    void arm(uint64_t tick);
+    void handle_timer(const boost::system::error_code &ec);
+};
@@ -1,4 +1,4 @@
-import os, time, socket, struct, tempfile, subprocess, ssl
+import os, time, socket, struct, tempfile, subprocess, ssl, signal
 
 __all__ = ['Daemon', 'Datagram', 'DatagramIterator',
            'MDConnection', 'ChannelConnection', 'ClientConnection']
@@ -6,8 +6,9 @@ __all__ = ['Daemon', 'Datagram', 'DatagramIterator',
 class Daemon(object):
     DAEMON_PATH = './astrond'
 
-    def __init__(self, config):
+    def __init__(self, config, log_file=None):
         self.config = config
+        self.log_file = log_file
 
         self.daemon = None
         self.config_file = None
@@ -28,6 +29,8 @@ class Daemon(object):
         os.close(configHandle)
 
         args = [self.DAEMON_PATH]
+        if self.log_file is not None:
+            args += ["--log", self.log_file]
         if 'USE_LOGLEVEL' in os.environ:
             args += ["--loglevel", os.environ['USE_LOGLEVEL']]
         args += [self.config_file]
@@ -36,9 +39,15 @@ class Daemon(object):
 
         time.sleep(1.0) # Allow some time for daemon to initialize...
 
+    def interrupt(self):
+        # Shut the daemon down cleanly, as with Ctrl+C, and wait for it to exit.
+        if self.daemon is not None:
+            self.daemon.send_signal(signal.SIGINT)
+            return self.daemon.wait()
+
     def stop(self):
         time.sleep(1.0) # Allow some time for daemon to finish up...
-        if self.daemon is not None:
+        if self.daemon is not None and self.daemon.poll() is None:
             self.daemon.kill()
         if self.config_file is not None:
             os.remove(self.config_file)
@@ -81,11 +90,14 @@ CONSTANTS = {
     'CONTROL_REMOVE_CHANNEL':       9001,
     'CONTROL_ADD_RANGE':            9002,
     'CONTROL_REMOVE_RANGE':         9003,
+    'CONTROL_ADD_CHANNELS':         9004,
+    'CONTROL_REMOVE_CHANNELS':      9005,
     'CONTROL_ADD_POST_REMOVE':      9010,
     'CONTROL_CLEAR_POST_REMOVE':    9011,
     'CONTROL_SET_CON_NAME':         9012,
     'CONTROL_SET_CON_URL':          9013,
     'CONTROL_LOG_MESSAGE':          9014,
+    'CONTROL_SET_LOG_LEVEL':        9015,
 
     # State Server control message-type constants
     'STATESERVER_CREATE_OBJECT_WITH_REQUIRED':          2000,
@@ -143,6 +155,7 @@ CONSTANTS = {
     # DBSS object message-type constants
     'DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS':        2200,
     'DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS_OTHER':  2201,
+    'DBSS_OBJECT_ACTIVATE_MULTIPLE':             2202,
     'DBSS_OBJECT_GET_ACTIVATED':                 2207,
     'DBSS_OBJECT_GET_ACTIVATED_RESP':            2208,
     'DBSS_OBJECT_DELETE_FIELD_DISK':             2230,
@@ -160,6 +173,10 @@ CONSTANTS = {
     'DBSERVER_OBJECT_GET_FIELDS_RESP':              3013,
     'DBSERVER_OBJECT_GET_ALL':                      3014,
     'DBSERVER_OBJECT_GET_ALL_RESP':                 3015,
+    'DBSERVER_OBJECT_GET_ALL_MULTIPLE':             3016,
+    'DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP':        3017,
+    'DBSERVER_OBJECT_GET_FIELDS_MULTIPLE':          3018,
+    'DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP':     3019,
     'DBSERVER_OBJECT_SET_FIELD':                    3020,
     'DBSERVER_OBJECT_SET_FIELDS':                   3021,
     'DBSERVER_OBJECT_SET_FIELD_IF_EQUALS':          3022,
@@ -171,6 +188,12 @@ CONSTANTS = {
     'DBSERVER_OBJECT_DELETE_FIELD':                 3030,
     'DBSERVER_OBJECT_DELETE_FIELDS':                3031,
     'DBSERVER_OBJECT_DELETE':                       3032,
+    'DBSERVER_OBJECT_SET_FIELDS_MULTIPLE':          3040,
+    'DBSERVER_OBJECT_SET_FIELDS_MULTIPLE_RESP':     3041,
+    'DBSERVER_OBJECT_DELETE_MULTIPLE':              3042,
+    'DBSERVER_OBJECT_DELETE_MULTIPLE_RESP':         3043,
+    'DBSERVER_CHECKPOINT':                          3050,
+    'DBSERVER_CHECKPOINT_RESP':                     3051,
 
     # Client Agent
     'CLIENTAGENT_SET_STATE':                        1000,
@@ -370,6 +393,24 @@ class Datagram(object):
         dg.add_channel(channel)
         return dg
 
+    @classmethod
+    def create_add_channels(cls, channels):
+        dg = cls.create_control()
+        dg.add_uint16(CONTROL_ADD_CHANNELS)
+        dg.add_uint16(len(channels))
+        for channel in channels:
+            dg.add_channel(channel)
+        return dg
+
+    @classmethod
+    def create_remove_channels(cls, channels):
+        dg = cls.create_control()
+        dg.add_uint16(CONTROL_REMOVE_CHANNELS)
+        dg.add_uint16(len(channels))
+        for channel in channels:
+            dg.add_channel(channel)
+        return dg
+
     @classmethod
     def create_add_range(cls, upper, lower):
         dg = cls.create_control()
@@ -499,7 +540,7 @@ class MDConnection(object):
     def send(self, datagram):
         data = datagram.get_data()
         msg = struct.pack(DATATYPES['size'], len(data)) + data
-        self.s.send(msg)
+        self.s.sendall(msg)
 
     def recv(self):
         dg = self._read()
@@ -33,6 +33,19 @@ class DBServerTestsuite(object):
         else:
             self.objects.flush()
 
+    def expectResults(self, recipient, msgtype, context, results):
+        # The results of a request on many objects come in whatever order they finish.
+        dg = self.conn.recv_maybe()
+        self.assertTrue(dg is not None, "Did not receive a response.")
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([recipient], 75757, msgtype))
+        self.assertEquals(dgi.read_uint32(), context)
+        received = {}
+        for i in xrange(dgi.read_uint16()):
+            doid = dgi.read_doid()
+            received[doid] = dgi.read_uint8()
+        self.assertEquals(received, results)
+
     def test_create_getall(self):
         self.objects.flush()
         self.conn.flush()
@@ -166,6 +179,266 @@ class DBServerTestsuite(object):
             self.deleteObject(20, doid)
         self.conn.send(Datagram.create_remove_channel(20))
 
+    def test_get_all_multiple(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(20))
+
+        # Create two objects to get at once
+        doids = []
+        for context, value in ((1, 1234), (2, 5678)):
+            dg = Datagram.create([75757], 20, DBSERVER_CREATE_OBJECT)
+            dg.add_uint32(context)
+            dg.add_uint16(DistributedTestObject3)
+            dg.add_uint16(2) # Field count
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            dg.add_uint16(setDb3)
+            dg.add_string("Many hands")
+            self.conn.send(dg)
+
+            dg = self.conn.recv_maybe()
+            self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+            dgi = DatagramIterator(dg)
+            dgi.seek(CREATE_DOID_OFFSET)
+            doids.append(dgi.read_doid())
+
+        # Get both of them, along with one that doesn't exist
+        dg = Datagram.create([75757], 20, DBSERVER_OBJECT_GET_ALL_MULTIPLE)
+        dg.add_uint32(3) # Context
+        dg.add_uint16(3) # Object count
+        dg.add_doid(doids[0])
+        dg.add_doid(78787) # Non-existant ID
+        dg.add_doid(doids[1])
+        self.conn.send(dg)
+
+        # Expect a response for each object
+        expected = []
+        for doid, value in ((doids[0], 1234), (doids[1], 5678)):
+            dg = Datagram.create([20], 75757, DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP)
+            dg.add_uint32(3) # Context
+            dg.add_doid(doid)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(DistributedTestObject3)
+            dg.add_uint16(2) # Field count
+            dg.add_uint16(setDb3)
+            dg.add_string("Many hands")
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            expected.append(dg)
+        dg = Datagram.create([20], 75757, DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_doid(78787)
+        dg.add_uint8(FAILURE)
+        expected.append(dg)
+        self.expectMany(self.conn, expected)
+
+        # An empty request gets no responses
+        dg = Datagram.create([75757], 20, DBSERVER_OBJECT_GET_ALL_MULTIPLE)
+        dg.add_uint32(4) # Context
+        dg.add_uint16(0) # Object count
+        self.conn.send(dg)
+        self.expectNone(self.conn)
+
+        # Cleanup
+        for doid in doids:
+            self.deleteObject(20, doid)
+        self.conn.send(Datagram.create_remove_channel(20))
+
+    def test_multiple(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(25))
+
+        # Create two objects to work on at once
+        doids = []
+        for context, value in ((1, 1234), (2, 5678)):
+            dg = Datagram.create([75757], 25, DBSERVER_CREATE_OBJECT)
+            dg.add_uint32(context)
+            dg.add_uint16(DistributedTestObject3)
+            dg.add_uint16(2) # Field count
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            dg.add_uint16(setDb3)
+            dg.add_string("Many hands")
+            self.conn.send(dg)
+
+            dg = self.conn.recv_maybe()
+            self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+            dgi = DatagramIterator(dg)
+            dgi.seek(CREATE_DOID_OFFSET)
+            doids.append(dgi.read_doid())
+
+        # Get a field of both of them, along with one that doesn't exist
+        dg = Datagram.create([75757], 25, DBSERVER_OBJECT_GET_FIELDS_MULTIPLE)
+        dg.add_uint32(3) # Context
+        dg.add_uint16(1) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint16(3) # Object count
+        dg.add_doid(doids[0])
+        dg.add_doid(78787) # Non-existant ID
+        dg.add_doid(doids[1])
+        self.conn.send(dg)
+
+        # Expect a response for each object
+        expected = []
+        for doid, value in ((doids[0], 1234), (doids[1], 5678)):
+            dg = Datagram.create([25], 75757, DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP)
+            dg.add_uint32(3) # Context
+            dg.add_doid(doid)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(1) # Field count
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            expected.append(dg)
+        dg = Datagram.create([25], 75757, DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_doid(78787)
+        dg.add_uint8(FAILURE)
+        expected.append(dg)
+        self.expectMany(self.conn, expected)
+
+        # Set fields on all three
+        dg = Datagram.create([75757], 25, DBSERVER_OBJECT_SET_FIELDS_MULTIPLE)
+        dg.add_uint32(4) # Context
+        dg.add_uint16(3) # Object count
+        dg.add_doid(doids[0])
+        dg.add_uint16(1) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(1111)
+        dg.add_doid(78787)
+        dg.add_uint16(1) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(1)
+        dg.add_doid(doids[1])
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2222)
+        dg.add_uint16(setDb3)
+        dg.add_string("Few hands")
+        self.conn.send(dg)
+
+        # The changes to the objects which exist are broadcast as usual...
+        expected = []
+        dg = Datagram.create([DATABASE_PREFIX|doids[0]], 25, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doids[0])
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(1111)
+        expected.append(dg)
+        dg = Datagram.create([DATABASE_PREFIX|doids[1]], 25, DBSERVER_OBJECT_SET_FIELDS)
+        dg.add_doid(doids[1])
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setDb3)
+        dg.add_string("Few hands")
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2222)
+        expected.append(dg)
+        self.expectMany(self.objects, expected)
+
+        # ... and the sender gets the result for each object
+        self.expectResults(25, DBSERVER_OBJECT_SET_FIELDS_MULTIPLE_RESP, 4,
+                           {doids[0]: SUCCESS, 78787: FAILURE, doids[1]: SUCCESS})
+
+        # The new values are stored
+        dg = Datagram.create([75757], 25, DBSERVER_OBJECT_GET_FIELDS_MULTIPLE)
+        dg.add_uint32(5) # Context
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint16(setDb3)
+        dg.add_uint16(2) # Object count
+        dg.add_doid(doids[0])
+        dg.add_doid(doids[1])
+        self.conn.send(dg)
+
+        expected = []
+        for doid, value, string in ((doids[0], 1111, "Many hands"), (doids[1], 2222, "Few hands")):
+            dg = Datagram.create([25], 75757, DBSERVER_OBJECT_GET_FIELDS_MULTIPLE_RESP)
+            dg.add_uint32(5) # Context
+            dg.add_doid(doid)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(2) # Field count
+            dg.add_uint16(setDb3)
+            dg.add_string(string)
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            expected.append(dg)
+        self.expectMany(self.conn, expected)
+
+        # An empty request is still answered
+        dg = Datagram.create([75757], 25, DBSERVER_OBJECT_SET_FIELDS_MULTIPLE)
+        dg.add_uint32(6) # Context
+        dg.add_uint16(0) # Object count
+        self.conn.send(dg)
+        self.expectResults(25, DBSERVER_OBJECT_SET_FIELDS_MULTIPLE_RESP, 6, {})
+
+        # Delete all three
+        dg = Datagram.create([75757], 25, DBSERVER_OBJECT_DELETE_MULTIPLE)
+        dg.add_uint32(7) # Context
+        dg.add_uint16(3) # Object count
+        dg.add_doid(doids[0])
+        dg.add_doid(78787)
+        dg.add_doid(doids[1])
+        self.conn.send(dg)
+
+        expected = []
+        for doid in doids:
+            dg = Datagram.create([DATABASE_PREFIX|doid], 25, DBSERVER_OBJECT_DELETE)
+            dg.add_doid(doid)
+            expected.append(dg)
+        self.expectMany(self.objects, expected)
+        self.expectResults(25, DBSERVER_OBJECT_DELETE_MULTIPLE_RESP, 7,
+                           {doids[0]: SUCCESS, 78787: FAILURE, doids[1]: SUCCESS})
+
+        # Cleanup
+        self.conn.send(Datagram.create_remove_channel(25))
+
+    def test_multiple_max(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(130))
+        timeout = self.conn.s.gettimeout()
+        self.conn.s.settimeout(max(timeout, 10.0)) # Allow time for many objects.
+
+        # The most objects whose results fit in a single response:
+        dg = Datagram()
+        dg.add_doid(0)
+        header_size = 1 + 2*CHANNEL_SIZE_BYTES + 2 + 4 + 2 # Header, context and count
+        max_count = min((DGSIZE_MAX - header_size) // (dg.get_size() + 1), 0xFFFF)
+
+        doid = self.createGenericGetId(130, 1)
+        others = [doid + 10000000 + i for i in xrange(max_count)]
+
+        # One more than that is refused as a whole...
+        dg = Datagram.create([75757], 130, DBSERVER_OBJECT_DELETE_MULTIPLE)
+        dg.add_uint32(2) # Context
+        dg.add_uint16(max_count + 1) # Object count
+        dg.add_doid(doid)
+        for other in others:
+            dg.add_doid(other)
+        self.conn.send(dg)
+        self.expectResults(130, DBSERVER_OBJECT_DELETE_MULTIPLE_RESP, 2, {})
+        self.expectNone(self.objects)
+
+        # ...but that many are all handled, and answered in one response.
+        dg = Datagram.create([75757], 130, DBSERVER_OBJECT_DELETE_MULTIPLE)
+        dg.add_uint32(3) # Context
+        dg.add_uint16(max_count) # Object count
+        dg.add_doid(doid)
+        for other in others[1:]:
+            dg.add_doid(other)
+        self.conn.send(dg)
+
+        dg = Datagram.create([DATABASE_PREFIX|doid], 130, DBSERVER_OBJECT_DELETE)
+        dg.add_doid(doid)
+        self.expect(self.objects, dg)
+        results = dict((other, FAILURE) for other in others[1:])
+        results[doid] = SUCCESS
+        self.expectResults(130, DBSERVER_OBJECT_DELETE_MULTIPLE_RESP, 3, results)
+
+        # Cleanup
+        self.conn.s.settimeout(timeout)
+        self.conn.send(Datagram.create_remove_channel(130))
+
     def test_delete(self):
         self.objects.flush()
         self.conn.flush()
@@ -1384,3 +1657,44 @@ class DBServerTestsuite(object):
         self.expect(self.conn, dg)
 
         self.conn.send(Datagram.create_remove_channel(110))
+
+    def test_checkpoint(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(120))
+
+        doid = self.createTypeGetId(120, 1, DistributedTestObject3)
+        dg = Datagram.create([75757], 120, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.conn.send(dg)
+
+        # Ask the database to checkpoint what it has...
+        dg = Datagram.create([75757], 120, DBSERVER_CHECKPOINT)
+        dg.add_uint32(2) # Context
+        self.conn.send(dg)
+
+        # ... which it does, once the set before it has been written.
+        dg = Datagram.create([120], 75757, DBSERVER_CHECKPOINT_RESP)
+        dg.add_uint32(2) # Context
+        dg.add_uint8(SUCCESS)
+        self.expect(self.conn, dg)
+
+        # The object is just as it was.
+        dg = Datagram.create([75757], 120, DBSERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(3) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([120], 75757, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.expect(self.conn, dg)
+
+        # Clean up
+        self.deleteObject(120, doid)
+        self.conn.send(Datagram.create_remove_channel(120))
@@ -0,0 +1,12 @@
+import tempfile, shutil, os
+
+def setup_logdb(unittest):
+    unittest.logdb_dir = tempfile.mkdtemp(prefix = 'astron-', suffix = '.logdb')
+    unittest.logdb_path = os.path.join(unittest.logdb_dir, 'objects.log')
+
+def teardown_logdb(unittest):
+    # Remove temp files
+    try:
+        shutil.rmtree(unittest.logdb_dir)
+    except:
+        pass
@@ -0,0 +1,12 @@
+import tempfile, shutil, os
+
+def setup_snapshotdb(unittest):
+    unittest.snapshotdb_dir = tempfile.mkdtemp(prefix = 'astron-', suffix = '.snapshotdb')
+    unittest.snapshotdb_wal = os.path.join(unittest.snapshotdb_dir, 'objects.wal')
+
+def teardown_snapshotdb(unittest):
+    # Remove temp files
+    try:
+        shutil.rmtree(unittest.snapshotdb_dir)
+    except:
+        pass
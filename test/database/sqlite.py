@@ -0,0 +1,12 @@
+import tempfile, shutil, os
+
+def setup_sqlite(unittest):
+    unittest.sqlite_dir = tempfile.mkdtemp(prefix = 'astron-', suffix = '.sqlite')
+    unittest.sqlite_path = os.path.join(unittest.sqlite_dir, 'astron.db')
+
+def teardown_sqlite(unittest):
+    # Remove temp files
+    try:
+        shutil.rmtree(unittest.sqlite_dir)
+    except:
+        pass
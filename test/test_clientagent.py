@@ -91,6 +91,20 @@ roles:
           certificate: %r
           key_file: %r
 
+    - type: clientagent
+      bind: 127.0.0.1:57129
+      version: "Sword Art Online v5.1"
+      channels:
+          min: 550600
+          max: 550699
+      client:
+          add_interest: enabled
+          write_buffer_size: 0
+          write_timeout_ms: 0
+      tuning:
+          interest_timeout: 500
+          stream_interests: true
+
     - type: clientagent
       bind: 127.0.0.1:51201
       version: "Sword Art Online v5.1"
@@ -1331,6 +1345,120 @@ class TestClientAgent(ProtocolTest):
         # Then we shouldn't expect any more datagrams
         self.expectNone(client)
 
+    def test_interest_streaming(self):
+        # With stream_interests on, objects should reach the client as soon as they arrive,
+        # while other messages for the interest still wait for it to finish.
+        self.server.flush()
+        client = self.connect(port=57129)
+        id = self.identify(client, min=550600, max=550699)
+
+        # Bring client out of the sandbox
+        self.set_state(client, CLIENT_STATE_ESTABLISHED)
+
+        # Open interest on a zone
+        dg = Datagram()
+        dg.add_uint16(CLIENT_ADD_INTEREST)
+        dg.add_uint32(2000) # Context
+        dg.add_uint16(1000) # Interest id
+        dg.add_doid(1234) # Parent
+        dg.add_zone(4321) # Zone
+        client.send(dg)
+
+        dg = self.server.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1234], id, STATESERVER_OBJECT_GET_ZONES_OBJECTS))
+        ss_context = dgi.read_uint32()
+
+        # There are two objects in the zone
+        dg = Datagram.create([id], 1234, STATESERVER_OBJECT_GET_ZONES_COUNT_RESP)
+        dg.add_uint32(ss_context)
+        dg.add_doid(2) # Object count
+        self.server.send(dg)
+
+        # The first object arrives...
+        dg = Datagram.create([id], 1, STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED)
+        dg.add_uint32(ss_context) # request_context
+        dg.add_doid(8888) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(999999) # setRequired1
+        self.server.send(dg)
+
+        # ...and is passed straight on to the client.
+        dg = Datagram()
+        dg.add_uint16(CLIENT_ENTER_OBJECT_REQUIRED)
+        dg.add_doid(8888) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(999999) # setRequired1
+        self.expect(client, dg, isClient = True)
+
+        # Updates for it don't need to wait either.
+        dg = Datagram.create([(1234<<ZONE_SIZE_BITS)|4321], 1, STATESERVER_OBJECT_SET_FIELD)
+        dg.add_doid(8888) # do_id
+        dg.add_uint16(setBR1)
+        dg.add_string("I've built my life on judgement and causing pain...")
+        self.server.send(dg)
+
+        dg = Datagram()
+        dg.add_uint16(CLIENT_OBJECT_SET_FIELD)
+        dg.add_doid(8888) # do_id
+        dg.add_uint16(setBR1)
+        dg.add_string("I've built my life on judgement and causing pain...")
+        self.expect(client, dg, isClient = True)
+
+        # A new object walks into the zone in the meantime; it isn't part of the
+        # snapshot, so it should be held back until the interest is done.
+        dg = Datagram.create([id], 1, STATESERVER_OBJECT_ENTER_LOCATION_WITH_REQUIRED)
+        dg.add_doid(6666) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(666666) # setRequired1
+        self.server.send(dg)
+        self.expectNone(client)
+
+        # The second object arrives, completing the interest.
+        dg = Datagram.create([id], 1, STATESERVER_OBJECT_ENTER_INTEREST_WITH_REQUIRED)
+        dg.add_uint32(ss_context) # request_context
+        dg.add_doid(7777) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(777777) # setRequired1
+        self.server.send(dg)
+
+        dg = Datagram()
+        dg.add_uint16(CLIENT_ENTER_OBJECT_REQUIRED)
+        dg.add_doid(7777) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(777777) # setRequired1
+        self.expect(client, dg, isClient = True)
+
+        dg = Datagram()
+        dg.add_uint16(CLIENT_DONE_INTEREST_RESP)
+        dg.add_uint32(2000) # Context
+        dg.add_uint16(1000) # Interest Id
+        self.expect(client, dg, isClient = True)
+
+        # Only then does the held back object follow.
+        dg = Datagram()
+        dg.add_uint16(CLIENT_ENTER_OBJECT_REQUIRED)
+        dg.add_doid(6666) # do_id
+        dg.add_doid(1234) # parent_id
+        dg.add_zone(4321) # zone_id
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint32(666666) # setRequired1
+        self.expect(client, dg, isClient = True)
+
+        self.expectNone(client)
+        client.close()
+
     def test_interest_ignore_early_location(self):
         # The point of this test is to make sure the ClientAgent ignores normal
         # incoming messages for a location until it receives ZONES_COUNT_RESP.
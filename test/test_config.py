@@ -66,6 +66,51 @@ class TestConfigCore(ConfigTest):
             """ % test_dc
         self.assertEquals(self.checkConfig(config), 'Valid')
 
+    def test_merge_subscriptions(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+                merge_subscriptions:
+                    min_channels: 16
+                    density: 0.5
+            """
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+                merge_subscriptions:
+                    min_channels: 16
+                    density: 1.5
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+    def test_shm(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+                shm:
+                    bind: local
+                    ring_size: 1048576
+            """
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+                connect: shm://
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+                shm:
+                    bind: local
+                    ring_size: 1000000
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
     def test_roles_missing_type(self):
         config = """\
             messagedirector:
@@ -141,6 +186,49 @@ class TestConfigCore(ConfigTest):
             """
         self.assertEquals(self.checkConfig(config), 'Invalid')
 
+    def test_event_loop_index(self):
+        config = """\
+            daemon:
+                event_loops:
+                    count: 2
+
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: stateserver
+                  control: 100100
+                  event_loop: 1
+            """
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+        config = """\
+            daemon:
+                event_loops:
+                    count: 2
+
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: stateserver
+                  control: 100100
+                  event_loop: 2
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+        # Without an event_loops section there is a single loop.
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: stateserver
+                  control: 100100
+                  event_loop: 1
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
     def test_core_address_hosts(self):
         config = """\
             messagedirector:
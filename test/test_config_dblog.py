@@ -0,0 +1,88 @@
+#!/usr/bin/env python2
+import unittest
+from common.unittests import ConfigTest
+from common.dcfile import *
+from database.logdb import setup_logdb, teardown_logdb
+
+class TestConfigDBLog(ConfigTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_logdb(cls)
+        super(TestConfigDBLog, cls).setUpClass()
+
+    @classmethod
+    def tearDownClass(cls):
+        super(TestConfigDBLog, cls).tearDownClass()
+        teardown_logdb(cls)
+
+    def test_dblog_good(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            general:
+                dc_files:
+                    - %r
+
+            roles:
+                - type: database
+                  control: 75757
+                  generate:
+                    min: 1000000
+                    max: 1000010
+                  backend:
+                    type: log
+                    filename: %r
+                    sync: false
+                    compact_size: 1048576
+                    compact_garbage: 0.25
+            """ % (test_dc, self.logdb_path)
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+    def test_dblog_boolean_sync(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            general:
+                dc_files:
+                    - %r
+
+            roles:
+                - type: database
+                  control: 75757
+                  generate:
+                    min: 1000000
+                    max: 1000010
+                  backend:
+                    type: log
+                    filename: %r
+                    sync: sometimes
+            """ % (test_dc, self.logdb_path)
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+    def test_dblog_compact_garbage(self):
+        for garbage in ('0', '1', '1.5', '-0.5'):
+            config = """\
+                messagedirector:
+                    bind: 127.0.0.1:57123
+
+                general:
+                    dc_files:
+                        - %r
+
+                roles:
+                    - type: database
+                      control: 75757
+                      generate:
+                        min: 1000000
+                        max: 1000010
+                      backend:
+                        type: log
+                        filename: %r
+                        compact_garbage: %s
+                """ % (test_dc, self.logdb_path, garbage)
+            self.assertEquals(self.checkConfig(config), 'Invalid')
+
+if __name__ == '__main__':
+    unittest.main()
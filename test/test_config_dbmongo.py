@@ -34,6 +34,7 @@ class TestConfigDBMongo(ConfigTest):
                   backend:
                     type: mongodb
                     server: mongodb://127.0.0.1:57023/test
+                    doid_block: 100
             """ % (test_dc)
         self.assertEquals(self.checkConfig(config), 'Valid')
 
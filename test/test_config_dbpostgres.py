@@ -63,6 +63,28 @@ class TestConfigDBPostgres(ConfigTest):
             """ % test_dc
         self.assertEquals(self.checkConfig(config), 'Invalid')
 
+    def test_postgres_invalid_port(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+            general:
+                dc_files:
+                    - %r
+            roles:
+                - type: database
+                  control: 75757
+                  generate:
+                    min: 1000000
+                    max: 1000010
+                  backend:
+                    type: soci
+                    driver: postgresql
+                    address: 127.0.0.1:astron
+                    username: astron
+                    database: astron
+            """ % test_dc
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
     def test_postgres_invalid_generate(self):
         config = """\
             messagedirector:
@@ -0,0 +1,64 @@
+#!/usr/bin/env python2
+import unittest
+from common.unittests import ConfigTest
+from common.dcfile import *
+from database.snapshotdb import setup_snapshotdb, teardown_snapshotdb
+
+class TestConfigDBSnapshot(ConfigTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_snapshotdb(cls)
+        super(TestConfigDBSnapshot, cls).setUpClass()
+
+    @classmethod
+    def tearDownClass(cls):
+        super(TestConfigDBSnapshot, cls).tearDownClass()
+        teardown_snapshotdb(cls)
+
+    def test_dbsnapshot_good(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            general:
+                dc_files:
+                    - %r
+
+            roles:
+                - type: database
+                  control: 75757
+                  generate:
+                    min: 1000000
+                    max: 1000010
+                  backend:
+                    type: snapshot
+                    directory: %r
+                    sync: false
+                    checkpoint_size: 1048576
+            """ % (test_dc, self.snapshotdb_dir)
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+    def test_dbsnapshot_boolean_sync(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            general:
+                dc_files:
+                    - %r
+
+            roles:
+                - type: database
+                  control: 75757
+                  generate:
+                    min: 1000000
+                    max: 1000010
+                  backend:
+                    type: snapshot
+                    directory: %r
+                    sync: sometimes
+            """ % (test_dc, self.snapshotdb_dir)
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+if __name__ == '__main__':
+    unittest.main()
@@ -16,9 +16,14 @@ class TestConfigDBSS(ConfigTest):
             roles:
                 - type: dbss
                   database: 1200
+                  control: 1201
                   ranges:
                       - min: 9000
                         max: 9999
+                  cache:
+                      enabled: true
+                      size: 1048576
+                      stats_interval: 60000
             """ % test_dc
         self.assertEquals(self.checkConfig(config), 'Valid')
 
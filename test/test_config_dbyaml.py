@@ -28,12 +28,18 @@ class TestConfigDBYaml(ConfigTest):
                 - type: database
                   control: 75757
                   broadcast: false
+                  write_behind: 50
+                  cache:
+                    enabled: true
+                    size: 1048576
+                    stats_interval: 60000
                   generate:
                     min: 1000000
                     max: 1000010
                   backend:
                     type: yaml
                     directory: %r
+                    workers: 2
             """ % (test_dc, self.yamldb_path)
         self.assertEquals(self.checkConfig(config), 'Valid')
 
@@ -43,5 +43,58 @@ class TestConfigEventLogger(ConfigTest):
             """
         #self.assertEquals(self.checkConfig(config), 'Valid')
 
+    def test_eventlogger_segments(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: eventlogger
+                  bind: 0.0.0.0:9090
+                  output: /var/log/astron/eventlogger/el-%Y-%m-%d-%H-%M-%S.seg
+                  rotate_interval: 1h
+                  format: segments
+                  compression: none
+            """
+        self.assertEquals(self.checkConfig(config), 'Valid')
+
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: eventlogger
+                  bind: 0.0.0.0:9090
+                  output: /var/log/astron/eventlogger/el-%Y-%m-%d-%H-%M-%S.seg
+                  format: xml
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: eventlogger
+                  bind: 0.0.0.0:9090
+                  output: /var/log/astron/eventlogger/el-%Y-%m-%d-%H-%M-%S.seg
+                  format: segments
+                  compression: rar
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
+    def test_eventlogger_rotate_interval(self):
+        config = """\
+            messagedirector:
+                bind: 127.0.0.1:57123
+
+            roles:
+                - type: eventlogger
+                  bind: 0.0.0.0:9090
+                  output: /var/log/astron/eventlogger/el-%Y-%m-%d-%H-%M-%S.log
+                  rotate_interval: 1 fortnight
+            """
+        self.assertEquals(self.checkConfig(config), 'Invalid')
+
 if __name__ == '__main__':
     unittest.main()
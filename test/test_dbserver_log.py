@@ -0,0 +1,189 @@
+#!/usr/bin/env python2
+import unittest, os
+from common.unittests import ProtocolTest
+from common.dbserver import DBServerTestsuite, CREATE_DOID_OFFSET
+from common.astron import *
+from common.dcfile import *
+from database.logdb import setup_logdb, teardown_logdb
+
+CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57123
+    threaded: %s
+
+general:
+    dc_files:
+        - %r
+
+roles:
+    - type: database
+      control: 75757
+      broadcast: true
+      generate:
+        min: 1000000
+        max: 1000010
+      backend:
+        type: log
+        filename: %r
+"""
+
+# Compact the log whenever at least half of it is garbage, however small it is.  Killing
+# the daemon doesn't lose what it has written, so there's no need to sync.
+COMPACT_CONFIG = CONFIG.replace("broadcast: true", "broadcast: false") + """\
+        sync: false
+        compact_size: 0
+        compact_garbage: 0.5
+"""
+
+class TestDatabaseServerLog(ProtocolTest, DBServerTestsuite):
+    @classmethod
+    def setUpClass(cls):
+        setup_logdb(cls)
+        cls.daemon = Daemon(CONFIG % (USE_THREADING, test_dc, cls.logdb_path))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+        cls.objects = cls.connectToServer()
+        cls.objects.send(Datagram.create_add_range(DATABASE_PREFIX|1000000,
+                                                   DATABASE_PREFIX|1000010))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.objects.send(Datagram.create_remove_range(DATABASE_PREFIX|1000000,
+                                                      DATABASE_PREFIX|1000010))
+        cls.objects.close()
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_logdb(cls)
+
+class TestDatabaseServerLogRecovery(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_logdb(cls)
+        cls.daemon = Daemon(COMPACT_CONFIG % (USE_THREADING, test_dc, cls.logdb_path))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_logdb(cls)
+
+    @classmethod
+    def crash(cls):
+        # Kill the daemon outright, as a crash would.
+        cls.conn.close()
+        cls.daemon.stop()
+
+    @classmethod
+    def restart(cls):
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0)
+        cls.conn.send(Datagram.create_add_channel(30))
+
+    def create(self, context):
+        dg = Datagram.create([75757], 30, DBSERVER_CREATE_OBJECT)
+        dg.add_uint32(context)
+        dg.add_uint16(DistributedTestObject3)
+        dg.add_uint16(0) # Field count
+        self.conn.send(dg)
+
+        dg = self.conn.recv_maybe()
+        self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+        dgi = DatagramIterator(dg)
+        dgi.seek(CREATE_DOID_OFFSET)
+        return dgi.read_doid()
+
+    def delete(self, doid):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_DELETE)
+        dg.add_doid(doid)
+        self.conn.send(dg)
+
+    def setRDB3(self, doid, value):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.conn.send(dg)
+
+    def expectRDB3(self, context, doid, value):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(context)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([30], 75757, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.expect(self.conn, dg)
+
+    def test_recovery(self):
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(30))
+
+        doid = self.create(1)
+        self.setRDB3(doid, 1234)
+        self.expectRDB3(2, doid, 1234)
+        deleted = self.create(3)
+        self.delete(deleted)
+
+        # Astron dies partway through writing out a record...
+        self.crash()
+        size = os.path.getsize(self.logdb_path)
+        with open(self.logdb_path, 'ab') as log:
+            log.write('\x40\x00\x00\x00\xde\xad\xbe\xef\x03\x01\x02')
+        self.restart()
+
+        # ...which is cut off when it starts back up, leaving everything before it.
+        self.assertEquals(os.path.getsize(self.logdb_path), size)
+        self.expectRDB3(4, doid, 1234)
+
+        # The ids in use are still known, and the object which was deleted is still gone.
+        created = self.create(5)
+        self.assertNotEquals(created, doid)
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_GET_ALL)
+        dg.add_uint32(6) # Context
+        dg.add_doid(deleted)
+        self.conn.send(dg)
+        dg = Datagram.create([30], 75757, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(6) # Context
+        dg.add_uint8(FAILURE)
+        self.expect(self.conn, dg)
+
+        # Clean up
+        self.delete(doid)
+        self.delete(created)
+        self.conn.send(Datagram.create_remove_channel(30))
+
+    def test_compaction(self):
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(30))
+
+        doid = self.create(1)
+        self.setRDB3(doid, 0)
+        self.expectRDB3(2, doid, 0)
+        size = os.path.getsize(self.logdb_path)
+
+        # Each change appends a new copy of the object, but the old ones are compacted away.
+        for value in xrange(1, 1000):
+            self.setRDB3(doid, value)
+        self.expectRDB3(3, doid, 999)
+        self.assertLess(os.path.getsize(self.logdb_path), size * 2)
+
+        # The compacted log is read back in just the same.
+        self.crash()
+        self.restart()
+        self.expectRDB3(4, doid, 999)
+
+        # Clean up
+        self.delete(doid)
+        self.conn.send(Datagram.create_remove_channel(30))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,7 +1,7 @@
 #!/usr/bin/env python2
 import unittest
 from common.unittests import ProtocolTest
-from common.dbserver import DBServerTestsuite
+from common.dbserver import DBServerTestsuite, CREATE_DOID_OFFSET
 from common.astron import *
 from common.dcfile import *
 from database.mongo import setup_mongo, teardown_mongo
@@ -47,5 +47,72 @@ class TestDatabaseServerMongo(ProtocolTest, DBServerTestsuite):
         cls.mongod.terminate()
         teardown_mongo(cls)
 
+LEASE_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57123
+
+general:
+    dc_files:
+        - %r
+
+roles:
+    - type: database
+      control: 75757
+      generate:
+        min: 1000000
+        max: 1000004
+      backend:
+        type: mongodb
+        server: mongodb://127.0.0.1:57023/leases
+        workers: 1
+        doid_block: 5
+""" % test_dc
+
+class TestDatabaseServerMongoLeases(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_mongo(cls)
+
+    @classmethod
+    def tearDownClass(cls):
+        teardown_mongo(cls)
+
+    def startDaemon(self):
+        self.daemon = Daemon(LEASE_CONFIG)
+        self.daemon.start()
+        self.conn = self.connectToServer()
+        self.conn.s.settimeout(1.0) # Allow time for Astron<->MongoDB communication.
+        self.conn.send(Datagram.create_add_channel(20))
+
+    def createObject(self, context):
+        dg = Datagram.create([75757], 20, DBSERVER_CREATE_OBJECT)
+        dg.add_uint32(context)
+        dg.add_uint16(DistributedTestObject1)
+        dg.add_uint16(0) # Field count
+        self.conn.send(dg)
+
+        dg = self.conn.recv_maybe()
+        self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+        dgi = DatagramIterator(dg)
+        dgi.seek(CREATE_DOID_OFFSET)
+        return dgi.read_doid()
+
+    def test_leases_returned(self):
+        # The first create leases the whole generate range...
+        self.startDaemon()
+        self.assertEquals(self.createObject(1), 1000000)
+        self.conn.close()
+        self.assertEquals(self.daemon.interrupt(), 0)
+        self.daemon.stop()
+
+        # ...and the rest of it is handed back when Astron shuts down cleanly, so a restarted
+        # Astron can still create an object with each of the other doids.
+        self.startDaemon()
+        doids = set(self.createObject(context) for context in range(2, 6))
+        self.assertEquals(doids, set([1000001, 1000002, 1000003, 1000004]))
+        self.assertEquals(self.createObject(6), INVALID_DO_ID)
+        self.conn.close()
+        self.daemon.stop()
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python2
+import unittest, os
+from common.unittests import ProtocolTest
+from common.dbserver import DBServerTestsuite, CREATE_DOID_OFFSET
+from common.astron import *
+from common.dcfile import *
+from database.snapshotdb import setup_snapshotdb, teardown_snapshotdb
+
+CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57123
+    threaded: %s
+
+general:
+    dc_files:
+        - %r
+
+roles:
+    - type: database
+      control: 75757
+      broadcast: true
+      generate:
+        min: 1000000
+        max: 1000010
+      backend:
+        type: snapshot
+        directory: %r
+"""
+
+# Only checkpoint when asked to.  Killing the daemon doesn't lose what it has written, so
+# there's no need to sync.
+CHECKPOINT_CONFIG = CONFIG.replace("broadcast: true", "broadcast: false") + """\
+        sync: false
+        checkpoint_size: 0
+"""
+
+# A new write-ahead log holds only the generation of its snapshot.
+EMPTY_WAL_SIZE = 9 + 8
+
+class TestDatabaseServerSnapshot(ProtocolTest, DBServerTestsuite):
+    @classmethod
+    def setUpClass(cls):
+        setup_snapshotdb(cls)
+        cls.daemon = Daemon(CONFIG % (USE_THREADING, test_dc, cls.snapshotdb_dir))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+        cls.objects = cls.connectToServer()
+        cls.objects.send(Datagram.create_add_range(DATABASE_PREFIX|1000000,
+                                                   DATABASE_PREFIX|1000010))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.objects.send(Datagram.create_remove_range(DATABASE_PREFIX|1000000,
+                                                      DATABASE_PREFIX|1000010))
+        cls.objects.close()
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_snapshotdb(cls)
+
+class TestDatabaseServerSnapshotRecovery(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_snapshotdb(cls)
+        cls.daemon = Daemon(CHECKPOINT_CONFIG % (USE_THREADING, test_dc, cls.snapshotdb_dir))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_snapshotdb(cls)
+
+    @classmethod
+    def crash(cls):
+        # Kill the daemon outright, as a crash would.
+        cls.conn.close()
+        cls.daemon.stop()
+
+    @classmethod
+    def restart(cls):
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0)
+        cls.conn.send(Datagram.create_add_channel(30))
+
+    def create(self, context):
+        dg = Datagram.create([75757], 30, DBSERVER_CREATE_OBJECT)
+        dg.add_uint32(context)
+        dg.add_uint16(DistributedTestObject3)
+        dg.add_uint16(0) # Field count
+        self.conn.send(dg)
+
+        dg = self.conn.recv_maybe()
+        self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+        dgi = DatagramIterator(dg)
+        dgi.seek(CREATE_DOID_OFFSET)
+        return dgi.read_doid()
+
+    def delete(self, doid):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_DELETE)
+        dg.add_doid(doid)
+        self.conn.send(dg)
+
+    def checkpoint(self, context):
+        dg = Datagram.create([75757], 30, DBSERVER_CHECKPOINT)
+        dg.add_uint32(context)
+        self.conn.send(dg)
+
+        dg = Datagram.create([30], 75757, DBSERVER_CHECKPOINT_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        self.expect(self.conn, dg)
+
+    def setRDB3(self, doid, value):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.conn.send(dg)
+
+    def expectRDB3(self, context, doid, value):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(context)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([30], 75757, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.expect(self.conn, dg)
+
+    def expectMissing(self, context, doid):
+        dg = Datagram.create([75757], 30, DBSERVER_OBJECT_GET_ALL)
+        dg.add_uint32(context)
+        dg.add_doid(doid)
+        self.conn.send(dg)
+
+        dg = Datagram.create([30], 75757, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(FAILURE)
+        self.expect(self.conn, dg)
+
+    def test_recovery(self):
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(30))
+
+        # Write one object into the snapshot...
+        doid = self.create(1)
+        self.setRDB3(doid, 1234)
+        deleted = self.create(2)
+        self.checkpoint(3)
+        self.assertEquals(os.path.getsize(self.snapshotdb_wal), EMPTY_WAL_SIZE)
+
+        # ...then change it, and delete the other one, in the write-ahead log.
+        self.setRDB3(doid, 5678)
+        self.delete(deleted)
+        self.expectRDB3(4, doid, 5678)
+
+        # Astron dies partway through writing out a record...
+        self.crash()
+        size = os.path.getsize(self.snapshotdb_wal)
+        with open(self.snapshotdb_wal, 'ab') as wal:
+            wal.write('\x40\x00\x00\x00\xde\xad\xbe\xef\x03\x01\x02')
+        self.restart()
+
+        # ...which is cut off when it starts back up, leaving the changes before it.
+        self.assertEquals(os.path.getsize(self.snapshotdb_wal), size)
+        self.expectRDB3(5, doid, 5678)
+        self.expectMissing(6, deleted)
+
+        # The changes are merged into the next snapshot, which is read back in just the same.
+        self.checkpoint(7)
+        self.assertEquals(os.path.getsize(self.snapshotdb_wal), EMPTY_WAL_SIZE)
+        self.crash()
+        self.restart()
+        self.expectRDB3(8, doid, 5678)
+        self.expectMissing(9, deleted)
+
+        # The ids in use are still known.
+        created = self.create(10)
+        self.assertNotEquals(created, doid)
+
+        # Clean up
+        self.delete(doid)
+        self.delete(created)
+        self.conn.send(Datagram.create_remove_channel(30))
+
+if __name__ == '__main__':
+    unittest.main()
@@ -1,7 +1,7 @@
 #!/usr/bin/env python2
-import unittest, tempfile, shutil
+import unittest, tempfile, shutil, os
 from common.unittests import ProtocolTest
-from common.dbserver import DBServerTestsuite
+from common.dbserver import DBServerTestsuite, CREATE_DOID_OFFSET
 from common.astron import *
 from common.dcfile import *
 from database.yamldb import setup_yamldb, teardown_yamldb
@@ -27,6 +27,10 @@ roles:
         directory: %r
 """
 
+WRITE_BEHIND_CONFIG = CONFIG.replace("broadcast: true", "broadcast: true\n      write_behind: 50")
+CACHE_CONFIG = CONFIG.replace("broadcast: true", "broadcast: true\n      cache:\n        enabled: true")
+SHUTDOWN_CONFIG = CONFIG.replace("broadcast: true", "broadcast: true\n      write_behind: 60000")
+
 class TestDatabaseServerYAML(ProtocolTest, DBServerTestsuite):
     @classmethod
     def setUpClass(cls):
@@ -48,5 +52,281 @@ class TestDatabaseServerYAML(ProtocolTest, DBServerTestsuite):
         cls.daemon.stop()
         teardown_yamldb(cls)
 
+class TestDatabaseServerYAMLWriteBehind(ProtocolTest, DBServerTestsuite):
+    @classmethod
+    def setUpClass(cls):
+        setup_yamldb(cls)
+        cls.daemon = Daemon(WRITE_BEHIND_CONFIG % (USE_THREADING, test_dc, cls.yamldb_path))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+        cls.objects = cls.connectToServer()
+        cls.objects.s.settimeout(1.0) # Broadcasts wait for the held back SETs to be written.
+        cls.objects.send(Datagram.create_add_range(DATABASE_PREFIX|1000000,
+                                                   DATABASE_PREFIX|1000010))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.objects.send(Datagram.create_remove_range(DATABASE_PREFIX|1000000,
+                                                      DATABASE_PREFIX|1000010))
+        cls.objects.close()
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_yamldb(cls)
+
+    def test_write_behind_merge(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(110))
+
+        doid = self.createTypeGetId(110, 1, DistributedTestObject3)
+
+        # Several SETs in quick succession...
+        for value in (1, 2):
+            dg = Datagram.create([75757], 110, DBSERVER_OBJECT_SET_FIELD)
+            dg.add_doid(doid)
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            self.conn.send(dg)
+        dg = Datagram.create([75757], 110, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setDb3)
+        dg.add_string("Merged")
+        self.conn.send(dg)
+
+        # ...are written, and broadcast, as one, with the last value of each field.
+        dg = Datagram.create([DATABASE_PREFIX|doid], 110, DBSERVER_OBJECT_SET_FIELDS)
+        dg.add_doid(doid)
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setDb3)
+        dg.add_string("Merged")
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2)
+        self.expect(self.objects, dg)
+        self.expectNone(self.objects)
+
+        # A GET right behind a SET sees the SET's value.
+        dg = Datagram.create([75757], 110, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(3)
+        self.conn.send(dg)
+        dg = Datagram.create([75757], 110, DBSERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(2) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([110], 75757, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(2) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(3)
+        self.expect(self.conn, dg)
+
+        # Clean up
+        self.deleteObject(110, doid)
+        self.conn.send(Datagram.create_remove_channel(110))
+
+    def test_write_behind_merge_invalid(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(110))
+
+        doid = self.createTypeGetId(110, 1, DistributedTestObject3)
+
+        # A SET of a field the object doesn't have, merged with valid SETs from others...
+        dg = Datagram.create([75757], 110, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(7)
+        self.conn.send(dg)
+        dg = Datagram.create([75757], 111, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setB2)
+        dg.add_uint32(8)
+        self.conn.send(dg)
+        dg = Datagram.create([75757], 112, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setDb3)
+        dg.add_string("Valid")
+        self.conn.send(dg)
+
+        # ...is dropped on its own; the others are still written and broadcast, each from
+        # its own sender.
+        dg = Datagram.create([DATABASE_PREFIX|doid], 110, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(7)
+        self.expect(self.objects, dg)
+        dg = Datagram.create([DATABASE_PREFIX|doid], 112, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setDb3)
+        dg.add_string("Valid")
+        self.expect(self.objects, dg)
+        self.expectNone(self.objects)
+
+        dg = Datagram.create([75757], 110, DBSERVER_OBJECT_GET_FIELDS)
+        dg.add_uint32(3) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint16(setDb3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([110], 75757, DBSERVER_OBJECT_GET_FIELDS_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setDb3)
+        dg.add_string("Valid")
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(7)
+        self.expect(self.conn, dg)
+
+        # Clean up
+        self.deleteObject(110, doid)
+        self.conn.send(Datagram.create_remove_channel(110))
+
+class TestDatabaseServerYAMLShutdown(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        setup_yamldb(cls)
+
+    @classmethod
+    def tearDownClass(cls):
+        teardown_yamldb(cls)
+
+    def startDaemon(self):
+        self.daemon = Daemon(SHUTDOWN_CONFIG % (USE_THREADING, test_dc, self.yamldb_path))
+        self.daemon.start()
+        self.conn = self.connectToServer()
+        self.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+        self.conn.send(Datagram.create_add_channel(130))
+
+    def createObject(self, context):
+        dg = Datagram.create([75757], 130, DBSERVER_CREATE_OBJECT)
+        dg.add_uint32(context)
+        dg.add_uint16(DistributedTestObject3)
+        dg.add_uint16(0) # Field count
+        self.conn.send(dg)
+
+        dg = self.conn.recv_maybe()
+        self.assertTrue(dg is not None, "Did not receive CreateObjectResp.")
+        dgi = DatagramIterator(dg)
+        dgi.seek(CREATE_DOID_OFFSET)
+        return dgi.read_doid()
+
+    def test_shutdown_flushes_sets(self):
+        # A SET is held back for much longer than Astron runs...
+        self.startDaemon()
+        doid = self.createObject(1)
+        dg = Datagram.create([75757], 130, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.conn.send(dg)
+        self.createObject(2) # Once this is answered, the SET has been held back.
+        self.conn.close()
+        self.assertEquals(self.daemon.interrupt(), 0)
+        self.daemon.stop()
+
+        # ...but is still written when Astron shuts down cleanly.
+        self.startDaemon()
+        dg = Datagram.create([75757], 130, DBSERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(3) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.conn.send(dg)
+
+        dg = Datagram.create([130], 75757, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.expect(self.conn, dg)
+        self.conn.close()
+        self.daemon.stop()
+
+class TestDatabaseServerYAMLCache(ProtocolTest, DBServerTestsuite):
+    @classmethod
+    def setUpClass(cls):
+        setup_yamldb(cls)
+        cls.daemon = Daemon(CACHE_CONFIG % (USE_THREADING, test_dc, cls.yamldb_path))
+        cls.daemon.start()
+        cls.conn = cls.connectToServer()
+        cls.conn.s.settimeout(1.0) # Allow time for Astron<->filesystem operations.
+        cls.objects = cls.connectToServer()
+        cls.objects.send(Datagram.create_add_range(DATABASE_PREFIX|1000000,
+                                                   DATABASE_PREFIX|1000010))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.objects.send(Datagram.create_remove_range(DATABASE_PREFIX|1000000,
+                                                      DATABASE_PREFIX|1000010))
+        cls.objects.close()
+        cls.conn.close()
+        cls.daemon.stop()
+        teardown_yamldb(cls)
+
+    def getAll(self, context, doid):
+        dg = Datagram.create([75757], 120, DBSERVER_OBJECT_GET_ALL)
+        dg.add_uint32(context)
+        dg.add_doid(doid)
+        self.conn.send(dg)
+
+    def expectAll(self, context, value):
+        dg = Datagram.create([120], 75757, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(DistributedTestObject3)
+        dg.add_uint16(1) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.expect(self.conn, dg)
+
+    def setRDB3(self, doid, value):
+        dg = Datagram.create([75757], 120, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.conn.send(dg)
+
+        dg = Datagram.create([DATABASE_PREFIX|doid], 120, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(value)
+        self.expect(self.objects, dg)
+
+    def test_cache(self):
+        self.objects.flush()
+        self.conn.flush()
+        self.conn.send(Datagram.create_add_channel(120))
+
+        doid = self.createTypeGetId(120, 1, DistributedTestObject3)
+        self.setRDB3(doid, 1234)
+        filename = os.path.join(self.yamldb_path, '%d.yaml' % doid)
+
+        # The first GET reads the object into the cache...
+        self.getAll(2, doid)
+        self.expectAll(2, 1234)
+
+        # ...so later GETs are answered from it, even with the object gone from the disk.
+        os.rename(filename, filename + '.hidden')
+        self.getAll(3, doid)
+        self.expectAll(3, 1234)
+        os.rename(filename + '.hidden', filename)
+
+        # Writes update the cached copy as they complete.
+        self.setRDB3(doid, 5678)
+        os.rename(filename, filename + '.hidden')
+        self.getAll(4, doid)
+        self.expectAll(4, 5678)
+        os.rename(filename + '.hidden', filename)
+
+        # Clean up
+        self.deleteObject(120, doid)
+        self.conn.send(Datagram.create_remove_channel(120))
+
 if __name__ == '__main__':
     unittest.main()
@@ -16,11 +16,16 @@ general:
 roles:
     - type: dbss
       database: 1200
+      control: 1201
       ranges:
           - min: 9000
             max: 9999
 """ % (USE_THREADING, test_dc)
 
+CACHE_CONFIG = CONFIG + """      cache:
+          enabled: true
+"""
+
 CONTEXT_OFFSET = 1 + (CHANNEL_SIZE_BYTES*2) + 2
 
 def appendMeta(datagram, doid=None, parent=None, zone=None, dclass=None):
@@ -330,6 +335,95 @@ class TestDBStateServer(ProtocolTest):
         ### Cleanup ###
         self.shard.send(Datagram.create_remove_channel(33000<<ZONE_SIZE_BITS|33))
 
+    # Tests the message DBSS_OBJECT_ACTIVATE_MULTIPLE
+    def test_activate_multiple(self):
+        self.database.flush()
+        self.shard.flush()
+        location = 80000<<ZONE_SIZE_BITS|102
+        self.shard.send(Datagram.create_add_channel(location))
+
+        doid1 = 9070
+        doid2 = 9071
+        doid3 = 9072
+
+        # Load doid3 into ram on its own first
+        dg = Datagram.create([doid3], 5, DBSS_OBJECT_ACTIVATE_WITH_DEFAULTS)
+        appendMeta(dg, doid3, 80000, 102)
+        self.shard.send(dg)
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid3, DBSERVER_OBJECT_GET_ALL))
+        context3 = dgi.read_uint32()
+
+        # Activate all three at once, along with an object another DBSS looks after
+        dg = Datagram.create([doid1, doid2, doid3], 5, DBSS_OBJECT_ACTIVATE_MULTIPLE)
+        dg.add_doid(80000) # Parent
+        dg.add_zone(102) # Zone
+        dg.add_uint16(4) # Object count
+        dg.add_doid(doid1)
+        dg.add_doid(50000)
+        dg.add_doid(doid2)
+        dg.add_doid(doid3)
+        self.shard.send(dg)
+
+        # Expect one request at the database, from the DBSS's control channel, for the two
+        # objects not already loading
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], 1201, DBSERVER_OBJECT_GET_ALL_MULTIPLE,
+                                            remaining = 4 + 2 + 2*DOID_SIZE_BYTES))
+        context = dgi.read_uint32()
+        self.assertEquals(dgi.read_uint16(), 2) # Object count
+        self.assertEquals(dgi.read_doid(), doid1)
+        self.assertEquals(dgi.read_doid(), doid2)
+        self.expectNone(self.database)
+
+        # Send back each object to the channel the request came from
+        for doid, value in ((doid2, 2002), (doid1, 1001)):
+            dg = Datagram.create([1201], 1200, DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP)
+            dg.add_uint32(context)
+            dg.add_doid(doid)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(DistributedTestObject5)
+            dg.add_uint16(1) # Field count
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            self.database.send(dg)
+
+        # Both should announce their entry
+        expected = []
+        for doid, value in ((doid1, 1001), (doid2, 2002)):
+            dg = Datagram.create([location], doid, STATESERVER_OBJECT_ENTER_LOCATION_WITH_REQUIRED)
+            appendMeta(dg, doid, 80000, 102, DistributedTestObject5)
+            dg.add_uint32(setRequired1DefaultValue) # setRequired1
+            dg.add_uint32(value) # setRDB3
+            expected.append(dg)
+        self.expectMany(self.shard, expected)
+
+        # A response for an object which isn't part of the request is ignored
+        dg = Datagram.create([1201], 1200, DBSERVER_OBJECT_GET_ALL_MULTIPLE_RESP)
+        dg.add_uint32(context)
+        dg.add_doid(doid3)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(DistributedTestObject5)
+        dg.add_uint16(0) # Field count
+        self.database.send(dg)
+        self.expectNone(self.shard)
+
+        ### Cleanup ###
+        dg = Datagram.create([doid3], 1200, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context3)
+        dg.add_uint8(FAILURE)
+        self.database.send(dg)
+        for doid in (doid1, doid2):
+            dg = Datagram.create([doid], 5, STATESERVER_OBJECT_DELETE_RAM)
+            dg.add_doid(doid)
+            self.shard.send(dg)
+        self.shard.send(Datagram.create_remove_channel(location))
+        self.shard.flush()
+
     # Tests the messages OBJECT_DELETE_DISK, OBJECT_DELETE_RAM
     def test_delete(self):
         return
@@ -1122,5 +1216,370 @@ class TestDBStateServer(ProtocolTest):
         dg.add_uint8(BOOL_NO)
         self.expect(self.shard, dg)
 
+    # Tests that identical reads of an inactive object share one query to the database
+    def test_coalesce_reads(self):
+        self.database.flush()
+        self.shard.flush()
+
+        doid = 9060
+
+        ### Test for GetAlls of the same object in flight at once ###
+        for context in (1, 2, 3):
+            dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_ALL)
+            dg.add_uint32(context)
+            dg.add_doid(doid)
+            self.shard.send(dg)
+
+        # Expect only one query at the database
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_ALL,
+                                            remaining = 4 + DOID_SIZE_BYTES))
+        context = dgi.read_uint32()
+        self.expectNone(self.database)
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(DistributedTestObject5)
+        dg.add_uint16(1)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(1111)
+        self.database.send(dg)
+
+        # Every caller should get the response
+        expected = []
+        for context in (1, 2, 3):
+            dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_ALL_RESP)
+            dg.add_uint32(context)
+            appendMeta(dg, doid, INVALID_DO_ID, INVALID_ZONE, DistributedTestObject5)
+            dg.add_uint32(setRequired1DefaultValue) # setRequired1
+            dg.add_uint32(1111) # setRDB3
+            dg.add_uint8(setRDbD5DefaultValue) # setRDbD5
+            dg.add_uint16(0) # Optional field count
+            expected.append(dg)
+        self.expectMany(self.shard, expected)
+
+
+        ### Test for GetFields of the same fields, and different fields, at once ###
+        for context, fields in ((4, [setRDB3, setDb3]), (5, [setRDB3, setDb3]), (6, [setRDB3])):
+            dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELDS)
+            dg.add_uint32(context)
+            dg.add_doid(doid)
+            dg.add_uint16(len(fields))
+            for field in fields:
+                dg.add_uint16(field)
+            self.shard.send(dg)
+
+        # Expect one query for each set of fields
+        contexts = {}
+        for i in xrange(2):
+            dg = self.database.recv_maybe()
+            self.assertTrue(dg is not None)
+            dgi = DatagramIterator(dg)
+            self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_FIELDS))
+            context = dgi.read_uint32()
+            self.assertEquals(dgi.read_doid(), doid)
+            contexts[dgi.read_uint16()] = context
+        self.expectNone(self.database)
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_FIELDS_RESP)
+        dg.add_uint32(contexts[2])
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(2)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2222)
+        dg.add_uint16(setDb3)
+        dg.add_string("Shared")
+        self.database.send(dg)
+
+        expected = []
+        for context in (4, 5):
+            dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELDS_RESP)
+            dg.add_uint32(context)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(2) # Field count
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(2222)
+            dg.add_uint16(setDb3)
+            dg.add_string("Shared")
+            expected.append(dg)
+        self.expectMany(self.shard, expected)
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_FIELDS_RESP)
+        dg.add_uint32(contexts[1])
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(1)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2222)
+        self.database.send(dg)
+
+        dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELDS_RESP)
+        dg.add_uint32(6) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(1) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(2222)
+        self.expect(self.shard, dg)
+
+
+        ### Test for a GetField made after a SetField to a field in flight ###
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(7) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.shard.send(dg)
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_FIELD))
+        context1 = dgi.read_uint32()
+
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(3333)
+        self.shard.send(dg)
+        self.assertTrue(self.database.recv_maybe() is not None) # The DB SetField
+
+        # The value in flight may be old, so expect the GetField to go to the database
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(8) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.shard.send(dg)
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_FIELD))
+        context2 = dgi.read_uint32()
+        self.assertNotEquals(context1, context2)
+
+        for context, value in ((context1, 2222), (context2, 3333)):
+            dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_FIELD_RESP)
+            dg.add_uint32(context)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            self.database.send(dg)
+
+        expected = []
+        for context, value in ((7, 2222), (8, 3333)):
+            dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELD_RESP)
+            dg.add_uint32(context)
+            dg.add_uint8(SUCCESS)
+            dg.add_uint16(setRDB3)
+            dg.add_uint32(value)
+            expected.append(dg)
+        self.expectMany(self.shard, expected)
+
+
+class TestDBStateServerCache(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        cls.daemon = Daemon(CACHE_CONFIG)
+        cls.daemon.start()
+
+        cls.shard = cls.connectToServer()
+        cls.shard.send(Datagram.create_set_con_name("Shard"))
+        cls.shard.send(Datagram.create_add_channel(5))
+
+        cls.database = cls.connectToServer()
+        cls.database.send(Datagram.create_set_con_name("Database"))
+        cls.database.send(Datagram.create_add_channel(1200))
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.database.send(Datagram.create_remove_channel(1200))
+        cls.database.close()
+        cls.shard.send(Datagram.create_remove_channel(5))
+        cls.shard.close()
+        cls.daemon.stop()
+
+    # getAll sends a GetAll for an inactive object and answers it from the database.
+    def getAll(self, doid, context, rdb3):
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_ALL)
+        dg.add_uint32(context)
+        dg.add_doid(doid)
+        self.shard.send(dg)
+
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_ALL,
+                                            remaining = 4 + DOID_SIZE_BYTES))
+        db_context = dgi.read_uint32()
+        self.assertEquals(dgi.read_doid(), doid)
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(db_context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(DistributedTestObject5)
+        dg.add_uint16(2)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(rdb3)
+        dg.add_uint16(setDb3)
+        dg.add_string("Cached!")
+        self.database.send(dg)
+
+        self.expect(self.shard, self.getAllResp(doid, context, rdb3))
+
+    def getAllResp(self, doid, context, rdb3):
+        dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context)
+        appendMeta(dg, doid, INVALID_DO_ID, INVALID_ZONE, DistributedTestObject5)
+        dg.add_uint32(setRequired1DefaultValue) # setRequired1
+        dg.add_uint32(rdb3) # setRDB3
+        dg.add_uint8(setRDbD5DefaultValue) # setRDbD5
+        dg.add_uint16(1) # Optional field count
+        dg.add_uint16(setDb3)
+        dg.add_string("Cached!")
+        return dg
+
+    def test_get_all(self):
+        self.database.flush()
+        self.shard.flush()
+
+        doid = 9100
+        self.getAll(doid, 1, 1234)
+
+        # The second GetAll should be answered without the database.
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_ALL)
+        dg.add_uint32(2)
+        dg.add_doid(doid)
+        self.shard.send(dg)
+        self.expect(self.shard, self.getAllResp(doid, 2, 1234))
+        self.expectNone(self.database)
+
+        # As should GetField and GetFields of the fields it read.
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(3) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setDb3)
+        self.shard.send(dg)
+        dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(3) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setDb3)
+        dg.add_string("Cached!")
+        self.expect(self.shard, dg)
+
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELDS)
+        dg.add_uint32(4) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint16(setDb3)
+        self.shard.send(dg)
+        dg = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELDS_RESP)
+        dg.add_uint32(4) # Context
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(2) # Field count
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(1234)
+        dg.add_uint16(setDb3)
+        dg.add_string("Cached!")
+        self.expect(self.shard, dg)
+        self.expectNone(self.database)
+
+        # A SetField through the DBSS drops the object from the cache...
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(5678)
+        self.shard.send(dg)
+
+        dg = Datagram.create([1200], doid, DBSERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(5678)
+        self.expect(self.database, dg)
+
+        # ... so the next GetAll goes back to the database.
+        self.getAll(doid, 5, 5678)
+
+    def test_get_fields(self):
+        self.database.flush()
+        self.shard.flush()
+
+        doid = 9101
+
+        # A GetField only caches the field it read.
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(1) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.shard.send(dg)
+
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_FIELD))
+        context = dgi.read_uint32()
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_FIELD_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.database.send(dg)
+
+        expected = Datagram.create([5], doid, STATESERVER_OBJECT_GET_FIELD_RESP)
+        expected.add_uint32(1) # Context
+        expected.add_uint8(SUCCESS)
+        expected.add_uint16(setRDB3)
+        expected.add_uint32(4321)
+        self.expect(self.shard, expected)
+
+        # Reading it again doesn't need the database...
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(1) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.shard.send(dg)
+        self.expect(self.shard, expected)
+        self.expectNone(self.database)
+
+        # ... but reading the whole object does.
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_ALL)
+        dg.add_uint32(2) # Context
+        dg.add_doid(doid)
+        self.shard.send(dg)
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_ALL))
+        context = dgi.read_uint32()
+
+        # A write through the DBSS while a read is in flight keeps its response out of the cache.
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_SET_FIELD)
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(8765)
+        self.shard.send(dg)
+        self.assertTrue(self.database.recv_maybe() is not None) # The DB SetField
+
+        dg = Datagram.create([doid], 1200, DBSERVER_OBJECT_GET_ALL_RESP)
+        dg.add_uint32(context)
+        dg.add_uint8(SUCCESS)
+        dg.add_uint16(DistributedTestObject5)
+        dg.add_uint16(1)
+        dg.add_uint16(setRDB3)
+        dg.add_uint32(4321)
+        self.database.send(dg)
+        self.assertTrue(self.shard.recv_maybe() is not None) # The GetAllResp
+
+        dg = Datagram.create([doid], 5, STATESERVER_OBJECT_GET_FIELD)
+        dg.add_uint32(3) # Context
+        dg.add_doid(doid)
+        dg.add_uint16(setRDB3)
+        self.shard.send(dg)
+        dg = self.database.recv_maybe()
+        self.assertTrue(dg is not None)
+        dgi = DatagramIterator(dg)
+        self.assertTrue(*dgi.matches_header([1200], doid, DBSERVER_OBJECT_GET_FIELD))
+
+
 if __name__ == '__main__':
     unittest.main()
@@ -1,5 +1,5 @@
 #!/usr/bin/env python2
-import unittest, time, socket, os, json, tempfile
+import unittest, time, socket, os, json, tempfile, subprocess
 from common.astron import *
 from common.dcfile import *
 
@@ -11,12 +11,29 @@ CONFIG = """\
 messagedirector:
     bind: 127.0.0.1:57123
 
+general:
+    eventlogger: 127.0.0.1:19090
+
 roles:
     - type: eventlogger
       bind: 127.0.0.1:19090
       output: %s
 """
 
+SEGMENTS_ADDR = ('127.0.0.1', 19091)
+SEGMENTS_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57124
+
+roles:
+    - type: eventlogger
+      bind: 127.0.0.1:19091
+      output: %s
+      format: segments
+      block_size: 256
+      block_interval: 10
+"""
+
 STANDARD_EVENT = '\x82\xa3bar\xa3baz\xa4type\xa3foo' # MessagePack formatted event
 NONSTANDARD_MSGPACK = '{'
 
@@ -90,15 +107,96 @@ class TestEventLogger(unittest.TestCase):
         self.lastLineCheck()
 
     def test_messageDirectorLogging(self):
-        dg = Datagram.create_control()
-        dg.add_uint16(CONTROL_LOG_MESSAGE)
-        dg.add_blob(STANDARD_EVENT)
+        numLines1 = self.numLinesLog()
 
-        self.mdsocket.send(dg.get_data())
+        # The daemon's EventSender may pack some of these together.
+        md = MDConnection(self.mdsocket)
+        for i in xrange(10):
+            dg = Datagram.create_control()
+            dg.add_uint16(CONTROL_LOG_MESSAGE)
+            dg.add_blob(STANDARD_EVENT)
+            md.send(dg)
         time.sleep(NETWORK_WAIT)
 
+        self.assertEqual(self.numLinesLog(), numLines1 + 10)
         self.lastLineCheck()
 
+    def test_packedEvents(self):
+        numLines1 = self.numLinesLog()
+
+        # An array16 of bin8s, each holding one event.
+        packed = '\xdc\x00\x03' + ('\xc4' + chr(len(STANDARD_EVENT)) + STANDARD_EVENT) * 3
+        self.socket.sendto(packed, NETWORK_ADDR)
+        time.sleep(NETWORK_WAIT) # allow network time
+
+        self.assertEqual(self.numLinesLog(), numLines1 + 3)
+        self.lastLineCheck()
+
+        # Packed events must be bins, not the events themselves.
+        self.socket.sendto('\x91' + STANDARD_EVENT, NETWORK_ADDR)
+        time.sleep(NETWORK_WAIT) # allow network time
+
+        self.assertEqual(self.numLinesLog(), numLines1 + 3)
+
+
+class TestEventLoggerSegments(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        logHandle, cls.log_file = tempfile.mkstemp(prefix = 'astron-', suffix = '.seg')
+        os.close(logHandle)
+
+        cls.daemon = Daemon(SEGMENTS_CONFIG % cls.log_file)
+        cls.daemon.start()
+
+        cls.socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.socket.close()
+        cls.daemon.stop()
+        time.sleep(1) # give time for the daemon to close so windows can delete the log
+        if cls.log_file is not None:
+            os.remove(cls.log_file)
+
+    def readEvents(self, *args):
+        output = subprocess.check_output(['./eventlog_reader'] + list(args) + [self.log_file])
+        return [json.loads(line) for line in output.splitlines()]
+
+    def test_readsBack(self):
+        self.socket.sendto(STANDARD_EVENT, SEGMENTS_ADDR)
+        self.socket.sendto(NONSTANDARD_MSGPACK, SEGMENTS_ADDR) # ignored
+        time.sleep(NETWORK_WAIT) # allow network time
+
+        events = self.readEvents('--type', 'foo')
+        self.assertTrue(events)
+        self.assertEqual(events[-1]["type"], "foo")
+        self.assertEqual(events[-1]["bar"], "baz")
+        self.assertIn("_time", events[-1])
+
+    def test_filtersByType(self):
+        # Enough events to fill several blocks, so that whole blocks can be skipped.
+        for i in xrange(20):
+            self.socket.sendto('\x82\xa4type\xa3one\xa1n' + chr(i), SEGMENTS_ADDR)
+        time.sleep(NETWORK_WAIT)
+        for i in xrange(20):
+            self.socket.sendto('\x82\xa4type\xa3two\xa1n' + chr(i), SEGMENTS_ADDR)
+        time.sleep(NETWORK_WAIT) # allow network time
+
+        ones = self.readEvents('--type', 'one')
+        self.assertEqual([e["n"] for e in ones], range(20))
+        self.assertTrue(all(e["type"] == "one" for e in ones))
+
+        both = self.readEvents('--type', 'one', '--type', 'two')
+        self.assertEqual(len(both), 40)
+
+        # Everything was logged just now, so nothing is from before an hour ago.
+        self.assertEqual(self.readEvents('--to', str(int(time.time()) - 3600)), [])
+
+        index = subprocess.check_output(['./eventlog_reader', '--index', '--type', 'two',
+                                         self.log_file])
+        self.assertIn(' two', index)
+        self.assertNotIn(' one', index)
+
 
 if __name__ == '__main__':
     unittest.main()
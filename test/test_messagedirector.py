@@ -1,5 +1,5 @@
 #!/usr/bin/env python2
-import unittest
+import unittest, time, os, tempfile
 from socket import *
 
 from common.unittests import ProtocolTest
@@ -20,7 +20,10 @@ class TestMessageDirector(ProtocolTest):
         listener.listen(1)
         listener.settimeout(0.3)
 
-        cls.daemon = Daemon(CONFIG)
+        # The daemon logs to a file too, so that the effect of its log level can be seen.
+        logHandle, cls.log_file = tempfile.mkstemp(prefix = 'astron', suffix = '.log')
+        os.close(logHandle)
+        cls.daemon = Daemon(CONFIG, cls.log_file)
         cls.daemon.start()
 
         l, _ = listener.accept()
@@ -36,6 +39,7 @@ class TestMessageDirector(ProtocolTest):
         cls.c1.close()
         cls.c2.close()
         cls.daemon.stop()
+        os.remove(cls.log_file)
 
     def test_single(self):
         self.l1.flush()
@@ -48,6 +52,53 @@ class TestMessageDirector(ProtocolTest):
         # Make sure the MD passes it upward.
         self.expect(self.l1, dg)
 
+    def setLogLevel(self, category, level):
+        dg = Datagram.create_control()
+        dg.add_uint16(CONTROL_SET_LOG_LEVEL)
+        dg.add_string(category)
+        dg.add_string(level)
+        self.c1.send(dg)
+
+    def routeLogged(self, text):
+        # Route a datagram, and return what the daemon logged while doing so.
+        start = os.path.getsize(self.log_file)
+        dg = Datagram.create([1234], 4321, 1337)
+        dg.add_string(text)
+        self.c1.send(dg)
+        self.expect(self.l1, dg)
+        time.sleep(0.3) # The log is written out in the background.
+        with open(self.log_file, 'rb') as log:
+            log.seek(start)
+            return log.read()
+
+    def test_set_log_level(self):
+        self.l1.flush()
+        self.c1.flush()
+
+        # With the MD on the info level, routing a datagram logs nothing...
+        self.setLogLevel('msgdir', 'info')
+        self.assertNotIn('Processing datagram', self.routeLogged('HELLO'))
+
+        # ...but once trace output is turned on for it, the MD traces its routing.
+        self.setLogLevel('msgdir', 'trace')
+        # The control message is consumed by the MD, not passed upward.
+        self.expectNone(self.l1)
+        self.assertIn('Processing datagram', self.routeLogged('HELLO'))
+
+        # An unknown level is ignored, leaving the category as it was.
+        self.setLogLevel('msgdir', 'loud')
+        self.expectNone(self.l1)
+        self.assertIn('Processing datagram', self.routeLogged('HELLO'))
+
+        # Raising the level turns the trace output back off.
+        self.setLogLevel('msgdir', 'warning')
+        self.assertNotIn('Processing datagram', self.routeLogged('HELLO'))
+
+        # Put the category back on the global level.
+        self.setLogLevel('msgdir', 'default')
+        self.expectNone(self.l1)
+        self.routeLogged('GOODBYE')
+
     def test_subscribe(self):
         self.l1.flush()
         self.c1.flush()
@@ -107,6 +158,41 @@ class TestMessageDirector(ProtocolTest):
         # MD should unsubscribe from parent.
         self.expect(self.l1, Datagram.create_remove_channel(12345654321))
 
+    def test_subscribe_bulk(self):
+        self.l1.flush()
+        self.c1.flush()
+        self.c2.flush()
+
+        # Subscribe to several channels at once...
+        self.c1.send(Datagram.create_add_channels([5003, 5001, 5002]))
+        self.expectNone(self.c1)
+        # The MD asks its parent for all of them in one message.
+        self.expect(self.l1, Datagram.create_add_channels([5001, 5002, 5003]))
+        self.expectNone(self.l1)
+
+        # Each of the channels is subscribed...
+        for channel in [5001, 5002, 5003]:
+            dg = Datagram.create([channel], 0, 1234)
+            dg.add_uint32(0xDEADBEEF)
+            self.l1.send(dg)
+            self.expect(self.c1, dg)
+
+        # A lone channel still goes upstream in the single-channel message.
+        self.c1.send(Datagram.create_remove_channels([5001]))
+        self.expect(self.l1, Datagram.create_remove_channel(5001))
+
+        self.c1.send(Datagram.create_remove_channels([5002, 5003, 5004]))
+        self.expect(self.l1, Datagram.create_remove_channels([5002, 5003]))
+        self.expectNone(self.l1)
+
+        # Abandoning a connection with many channels unsubscribes them together.
+        self.c2.send(Datagram.create_add_channels([6001, 6002, 6003]))
+        self.expect(self.l1, Datagram.create_add_channels([6001, 6002, 6003]))
+        self.c2.close()
+        self.__class__.c2 = self.connectToServer()
+        self.expect(self.l1, Datagram.create_remove_channels([6001, 6002, 6003]))
+        self.expectNone(self.l1)
+
     def test_multi(self):
         self.l1.flush()
         self.c1.flush()
@@ -633,5 +719,241 @@ class TestMessageDirector(ProtocolTest):
         self.__class__.c2 = self.connectToServer()
         self.l1.flush()
 
+MERGE_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57125
+    connect: 127.0.0.1:57126
+    merge_subscriptions:
+        min_channels: 4
+        density: 0.5
+"""
+
+class TestMessageDirectorMerging(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        listener = socket(AF_INET, SOCK_STREAM)
+        listener.setsockopt(SOL_SOCKET, SO_REUSEADDR, 1)
+        listener.bind(('127.0.0.1', 57126))
+        listener.listen(1)
+        listener.settimeout(0.3)
+
+        cls.daemon = Daemon(MERGE_CONFIG)
+        cls.daemon.start()
+
+        l, _ = listener.accept()
+        listener.close()
+        cls.l1 = MDConnection(l)
+
+        cls.c1 = cls.connectToServer(port=57125)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.l1.close()
+        cls.c1.close()
+        cls.daemon.stop()
+
+    def test_merge(self):
+        self.l1.flush()
+        self.c1.flush()
+
+        # A run too short to merge is subscribed channel by channel...
+        self.c1.send(Datagram.create_add_channels([100, 101, 102]))
+        self.expect(self.l1, Datagram.create_add_channels([100, 101, 102]))
+
+        # ...until it's long enough, when it's replaced by a range.
+        self.c1.send(Datagram.create_add_channel(103))
+        self.expect(self.l1, Datagram.create_add_range(100, 103))
+        self.expect(self.l1, Datagram.create_remove_channels([100, 101, 102]))
+        self.expectNone(self.l1)
+
+        # Channels close enough to the run extend the range, gaps and all.
+        self.c1.send(Datagram.create_add_channel(105))
+        self.expect(self.l1, Datagram.create_add_range(104, 105))
+        self.expectNone(self.l1)
+
+        # Messages on the merged channels still only reach their subscribers.
+        for channel, subscribed in [(101, True), (104, False), (105, True)]:
+            dg = Datagram.create([channel], 0, 1234)
+            dg.add_uint32(0xDEADBEEF)
+            self.l1.send(dg)
+            if subscribed:
+                self.expect(self.c1, dg)
+            self.expectNone(self.c1)
+
+        # Splitting the run drops the part of the range left uncovered...
+        self.c1.send(Datagram.create_remove_channel(103))
+        self.expect(self.l1, Datagram.create_remove_range(103, 104))
+        self.expectNone(self.l1)
+
+        dg = Datagram.create([102], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.l1.send(dg)
+        self.expect(self.c1, dg)
+
+        # ...and the rest goes with the last of its channels.
+        self.c1.send(Datagram.create_remove_channels([100, 101, 102, 105]))
+        self.expectMany(self.l1, [Datagram.create_remove_range(100, 102),
+                                  Datagram.create_remove_range(105, 105)])
+        self.expectNone(self.l1)
+
+MESH_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:%d
+    mesh:
+        bind: 127.0.0.1:%d
+        peers:
+            - 127.0.0.1:%d
+"""
+
+class TestMessageDirectorMesh(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        cls.daemon1 = Daemon(MESH_CONFIG % (57130, 57131, 57133))
+        cls.daemon1.start()
+        cls.daemon2 = Daemon(MESH_CONFIG % (57132, 57133, 57131))
+        cls.daemon2.start()
+        time.sleep(1.5) # Allow time for the peers to connect to each other.
+
+        cls.a1 = cls.connectToServer(port=57130)
+        cls.a2 = cls.connectToServer(port=57130)
+        cls.b1 = cls.connectToServer(port=57132)
+        cls.b2 = cls.connectToServer(port=57132)
+
+    @classmethod
+    def tearDownClass(cls):
+        for conn in [cls.a1, cls.a2, cls.b1, cls.b2]:
+            conn.close()
+        cls.daemon1.stop()
+        cls.daemon2.stop()
+
+    def subscribe(self, conn, channels):
+        for channel in channels:
+            conn.send(Datagram.create_add_channel(channel))
+        time.sleep(0.1) # Allow time for the subscriptions to reach the other peer.
+
+    def test_mesh(self):
+        for conn in [self.a1, self.a2, self.b1, self.b2]:
+            conn.flush()
+
+        self.subscribe(self.a1, [7777])
+        self.subscribe(self.b1, [8888])
+        self.subscribe(self.a2, [9999])
+        self.subscribe(self.b2, [9999])
+
+        # Messages cross the mesh to the peer whose participants want them...
+        dg = Datagram.create([7777], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.b2.send(dg)
+        self.expect(self.a1, dg)
+        dg = Datagram.create([8888], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.a2.send(dg)
+        self.expect(self.b1, dg)
+
+        # ...and reach every subscriber once, without echoing back to the sender.
+        dg = Datagram.create([9999, 7777], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.b1.send(dg)
+        self.expect(self.a1, dg)
+        self.expect(self.a2, dg)
+        self.expect(self.b2, dg)
+        for conn in [self.a1, self.a2, self.b1, self.b2]:
+            self.expectNone(conn)
+
+        # Once a channel is dropped, its messages stay home.
+        self.a1.send(Datagram.create_remove_channel(7777))
+        time.sleep(0.1)
+        dg = Datagram.create([7777], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.b2.send(dg)
+        self.expectNone(self.a1)
+
+        # A participant which joins after the peers have connected is reachable too.
+        self.a1.close()
+        self.__class__.a1 = self.connectToServer(port=57130)
+        self.subscribe(self.a1, [6666])
+        dg = Datagram.create([6666], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.b2.send(dg)
+        self.expect(self.a1, dg)
+
+SHM_ROOT_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57135
+    shm:
+        bind: astron-test-%d
+        ring_size: 131072
+"""
+
+SHM_LEAF_CONFIG = """\
+messagedirector:
+    bind: 127.0.0.1:57136
+    connect: shm://astron-test-%d
+"""
+
+class TestMessageDirectorShm(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        cls.root = Daemon(SHM_ROOT_CONFIG % os.getpid())
+        cls.root.start()
+        cls.leaf = Daemon(SHM_LEAF_CONFIG % os.getpid())
+        cls.leaf.start()
+
+        cls.up = cls.connectToServer(port=57135)
+        cls.down = cls.connectToServer(port=57136)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.up.close()
+        cls.down.close()
+        cls.leaf.stop()
+        cls.root.stop()
+
+    def test_shm(self):
+        self.up.flush()
+        self.down.flush()
+
+        self.up.send(Datagram.create_add_channel(7777))
+        self.down.send(Datagram.create_add_channel(8888))
+        self.down.send(Datagram.create_add_range(10000, 10999))
+        time.sleep(0.1) # Allow time for the subscriptions to reach the root.
+
+        # Messages go up and down the shared memory link.
+        dg = Datagram.create([8888], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.up.send(dg)
+        self.expect(self.down, dg)
+        dg = Datagram.create([10500], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.up.send(dg)
+        self.expect(self.down, dg)
+        dg = Datagram.create([7777], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.down.send(dg)
+        self.expect(self.up, dg)
+        self.expectNone(self.up)
+        self.expectNone(self.down)
+
+        # Far more than the rings hold arrive intact and in order.
+        dgs = []
+        for i in xrange(1000):
+            dg = Datagram.create([8888], 0, 1234)
+            dg.add_uint32(i)
+            dg.add_string('x' * 1000)
+            dgs.append(dg)
+        for dg in dgs:
+            self.up.send(dg)
+        for dg in dgs:
+            self.expect(self.down, dg)
+        self.expectNone(self.down)
+
+        # Dropping a subscription stops its messages coming down.
+        self.down.send(Datagram.create_remove_channel(8888))
+        time.sleep(0.1)
+        dg = Datagram.create([8888], 0, 1234)
+        dg.add_uint32(0xDEADBEEF)
+        self.up.send(dg)
+        self.expectNone(self.down)
+
 if __name__ == '__main__':
     unittest.main()
@@ -2035,5 +2035,54 @@ class TestStateServer(ProtocolTest):
         deleteObject(conn, 5, doid1)
         self.disconnect(conn)
 
+EVENT_LOOPS_CONFIG = """\
+daemon:
+    event_loops:
+        count: 2
+
+messagedirector:
+    bind: 127.0.0.1:57123
+    threaded: %s
+
+general:
+    dc_files:
+        - %r
+
+roles:
+    - type: stateserver
+      control: 100100
+      event_loop: 1
+""" % (USE_THREADING, test_dc)
+
+# The state server runs on the second of two event loops, so every message to and from it
+# crosses between loops.
+class TestStateServerEventLoops(ProtocolTest):
+    @classmethod
+    def setUpClass(cls):
+        cls.daemon = Daemon(EVENT_LOOPS_CONFIG)
+        cls.daemon.start()
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.daemon.stop()
+
+    def test_create_delete(self):
+        ai = ChannelConnection('127.0.0.1', 57123)
+        ai.add_channel(5000<<ZONE_SIZE_BITS|1500)
+
+        createEmptyDTO1(ai, 5, 101000000, 5000, 1500, 6789)
+        dg = Datagram.create([5000<<ZONE_SIZE_BITS|1500], 101000000,
+                             STATESERVER_OBJECT_ENTER_LOCATION_WITH_REQUIRED)
+        appendMeta(dg, 101000000, 5000, 1500, DistributedTestObject1)
+        dg.add_uint32(6789) # setRequired1
+        self.expect(ai, dg)
+
+        deleteObject(ai, 5, 101000000)
+        dg = Datagram.create([5000<<ZONE_SIZE_BITS|1500], 5, STATESERVER_OBJECT_DELETE_RAM)
+        dg.add_doid(101000000)
+        self.expect(ai, dg)
+
+        ai.close()
+
 if __name__ == '__main__':
     unittest.main()